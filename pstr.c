@@ -2,17 +2,5225 @@
 // SPDX-License-Identifier: blessing
 
 #include <assert.h>
-#include <ctype.h>
+#include <math.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "pstr.h"
+
+#ifdef PSTR_FILE_LINES
+// `posix_madvise()` is only declared from POSIX.1-2001 onwards, and `-std=c99` on its
+// own doesn't ask for that
+#if !defined(_POSIX_C_SOURCE) || _POSIX_C_SOURCE < 200112L
+#error "PSTR_FILE_LINES needs _POSIX_C_SOURCE to be at least 200112L"
+#endif
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define PSTR_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define PSTR_LITTLE_ENDIAN 1
+#endif
+
+
+// Internal kernels
+// These scan blocks of 8, 16 or 32 bytes at a time. They only ever load bytes inside
+// the range they are given, so they are safe to use on buffers that end right before
+// an unmapped page.
+// ------------------------
+
+#define PSTR_SWAR_ONES 0x0101010101010101ULL
+#define PSTR_SWAR_HIGHS 0x8080808080808080ULL
+
+
+static uint64_t pstr_swar_load(char const *str) {
+  uint64_t word;
+  memcpy(&word, str, sizeof(word));
+  return word;
+}
+
+
+static bool pstr_swar_has_zero(uint64_t const word) {
+  return ((word - PSTR_SWAR_ONES) & ~word & PSTR_SWAR_HIGHS) != 0;
+}
+
+
+static size_t pstr_find_byte_scalar(
+  char const *str, size_t const size, char const target, size_t idx
+) {
+  // Check 8 bytes at a time until we find a word containing `target`
+  uint64_t const pattern = PSTR_SWAR_ONES * (uint8_t)target;
+  for (; idx + 8 <= size; idx += 8) {
+    if (pstr_swar_has_zero(pstr_swar_load(str + idx) ^ pattern)) {
+      break;
+    }
+  }
+  for (; idx < size; idx++) {
+    if (str[idx] == target) {
+      return idx;
+    }
+  }
+  return size;
+}
+
+
+#ifdef PSTR_X86
+static bool pstr_cpu_has_avx2(void) {
+  // The compiler's runtime works out the CPU's features before main() runs, and never
+  // changes them afterwards, so we only ever read them here, and any thread can call this
+  return __builtin_cpu_supports("avx2");
+}
+
+
+static size_t pstr_find_byte_sse2(char const *str, size_t const size, char const target) {
+  __m128i const pattern = _mm_set1_epi8(target);
+  size_t idx = 0;
+  // Check 64 bytes per iteration, and only work out where the match is once we've found
+  // one
+  for (; idx + 64 <= size; idx += 64) {
+    __m128i const eq0 = _mm_cmpeq_epi8(
+      _mm_loadu_si128((__m128i const *)(str + idx)), pattern
+    );
+    __m128i const eq1 = _mm_cmpeq_epi8(
+      _mm_loadu_si128((__m128i const *)(str + idx + 16)), pattern
+    );
+    __m128i const eq2 = _mm_cmpeq_epi8(
+      _mm_loadu_si128((__m128i const *)(str + idx + 32)), pattern
+    );
+    __m128i const eq3 = _mm_cmpeq_epi8(
+      _mm_loadu_si128((__m128i const *)(str + idx + 48)), pattern
+    );
+    if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(eq0, eq1), _mm_or_si128(eq2, eq3)))) {
+      break;
+    }
+  }
+  for (; idx + 16 <= size; idx += 16) {
+    __m128i const block = _mm_loadu_si128((__m128i const *)(str + idx));
+    uint32_t const mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, pattern));
+    if (mask) {
+      return idx + __builtin_ctz(mask);
+    }
+  }
+  return pstr_find_byte_scalar(str, size, target, idx);
+}
+
+
+__attribute__((target("avx2")))
+static size_t pstr_find_byte_avx2(char const *str, size_t const size, char const target) {
+  __m256i const pattern = _mm256_set1_epi8(target);
+  size_t idx = 0;
+
+  // Matches are often close by, so check the first block on its own before we start
+  // checking four at a time. We're only called with at least 32 bytes.
+  uint32_t const first_mask = _mm256_movemask_epi8(
+    _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i const *)str), pattern)
+  );
+  if (first_mask) {
+    return __builtin_ctz(first_mask);
+  }
+  idx = 32;
+
+  for (; idx + 128 <= size; idx += 128) {
+    __m256i const eq0 = _mm256_cmpeq_epi8(
+      _mm256_loadu_si256((__m256i const *)(str + idx)), pattern
+    );
+    __m256i const eq1 = _mm256_cmpeq_epi8(
+      _mm256_loadu_si256((__m256i const *)(str + idx + 32)), pattern
+    );
+    __m256i const eq2 = _mm256_cmpeq_epi8(
+      _mm256_loadu_si256((__m256i const *)(str + idx + 64)), pattern
+    );
+    __m256i const eq3 = _mm256_cmpeq_epi8(
+      _mm256_loadu_si256((__m256i const *)(str + idx + 96)), pattern
+    );
+    __m256i const any_eq = _mm256_or_si256(
+      _mm256_or_si256(eq0, eq1), _mm256_or_si256(eq2, eq3)
+    );
+    if (_mm256_movemask_epi8(any_eq)) {
+      break;
+    }
+  }
+  for (; idx + 32 <= size; idx += 32) {
+    __m256i const block = _mm256_loadu_si256((__m256i const *)(str + idx));
+    uint32_t const mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, pattern));
+    if (mask) {
+      return idx + __builtin_ctz(mask);
+    }
+  }
+  return pstr_find_byte_scalar(str, size, target, idx);
+}
+#endif
+
+
+/*
+  Returns the index of the first occurrence of `target` in the first `size` bytes of
+  `str`, or `size` if there isn't one.
+*/
+static size_t pstr_find_byte(char const *str, size_t const size, char const target) {
+#ifdef PSTR_X86
+  if (size >= 32 && pstr_cpu_has_avx2()) {
+    return pstr_find_byte_avx2(str, size, target);
+  }
+  return pstr_find_byte_sse2(str, size, target);
+#else
+  return pstr_find_byte_scalar(str, size, target, 0);
+#endif
+}
+
+
+/*
+  Returns whether `c` is one of the characters removed by the trim functions: either
+  whitespace, as `isspace()` sees it in the "C" locale, or `target`.
+*/
+static bool pstr_is_trim_match(char const c, bool const is_space, char const target) {
+  if (is_space) {
+    return c == ' ' || (uint8_t)(c - '\t') <= '\r' - '\t';
+  }
+  return c == target;
+}
+
+
+#ifdef PSTR_X86
+static uint32_t pstr_trim_mask_sse2(
+  __m128i const block, bool const is_space, __m128i const pattern
+) {
+  __m128i matches;
+  if (is_space) {
+    // Bytes in '\t'..'\r' are at most 4 after subtracting '\t', as unsigned values
+    __m128i const shifted = _mm_sub_epi8(block, _mm_set1_epi8('\t'));
+    matches = _mm_or_si128(
+      _mm_cmpeq_epi8(block, _mm_set1_epi8(' ')),
+      _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(4)), shifted)
+    );
+  } else {
+    matches = _mm_cmpeq_epi8(block, pattern);
+  }
+  return _mm_movemask_epi8(matches);
+}
+
+
+__attribute__((target("avx2")))
+static uint32_t pstr_trim_mask_avx2(
+  __m256i const block, bool const is_space, __m256i const pattern
+) {
+  __m256i matches;
+  if (is_space) {
+    __m256i const shifted = _mm256_sub_epi8(block, _mm256_set1_epi8('\t'));
+    matches = _mm256_or_si256(
+      _mm256_cmpeq_epi8(block, _mm256_set1_epi8(' ')),
+      _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(4)), shifted)
+    );
+  } else {
+    matches = _mm256_cmpeq_epi8(block, pattern);
+  }
+  return _mm256_movemask_epi8(matches);
+}
+#endif
+
+
+#ifdef PSTR_X86
+/*
+  Skips 32-byte blocks of matching characters from the start, returning the index of
+  the first block that has a non-matching character (or that doesn't fit), so that the
+  caller can finish off with a scalar scan.
+*/
+__attribute__((target("avx2")))
+static size_t pstr_trim_span_avx2(
+  char const *str, size_t const size, bool const is_space, char const target
+) {
+  __m256i const pattern = _mm256_set1_epi8(target);
+  size_t idx = 0;
+  for (; idx + 32 <= size; idx += 32) {
+    __m256i const block = _mm256_loadu_si256((__m256i const *)(str + idx));
+    if (pstr_trim_mask_avx2(block, is_space, pattern) != 0xffffffff) {
+      break;
+    }
+  }
+  return idx;
+}
+
+
+/*
+  Like `pstr_trim_span_avx2()`, but skips blocks from the end, returning the end of the
+  last block that has a non-matching character.
+*/
+__attribute__((target("avx2")))
+static size_t pstr_trim_rspan_avx2(
+  char const *str, size_t const size, bool const is_space, char const target
+) {
+  __m256i const pattern = _mm256_set1_epi8(target);
+  size_t end = size;
+  for (; end >= 32; end -= 32) {
+    __m256i const block = _mm256_loadu_si256((__m256i const *)(str + end - 32));
+    if (pstr_trim_mask_avx2(block, is_space, pattern) != 0xffffffff) {
+      break;
+    }
+  }
+  return end;
+}
+#endif
+
+
+/*
+  Returns how many characters at the start of the first `size` bytes of `str` would be
+  removed by a left trim.
+*/
+static size_t pstr_trim_span(
+  char const *str, size_t const size, bool const is_space, char const target
+) {
+  size_t idx = 0;
+#ifdef PSTR_X86
+  if (size >= 32 && pstr_cpu_has_avx2()) {
+    idx = pstr_trim_span_avx2(str, size, is_space, target);
+  } else {
+    __m128i const pattern = _mm_set1_epi8(target);
+    for (; idx + 16 <= size; idx += 16) {
+      __m128i const block = _mm_loadu_si128((__m128i const *)(str + idx));
+      uint32_t const mask = pstr_trim_mask_sse2(block, is_space, pattern);
+      if (mask != 0xffff) {
+        return idx + __builtin_ctz(~mask);
+      }
+    }
+  }
+#endif
+  while (idx < size && pstr_is_trim_match(str[idx], is_space, target)) {
+    idx++;
+  }
+  return idx;
+}
+
+
+/*
+  Returns how many characters at the end of the first `size` bytes of `str` would be
+  removed by a right trim.
+*/
+static size_t pstr_trim_rspan(
+  char const *str, size_t const size, bool const is_space, char const target
+) {
+  size_t end = size;
+#ifdef PSTR_X86
+  if (size >= 32 && pstr_cpu_has_avx2()) {
+    end = pstr_trim_rspan_avx2(str, size, is_space, target);
+  } else {
+    __m128i const pattern = _mm_set1_epi8(target);
+    for (; end >= 16; end -= 16) {
+      __m128i const block = _mm_loadu_si128((__m128i const *)(str + end - 16));
+      uint32_t const mask = pstr_trim_mask_sse2(block, is_space, pattern);
+      if (mask != 0xffff) {
+        size_t const idx_last_kept = end - 16 + (31 - __builtin_clz(~mask & 0xffff));
+        return size - idx_last_kept - 1;
+      }
+    }
+  }
+#endif
+  while (end > 0 && pstr_is_trim_match(str[end - 1], is_space, target)) {
+    end--;
+  }
+  return size - end;
+}
+
+
+// ASCII case
+// Only 'A'..'Z' and 'a'..'z' are ever changed or folded, whatever the locale, so a
+// letter's case can be flipped by toggling its 0x20 bit.
+// ------------------------
+
+static char pstr_ascii_to_lower(char const c) {
+  return (c >= 'A' && c <= 'Z') ? (char)(c + ('a' - 'A')) : c;
+}
+
+
+/*
+  Flips the case of every byte of `word` that is one of the 26 letters starting at
+  `first`. Each byte's low 7 bits are added to two constants, so that the top bit says
+  whether they're at least `first` or past the last letter, and bytes that already had
+  their top bit set are left alone.
+*/
+static uint64_t pstr_swar_flip_case(uint64_t const word, char const first) {
+  uint64_t const low_bits = word & ~PSTR_SWAR_HIGHS;
+  uint64_t const is_at_least_first = low_bits + PSTR_SWAR_ONES * (uint8_t)(0x80 - first);
+  uint64_t const is_past_last = low_bits + PSTR_SWAR_ONES * (uint8_t)(0x80 - 26 - first);
+  uint64_t const is_letter = (is_at_least_first ^ is_past_last) & ~word & PSTR_SWAR_HIGHS;
+  return word ^ (is_letter >> 2);
+}
+
+
+#ifdef PSTR_X86
+/*
+  Returns a mask of the bytes of `block` that are one of the 26 letters starting at
+  `first`. Adding `0x80 - first` moves those letters to the 26 smallest signed bytes, so
+  this takes a single comparison.
+*/
+static __m128i pstr_letter_mask_sse2(__m128i const block, char const first) {
+  __m128i const shifted = _mm_add_epi8(block, _mm_set1_epi8((char)(0x80 - first)));
+  return _mm_cmplt_epi8(shifted, _mm_set1_epi8(-128 + 26));
+}
+
+
+/*
+  Returns a mask of the bytes of `block1` and `block2` that are equal once folded to
+  lower case. They're either equal, or they only differ in the case bit and are letters.
+*/
+static __m128i pstr_eq_ci_mask_sse2(__m128i const block1, __m128i const block2) {
+  __m128i const case_bit = _mm_set1_epi8(0x20);
+  __m128i const lower1 = _mm_or_si128(block1, case_bit);
+  __m128i const is_eq_lower = _mm_cmpeq_epi8(lower1, _mm_or_si128(block2, case_bit));
+  __m128i const is_eq = _mm_cmpeq_epi8(block1, block2);
+  return _mm_and_si128(
+    is_eq_lower, _mm_or_si128(is_eq, pstr_letter_mask_sse2(lower1, 'a'))
+  );
+}
+
+
+__attribute__((target("avx2")))
+static __m256i pstr_letter_mask_avx2(__m256i const block, char const first) {
+  __m256i const shifted = _mm256_add_epi8(block, _mm256_set1_epi8((char)(0x80 - first)));
+  return _mm256_cmpgt_epi8(_mm256_set1_epi8(-128 + 26), shifted);
+}
+
+
+__attribute__((target("avx2")))
+static __m256i pstr_eq_ci_mask_avx2(__m256i const block1, __m256i const block2) {
+  __m256i const case_bit = _mm256_set1_epi8(0x20);
+  __m256i const lower1 = _mm256_or_si256(block1, case_bit);
+  __m256i const is_eq_lower =
+    _mm256_cmpeq_epi8(lower1, _mm256_or_si256(block2, case_bit));
+  __m256i const is_eq = _mm256_cmpeq_epi8(block1, block2);
+  return _mm256_and_si256(
+    is_eq_lower, _mm256_or_si256(is_eq, pstr_letter_mask_avx2(lower1, 'a'))
+  );
+}
+
+
+__attribute__((target("avx2")))
+static size_t pstr_flip_case_blocks_avx2(char *str, size_t const size, char const first) {
+  __m256i const case_bit = _mm256_set1_epi8(0x20);
+  size_t idx = 0;
+  for (; idx + 32 <= size; idx += 32) {
+    __m256i const block = _mm256_loadu_si256((__m256i const *)(str + idx));
+    __m256i const flip = _mm256_and_si256(pstr_letter_mask_avx2(block, first), case_bit);
+    _mm256_storeu_si256((__m256i *)(str + idx), _mm256_xor_si256(block, flip));
+  }
+  return idx;
+}
+
+
+/*
+  Returns the index of the first 32-byte block in which `str1` and `str2` differ, ignoring
+  case, or of the first block that doesn't fit. Two blocks are checked at a time, so
+  there's only one branch for every 64 bytes.
+*/
+__attribute__((target("avx2")))
+static size_t pstr_mismatch_ci_blocks_avx2(
+  char const *str1, char const *str2, size_t const size
+) {
+  size_t idx = 0;
+  for (; idx + 64 <= size; idx += 64) {
+    __m256i const is_eq = _mm256_and_si256(
+      pstr_eq_ci_mask_avx2(
+        _mm256_loadu_si256((__m256i const *)(str1 + idx)),
+        _mm256_loadu_si256((__m256i const *)(str2 + idx))
+      ),
+      pstr_eq_ci_mask_avx2(
+        _mm256_loadu_si256((__m256i const *)(str1 + idx + 32)),
+        _mm256_loadu_si256((__m256i const *)(str2 + idx + 32))
+      )
+    );
+    if ((uint32_t)_mm256_movemask_epi8(is_eq) != UINT32_MAX) {
+      break;
+    }
+  }
+  for (; idx + 32 <= size; idx += 32) {
+    __m256i const is_eq = pstr_eq_ci_mask_avx2(
+      _mm256_loadu_si256((__m256i const *)(str1 + idx)),
+      _mm256_loadu_si256((__m256i const *)(str2 + idx))
+    );
+    if ((uint32_t)_mm256_movemask_epi8(is_eq) != UINT32_MAX) {
+      break;
+    }
+  }
+  return idx;
+}
+#endif
+
+
+/*
+  Flips the case of the letters among the `size` characters at `str` that are in the
+  same case as `first`, so 'A' makes them lower case and 'a' makes them upper case.
+*/
+static void pstr_flip_case(char *str, size_t const size, char const first) {
+  size_t idx = 0;
+#ifdef PSTR_X86
+  if (size >= 32 && pstr_cpu_has_avx2()) {
+    idx = pstr_flip_case_blocks_avx2(str, size, first);
+  }
+  for (; idx + 16 <= size; idx += 16) {
+    __m128i const block = _mm_loadu_si128((__m128i const *)(str + idx));
+    __m128i const flip = _mm_and_si128(
+      pstr_letter_mask_sse2(block, first), _mm_set1_epi8(0x20)
+    );
+    _mm_storeu_si128((__m128i *)(str + idx), _mm_xor_si128(block, flip));
+  }
+#endif
+  for (; idx + 8 <= size; idx += 8) {
+    uint64_t const word = pstr_swar_flip_case(pstr_swar_load(str + idx), first);
+    memcpy(str + idx, &word, sizeof(word));
+  }
+  for (; idx < size; idx++) {
+    if (str[idx] >= first && str[idx] < first + 26) {
+      str[idx] ^= 0x20;
+    }
+  }
+}
+
+
+/*
+  Returns the index of the first of the `size` characters at which `str1` and `str2`
+  differ, ignoring case, or `size` if they don't.
+*/
+static size_t pstr_mismatch_ci(char const *str1, char const *str2, size_t const size) {
+  size_t idx = 0;
+#ifdef PSTR_X86
+  if (size >= 64 && pstr_cpu_has_avx2()) {
+    idx = pstr_mismatch_ci_blocks_avx2(str1, str2, size);
+  }
+  for (; idx + 16 <= size; idx += 16) {
+    __m128i const is_eq = pstr_eq_ci_mask_sse2(
+      _mm_loadu_si128((__m128i const *)(str1 + idx)),
+      _mm_loadu_si128((__m128i const *)(str2 + idx))
+    );
+    uint32_t const mask = _mm_movemask_epi8(is_eq);
+    if (mask != 0xffff) {
+      return idx + __builtin_ctz(~mask);
+    }
+  }
+#endif
+#ifdef PSTR_LITTLE_ENDIAN
+  for (; idx + 8 <= size; idx += 8) {
+    uint64_t const diff =
+      pstr_swar_flip_case(pstr_swar_load(str1 + idx), 'A') ^
+      pstr_swar_flip_case(pstr_swar_load(str2 + idx), 'A');
+    if (diff) {
+      return idx + __builtin_ctzll(diff) / 8;
+    }
+  }
+#endif
+  while (idx < size && pstr_ascii_to_lower(str1[idx]) == pstr_ascii_to_lower(str2[idx])) {
+    idx++;
+  }
+  return idx;
+}
+
+
+// Character sets
+// A `pstr_charset` is laid out so that, for 32 bytes at a time, one shuffle by each
+// byte's low 4 bits picks out its row, and another by its high 4 bits picks out the bit
+// to check in that row.
+// ------------------------
+
+static bool pstr_charset_has_byte(pstr_charset const *set, uint8_t const c) {
+  return (set->rows[(c & 15) | ((c >> 3) & 16)] >> ((c >> 4) & 7)) & 1;
+}
+
+
+#ifdef PSTR_X86
+__attribute__((target("avx2")))
+static uint32_t pstr_charset_mask_avx2(
+  __m256i const block, __m256i const low_rows, __m256i const high_rows
+) {
+  __m256i const nibble_mask = _mm256_set1_epi8(0x0f);
+  __m256i const low_nibbles = _mm256_and_si256(block, nibble_mask);
+  __m256i const high_nibbles = _mm256_and_si256(_mm256_srli_epi16(block, 4), nibble_mask);
+  // Bytes of 0x80 and up, which have their top bit set, take their row from `high_rows`
+  __m256i const rows = _mm256_blendv_epi8(
+    _mm256_shuffle_epi8(low_rows, low_nibbles),
+    _mm256_shuffle_epi8(high_rows, low_nibbles),
+    block
+  );
+  __m256i const bits = _mm256_shuffle_epi8(
+    _mm256_setr_epi8(
+      1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+      1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128
+    ),
+    high_nibbles
+  );
+  return _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(rows, bits), bits));
+}
+
+
+/*
+  Skips 32-byte blocks from the start for as long as every byte's membership in `set` is
+  `is_member`. Returns the index of the first byte that isn't, or of the first block that
+  doesn't fit, so that the caller can finish off with a scalar scan.
+*/
+__attribute__((target("avx2")))
+static size_t pstr_charset_skip_avx2(
+  char const *str, size_t const size, pstr_charset const *set, bool const is_member
+) {
+  __m256i const low_rows = _mm256_broadcastsi128_si256(
+    _mm_loadu_si128((__m128i const *)set->rows)
+  );
+  __m256i const high_rows = _mm256_broadcastsi128_si256(
+    _mm_loadu_si128((__m128i const *)(set->rows + 16))
+  );
+  uint32_t const flip = is_member ? UINT32_MAX : 0;
+  size_t idx = 0;
+  for (; idx + 32 <= size; idx += 32) {
+    __m256i const block = _mm256_loadu_si256((__m256i const *)(str + idx));
+    uint32_t const mask = pstr_charset_mask_avx2(block, low_rows, high_rows) ^ flip;
+    if (mask) {
+      return idx + __builtin_ctz(mask);
+    }
+  }
+  return idx;
+}
+
+
+/*
+  Like `pstr_charset_skip_avx2()`, but skips blocks from the end, returning the end of the
+  last byte whose membership isn't `is_member`.
+*/
+__attribute__((target("avx2")))
+static size_t pstr_charset_rskip_avx2(
+  char const *str, size_t const size, pstr_charset const *set, bool const is_member
+) {
+  __m256i const low_rows = _mm256_broadcastsi128_si256(
+    _mm_loadu_si128((__m128i const *)set->rows)
+  );
+  __m256i const high_rows = _mm256_broadcastsi128_si256(
+    _mm_loadu_si128((__m128i const *)(set->rows + 16))
+  );
+  uint32_t const flip = is_member ? UINT32_MAX : 0;
+  size_t end = size;
+  for (; end >= 32; end -= 32) {
+    __m256i const block = _mm256_loadu_si256((__m256i const *)(str + end - 32));
+    uint32_t const mask = pstr_charset_mask_avx2(block, low_rows, high_rows) ^ flip;
+    if (mask) {
+      return end - __builtin_clz(mask);
+    }
+  }
+  return end;
+}
+#endif
+
+
+/*
+  Returns the index of the first of the `size` bytes at `str` whose membership in `set`
+  isn't `is_member`, or `size` if there isn't one. A span skips members and a cspan
+  skips non-members.
+*/
+static size_t pstr_charset_skip(
+  char const *str, size_t const size, pstr_charset const *set, bool const is_member
+) {
+  size_t idx = 0;
+#ifdef PSTR_X86
+  if (size >= 32 && pstr_cpu_has_avx2()) {
+    idx = pstr_charset_skip_avx2(str, size, set, is_member);
+  }
+#endif
+  while (idx < size && pstr_charset_has_byte(set, (uint8_t)str[idx]) == is_member) {
+    idx++;
+  }
+  return idx;
+}
+
+
+/*
+  Like `pstr_charset_skip()`, but from the end, returning how many bytes at the end of
+  `str` were skipped.
+*/
+static size_t pstr_charset_rskip(
+  char const *str, size_t const size, pstr_charset const *set, bool const is_member
+) {
+  size_t end = size;
+#ifdef PSTR_X86
+  if (size >= 32 && pstr_cpu_has_avx2()) {
+    end = pstr_charset_rskip_avx2(str, size, set, is_member);
+  }
+#endif
+  while (end > 0 && pstr_charset_has_byte(set, (uint8_t)str[end - 1]) == is_member) {
+    end--;
+  }
+  return size - end;
+}
+
+
+// Prefix tables
+// Each prefix's first 8 characters are kept as one word, so a string's first 8
+// characters are loaded once, and most prefixes are ruled out with one comparison.
+// ------------------------
+
+#define PSTR_PREFIX_HEAD_LEN 8
+
+
+/*
+  Loads the first `len` characters of `str`, which is at most 8, into a word, with zero
+  bytes after them.
+*/
+static uint64_t pstr_prefix_load_head(char const *str, size_t const len) {
+  uint64_t head = 0;
+  memcpy(&head, str, len);
+  return head;
+}
+
+
+/*
+  Returns the index of the longest of `table`'s prefixes that `str` starts with, or -1.
+  `head_len` is how many of the first 8 characters of `str` there are, and `str_len` is
+  its length, or `SIZE_MAX` if it's NULL-terminated and we don't know it.
+*/
+static int64_t pstr_prefix_table_match(
+  pstr_prefix_table const *table, char const *str, size_t const head_len,
+  size_t const str_len
+) {
+  if (head_len == 0) {
+    return -1;
+  }
+  uint64_t const head = pstr_prefix_load_head(str, head_len);
+  uint8_t const first_char = (uint8_t)str[0];
+  size_t const end = table->first_char_starts[first_char + 1];
+  for (size_t idx = table->first_char_starts[first_char]; idx < end; idx++) {
+    pstr_prefix const *prefix = &table->prefixes[idx];
+    if ((head & prefix->head_mask) != prefix->head) {
+      continue;
+    }
+    // Prefixes have no NULL bytes, so a matching head means that `str` has at least as
+    // many characters, and we can go on to compare the rest of them
+    if (prefix->len <= PSTR_PREFIX_HEAD_LEN) {
+      return (int64_t)prefix->prefix_idx;
+    }
+    size_t const tail_len = prefix->len - PSTR_PREFIX_HEAD_LEN;
+    char const *const str_tail = str + PSTR_PREFIX_HEAD_LEN;
+    char const *const prefix_tail = prefix->str + PSTR_PREFIX_HEAD_LEN;
+    bool const is_tail_match = str_len == SIZE_MAX ?
+      strncmp(str_tail, prefix_tail, tail_len) == 0 :
+      prefix->len <= str_len && memcmp(str_tail, prefix_tail, tail_len) == 0;
+    if (is_tail_match) {
+      return (int64_t)prefix->prefix_idx;
+    }
+  }
+  return -1;
+}
+
+
+/*
+  Orders prefixes by their first character, then longest first, then in the order they
+  were given.
+*/
+static int pstr_prefix_compare(void const *ptr1, void const *ptr2) {
+  pstr_prefix const *prefix1 = ptr1;
+  pstr_prefix const *prefix2 = ptr2;
+  uint8_t const first_char1 = (uint8_t)prefix1->str[0];
+  uint8_t const first_char2 = (uint8_t)prefix2->str[0];
+  if (first_char1 != first_char2) {
+    return first_char1 < first_char2 ? -1 : 1;
+  }
+  if (prefix1->len != prefix2->len) {
+    return prefix1->len > prefix2->len ? -1 : 1;
+  }
+  return (prefix1->prefix_idx > prefix2->prefix_idx) -
+    (prefix1->prefix_idx < prefix2->prefix_idx);
+}
+
+
+// Substring search
+// Candidates are found by looking for blocks where two of the needle's characters line
+// up, the first one and the last one that's different from it, and then the rest is
+// checked. For needles longer than `PSTR_SHORT_NEEDLE_LEN`, checking can cost a lot on
+// input made to trip this up, so if we've compared more characters than we've moved
+// past, plus some slack, we hand over to the Two-Way algorithm, which always takes
+// linear time.
+// ------------------------
+
+#define PSTR_SHORT_NEEDLE_LEN 32
+#define PSTR_SEARCH_SLACK 4096
+// How many occurrences `pstr_sv_replace_all()` remembers when the string grows. If there
+// are no more than this, every character is moved once, otherwise twice.
+#define PSTR_N_TRACKED_REPLACEMENTS 64
+
+
+typedef struct {
+  pstr_sv haystack;
+  pstr_sv needle;
+  // Where the other character we look for is in the needle
+  size_t other_offset;
+  // How many characters we've compared while checking candidates
+  size_t n_compared;
+  bool did_give_up;
+} pstr_search;
+
+
+static pstr_search pstr_search_init(pstr_sv const haystack, pstr_sv const needle) {
+  // Looking for the first and last characters does nothing for us if they're the same,
+  // and they often are in input made to trip us up, like runs of one character
+  size_t other_offset = needle.len - 1;
+  while (other_offset > 0 && needle.str[other_offset] == needle.str[0]) {
+    other_offset--;
+  }
+  if (other_offset == 0) {
+    other_offset = needle.len - 1;
+  }
+  pstr_search search = {
+    .haystack = haystack, .needle = needle, .other_offset = other_offset,
+    .n_compared = 0, .did_give_up = false,
+  };
+  return search;
+}
+
+
+/*
+  Returns how many characters at the start of `str1` and `str2` are the same, checking
+  8 at a time.
+*/
+static size_t pstr_count_matching(char const *str1, char const *str2, size_t const n) {
+  size_t idx = 0;
+#ifdef PSTR_LITTLE_ENDIAN
+  for (; idx + 8 <= n; idx += 8) {
+    uint64_t const diff = pstr_swar_load(str1 + idx) ^ pstr_swar_load(str2 + idx);
+    if (diff) {
+      return idx + __builtin_ctzll(diff) / 8;
+    }
+  }
+#endif
+  while (idx < n && str1[idx] == str2[idx]) {
+    idx++;
+  }
+  return idx;
+}
+
+
+/*
+  Checks the candidate at `idx`, whose first character and the one at `other_offset`
+  are already known to match. Returns whether we can stop searching, either because
+  `needle` is at `idx`, or because we've spent too long checking candidates, in which
+  case `did_give_up` is set. `progress` is how many positions we've moved past.
+*/
+static inline bool pstr_search_is_done(
+  pstr_search *search, size_t const idx, size_t const progress
+) {
+  pstr_sv const needle = search->needle;
+  char const *candidate = search->haystack.str + idx;
+  if (needle.len <= 2) {
+    return true;
+  }
+  if (needle.len <= PSTR_SHORT_NEEDLE_LEN) {
+    return memcmp(candidate + 1, needle.str + 1, needle.len - 1) == 0;
+  }
+  size_t const n_matching =
+    pstr_count_matching(candidate + 1, needle.str + 1, needle.len - 1);
+  if (n_matching == needle.len - 1) {
+    return true;
+  }
+  search->n_compared += n_matching + 1;
+  if (search->n_compared > progress + PSTR_SEARCH_SLACK) {
+    search->did_give_up = true;
+    return true;
+  }
+  return false;
+}
+
+
+static size_t pstr_find_filtered_scalar(pstr_search *search, size_t idx) {
+  pstr_sv const haystack = search->haystack;
+  pstr_sv const needle = search->needle;
+  size_t const last_start = haystack.len - needle.len;
+  while (idx <= last_start) {
+    idx += pstr_find_byte(haystack.str + idx, last_start + 1 - idx, needle.str[0]);
+    if (idx > last_start) {
+      break;
+    }
+    if (
+      haystack.str[idx + search->other_offset] == needle.str[search->other_offset] &&
+      pstr_search_is_done(search, idx, idx)
+    ) {
+      return idx;
+    }
+    idx++;
+  }
+  return haystack.len;
+}
+
+
+static size_t pstr_rfind_filtered_scalar(pstr_search *search, size_t end) {
+  pstr_sv const haystack = search->haystack;
+  pstr_sv const needle = search->needle;
+  size_t const n_starts = haystack.len - needle.len + 1;
+  while (end > 0) {
+    end--;
+    if (
+      haystack.str[end] == needle.str[0] &&
+      haystack.str[end + search->other_offset] == needle.str[search->other_offset] &&
+      pstr_search_is_done(search, end, n_starts - end)
+    ) {
+      return end;
+    }
+  }
+  return haystack.len;
+}
+
+
+#ifdef PSTR_X86
+static uint32_t pstr_pair_mask_sse2(
+  char const *str, size_t const other_offset, __m128i const first, __m128i const other
+) {
+  __m128i const eq_first = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i const *)str), first);
+  __m128i const eq_other = _mm_cmpeq_epi8(
+    _mm_loadu_si128((__m128i const *)(str + other_offset)), other
+  );
+  return _mm_movemask_epi8(_mm_and_si128(eq_first, eq_other));
+}
+
+
+static size_t pstr_find_filtered_sse2(pstr_search *search, size_t idx) {
+  pstr_sv const haystack = search->haystack;
+  pstr_sv const needle = search->needle;
+  size_t const n_starts = haystack.len - needle.len + 1;
+  __m128i const first = _mm_set1_epi8(needle.str[0]);
+  size_t const other_offset = search->other_offset;
+  __m128i const other = _mm_set1_epi8(needle.str[other_offset]);
+  for (; idx + 16 <= n_starts; idx += 16) {
+    uint32_t mask = pstr_pair_mask_sse2(haystack.str + idx, other_offset, first, other);
+    while (mask) {
+      size_t const candidate = idx + __builtin_ctz(mask);
+      if (pstr_search_is_done(search, candidate, candidate)) {
+        return candidate;
+      }
+      mask &= mask - 1;
+    }
+  }
+  if (n_starts < 16) {
+    return pstr_find_filtered_scalar(search, idx);
+  }
+  // Check what's left with a block that overlaps the last one, ignoring the positions
+  // we've already done, rather than going one position at a time
+  if (idx < n_starts) {
+    size_t const start = n_starts - 16;
+    uint32_t mask = pstr_pair_mask_sse2(haystack.str + start, other_offset, first, other);
+    mask &= UINT32_MAX << (idx - start);
+    while (mask) {
+      size_t const candidate = start + __builtin_ctz(mask);
+      if (pstr_search_is_done(search, candidate, candidate)) {
+        return candidate;
+      }
+      mask &= mask - 1;
+    }
+  }
+  return haystack.len;
+}
+
+
+static size_t pstr_rfind_filtered_sse2(pstr_search *search, size_t end) {
+  pstr_sv const haystack = search->haystack;
+  pstr_sv const needle = search->needle;
+  size_t const n_starts = haystack.len - needle.len + 1;
+  __m128i const first = _mm_set1_epi8(needle.str[0]);
+  size_t const other_offset = search->other_offset;
+  __m128i const other = _mm_set1_epi8(needle.str[other_offset]);
+  for (; end >= 16; end -= 16) {
+    uint32_t mask =
+      pstr_pair_mask_sse2(haystack.str + end - 16, other_offset, first, other);
+    while (mask) {
+      size_t const bit = 31 - __builtin_clz(mask);
+      size_t const candidate = end - 16 + bit;
+      if (pstr_search_is_done(search, candidate, n_starts - candidate)) {
+        return candidate;
+      }
+      mask &= ~(1u << bit);
+    }
+  }
+  if (n_starts < 16) {
+    return pstr_rfind_filtered_scalar(search, end);
+  }
+  // Check what's left with the first block, ignoring the positions we've already done
+  uint32_t mask = pstr_pair_mask_sse2(haystack.str, other_offset, first, other) &
+    ((1u << end) - 1);
+  while (mask) {
+    size_t const bit = 31 - __builtin_clz(mask);
+    if (pstr_search_is_done(search, bit, n_starts - bit)) {
+      return bit;
+    }
+    mask &= ~(1u << bit);
+  }
+  return haystack.len;
+}
+
+
+__attribute__((target("avx2")))
+static uint32_t pstr_pair_mask_avx2(
+  char const *str, size_t const other_offset, __m256i const first, __m256i const other
+) {
+  __m256i const eq_first = _mm256_cmpeq_epi8(
+    _mm256_loadu_si256((__m256i const *)str), first
+  );
+  __m256i const eq_other = _mm256_cmpeq_epi8(
+    _mm256_loadu_si256((__m256i const *)(str + other_offset)), other
+  );
+  return _mm256_movemask_epi8(_mm256_and_si256(eq_first, eq_other));
+}
+
+
+__attribute__((target("avx2")))
+static size_t pstr_find_filtered_avx2(pstr_search *search, size_t idx) {
+  pstr_sv const haystack = search->haystack;
+  pstr_sv const needle = search->needle;
+  size_t const n_starts = haystack.len - needle.len + 1;
+  __m256i const first = _mm256_set1_epi8(needle.str[0]);
+  size_t const other_offset = search->other_offset;
+  __m256i const other = _mm256_set1_epi8(needle.str[other_offset]);
+  // Check 64 positions per iteration, since candidates are usually rare
+  for (; idx + 64 <= n_starts; idx += 64) {
+    uint64_t const mask_hi =
+      pstr_pair_mask_avx2(haystack.str + idx + 32, other_offset, first, other);
+    uint64_t mask =
+      pstr_pair_mask_avx2(haystack.str + idx, other_offset, first, other) | mask_hi << 32;
+    while (mask) {
+      size_t const candidate = idx + __builtin_ctzll(mask);
+      if (pstr_search_is_done(search, candidate, candidate)) {
+        return candidate;
+      }
+      mask &= mask - 1;
+    }
+  }
+  if (n_starts < 32) {
+    return pstr_find_filtered_sse2(search, idx);
+  }
+  // Check what's left a block at a time, with the last block overlapping the one before
+  // it, ignoring the positions we've already done
+  while (idx < n_starts) {
+    size_t const start = idx + 32 <= n_starts ? idx : n_starts - 32;
+    uint32_t mask = pstr_pair_mask_avx2(haystack.str + start, other_offset, first, other);
+    mask &= UINT32_MAX << (idx - start);
+    while (mask) {
+      size_t const candidate = start + __builtin_ctz(mask);
+      if (pstr_search_is_done(search, candidate, candidate)) {
+        return candidate;
+      }
+      mask &= mask - 1;
+    }
+    idx = start + 32;
+  }
+  return haystack.len;
+}
+
+
+__attribute__((target("avx2")))
+static size_t pstr_rfind_filtered_avx2(pstr_search *search, size_t end) {
+  pstr_sv const haystack = search->haystack;
+  pstr_sv const needle = search->needle;
+  size_t const n_starts = haystack.len - needle.len + 1;
+  __m256i const first = _mm256_set1_epi8(needle.str[0]);
+  size_t const other_offset = search->other_offset;
+  __m256i const other = _mm256_set1_epi8(needle.str[other_offset]);
+  for (; end >= 32; end -= 32) {
+    uint32_t mask =
+      pstr_pair_mask_avx2(haystack.str + end - 32, other_offset, first, other);
+    while (mask) {
+      size_t const bit = 31 - __builtin_clz(mask);
+      size_t const candidate = end - 32 + bit;
+      if (pstr_search_is_done(search, candidate, n_starts - candidate)) {
+        return candidate;
+      }
+      mask &= ~(1u << bit);
+    }
+  }
+  if (n_starts < 32) {
+    return pstr_rfind_filtered_sse2(search, end);
+  }
+  // Check what's left with the first block, ignoring the positions we've already done
+  uint32_t mask = pstr_pair_mask_avx2(haystack.str, other_offset, first, other) &
+    ((1u << end) - 1);
+  while (mask) {
+    size_t const bit = 31 - __builtin_clz(mask);
+    if (pstr_search_is_done(search, bit, n_starts - bit)) {
+      return bit;
+    }
+    mask &= ~(1u << bit);
+  }
+  return haystack.len;
+}
+#endif
+
+
+/*
+  Returns the index of the first candidate from `idx` onwards at which we can stop
+  searching, as decided by `pstr_search_is_done()`, or `haystack.len` if there isn't one.
+  `needle` must have between 1 and `haystack.len` characters.
+*/
+static size_t pstr_find_filtered(pstr_search *search, size_t const idx) {
+#ifdef PSTR_X86
+  if (pstr_cpu_has_avx2()) {
+    return pstr_find_filtered_avx2(search, idx);
+  }
+  return pstr_find_filtered_sse2(search, idx);
+#else
+  return pstr_find_filtered_scalar(search, idx);
+#endif
+}
+
+
+/*
+  Like `pstr_find_filtered()`, but goes backwards from just before the start position
+  `end`.
+*/
+static size_t pstr_rfind_filtered(pstr_search *search, size_t const end) {
+#ifdef PSTR_X86
+  if (pstr_cpu_has_avx2()) {
+    return pstr_rfind_filtered_avx2(search, end);
+  }
+  return pstr_rfind_filtered_sse2(search, end);
+#else
+  return pstr_rfind_filtered_scalar(search, end);
+#endif
+}
+
+
+/*
+  Returns the byte at `idx` in `sv`, counting from the end if `is_reverse` is set, so
+  that the Two-Way functions below can search backwards without another copy of the
+  algorithm.
+*/
+static uint8_t pstr_sv_at(pstr_sv const sv, size_t const idx, bool const is_reverse) {
+  return (uint8_t)sv.str[is_reverse ? sv.len - 1 - idx : idx];
+}
+
+
+/*
+  What the Two-Way algorithm needs to know about a needle, worked out once so that it
+  can be reused for every search. `shifts` says how far we can move along when the
+  haystack character under the needle's last character is a given byte.
+*/
+typedef struct {
+  size_t suffix;
+  size_t period;
+  bool is_periodic;
+  size_t shifts[256];
+} pstr_two_way;
+
+
+/*
+  Finds the maximal suffix of `needle`, under the usual byte order or, if `is_flipped`
+  is set, the opposite one, and its period. This is half of the critical factorization.
+*/
+static size_t pstr_two_way_max_suffix(
+  pstr_sv const needle, bool const is_reverse, bool const is_flipped, size_t *period
+) {
+  // `max_suffix` starts at -1, and wraps around to the start of the needle when we add
+  // to it
+  size_t max_suffix = SIZE_MAX;
+  size_t idx = 0;
+  size_t offset = 1;
+  size_t p = 1;
+  while (idx + offset < needle.len) {
+    uint8_t const a = pstr_sv_at(needle, idx + offset, is_reverse);
+    uint8_t const b = pstr_sv_at(needle, max_suffix + offset, is_reverse);
+    if (a == b) {
+      if (offset != p) {
+        offset++;
+      } else {
+        idx += p;
+        offset = 1;
+      }
+    } else if ((a < b) != is_flipped) {
+      idx += offset;
+      offset = 1;
+      p = idx - max_suffix;
+    } else {
+      max_suffix = idx;
+      idx++;
+      offset = 1;
+      p = 1;
+    }
+  }
+  *period = p;
+  return max_suffix + 1;
+}
+
+
+static void pstr_two_way_init(
+  pstr_two_way *tw, pstr_sv const needle, bool const is_reverse
+) {
+  size_t period;
+  size_t flipped_period;
+  size_t const suffix = pstr_two_way_max_suffix(needle, is_reverse, false, &period);
+  size_t const flipped_suffix =
+    pstr_two_way_max_suffix(needle, is_reverse, true, &flipped_period);
+  if (flipped_suffix < suffix) {
+    tw->suffix = suffix;
+    tw->period = period;
+  } else {
+    tw->suffix = flipped_suffix;
+    tw->period = flipped_period;
+  }
+
+  // The needle is periodic if the part before the critical position repeats after one
+  // period
+  tw->is_periodic = true;
+  for (size_t idx = 0; tw->is_periodic && idx < tw->suffix; idx++) {
+    uint8_t const c = pstr_sv_at(needle, idx, is_reverse);
+    if (c != pstr_sv_at(needle, idx + tw->period, is_reverse)) {
+      tw->is_periodic = false;
+    }
+  }
+  if (!tw->is_periodic) {
+    size_t const longer_half =
+      tw->suffix > needle.len - tw->suffix ? tw->suffix : needle.len - tw->suffix;
+    tw->period = longer_half + 1;
+  }
+
+  for (size_t idx = 0; idx < 256; idx++) {
+    tw->shifts[idx] = needle.len;
+  }
+  for (size_t idx = 0; idx < needle.len; idx++) {
+    tw->shifts[pstr_sv_at(needle, idx, is_reverse)] = needle.len - idx - 1;
+  }
+}
+
+
+/*
+  Returns the index of the first occurrence of `needle` in `haystack`, or `haystack.len`
+  if there isn't one. If `is_reverse` is set, both are read from the end, so this finds
+  the last occurrence, and the index is counted from the end of `haystack` to the end of
+  the match. `tw` must have been set up for `needle` with the same `is_reverse`.
+*/
+static size_t pstr_two_way_find(
+  pstr_two_way const *tw, pstr_sv const haystack, pstr_sv const needle,
+  bool const is_reverse
+) {
+  size_t const last_start = haystack.len - needle.len;
+  // For periodic needles, `memory` is how much of the needle we know already matches
+  // from the last attempt, so that we never check the same characters twice
+  size_t memory = 0;
+  size_t start = 0;
+  while (start <= last_start) {
+    // Check the last character first, and skip ahead if the needle can't end here
+    uint8_t const last = pstr_sv_at(haystack, start + needle.len - 1, is_reverse);
+    size_t shift = tw->shifts[last];
+    if (shift > 0) {
+      if (memory && shift < tw->period) {
+        shift = needle.len - tw->period;
+      }
+      memory = 0;
+      start += shift;
+      continue;
+    }
+
+    // Match the right half, from the critical position onwards
+    size_t idx = tw->suffix > memory ? tw->suffix : memory;
+    while (
+      idx < needle.len - 1 &&
+      pstr_sv_at(needle, idx, is_reverse) == pstr_sv_at(haystack, start + idx, is_reverse)
+    ) {
+      idx++;
+    }
+    if (idx < needle.len - 1) {
+      start += idx - tw->suffix + 1;
+      memory = 0;
+      continue;
+    }
+
+    // Match the left half, backwards from the critical position
+    idx = tw->suffix;
+    while (
+      idx > memory &&
+      pstr_sv_at(needle, idx - 1, is_reverse) ==
+        pstr_sv_at(haystack, start + idx - 1, is_reverse)
+    ) {
+      idx--;
+    }
+    if (idx <= memory) {
+      return start;
+    }
+    start += tw->period;
+    if (tw->is_periodic) {
+      memory = needle.len - tw->period;
+    }
+  }
+  return haystack.len;
+}
+
+
+/*
+  Like `pstr_two_way_find()`, going forwards, but starts at `idx`, and returns an index
+  into the whole of `haystack`.
+*/
+static size_t pstr_two_way_find_from(
+  pstr_two_way const *tw, pstr_sv const haystack, pstr_sv const needle, size_t const idx
+) {
+  pstr_sv const rest = pstr_sv_from_n(haystack.str + idx, haystack.len - idx);
+  size_t const idx_in_rest = pstr_two_way_find(tw, rest, needle, false);
+  return idx_in_rest == rest.len ? haystack.len : idx + idx_in_rest;
+}
+
+
+/*
+  Returns the index of the first occurrence of the needle at or after `idx`, or
+  `haystack.len` if there isn't one. Once checking candidates gets too slow, carries on
+  with Two-Way, setting up `tw` the first time, so finding every occurrence one after
+  the other still takes linear time.
+*/
+static size_t pstr_search_next(pstr_search *search, pstr_two_way *tw, size_t const idx) {
+  pstr_sv const haystack = search->haystack;
+  pstr_sv const needle = search->needle;
+  if (haystack.len - idx < needle.len) {
+    return haystack.len;
+  }
+  if (search->did_give_up) {
+    return pstr_two_way_find_from(tw, haystack, needle, idx);
+  }
+  size_t const found = pstr_find_filtered(search, idx);
+  if (!search->did_give_up) {
+    return found;
+  }
+  pstr_two_way_init(tw, needle, false);
+  return pstr_two_way_find_from(tw, haystack, needle, found);
+}
+
+
+/*
+  Returns the index of the first occurrence of `needle` in `haystack`, or `haystack.len`
+  if there isn't one or `needle` is empty.
+*/
+static size_t pstr_find_sv(pstr_sv const haystack, pstr_sv const needle) {
+  if (needle.len == 0 || needle.len > haystack.len) {
+    return haystack.len;
+  }
+  if (needle.len == 1) {
+    return pstr_find_byte(haystack.str, haystack.len, needle.str[0]);
+  }
+  pstr_search search = pstr_search_init(haystack, needle);
+  size_t const idx = pstr_find_filtered(&search, 0);
+  if (!search.did_give_up) {
+    return idx;
+  }
+  pstr_two_way tw;
+  pstr_two_way_init(&tw, needle, false);
+  return pstr_two_way_find_from(&tw, haystack, needle, idx);
+}
+
+
+/*
+  Like `pstr_find_sv()`, but finds the last occurrence.
+*/
+static size_t pstr_rfind_sv(pstr_sv const haystack, pstr_sv const needle) {
+  if (needle.len == 0 || needle.len > haystack.len) {
+    return haystack.len;
+  }
+  pstr_search search = pstr_search_init(haystack, needle);
+  size_t const idx = pstr_rfind_filtered(&search, haystack.len - needle.len + 1);
+  if (!search.did_give_up) {
+    return idx;
+  }
+  // Carry on backwards from the candidate we gave up on
+  pstr_two_way tw;
+  pstr_two_way_init(&tw, needle, true);
+  pstr_sv const rest = pstr_sv_from_n(haystack.str, idx + needle.len);
+  size_t const idx_from_end = pstr_two_way_find(&tw, rest, needle, true);
+  if (idx_from_end == rest.len) {
+    return haystack.len;
+  }
+  return rest.len - idx_from_end - needle.len;
+}
+
+
+// Hashing
+// This is wyhash, by Wang Yi, which is in the public domain. Strings of up to 16
+// characters are read as two overlapping 8-byte halves, and longer ones 48 bytes at a
+// time, with three independent lanes, then 16 at a time, ending on the last 16
+// characters. Everything is mixed by multiplying into 128 bits and folding the halves
+// together.
+// ------------------------
+
+// How much of a NULL-terminated string `pstr_len_and_hash()` checks for the terminator
+// before hashing it, which is a whole number of 48-byte rounds
+#define PSTR_HASH_CHUNK_SIZE 1536
+
+
+static uint64_t const pstr_hash_secret[4] = {
+  0xa0761d6478bd642fULL, 0xe7037ed1a0b428dbULL,
+  0x8ebc6af09c88c6e3ULL, 0x589965cc75374cc3ULL,
+};
+
+
+/*
+  Multiplies `*a` and `*b`, putting the low half of the result into `*a` and the high
+  half into `*b`.
+*/
+static void pstr_hash_multiply(uint64_t *a, uint64_t *b) {
+#ifdef __SIZEOF_INT128__
+  __uint128_t const product = (__uint128_t)*a * *b;
+  *a = (uint64_t)product;
+  *b = (uint64_t)(product >> 64);
+#else
+  uint64_t const a_high = *a >> 32;
+  uint64_t const a_low = (uint32_t)*a;
+  uint64_t const b_high = *b >> 32;
+  uint64_t const b_low = (uint32_t)*b;
+  uint64_t const high_low = a_high * b_low;
+  uint64_t const low_high = a_low * b_high;
+  uint64_t const low_low = a_low * b_low;
+  uint64_t const middle = (low_low >> 32) + (uint32_t)high_low + (uint32_t)low_high;
+  *a = (middle << 32) | (uint32_t)low_low;
+  *b = a_high * b_high + (high_low >> 32) + (low_high >> 32) + (middle >> 32);
+#endif
+}
+
+
+static uint64_t pstr_hash_mix(uint64_t a, uint64_t b) {
+  pstr_hash_multiply(&a, &b);
+  return a ^ b;
+}
+
+
+static uint64_t pstr_hash_load4(char const *str) {
+  uint32_t word;
+  memcpy(&word, str, sizeof(word));
+  return word;
+}
+
+
+static uint64_t pstr_hash_init(uint64_t const seed) {
+  return seed ^ pstr_hash_mix(seed ^ pstr_hash_secret[0], pstr_hash_secret[1]);
+}
+
+
+/*
+  Runs `n_rounds` rounds of 48 bytes of `str` through the three lanes in `lanes`.
+*/
+static void pstr_hash_rounds(char const *str, size_t const n_rounds, uint64_t lanes[3]) {
+  for (size_t idx = 0; idx < n_rounds; idx++, str += 48) {
+    lanes[0] = pstr_hash_mix(
+      pstr_swar_load(str) ^ pstr_hash_secret[1], pstr_swar_load(str + 8) ^ lanes[0]
+    );
+    lanes[1] = pstr_hash_mix(
+      pstr_swar_load(str + 16) ^ pstr_hash_secret[2], pstr_swar_load(str + 24) ^ lanes[1]
+    );
+    lanes[2] = pstr_hash_mix(
+      pstr_swar_load(str + 32) ^ pstr_hash_secret[3], pstr_swar_load(str + 40) ^ lanes[2]
+    );
+  }
+}
+
+
+/*
+  Hashes the last `n_left` characters of a string `len` characters long, which start at
+  `str`, once everything before them has been mixed into `state`.
+*/
+static uint64_t pstr_hash_finish(
+  char const *str, size_t n_left, size_t const len, uint64_t state
+) {
+  uint64_t a;
+  uint64_t b;
+  if (len <= 16) {
+    if (len >= 4) {
+      size_t const offset = (len >> 3) << 2;
+      a = (pstr_hash_load4(str) << 32) | pstr_hash_load4(str + offset);
+      b = (pstr_hash_load4(str + len - 4) << 32) | pstr_hash_load4(str + len - 4 - offset);
+    } else if (len > 0) {
+      a = ((uint64_t)(uint8_t)str[0] << 16) | ((uint64_t)(uint8_t)str[len >> 1] << 8) |
+        (uint8_t)str[len - 1];
+      b = 0;
+    } else {
+      a = 0;
+      b = 0;
+    }
+  } else {
+    while (n_left > 16) {
+      state = pstr_hash_mix(
+        pstr_swar_load(str) ^ pstr_hash_secret[1], pstr_swar_load(str + 8) ^ state
+      );
+      str += 16;
+      n_left -= 16;
+    }
+    // These can reach back before `str`, which is fine, because we have at least 16
+    // characters in total
+    a = pstr_swar_load(str + n_left - 16);
+    b = pstr_swar_load(str + n_left - 8);
+  }
+  a ^= pstr_hash_secret[1];
+  b ^= state;
+  pstr_hash_multiply(&a, &b);
+  return pstr_hash_mix(a ^ pstr_hash_secret[0] ^ len, b ^ pstr_hash_secret[1]);
+}
+
+
+/*
+  Hashes what's left of a string `len` characters long, starting `str`, once the first
+  `len - n_left` characters have been run through `lanes`.
+*/
+static uint64_t pstr_hash_rest(
+  char const *str, size_t n_left, size_t const len, uint64_t lanes[3]
+) {
+  // Go 48 bytes at a time while there's more than that left, so the last 48 go through
+  // `pstr_hash_finish()`
+  size_t const n_rounds = n_left > 48 ? (n_left - 1) / 48 : 0;
+  pstr_hash_rounds(str, n_rounds, lanes);
+  str += n_rounds * 48;
+  n_left -= n_rounds * 48;
+  uint64_t const state = len > 48 ? lanes[0] ^ lanes[1] ^ lanes[2] : lanes[0];
+  return pstr_hash_finish(str, n_left, len, state);
+}
+
 
 bool pstr_is_valid(char const *str, size_t const size) {
-  for (size_t idx = 0; idx < size; idx++) {
-    if (str[idx] == 0) {
+  return pstr_find_byte(str, size, '\0') < size;
+}
+
+
+int64_t pstr_len(char const *str) {
+  return strlen(str);
+}
+
+
+bool pstr_is_empty(char const *str) {
+  return str[0] == '\0';
+}
+
+
+bool pstr_eq(char const *str1, char const *str2) {
+  return str1 == str2 || strcmp(str1, str2) == 0;
+}
+
+
+bool pstr_starts_with_char(char const *str, char const character) {
+  return str[0] == character;
+}
+
+
+bool pstr_starts_with(char const *str, char const *prefix) {
+  // `strncmp()` stops at the end of `str`, if that comes first
+  size_t const prefix_len = strlen(prefix);
+  return prefix_len > 0 && strncmp(str, prefix, prefix_len) == 0;
+}
+
+
+int64_t pstr_starts_with_any(char const *str, pstr_prefix_table const *table) {
+  size_t head_len = 0;
+  while (head_len < PSTR_PREFIX_HEAD_LEN && str[head_len] != '\0') {
+    head_len++;
+  }
+  return pstr_prefix_table_match(table, str, head_len, SIZE_MAX);
+}
+
+
+bool pstr_ends_with_char(char const *str, char const character) {
+  return pstr_sv_ends_with_char(pstr_sv_from(str), character);
+}
+
+
+bool pstr_ends_with(char const *str, char const *prefix) {
+  return pstr_sv_ends_with(pstr_sv_from(str), pstr_sv_from(prefix));
+}
+
+
+bool pstr_ends_with_char_len(
+  char const *str, size_t const str_len, char const character
+) {
+  return pstr_sv_ends_with_char(pstr_sv_from_n(str, str_len), character);
+}
+
+
+bool pstr_ends_with_len(char const *str, size_t const str_len, char const *suffix) {
+  return pstr_sv_ends_with(pstr_sv_from_n(str, str_len), pstr_sv_from(suffix));
+}
+
+
+bool pstr_eq_ci(char const *str1, char const *str2) {
+  return str1 == str2 || pstr_sv_eq_ci(pstr_sv_from(str1), pstr_sv_from(str2));
+}
+
+
+bool pstr_starts_with_ci(char const *str, char const *prefix) {
+  if (prefix[0] == '\0') {
+    return false;
+  }
+  // The end of `str` never matches a character of `prefix`, so we stop there if it
+  // comes first
+  for (size_t idx = 0; prefix[idx] != '\0'; idx++) {
+    if (pstr_ascii_to_lower(str[idx]) != pstr_ascii_to_lower(prefix[idx])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+bool pstr_ends_with_ci(char const *str, char const *suffix) {
+  return pstr_sv_ends_with_ci(pstr_sv_from(str), pstr_sv_from(suffix));
+}
+
+
+int pstr_cmp_ci(char const *str1, char const *str2) {
+  return pstr_sv_cmp_ci(pstr_sv_from(str1), pstr_sv_from(str2));
+}
+
+
+size_t pstr_span(char const *str, pstr_charset const *set) {
+  return pstr_sv_span(pstr_sv_from(str), set);
+}
+
+
+size_t pstr_cspan(char const *str, pstr_charset const *set) {
+  return pstr_sv_cspan(pstr_sv_from(str), set);
+}
+
+
+int64_t pstr_find(char const *str, char const *needle) {
+  return pstr_sv_find(pstr_sv_from(str), pstr_sv_from(needle));
+}
+
+
+int64_t pstr_rfind(char const *str, char const *needle) {
+  return pstr_sv_rfind(pstr_sv_from(str), pstr_sv_from(needle));
+}
+
+
+int64_t pstr_find_char(char const *str, char const character) {
+  return pstr_sv_find_char(pstr_sv_from(str), character);
+}
+
+
+size_t pstr_count(char const *str, char const *needle) {
+  return pstr_sv_count(pstr_sv_from(str), pstr_sv_from(needle));
+}
+
+
+uint64_t pstr_hash64(char const *str, uint64_t const seed) {
+  return pstr_sv_hash64(pstr_sv_from(str), seed);
+}
+
+
+uint64_t pstr_len_and_hash(char const *str, uint64_t const seed, size_t *len) {
+  uint64_t const state = pstr_hash_init(seed);
+  uint64_t lanes[3] = { state, state, state };
+
+  // Hash a chunk at a time for as long as we know the string goes on past it, looking one
+  // character further so that the last round is always left to `pstr_hash_finish()`.
+  // `memchr()` stops at the terminator, so it never reads past the end of `str`.
+  size_t idx = 0;
+  char const *terminator;
+  while (!(terminator = memchr(str + idx, '\0', PSTR_HASH_CHUNK_SIZE + 1))) {
+    pstr_hash_rounds(str + idx, PSTR_HASH_CHUNK_SIZE / 48, lanes);
+    idx += PSTR_HASH_CHUNK_SIZE;
+  }
+
+  *len = terminator - str;
+  return pstr_hash_rest(str + idx, *len - idx, *len, lanes);
+}
+
+
+bool pstr_copy(char *dest, size_t const dest_size, char const *src) {
+  return pstr_sv_copy(dest, dest_size, pstr_sv_from(src));
+}
+
+
+bool pstr_copy_n(char *dest, size_t const dest_size, char const *src, size_t const n) {
+  return pstr_sv_copy_n(dest, dest_size, pstr_sv_from(src), n);
+}
+
+
+bool pstr_cat(char *dest, size_t const dest_size, char const *src) {
+  size_t dest_len = pstr_len(dest);
+  return pstr_sv_cat(dest, dest_size, &dest_len, pstr_sv_from(src));
+}
+
+
+bool pstr_vcat(char *dest, size_t const dest_size, ...) {
+  size_t const orig_dest_len = pstr_len(dest);
+  size_t dest_len = orig_dest_len;
+
+  va_list args;
+  va_start(args, dest_size);
+
+  char const *src;
+
+  while (true) {
+    src = va_arg(args, char const*);
+    if (!src) {
+      break;
+    }
+
+    // If there's no room, return false
+    if (!pstr_sv_cat(dest, dest_size, &dest_len, pstr_sv_from(src))) {
+      // Restore our string to what it was before
+      dest[orig_dest_len] = 0;
+      va_end(args);
+      return false;
+    }
+  }
+
+  va_end(args);
+
+  return true;
+}
+
+
+bool pstr_split_on_first_occurrence(
+  char const *src,
+  char *part1, size_t const part1_size,
+  char *part2, size_t const part2_size,
+  char const separator
+) {
+  return pstr_sv_split_on_first_occurrence(
+    pstr_sv_from(src), part1, part1_size, part2, part2_size, separator
+  );
+}
+
+
+bool pstr_replace(
+  char *str, size_t const str_size, char const *needle, char const *replacement
+) {
+  size_t str_len = pstr_len(str);
+  return pstr_sv_replace(
+    str, str_size, &str_len, pstr_sv_from(needle), pstr_sv_from(replacement)
+  );
+}
+
+
+bool pstr_replace_all(
+  char *str, size_t const str_size, char const *needle, char const *replacement
+) {
+  size_t str_len = pstr_len(str);
+  return pstr_sv_replace_all(
+    str, str_size, &str_len, pstr_sv_from(needle), pstr_sv_from(replacement)
+  );
+}
+
+
+void pstr_clear(char *str) {
+  str[0] = '\0';
+}
+
+
+/*
+  Replaces `str` with `sv`, which must be a view of part of `str`, moving it down if it
+  doesn't start at the start.
+*/
+static void pstr_set_to_view(char *str, pstr_sv const sv) {
+  if (sv.str != str) {
+    memmove(str, sv.str, sv.len);
+  }
+  str[sv.len] = '\0';
+}
+
+
+static bool pstr_slice_from_len(char *str, size_t const str_len, size_t const start) {
+  if (start >= str_len) {
+    return false;
+  }
+  // Move the remaining characters down, along with the NULL terminator
+  memmove(str, str + start, str_len - start + 1);
+  return true;
+}
+
+
+static bool pstr_slice_to_len(char *str, size_t const str_len, size_t const end) {
+  if (end >= str_len) {
+    return false;
+  }
+  str[end] = 0;
+  return true;
+}
+
+
+bool pstr_slice_from(char *str, size_t const start) {
+  return pstr_slice_from_len(str, pstr_len(str), start);
+}
+
+
+bool pstr_slice_to(char *str, size_t const end) {
+  return pstr_slice_to_len(str, pstr_len(str), end);
+}
+
+
+bool pstr_slice(char *str, size_t const start, size_t const end) {
+  if (start >= end || end >= (size_t)pstr_len(str)) {
+    return false;
+  }
+  pstr_set_to_view(str, pstr_sv_from_n(str + start, end - start));
+  return true;
+}
+
+
+void pstr_ltrim(char *str) {
+  pstr_sv const trimmed = pstr_sv_ltrim(pstr_sv_from(str));
+  // As with `pstr_slice_from()`, a string that would be left empty isn't changed
+  if (trimmed.len > 0) {
+    pstr_set_to_view(str, trimmed);
+  }
+}
+
+
+void pstr_rtrim(char *str) {
+  pstr_set_to_view(str, pstr_sv_rtrim(pstr_sv_from(str)));
+}
+
+
+void pstr_trim(char *str) {
+  pstr_set_to_view(str, pstr_sv_trim(pstr_sv_from(str)));
+}
+
+
+void pstr_ltrim_char(char *str, char const target) {
+  pstr_sv const trimmed = pstr_sv_ltrim_char(pstr_sv_from(str), target);
+  if (trimmed.len > 0) {
+    pstr_set_to_view(str, trimmed);
+  }
+}
+
+
+void pstr_rtrim_char(char *str, char const target) {
+  pstr_set_to_view(str, pstr_sv_rtrim_char(pstr_sv_from(str), target));
+}
+
+
+void pstr_trim_char(char *str, char const target) {
+  pstr_set_to_view(str, pstr_sv_trim_char(pstr_sv_from(str), target));
+}
+
+
+void pstr_ltrim_set(char *str, pstr_charset const *set) {
+  pstr_set_to_view(str, pstr_sv_ltrim_set(pstr_sv_from(str), set));
+}
+
+
+void pstr_rtrim_set(char *str, pstr_charset const *set) {
+  pstr_set_to_view(str, pstr_sv_rtrim_set(pstr_sv_from(str), set));
+}
+
+
+void pstr_trim_set(char *str, pstr_charset const *set) {
+  pstr_set_to_view(str, pstr_sv_trim_set(pstr_sv_from(str), set));
+}
+
+
+void pstr_to_lower(char *str) {
+  pstr_flip_case(str, strlen(str), 'A');
+}
+
+
+void pstr_to_upper(char *str) {
+  pstr_flip_case(str, strlen(str), 'a');
+}
+
+
+static char const pstr_decimal_pairs[] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+static char const pstr_hex_digits[] = "0123456789abcdef";
+
+
+static size_t pstr_count_decimal_digits(uint64_t number) {
+  size_t n_digits = 1;
+  while (true) {
+    if (number < 10) { return n_digits; }
+    if (number < 100) { return n_digits + 1; }
+    if (number < 1000) { return n_digits + 2; }
+    if (number < 10000) { return n_digits + 3; }
+    number /= 10000;
+    n_digits += 4;
+  }
+}
+
+
+static size_t pstr_count_hex_digits(uint64_t number) {
+  size_t n_digits = 1;
+  while (number >>= 4) {
+    n_digits++;
+  }
+  return n_digits;
+}
+
+
+/*
+  Writes the `n_digits` decimal digits of `number` into `dest`, two at a time. Every
+  digit goes straight into its final position, so no reversing is needed.
+*/
+static void pstr_write_decimal_digits(char *dest, size_t n_digits, uint64_t number) {
+  while (n_digits >= 2) {
+    size_t const pair_idx = (number % 100) * 2;
+    number /= 100;
+    n_digits -= 2;
+    memcpy(dest + n_digits, pstr_decimal_pairs + pair_idx, 2);
+  }
+  if (n_digits == 1) {
+    dest[0] = '0' + (char)number;
+  }
+}
+
+
+static void pstr_write_hex_digits(char *dest, size_t n_digits, uint64_t number) {
+  while (n_digits > 0) {
+    dest[--n_digits] = pstr_hex_digits[number & 0xf];
+    number >>= 4;
+  }
+}
+
+
+/*
+  Puts `magnitude`, in base 10 or 16 and preceded by a '-' if `is_negative`, into `str`.
+  The length is worked out before anything is written, so if it doesn't fit we can fail
+  straight away.
+*/
+static bool pstr_from_magnitude(
+  char *str, size_t const str_size,
+  uint64_t const magnitude, bool const is_negative, uint32_t const base,
+  size_t *new_str_len
+) {
+  size_t const n_digits = (base == 16) ?
+    pstr_count_hex_digits(magnitude) : pstr_count_decimal_digits(magnitude);
+  size_t const len = n_digits + (is_negative ? 1 : 0);
+
+  // Check that we have space for the string and the NULL terminator
+  if (str_size < len + 1) {
+    if (str_size > 0) {
+      str[0] = 0;
+    }
+    *new_str_len = 0;
+    return false;
+  }
+
+  char *cursor = str;
+  if (is_negative) {
+    *cursor++ = '-';
+  }
+  if (base == 16) {
+    pstr_write_hex_digits(cursor, n_digits, magnitude);
+  } else {
+    pstr_write_decimal_digits(cursor, n_digits, magnitude);
+  }
+  str[len] = '\0';
+  *new_str_len = len;
+
+  return true;
+}
+
+
+bool pstr_from_int64(
+  char *str, size_t const str_size, int64_t number, size_t *new_str_len
+) {
+  // Negate as unsigned, so that INT64_MIN doesn't overflow
+  uint64_t const magnitude = (number < 0) ? (uint64_t)0 - (uint64_t)number : (uint64_t)number;
+  return pstr_from_magnitude(str, str_size, magnitude, number < 0, 10, new_str_len);
+}
+
+
+bool pstr_from_uint64(
+  char *str, size_t const str_size, uint64_t number, size_t *new_str_len
+) {
+  return pstr_from_magnitude(str, str_size, number, false, 10, new_str_len);
+}
+
+
+bool pstr_from_int32(
+  char *str, size_t const str_size, int32_t number, size_t *new_str_len
+) {
+  return pstr_from_int64(str, str_size, number, new_str_len);
+}
+
+
+bool pstr_from_uint64_hex(
+  char *str, size_t const str_size, uint64_t number, size_t *new_str_len
+) {
+  return pstr_from_magnitude(str, str_size, number, false, 16, new_str_len);
+}
+
+
+// Floating-point formatting, using Florian Loitsch's Grisu3 algorithm. This works out
+// the shortest digits that fall within the rounding boundaries of a double, using only
+// 64-bit integer arithmetic. For about 0.5% of doubles, it can't be sure that its digits
+// are the shortest, and we fall back to exact arithmetic on big integers.
+
+typedef struct {
+  uint64_t f;
+  int e;
+} pstr_diyfp;
+
+// Normalized significands and binary exponents of 10^-348, 10^-340, ..., 10^340
+static uint64_t const pstr_cached_pow10_f[] = {
+  0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+  0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+  0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+  0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+  0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+  0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+  0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+  0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+  0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+  0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+  0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+  0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+  0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+  0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+  0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+  0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+  0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+  0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+  0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+  0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+  0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+  0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+  0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+  0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+  0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+  0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+  0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+  0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+  0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL
+};
+
+static int16_t const pstr_cached_pow10_e[] = {
+  -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+  -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+  -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+  -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+  -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+  109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+  375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+  641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+  907, 933, 960, 986, 1013, 1039, 1066
+};
+
+static uint64_t const pstr_pow10_u64[] = {
+  1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+  100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+  10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+  100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+#define PSTR_DP_HIDDEN_BIT 0x0010000000000000ULL
+#define PSTR_DP_SIGNIFICAND_MASK 0x000fffffffffffffULL
+#define PSTR_DP_EXPONENT_MASK 0x7ff0000000000000ULL
+#define PSTR_DP_SIGN_MASK 0x8000000000000000ULL
+#define PSTR_DP_EXPONENT_BIAS 1075
+
+
+static uint64_t pstr_double_to_bits(double const number) {
+  uint64_t bits;
+  memcpy(&bits, &number, sizeof(bits));
+  return bits;
+}
+
+
+static pstr_diyfp pstr_diyfp_multiply(pstr_diyfp const x, pstr_diyfp const y) {
+  uint64_t const mask_32 = 0xffffffffULL;
+  uint64_t const a = x.f >> 32;
+  uint64_t const b = x.f & mask_32;
+  uint64_t const c = y.f >> 32;
+  uint64_t const d = y.f & mask_32;
+  uint64_t const ac = a * c;
+  uint64_t const bc = b * c;
+  uint64_t const ad = a * d;
+  uint64_t const bd = b * d;
+  // Add 2^31 to round the lower half we're about to throw away
+  uint64_t const tmp = (bd >> 32) + (ad & mask_32) + (bc & mask_32) + (1ULL << 31);
+  pstr_diyfp result = { .f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), .e = x.e + y.e + 64 };
+  return result;
+}
+
+
+static pstr_diyfp pstr_diyfp_normalize(pstr_diyfp x) {
+  while (!(x.f & (1ULL << 63))) {
+    x.f <<= 1;
+    x.e--;
+  }
+  return x;
+}
+
+
+/*
+  Gets the cached power of ten c = 10^-k such that multiplying a number with binary
+  exponent `e` by it brings the exponent into [-60, -32].
+*/
+static pstr_diyfp pstr_get_cached_pow10(int const e, int *k) {
+  double const dk = (-61 - e) * 0.30102999566398114 + 347;
+  int ik = (int)dk;
+  if (dk - ik > 0.0) {
+    ik++;
+  }
+  uint32_t const idx = (uint32_t)((ik >> 3) + 1);
+  *k = -(-348 + (int)idx * 8);
+  pstr_diyfp result = { .f = pstr_cached_pow10_f[idx], .e = pstr_cached_pow10_e[idx] };
+  return result;
+}
+
+
+/*
+  Checks that the last digit we generated leaves us as close to w as we can get, while
+  making sure that the imprecision in our scaled numbers can't have fooled us. Returns
+  false if we can't be sure the digits are the shortest and closest ones.
+*/
+static bool pstr_grisu_round_weed(
+  char *digits, size_t const n_digits, uint64_t const distance_too_high_w,
+  uint64_t const unsafe_interval, uint64_t rest, uint64_t const ten_kappa,
+  uint64_t const unit
+) {
+  uint64_t const small_distance = distance_too_high_w - unit;
+  uint64_t const big_distance = distance_too_high_w + unit;
+  // Move the last digit down for as long as that gets us closer to w, even if w is
+  // as far away as it could possibly be
+  while (
+    rest < small_distance && unsafe_interval - rest >= ten_kappa &&
+    (
+      rest + ten_kappa < small_distance ||
+      small_distance - rest >= rest + ten_kappa - small_distance
+    )
+  ) {
+    digits[n_digits - 1]--;
+    rest += ten_kappa;
+  }
+  // If moving it down once more might still get us closer to where w could be, we can't
+  // tell which of the two is right
+  if (
+    rest < big_distance && unsafe_interval - rest >= ten_kappa &&
+    (
+      rest + ten_kappa < big_distance ||
+      big_distance - rest > rest + ten_kappa - big_distance
+    )
+  ) {
+    return false;
+  }
+  // Make sure that we're still inside the boundaries, whatever the imprecision was
+  return 2 * unit <= rest && rest <= unsafe_interval - 4 * unit;
+}
+
+
+static bool pstr_grisu_digit_gen(
+  pstr_diyfp const low, pstr_diyfp const w, pstr_diyfp const high,
+  char *digits, size_t *n_digits, int *kappa
+) {
+  // Each of our scaled numbers is off by less than one unit, so we generate digits
+  // within boundaries that are one unit wider than they should be, and check that the
+  // digits we end up with also fall within ones that are one unit narrower
+  uint64_t unit = 1;
+  uint64_t const too_low = low.f - unit;
+  uint64_t const too_high = high.f + unit;
+  uint64_t unsafe_interval = too_high - too_low;
+  int const shift = -w.e;
+  uint64_t const one_f = 1ULL << shift;
+  uint32_t integrals = (uint32_t)(too_high >> shift);
+  uint64_t fractionals = too_high & (one_f - 1);
+  *kappa = (int)pstr_count_decimal_digits(integrals);
+  uint32_t divisor = (uint32_t)pstr_pow10_u64[*kappa - 1];
+  *n_digits = 0;
+
+  while (*kappa > 0) {
+    digits[(*n_digits)++] = (char)('0' + integrals / divisor);
+    integrals %= divisor;
+    (*kappa)--;
+    uint64_t const rest = ((uint64_t)integrals << shift) + fractionals;
+    if (rest < unsafe_interval) {
+      return pstr_grisu_round_weed(
+        digits, *n_digits, too_high - w.f, unsafe_interval, rest,
+        (uint64_t)divisor << shift, unit
+      );
+    }
+    divisor /= 10;
+  }
+
+  while (true) {
+    fractionals *= 10;
+    unit *= 10;
+    unsafe_interval *= 10;
+    digits[(*n_digits)++] = (char)('0' + (fractionals >> shift));
+    fractionals &= one_f - 1;
+    (*kappa)--;
+    if (fractionals < unsafe_interval) {
+      return pstr_grisu_round_weed(
+        digits, *n_digits, (too_high - w.f) * unit, unsafe_interval, fractionals, one_f,
+        unit
+      );
+    }
+  }
+}
+
+
+/*
+  Tries to put the shortest digits of f * 2^e into `digits`, such that the number reads
+  back from digits * 10^k. Returns false for the rare numbers where 64 bits aren't
+  enough to be sure of the result.
+*/
+static bool pstr_grisu3(
+  uint64_t const f, int const e, bool const is_lower_closer,
+  char *digits, size_t *n_digits, int *k
+) {
+  pstr_diyfp const v = { .f = f, .e = e };
+
+  // Work out the boundaries halfway to the neighbouring doubles, sharing the exponent
+  // of the upper one. The lower boundary is closer when we're at a power of two.
+  pstr_diyfp plus = { .f = (v.f << 1) + 1, .e = v.e - 1 };
+  plus = pstr_diyfp_normalize(plus);
+  pstr_diyfp minus;
+  if (is_lower_closer) {
+    minus.f = (v.f << 2) - 1;
+    minus.e = v.e - 2;
+  } else {
+    minus.f = (v.f << 1) - 1;
+    minus.e = v.e - 1;
+  }
+  minus.f <<= minus.e - plus.e;
+  minus.e = plus.e;
+
+  int mk;
+  pstr_diyfp const c_mk = pstr_get_cached_pow10(plus.e, &mk);
+  pstr_diyfp const w = pstr_diyfp_multiply(pstr_diyfp_normalize(v), c_mk);
+  pstr_diyfp const wp = pstr_diyfp_multiply(plus, c_mk);
+  pstr_diyfp const wm = pstr_diyfp_multiply(minus, c_mk);
+  int kappa;
+  if (!pstr_grisu_digit_gen(wm, w, wp, digits, n_digits, &kappa)) {
+    return false;
+  }
+  *k = mk + kappa;
+  return true;
+}
+
+
+// Big unsigned integers, for the numbers Grisu3 can't handle. The biggest number we
+// deal with is a bit under 2^1140, which fits into 36 words.
+#define PSTR_BIGNUM_N_WORDS 40
+
+typedef struct {
+  uint32_t words[PSTR_BIGNUM_N_WORDS];
+  size_t n_words;
+} pstr_bignum;
+
+
+static void pstr_bignum_from_uint64(pstr_bignum *x, uint64_t const value) {
+  x->words[0] = (uint32_t)value;
+  x->words[1] = (uint32_t)(value >> 32);
+  x->n_words = x->words[1] ? 2 : (x->words[0] ? 1 : 0);
+}
+
+
+static void pstr_bignum_multiply(pstr_bignum *x, uint32_t const factor) {
+  uint64_t carry = 0;
+  for (size_t idx = 0; idx < x->n_words; idx++) {
+    uint64_t const product = (uint64_t)x->words[idx] * factor + carry;
+    x->words[idx] = (uint32_t)product;
+    carry = product >> 32;
+  }
+  if (carry) {
+    x->words[x->n_words++] = (uint32_t)carry;
+  }
+}
+
+
+static void pstr_bignum_multiply_pow10(pstr_bignum *x, int exponent) {
+  for (; exponent >= 9; exponent -= 9) {
+    pstr_bignum_multiply(x, 1000000000);
+  }
+  if (exponent > 0) {
+    pstr_bignum_multiply(x, (uint32_t)pstr_pow10_u64[exponent]);
+  }
+}
+
+
+static void pstr_bignum_shift_left(pstr_bignum *x, int const n_bits) {
+  size_t const n_words = (size_t)n_bits / 32;
+  int const n_rest_bits = n_bits % 32;
+  if (x->n_words == 0) {
+    return;
+  }
+  x->words[x->n_words] = 0;
+  for (size_t idx = x->n_words + 1; idx-- > 0;) {
+    uint32_t const lower = idx > 0 ? x->words[idx - 1] : 0;
+    x->words[idx + n_words] = n_rest_bits ?
+      (x->words[idx] << n_rest_bits) | (lower >> (32 - n_rest_bits)) : x->words[idx];
+  }
+  memset(x->words, 0, n_words * sizeof(uint32_t));
+  x->n_words += n_words + 1;
+  if (x->words[x->n_words - 1] == 0) {
+    x->n_words--;
+  }
+}
+
+
+static int pstr_bignum_compare(pstr_bignum const *a, pstr_bignum const *b) {
+  if (a->n_words != b->n_words) {
+    return a->n_words < b->n_words ? -1 : 1;
+  }
+  for (size_t idx = a->n_words; idx-- > 0;) {
+    if (a->words[idx] != b->words[idx]) {
+      return a->words[idx] < b->words[idx] ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+
+static void pstr_bignum_add(
+  pstr_bignum *result, pstr_bignum const *a, pstr_bignum const *b
+) {
+  size_t const n_words = a->n_words > b->n_words ? a->n_words : b->n_words;
+  uint64_t carry = 0;
+  for (size_t idx = 0; idx < n_words; idx++) {
+    uint64_t const sum = carry +
+      (idx < a->n_words ? a->words[idx] : 0) + (idx < b->n_words ? b->words[idx] : 0);
+    result->words[idx] = (uint32_t)sum;
+    carry = sum >> 32;
+  }
+  result->n_words = n_words;
+  if (carry) {
+    result->words[result->n_words++] = (uint32_t)carry;
+  }
+}
+
+
+// Subtracts `b` from `a`, which must be at least as big as `b`
+static void pstr_bignum_subtract(pstr_bignum *a, pstr_bignum const *b) {
+  uint64_t borrow = 0;
+  for (size_t idx = 0; idx < a->n_words; idx++) {
+    uint64_t const difference =
+      (uint64_t)a->words[idx] - (idx < b->n_words ? b->words[idx] : 0) - borrow;
+    a->words[idx] = (uint32_t)difference;
+    borrow = difference >> 63;
+  }
+  while (a->n_words > 0 && a->words[a->n_words - 1] == 0) {
+    a->n_words--;
+  }
+}
+
+
+/*
+  Puts the shortest digits of f * 2^e into `digits`, such that the number reads back
+  from digits * 10^k, using Steele and White's exact algorithm (Dragon4), as set out by
+  Burger and Dybvig. This is slow, but always works.
+*/
+static void pstr_dragon4(
+  uint64_t const f, int const e, bool const is_lower_closer,
+  char *digits, size_t *n_digits, int *k
+) {
+  // The boundaries are inclusive when the significand is even, since a number halfway
+  // between two doubles reads back as the even one
+  bool const is_even = (f & 1) == 0;
+
+  // Scale everything up by 4, so that r / s is our number, and m_plus and m_minus are the
+  // distances to the boundaries, all as whole numbers
+  pstr_bignum r, s, m_plus, m_minus;
+  pstr_bignum_from_uint64(&r, f);
+  pstr_bignum_from_uint64(&s, 1);
+  pstr_bignum_from_uint64(&m_plus, 2);
+  pstr_bignum_from_uint64(&m_minus, is_lower_closer ? 1 : 2);
+  if (e >= 0) {
+    pstr_bignum_shift_left(&r, e + 2);
+    pstr_bignum_shift_left(&s, 2);
+    pstr_bignum_shift_left(&m_plus, e);
+    pstr_bignum_shift_left(&m_minus, e);
+  } else {
+    pstr_bignum_shift_left(&r, 2);
+    pstr_bignum_shift_left(&s, 2 - e);
+  }
+
+  // Estimate the position of the decimal point from the number's binary exponent. The
+  // estimate is either right or one too small.
+  pstr_diyfp const normalized = pstr_diyfp_normalize((pstr_diyfp){ .f = f, .e = e });
+  double const estimate = (normalized.e + 63) * 0.30102999566398114 - 1e-10;
+  int point = (int)estimate;
+  if (estimate - point > 0.0) {
+    point++;
+  }
+  if (point >= 0) {
+    pstr_bignum_multiply_pow10(&s, point);
+  } else {
+    pstr_bignum_multiply_pow10(&r, -point);
+    pstr_bignum_multiply_pow10(&m_plus, -point);
+    pstr_bignum_multiply_pow10(&m_minus, -point);
+  }
+
+  // Now, r / s is our number divided by 10^point. If the upper boundary is still at least
+  // 1, the estimate was one too small, and r / s already has our first digit before its
+  // decimal point. Otherwise, we move on to the first digit.
+  pstr_bignum sum;
+  pstr_bignum_add(&sum, &r, &m_plus);
+  int const cmp_high = pstr_bignum_compare(&sum, &s);
+  if (is_even ? cmp_high >= 0 : cmp_high > 0) {
+    point++;
+  } else {
+    pstr_bignum_multiply(&r, 10);
+    pstr_bignum_multiply(&m_plus, 10);
+    pstr_bignum_multiply(&m_minus, 10);
+  }
+
+  *n_digits = 0;
+  while (true) {
+    // The next digit is always less than 10, so we find it by subtracting
+    uint32_t digit = 0;
+    while (pstr_bignum_compare(&r, &s) >= 0) {
+      pstr_bignum_subtract(&r, &s);
+      digit++;
+    }
+    digits[(*n_digits)++] = (char)('0' + digit);
+
+    // Stop once the digits so far, or the digits so far with the last one going up by
+    // one, fall within the boundaries
+    int const cmp_low = pstr_bignum_compare(&r, &m_minus);
+    bool const is_low_in = is_even ? cmp_low <= 0 : cmp_low < 0;
+    pstr_bignum_add(&sum, &r, &m_plus);
+    int const cmp_high = pstr_bignum_compare(&sum, &s);
+    bool const is_high_in = is_even ? cmp_high >= 0 : cmp_high > 0;
+    if (!is_low_in && !is_high_in) {
+      pstr_bignum_multiply(&r, 10);
+      pstr_bignum_multiply(&m_plus, 10);
+      pstr_bignum_multiply(&m_minus, 10);
+      continue;
+    }
+
+    // If both work, take the closer one, and break ties towards an even digit
+    bool should_round_up = is_high_in;
+    if (is_low_in && is_high_in) {
+      pstr_bignum_add(&sum, &r, &r);
+      int const cmp_half = pstr_bignum_compare(&sum, &s);
+      should_round_up = cmp_half > 0 || (cmp_half == 0 && (digit & 1));
+    }
+    if (should_round_up) {
+      digits[*n_digits - 1]++;
+    }
+    break;
+  }
+
+  *k = point - (int)*n_digits;
+}
+
+
+/*
+  Puts the shortest digits of the finite, positive `number` into `digits`, such that
+  `number` reads back from digits * 10^k. If more than one string of digits that short
+  reads back as `number`, we pick the one closest to it.
+*/
+static void pstr_double_to_digits(
+  double const number, char *digits, size_t *n_digits, int *k
+) {
+  uint64_t const bits = pstr_double_to_bits(number);
+  int const biased_e = (int)((bits & PSTR_DP_EXPONENT_MASK) >> 52);
+  uint64_t const significand = bits & PSTR_DP_SIGNIFICAND_MASK;
+  uint64_t f;
+  int e;
+  if (biased_e != 0) {
+    f = significand + PSTR_DP_HIDDEN_BIT;
+    e = biased_e - PSTR_DP_EXPONENT_BIAS;
+  } else {
+    f = significand;
+    e = 1 - PSTR_DP_EXPONENT_BIAS;
+  }
+  // At a power of two, the next double down is half as far away as the next one up,
+  // except for the smallest normal number, whose neighbours are equally spaced
+  bool const is_lower_closer = significand == 0 && biased_e > 1;
+
+  if (!pstr_grisu3(f, e, is_lower_closer, digits, n_digits, k)) {
+    pstr_dragon4(f, e, is_lower_closer, digits, n_digits, k);
+  }
+}
+
+
+/*
+  Lays out `n_digits` digits, whose value is digits * 10^k, as a decimal or, for very
+  large and small numbers, in exponential notation. Returns the length of the result.
+*/
+static size_t pstr_format_decimal_digits(
+  char *dest, char const *digits, size_t const n_digits, int const k
+) {
+  int const n = (int)n_digits;
+  // The position of the decimal point, relative to the start of the digits
+  int const point = n + k;
+  char *cursor = dest;
+
+  if (k >= 0 && point <= 21) {
+    // 1234e7 -> 12340000000
+    memcpy(cursor, digits, n_digits);
+    cursor += n_digits;
+    memset(cursor, '0', (size_t)k);
+    cursor += k;
+  } else if (point > 0 && point <= 21) {
+    // 1234e-2 -> 12.34
+    memcpy(cursor, digits, (size_t)point);
+    cursor += point;
+    *cursor++ = '.';
+    memcpy(cursor, digits + point, (size_t)(n - point));
+    cursor += n - point;
+  } else if (point > -6 && point <= 0) {
+    // 1234e-6 -> 0.001234
+    *cursor++ = '0';
+    *cursor++ = '.';
+    memset(cursor, '0', (size_t)-point);
+    cursor += -point;
+    memcpy(cursor, digits, n_digits);
+    cursor += n_digits;
+  } else {
+    // 1234e30 -> 1.234e33
+    *cursor++ = digits[0];
+    if (n > 1) {
+      *cursor++ = '.';
+      memcpy(cursor, digits + 1, n_digits - 1);
+      cursor += n - 1;
+    }
+    *cursor++ = 'e';
+    int exponent = point - 1;
+    if (exponent < 0) {
+      *cursor++ = '-';
+      exponent = -exponent;
+    }
+    size_t const n_exponent_digits = pstr_count_decimal_digits((uint64_t)exponent);
+    pstr_write_decimal_digits(cursor, n_exponent_digits, (uint64_t)exponent);
+    cursor += n_exponent_digits;
+  }
+
+  return (size_t)(cursor - dest);
+}
+
+
+bool pstr_from_double(
+  char *str, size_t const str_size, double number, size_t *new_str_len
+) {
+  // The longest possible output is something like "-0.000001234567890123456"
+  char buffer[32];
+  char *cursor = buffer;
+  uint64_t const bits = pstr_double_to_bits(number);
+
+  if ((bits & PSTR_DP_EXPONENT_MASK) == PSTR_DP_EXPONENT_MASK) {
+    if (bits & PSTR_DP_SIGNIFICAND_MASK) {
+      memcpy(cursor, "nan", 3);
+      cursor += 3;
+    } else {
+      if (bits & PSTR_DP_SIGN_MASK) {
+        *cursor++ = '-';
+      }
+      memcpy(cursor, "inf", 3);
+      cursor += 3;
+    }
+  } else {
+    if (bits & PSTR_DP_SIGN_MASK) {
+      *cursor++ = '-';
+    }
+    if ((bits & ~PSTR_DP_SIGN_MASK) == 0) {
+      *cursor++ = '0';
+    } else {
+      char digits[20];
+      size_t n_digits;
+      int k = 0;
+      pstr_double_to_digits(number < 0 ? -number : number, digits, &n_digits, &k);
+      cursor += pstr_format_decimal_digits(cursor, digits, n_digits, k);
+    }
+  }
+
+  size_t const len = (size_t)(cursor - buffer);
+
+  // Check that we have space for the string and the NULL terminator
+  if (str_size < len + 1) {
+    if (str_size > 0) {
+      str[0] = 0;
+    }
+    *new_str_len = 0;
+    return false;
+  }
+
+  memcpy(str, buffer, len);
+  str[len] = '\0';
+  *new_str_len = len;
+
+  return true;
+}
+
+
+bool pstr_to_int64(char const *str, int64_t *number, size_t *n_consumed) {
+  pstr_sv const sv = pstr_sv_from(str);
+  int64_t value;
+  size_t n_value_chars;
+  if (!pstr_sv_to_int64(sv, &value, &n_value_chars) || n_value_chars != sv.len) {
+    return false;
+  }
+  *number = value;
+  *n_consumed = n_value_chars;
+  return true;
+}
+
+
+bool pstr_to_uint64(char const *str, uint64_t *number, size_t *n_consumed) {
+  pstr_sv const sv = pstr_sv_from(str);
+  uint64_t value;
+  size_t n_value_chars;
+  if (!pstr_sv_to_uint64(sv, &value, &n_value_chars) || n_value_chars != sv.len) {
+    return false;
+  }
+  *number = value;
+  *n_consumed = n_value_chars;
+  return true;
+}
+
+
+bool pstr_to_double(char const *str, double *number, size_t *n_consumed) {
+  pstr_sv const sv = pstr_sv_from(str);
+  double value;
+  size_t n_value_chars;
+  if (!pstr_sv_to_double(sv, &value, &n_value_chars) || n_value_chars != sv.len) {
+    return false;
+  }
+  *number = value;
+  *n_consumed = n_value_chars;
+  return true;
+}
+
+
+static void *pstr_libc_resize(
+  void *ctx, void *ptr, size_t const old_size, size_t const new_size
+) {
+  (void)ctx;
+  (void)old_size;
+  if (new_size == 0) {
+    free(ptr);
+    return NULL;
+  }
+  return realloc(ptr, new_size);
+}
+
+
+pstr_allocator pstr_libc_allocator() {
+  pstr_allocator allocator = { .resize = pstr_libc_resize, .ctx = NULL };
+  return allocator;
+}
+
+
+bool pstr_builder_init(
+  pstr_builder *builder, pstr_allocator const allocator, size_t const initial_capacity
+) {
+  size_t const capacity = initial_capacity + 1;
+  char *str = allocator.resize(allocator.ctx, NULL, 0, capacity);
+  if (!str) {
+    return false;
+  }
+  str[0] = '\0';
+  builder->str = str;
+  builder->len = 0;
+  builder->capacity = capacity;
+  builder->allocator = allocator;
+  return true;
+}
+
+
+void pstr_builder_free(pstr_builder *builder) {
+  builder->allocator.resize(builder->allocator.ctx, builder->str, builder->capacity, 0);
+  builder->str = NULL;
+  builder->len = 0;
+  builder->capacity = 0;
+}
+
+
+bool pstr_builder_reserve(pstr_builder *builder, size_t const extra_len) {
+  if (extra_len > SIZE_MAX - builder->len - 1) {
+    return false;
+  }
+  size_t const needed_capacity = builder->len + extra_len + 1;
+  if (needed_capacity <= builder->capacity) {
+    return true;
+  }
+
+  size_t new_capacity =
+    builder->capacity > SIZE_MAX / 2 ? SIZE_MAX : builder->capacity * 2;
+  if (new_capacity < needed_capacity) {
+    new_capacity = needed_capacity;
+  }
+
+  char *new_str = builder->allocator.resize(
+    builder->allocator.ctx, builder->str, builder->capacity, new_capacity
+  );
+  if (!new_str) {
+    return false;
+  }
+  builder->str = new_str;
+  builder->capacity = new_capacity;
+  return true;
+}
+
+
+bool pstr_builder_append(pstr_builder *builder, char const *src) {
+  return pstr_builder_append_sv(builder, pstr_sv_from(src));
+}
+
+
+bool pstr_builder_append_sv(pstr_builder *builder, pstr_sv const src) {
+  // `src` might be part of the builder's own string, which growing it could move, so we
+  // remember where it was in the string, and find it again afterwards
+  uintptr_t const src_addr = (uintptr_t)src.str;
+  uintptr_t const str_addr = (uintptr_t)builder->str;
+  bool const is_own_str = src_addr >= str_addr && src_addr <= str_addr + builder->len;
+  size_t const src_offset = is_own_str ? (size_t)(src_addr - str_addr) : 0;
+  if (!pstr_builder_reserve(builder, src.len)) {
+    return false;
+  }
+  char const *src_str = is_own_str ? builder->str + src_offset : src.str;
+  memcpy(builder->str + builder->len, src_str, src.len);
+  builder->len += src.len;
+  builder->str[builder->len] = '\0';
+  return true;
+}
+
+
+bool pstr_builder_append_char(pstr_builder *builder, char const character) {
+  if (!pstr_builder_reserve(builder, 1)) {
+    return false;
+  }
+  builder->str[builder->len++] = character;
+  builder->str[builder->len] = '\0';
+  return true;
+}
+
+
+bool pstr_builder_append_int64(pstr_builder *builder, int64_t const number) {
+  // Any 64-bit number fits into 20 characters
+  if (!pstr_builder_reserve(builder, 20)) {
+    return false;
+  }
+  size_t number_len;
+  pstr_from_int64(
+    builder->str + builder->len, builder->capacity - builder->len, number, &number_len
+  );
+  builder->len += number_len;
+  return true;
+}
+
+
+void pstr_builder_clear(pstr_builder *builder) {
+  builder->len = 0;
+  builder->str[0] = '\0';
+}
+
+
+pstr_sv pstr_builder_view(pstr_builder const *builder) {
+  return pstr_sv_from_n(builder->str, builder->len);
+}
+
+
+bool pstr_small_copy(pstr_small_str *small, char const *src) {
+  return pstr_small_copy_sv(small, pstr_sv_from(src));
+}
+
+
+bool pstr_small_copy_sv(pstr_small_str *small, pstr_sv const src) {
+  if (!pstr_sv_copy(small->str, small->size, src)) {
+    return false;
+  }
+  small->len = src.len;
+  return true;
+}
+
+
+bool pstr_small_cat(pstr_small_str *small, char const *src) {
+  return pstr_small_cat_sv(small, pstr_sv_from(src));
+}
+
+
+bool pstr_small_cat_sv(pstr_small_str *small, pstr_sv const src) {
+  return pstr_sv_cat(small->str, small->size, &small->len, src);
+}
+
+
+bool pstr_small_vcat(pstr_small_str *small, ...) {
+  size_t const orig_len = small->len;
+
+  va_list args;
+  va_start(args, small);
+
+  char const *src;
+
+  while (true) {
+    src = va_arg(args, char const*);
+    if (!src) {
+      break;
+    }
+
+    // If there's no room, return false
+    if (!pstr_sv_cat(small->str, small->size, &small->len, pstr_sv_from(src))) {
+      // Restore our string to what it was before
+      small->len = orig_len;
+      small->str[orig_len] = 0;
+      va_end(args);
+      return false;
+    }
+  }
+
+  va_end(args);
+
+  return true;
+}
+
+
+/*
+  Replaces the string with `sv`, which must be a view of part of it.
+*/
+static void pstr_small_set_to_view(pstr_small_str *small, pstr_sv const sv) {
+  pstr_set_to_view(small->str, sv);
+  small->len = sv.len;
+}
+
+
+void pstr_small_ltrim(pstr_small_str *small) {
+  pstr_sv const trimmed = pstr_sv_ltrim(pstr_small_view(small));
+  // As with `pstr_ltrim()`, a string that would be left empty isn't changed
+  if (trimmed.len > 0) {
+    pstr_small_set_to_view(small, trimmed);
+  }
+}
+
+
+void pstr_small_rtrim(pstr_small_str *small) {
+  pstr_small_set_to_view(small, pstr_sv_rtrim(pstr_small_view(small)));
+}
+
+
+void pstr_small_trim(pstr_small_str *small) {
+  pstr_small_set_to_view(small, pstr_sv_trim(pstr_small_view(small)));
+}
+
+
+void pstr_small_ltrim_char(pstr_small_str *small, char const target) {
+  pstr_sv const trimmed = pstr_sv_ltrim_char(pstr_small_view(small), target);
+  if (trimmed.len > 0) {
+    pstr_small_set_to_view(small, trimmed);
+  }
+}
+
+
+void pstr_small_rtrim_char(pstr_small_str *small, char const target) {
+  pstr_small_set_to_view(small, pstr_sv_rtrim_char(pstr_small_view(small), target));
+}
+
+
+void pstr_small_trim_char(pstr_small_str *small, char const target) {
+  pstr_small_set_to_view(small, pstr_sv_trim_char(pstr_small_view(small), target));
+}
+
+
+bool pstr_small_from_int64(pstr_small_str *small, int64_t const number) {
+  return pstr_from_int64(small->str, small->size, number, &small->len);
+}
+
+
+void pstr_small_clear(pstr_small_str *small) {
+  small->str[0] = '\0';
+  small->len = 0;
+}
+
+
+pstr_sv pstr_small_view(pstr_small_str const *small) {
+  return pstr_sv_from_n(small->str, small->len);
+}
+
+
+pstr_charset pstr_charset_from(char const *chars) {
+  return pstr_charset_from_sv(pstr_sv_from(chars));
+}
+
+
+pstr_charset pstr_charset_from_sv(pstr_sv const chars) {
+  pstr_charset set = { .rows = { 0 } };
+  for (size_t idx = 0; idx < chars.len; idx++) {
+    pstr_charset_add(&set, chars.str[idx]);
+  }
+  return set;
+}
+
+
+void pstr_charset_add(pstr_charset *set, char const character) {
+  uint8_t const c = (uint8_t)character;
+  set->rows[(c & 15) | ((c >> 3) & 16)] |= (uint8_t)(1 << ((c >> 4) & 7));
+}
+
+
+void pstr_charset_add_range(pstr_charset *set, char const first, char const last) {
+  for (unsigned c = (uint8_t)first; c <= (uint8_t)last; c++) {
+    pstr_charset_add(set, (char)c);
+  }
+}
+
+
+bool pstr_charset_has(pstr_charset const *set, char const character) {
+  return pstr_charset_has_byte(set, (uint8_t)character);
+}
+
+
+void pstr_tokenizer_init(
+  pstr_tokenizer *tokenizer, pstr_sv const src, pstr_sv const separator
+) {
+  pstr_tokenizer_init_quoted(tokenizer, src, separator, '\0');
+}
+
+
+void pstr_tokenizer_init_quoted(
+  pstr_tokenizer *tokenizer, pstr_sv const src, pstr_sv const separator, char const quote
+) {
+  tokenizer->rest = src;
+  tokenizer->separator = separator;
+  tokenizer->separators = NULL;
+  tokenizer->quote = quote;
+  tokenizer->is_done = false;
+}
+
+
+void pstr_tokenizer_init_set(
+  pstr_tokenizer *tokenizer, pstr_sv const src, pstr_charset const *separators
+) {
+  pstr_tokenizer_init_quoted(tokenizer, src, PSTR_SV(""), '\0');
+  tokenizer->separators = separators;
+}
+
+
+bool pstr_tokenizer_next(pstr_tokenizer *tokenizer, pstr_sv *token) {
+  if (tokenizer->is_done) {
+    return false;
+  }
+
+  pstr_sv const rest = tokenizer->rest;
+  size_t token_start = 0;
+  size_t token_end = rest.len;
+  size_t search_start = 0;
+
+  // For a quoted token, skip to the closing quote, stepping over doubled quotes, and
+  // look for the separator after that
+  if (tokenizer->quote && pstr_sv_starts_with_char(rest, tokenizer->quote)) {
+    token_start = 1;
+    size_t idx = 1;
+    while (idx < rest.len) {
+      idx += pstr_find_byte(rest.str + idx, rest.len - idx, tokenizer->quote);
+      if (idx + 1 < rest.len && rest.str[idx + 1] == tokenizer->quote) {
+        idx += 2;
+        continue;
+      }
+      token_end = idx;
+      break;
+    }
+    // If the quote is never closed, the token runs to the end of `src`, and we give the
+    // whole of it, opening quote and all, so that it can be told apart from a quoted one
+    if (token_end == rest.len) {
+      token_start = 0;
+    }
+    search_start = token_end < rest.len ? token_end + 1 : rest.len;
+  }
+
+  pstr_sv const after_token = pstr_sv_from_n(
+    rest.str + search_start, rest.len - search_start
+  );
+  size_t const idx_separator = search_start + (
+    tokenizer->separators ?
+      pstr_charset_skip(after_token.str, after_token.len, tokenizer->separators, false) :
+      pstr_find_sv(after_token, tokenizer->separator)
+  );
+  // If there's anything between the closing quote and the separator, as in `"ab"cd`, the
+  // field isn't really quoted, so we give the whole of it, quotes and all, rather than
+  // dropping what comes after the quote
+  if (token_start == 1 && idx_separator != search_start) {
+    token_start = 0;
+  }
+  if (token_start == 0) {
+    token_end = idx_separator;
+  }
+
+  *token = pstr_sv_from_n(rest.str + token_start, token_end - token_start);
+
+  if (idx_separator == rest.len) {
+    tokenizer->is_done = true;
+    tokenizer->rest = pstr_sv_from_n(rest.str + rest.len, 0);
+  } else {
+    size_t const separator_len = tokenizer->separators ? 1 : tokenizer->separator.len;
+    size_t const next_start = idx_separator + separator_len;
+    tokenizer->rest = pstr_sv_from_n(rest.str + next_start, rest.len - next_start);
+  }
+
+  return true;
+}
+
+
+void pstr_splitter_init(
+  pstr_splitter *splitter, pstr_allocator const allocator, char const separator,
+  size_t const max_record_len
+) {
+  *splitter = (pstr_splitter){
+    .separator = separator, .max_record_len = max_record_len, .allocator = allocator,
+  };
+}
+
+
+void pstr_splitter_feed(pstr_splitter *splitter, pstr_sv const chunk) {
+  splitter->chunk = chunk;
+  splitter->idx_next = 0;
+  splitter->block_separators = 0;
+  splitter->idx_block = 0;
+  splitter->idx_next_block = 0;
+}
+
+
+#ifdef PSTR_X86
+static uint32_t pstr_byte_mask16_sse2(char const *str, __m128i const pattern) {
+  __m128i const block = _mm_loadu_si128((__m128i const *)str);
+  return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, pattern));
+}
+
+
+__attribute__((target("avx2")))
+static uint64_t pstr_byte_mask64_avx2(char const *str, char const target) {
+  __m256i const pattern = _mm256_set1_epi8(target);
+  __m256i const eq0 = _mm256_cmpeq_epi8(
+    _mm256_loadu_si256((__m256i const *)str), pattern
+  );
+  __m256i const eq1 = _mm256_cmpeq_epi8(
+    _mm256_loadu_si256((__m256i const *)(str + 32)), pattern
+  );
+  return ((uint64_t)(uint32_t)_mm256_movemask_epi8(eq1) << 32) |
+    (uint32_t)_mm256_movemask_epi8(eq0);
+}
+
+
+/*
+  Returns a mask with bit `idx` set if `str[idx]` is `target`, for the 64 bytes at `str`.
+*/
+static uint64_t pstr_byte_mask64(char const *str, char const target) {
+  if (pstr_cpu_has_avx2()) {
+    return pstr_byte_mask64_avx2(str, target);
+  }
+  __m128i const pattern = _mm_set1_epi8(target);
+  uint64_t mask = 0;
+  for (size_t idx = 0; idx < 64; idx += 16) {
+    mask |= (uint64_t)pstr_byte_mask16_sse2(str + idx, pattern) << idx;
+  }
+  return mask;
+}
+#endif
+
+
+/*
+  Returns the index of the next separator in the chunk, or the chunk's length if there
+  isn't one. Records are usually short, so rather than starting a new search for each
+  one, we find all of the separators in 64 characters at once, and go through them one
+  by one.
+*/
+static size_t pstr_splitter_find(pstr_splitter *splitter) {
+  char const *str = splitter->chunk.str;
+  size_t const len = splitter->chunk.len;
+#ifdef PSTR_X86
+  while (splitter->block_separators == 0) {
+    size_t const idx_block = splitter->idx_next_block;
+    if (idx_block + 64 > len) {
+      // Everything before `idx_block` has been looked at, so we only look at the rest
+      size_t const idx_start =
+        splitter->idx_next > idx_block ? splitter->idx_next : idx_block;
+      return idx_start +
+        pstr_find_byte(str + idx_start, len - idx_start, splitter->separator);
+    }
+    splitter->block_separators = pstr_byte_mask64(str + idx_block, splitter->separator);
+    splitter->idx_block = idx_block;
+    splitter->idx_next_block = idx_block + 64;
+  }
+  size_t const idx_separator =
+    splitter->idx_block + (size_t)__builtin_ctzll(splitter->block_separators);
+  splitter->block_separators &= splitter->block_separators - 1;
+  return idx_separator;
+#else
+  size_t const idx_next = splitter->idx_next;
+  return idx_next + pstr_find_byte(str + idx_next, len - idx_next, splitter->separator);
+#endif
+}
+
+
+/*
+  Adds `piece` to the end of the record we're putting together in the splitter's tail,
+  growing the tail if needed, but never past `max_record_len`.
+*/
+static bool pstr_splitter_keep(pstr_splitter *splitter, pstr_sv const piece) {
+  if (piece.len == 0) {
+    return true;
+  }
+  if (piece.len > splitter->max_record_len - splitter->tail_len) {
+    splitter->did_fail = true;
+    return false;
+  }
+  size_t const new_len = splitter->tail_len + piece.len;
+  if (new_len > splitter->tail_size) {
+    size_t new_size = splitter->tail_size * 2;
+    if (new_size < new_len) {
+      new_size = new_len;
+    }
+    if (new_size > splitter->max_record_len) {
+      new_size = splitter->max_record_len;
+    }
+    char *new_tail = splitter->allocator.resize(
+      splitter->allocator.ctx, splitter->tail, splitter->tail_size, new_size
+    );
+    if (!new_tail) {
+      splitter->did_fail = true;
+      return false;
+    }
+    splitter->tail = new_tail;
+    splitter->tail_size = new_size;
+  }
+  memcpy(splitter->tail + splitter->tail_len, piece.str, piece.len);
+  splitter->tail_len = new_len;
+  return true;
+}
+
+
+bool pstr_splitter_next(pstr_splitter *splitter, pstr_sv *record) {
+  if (splitter->did_fail) {
+    return false;
+  }
+
+  pstr_sv const chunk = splitter->chunk;
+  size_t const idx_next = splitter->idx_next;
+  if (idx_next == chunk.len) {
+    return false;
+  }
+  size_t const idx_separator = pstr_splitter_find(splitter);
+  if (idx_separator == chunk.len) {
+    // The rest of the chunk is the start of a record that ends in a later one
+    splitter->idx_next = chunk.len;
+    pstr_splitter_keep(
+      splitter, pstr_sv_from_n(chunk.str + idx_next, chunk.len - idx_next)
+    );
+    return false;
+  }
+  pstr_sv const before_separator =
+    pstr_sv_from_n(chunk.str + idx_next, idx_separator - idx_next);
+  splitter->idx_next = idx_separator + 1;
+
+  if (splitter->tail_len == 0) {
+    *record = before_separator;
+    return true;
+  }
+
+  // The record began in an earlier chunk, so we finish putting it together. The tail
+  // isn't written to again until the next call, so the record stays valid until then.
+  if (!pstr_splitter_keep(splitter, before_separator)) {
+    return false;
+  }
+  *record = pstr_sv_from_n(splitter->tail, splitter->tail_len);
+  splitter->tail_len = 0;
+  return true;
+}
+
+
+bool pstr_splitter_finish(pstr_splitter *splitter, pstr_sv *record) {
+  if (splitter->did_fail) {
+    return false;
+  }
+  pstr_sv const chunk = splitter->chunk;
+  size_t const idx_next = splitter->idx_next;
+  pstr_sv const rest = idx_next < chunk.len ?
+    pstr_sv_from_n(chunk.str + idx_next, chunk.len - idx_next) : pstr_sv_from_n(NULL, 0);
+  splitter->idx_next = chunk.len;
+  if (!pstr_splitter_keep(splitter, rest) || splitter->tail_len == 0) {
+    return false;
+  }
+  *record = pstr_sv_from_n(splitter->tail, splitter->tail_len);
+  splitter->tail_len = 0;
+  return true;
+}
+
+
+void pstr_splitter_free(pstr_splitter *splitter) {
+  if (splitter->tail) {
+    splitter->allocator.resize(
+      splitter->allocator.ctx, splitter->tail, splitter->tail_size, 0
+    );
+  }
+  splitter->tail = NULL;
+  splitter->tail_size = 0;
+  splitter->tail_len = 0;
+}
+
+
+#define PSTR_MATCHER_NO_STATE UINT32_MAX
+#define PSTR_MATCHER_NO_PATTERN UINT32_MAX
+// Set on a transition if the state it goes to ends at least one pattern, so that we
+// only need to look any further when it is
+#define PSTR_MATCHER_MATCH_FLAG 0x80000000u
+
+
+static pstr_sv pstr_matcher_pattern(
+  char const *const *strs, pstr_sv const *svs, size_t const idx
+) {
+  return strs ? pstr_sv_from(strs[idx]) : svs[idx];
+}
+
+
+static uint32_t *pstr_matcher_alloc(pstr_allocator const allocator, size_t const n) {
+  if (n == 0) {
+    return NULL;
+  }
+  return allocator.resize(allocator.ctx, NULL, 0, n * sizeof(uint32_t));
+}
+
+
+static void pstr_matcher_release(
+  pstr_allocator const allocator, uint32_t *ptr, size_t const n
+) {
+  if (ptr) {
+    allocator.resize(allocator.ctx, ptr, n * sizeof(uint32_t), 0);
+  }
+}
+
+
+/*
+  Builds the automaton for either `strs` or `svs`, whichever isn't NULL. We first build
+  a trie of the patterns, in a table big enough for the worst case where they share no
+  prefixes, and then copy it into a table of the right size and fill in the rest of the
+  transitions, breadth-first, so that every state has one for every byte class.
+*/
+static bool pstr_matcher_build(
+  pstr_matcher *matcher, pstr_allocator const allocator,
+  char const *const *strs, pstr_sv const *svs, size_t const n_patterns
+) {
+  pstr_matcher m;
+  memset(&m, 0, sizeof(m));
+  m.allocator = allocator;
+  m.n_patterns = n_patterns;
+
+  // Give each byte that's in a pattern its own class, and lump all other bytes together
+  // in class 0, so that states only need as many transitions as there are classes
+  size_t max_states = 1;
+  m.n_classes = 1;
+  for (size_t idx_pattern = 0; idx_pattern < n_patterns; idx_pattern++) {
+    pstr_sv const pattern = pstr_matcher_pattern(strs, svs, idx_pattern);
+    max_states += pattern.len;
+    for (size_t idx = 0; idx < pattern.len; idx++) {
+      uint8_t const byte = (uint8_t)pattern.str[idx];
+      if (m.byte_classes[byte] == 0) {
+        m.byte_classes[byte] = (uint16_t)m.n_classes++;
+      }
+    }
+  }
+  if (max_states > (PSTR_MATCHER_MATCH_FLAG - 1) / m.n_classes) {
+    return false;
+  }
+
+  uint32_t *trie = pstr_matcher_alloc(allocator, max_states * m.n_classes);
+  uint32_t *trie_patterns = pstr_matcher_alloc(allocator, max_states);
+  m.pattern_lens = pstr_matcher_alloc(allocator, n_patterns);
+  if (!trie || !trie_patterns || (n_patterns > 0 && !m.pattern_lens)) {
+    pstr_matcher_release(allocator, trie, max_states * m.n_classes);
+    pstr_matcher_release(allocator, trie_patterns, max_states);
+    pstr_matcher_release(allocator, m.pattern_lens, n_patterns);
+    return false;
+  }
+
+  // Build the trie. Empty patterns are left out, since they never match.
+  for (size_t idx = 0; idx < max_states * m.n_classes; idx++) {
+    trie[idx] = PSTR_MATCHER_NO_STATE;
+  }
+  for (size_t idx = 0; idx < max_states; idx++) {
+    trie_patterns[idx] = PSTR_MATCHER_NO_PATTERN;
+  }
+  m.n_states = 1;
+  for (size_t idx_pattern = 0; idx_pattern < n_patterns; idx_pattern++) {
+    pstr_sv const pattern = pstr_matcher_pattern(strs, svs, idx_pattern);
+    m.pattern_lens[idx_pattern] = (uint32_t)pattern.len;
+    if (pattern.len == 0) {
+      continue;
+    }
+    uint32_t state = 0;
+    for (size_t idx = 0; idx < pattern.len; idx++) {
+      size_t const cell = state * m.n_classes + m.byte_classes[(uint8_t)pattern.str[idx]];
+      if (trie[cell] == PSTR_MATCHER_NO_STATE) {
+        trie[cell] = (uint32_t)m.n_states++;
+      }
+      state = trie[cell];
+    }
+    if (trie_patterns[state] == PSTR_MATCHER_NO_PATTERN) {
+      trie_patterns[state] = (uint32_t)idx_pattern;
+    }
+  }
+
+  m.transitions = pstr_matcher_alloc(allocator, m.n_states * m.n_classes);
+  m.state_patterns = pstr_matcher_alloc(allocator, m.n_states);
+  m.output_links = pstr_matcher_alloc(allocator, m.n_states);
+  uint32_t *fails = pstr_matcher_alloc(allocator, m.n_states);
+  uint32_t *queue = pstr_matcher_alloc(allocator, m.n_states);
+  bool const did_alloc =
+    m.transitions && m.state_patterns && m.output_links && fails && queue;
+  if (did_alloc) {
+    memcpy(m.transitions, trie, m.n_states * m.n_classes * sizeof(uint32_t));
+    memcpy(m.state_patterns, trie_patterns, m.n_states * sizeof(uint32_t));
+  }
+  pstr_matcher_release(allocator, trie, max_states * m.n_classes);
+  pstr_matcher_release(allocator, trie_patterns, max_states);
+  if (!did_alloc) {
+    pstr_matcher_release(allocator, fails, m.n_states);
+    pstr_matcher_release(allocator, queue, m.n_states);
+    pstr_matcher_free(&m);
+    return false;
+  }
+
+  // Go through the states breadth-first, so that each state's failure state, which is
+  // always shallower, is done before it. A missing transition goes wherever the failure
+  // state's does. A state's output link is the nearest state along its failure chain
+  // that ends a pattern.
+  size_t queue_start = 0;
+  size_t queue_end = 0;
+  fails[0] = 0;
+  m.output_links[0] = 0;
+  for (size_t idx_class = 0; idx_class < m.n_classes; idx_class++) {
+    uint32_t const child = m.transitions[idx_class];
+    if (child == PSTR_MATCHER_NO_STATE) {
+      m.transitions[idx_class] = 0;
+    } else {
+      fails[child] = 0;
+      m.output_links[child] = 0;
+      queue[queue_end++] = child;
+    }
+  }
+  while (queue_start < queue_end) {
+    uint32_t const state = queue[queue_start++];
+    for (size_t idx_class = 0; idx_class < m.n_classes; idx_class++) {
+      size_t const cell = state * m.n_classes + idx_class;
+      uint32_t const child = m.transitions[cell];
+      uint32_t const fallback = m.transitions[fails[state] * m.n_classes + idx_class];
+      if (child == PSTR_MATCHER_NO_STATE) {
+        m.transitions[cell] = fallback;
+      } else {
+        fails[child] = fallback;
+        m.output_links[child] = m.state_patterns[fallback] != PSTR_MATCHER_NO_PATTERN ?
+          fallback : m.output_links[fallback];
+        queue[queue_end++] = child;
+      }
+    }
+  }
+  pstr_matcher_release(allocator, fails, m.n_states);
+  pstr_matcher_release(allocator, queue, m.n_states);
+
+  // Store transitions as the offset of the next state's row, so that following one is a
+  // single lookup, and flag the ones that go to states ending a pattern
+  for (size_t cell = 0; cell < m.n_states * m.n_classes; cell++) {
+    uint32_t const next = m.transitions[cell];
+    bool const is_match =
+      m.state_patterns[next] != PSTR_MATCHER_NO_PATTERN || m.output_links[next] != 0;
+    m.transitions[cell] =
+      (uint32_t)(next * m.n_classes) | (is_match ? PSTR_MATCHER_MATCH_FLAG : 0);
+  }
+
+  *matcher = m;
+  return true;
+}
+
+
+bool pstr_matcher_init(
+  pstr_matcher *matcher, pstr_allocator const allocator,
+  char const *const *patterns, size_t const n_patterns
+) {
+  return pstr_matcher_build(matcher, allocator, patterns, NULL, n_patterns);
+}
+
+
+bool pstr_matcher_init_sv(
+  pstr_matcher *matcher, pstr_allocator const allocator,
+  pstr_sv const *patterns, size_t const n_patterns
+) {
+  return pstr_matcher_build(matcher, allocator, NULL, patterns, n_patterns);
+}
+
+
+void pstr_matcher_free(pstr_matcher *matcher) {
+  pstr_allocator const allocator = matcher->allocator;
+  size_t const n_cells = matcher->n_states * matcher->n_classes;
+  pstr_matcher_release(allocator, matcher->transitions, n_cells);
+  pstr_matcher_release(allocator, matcher->state_patterns, matcher->n_states);
+  pstr_matcher_release(allocator, matcher->output_links, matcher->n_states);
+  pstr_matcher_release(allocator, matcher->pattern_lens, matcher->n_patterns);
+  matcher->transitions = NULL;
+  matcher->state_patterns = NULL;
+  matcher->output_links = NULL;
+  matcher->pattern_lens = NULL;
+  matcher->n_states = 0;
+  matcher->n_patterns = 0;
+}
+
+
+bool pstr_matcher_find(pstr_matcher const *matcher, char const *str, pstr_match *match) {
+  return pstr_matcher_find_sv(matcher, pstr_sv_from(str), match);
+}
+
+
+bool pstr_matcher_find_sv(
+  pstr_matcher const *matcher, pstr_sv const str, pstr_match *match
+) {
+  pstr_match_iterator iterator;
+  pstr_match_iterator_init(&iterator, matcher, str);
+  return pstr_match_iterator_next(&iterator, match);
+}
+
+
+bool pstr_prefix_table_init(
+  pstr_prefix_table *table, pstr_allocator const allocator,
+  char const *const *prefixes, size_t const n_prefixes
+) {
+  size_t n_nonempty = 0;
+  size_t total_len = 0;
+  for (size_t idx = 0; idx < n_prefixes; idx++) {
+    size_t const len = strlen(prefixes[idx]);
+    n_nonempty += len > 0;
+    total_len += len;
+  }
+  if (
+    n_nonempty > UINT32_MAX ||
+    n_nonempty > (SIZE_MAX - total_len) / sizeof(pstr_prefix)
+  ) {
+    return false;
+  }
+
+  // The prefixes' characters go right after the table's entries, in the same block
+  pstr_prefix_table t;
+  memset(&t, 0, sizeof(t));
+  t.allocator = allocator;
+  t.n_prefixes = n_nonempty;
+  t.size = n_nonempty * sizeof(pstr_prefix) + total_len;
+  if (t.size > 0) {
+    t.prefixes = allocator.resize(allocator.ctx, NULL, 0, t.size);
+    if (!t.prefixes) {
+      return false;
+    }
+  }
+
+  char *chars = (char *)(t.prefixes + n_nonempty);
+  size_t idx_prefix = 0;
+  for (size_t idx = 0; idx < n_prefixes; idx++) {
+    size_t const len = strlen(prefixes[idx]);
+    if (len == 0) {
+      continue;
+    }
+    size_t const head_len = len < PSTR_PREFIX_HEAD_LEN ? len : PSTR_PREFIX_HEAD_LEN;
+    pstr_prefix *prefix = &t.prefixes[idx_prefix++];
+    memcpy(chars, prefixes[idx], len);
+    prefix->head = pstr_prefix_load_head(chars, head_len);
+    prefix->head_mask = 0;
+    memset(&prefix->head_mask, 0xff, head_len);
+    prefix->str = chars;
+    prefix->len = len;
+    prefix->prefix_idx = idx;
+    chars += len;
+  }
+  if (n_nonempty > 1) {
+    qsort(t.prefixes, n_nonempty, sizeof(pstr_prefix), pstr_prefix_compare);
+  }
+
+  // The prefixes starting with character `c` are the ones from `first_char_starts[c]`
+  // up to `first_char_starts[c + 1]`
+  size_t idx = 0;
+  for (size_t c = 0; c <= 256; c++) {
+    while (idx < n_nonempty && (uint8_t)t.prefixes[idx].str[0] < c) {
+      idx++;
+    }
+    t.first_char_starts[c] = (uint32_t)idx;
+  }
+
+  *table = t;
+  return true;
+}
+
+
+void pstr_prefix_table_free(pstr_prefix_table *table) {
+  if (table->prefixes) {
+    table->allocator.resize(table->allocator.ctx, table->prefixes, table->size, 0);
+  }
+  table->prefixes = NULL;
+  table->n_prefixes = 0;
+  table->size = 0;
+  memset(table->first_char_starts, 0, sizeof(table->first_char_starts));
+}
+
+
+/*
+  Loads the 8 bytes of `bytes` from `start`, or as many as there are before `end`, with
+  zero bytes after them. Short strings are compared a word at a time, and this lets us
+  load a whole word even when it runs into the next string.
+*/
+static uint64_t pstr_column_load_head(
+  char const *bytes, size_t const start, size_t const end
+) {
+  if (start + 8 <= end) {
+    return pstr_swar_load(bytes + start);
+  }
+  return pstr_prefix_load_head(bytes + start, end - start);
+}
+
+
+/*
+  Returns a mask of the first `len` bytes of a word, or all of them if `len` is 8 or more,
+  so that a head loaded with `pstr_column_load_head()` can be cut down to just its string.
+*/
+static uint64_t pstr_column_head_mask(size_t const len) {
+  static uint8_t const mask_bytes[16] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0, 0, 0, 0, 0, 0, 0, 0,
+  };
+  return pstr_swar_load((char const *)mask_bytes + 8 - (len < 8 ? len : 8));
+}
+
+
+// The number of strings `pstr_batch_eq()` checks together, so that it can keep track of
+// which of them it still has to compare the rest of in one word
+#define PSTR_BATCH_BLOCK_SIZE 64
+
+/*
+  Loads the last 8 bytes of string `idx` of `column`, or the 8 bytes from where it starts
+  if it's shorter than that, which there must be room for.
+*/
+static uint64_t pstr_column_load_last_word(pstr_column const *column, size_t const idx) {
+  size_t const start = column->offsets[idx];
+  size_t const len = column->offsets[idx + 1] - start;
+  return pstr_swar_load(column->bytes + start + (len > 8 ? len - 8 : 0));
+}
+
+
+#ifdef PSTR_X86
+/*
+  Loads the heads of the 4 strings starting at `starts`, which must all have 8 bytes
+  after them. Loading them one by one is as fast as a gather, or faster, on most CPUs.
+*/
+__attribute__((target("avx2")))
+static __m256i pstr_column_load_heads_avx2(char const *bytes, size_t const *starts) {
+  return _mm256_set_epi64x(
+    (long long)pstr_swar_load(bytes + starts[3]),
+    (long long)pstr_swar_load(bytes + starts[2]),
+    (long long)pstr_swar_load(bytes + starts[1]),
+    (long long)pstr_swar_load(bytes + starts[0])
+  );
+}
+
+
+/*
+  Does the length and head checks of `pstr_batch_compare_heads()` for 4 strings at a
+  time, for as many of the first `n_whole_heads` strings as it can. Returns how many
+  strings it's checked.
+*/
+__attribute__((target("avx2")))
+static size_t pstr_batch_compare_heads_avx2(
+  pstr_column const *column, size_t const n_whole_heads, pstr_sv const str,
+  bool const is_exact, uint64_t const head, uint64_t const mask, bool *results
+) {
+  size_t const *offsets = column->offsets;
+  // Lengths are much smaller than 2^63, so comparing them as signed numbers is fine, and
+  // `len >= str.len` is the same as `len > str.len - 1`
+  __m256i const str_len = _mm256_set1_epi64x((long long)(str.len - !is_exact));
+  __m256i const head_vec = _mm256_set1_epi64x((long long)head);
+  __m256i const mask_vec = _mm256_set1_epi64x((long long)mask);
+  size_t idx = 0;
+  for (; idx + 4 <= n_whole_heads; idx += 4) {
+    __m256i const starts = _mm256_loadu_si256((__m256i const *)(offsets + idx));
+    __m256i const ends = _mm256_loadu_si256((__m256i const *)(offsets + idx + 1));
+    __m256i const lens = _mm256_sub_epi64(ends, starts);
+    __m256i const is_len_ok = is_exact ?
+      _mm256_cmpeq_epi64(lens, str_len) : _mm256_cmpgt_epi64(lens, str_len);
+    __m256i const heads = pstr_column_load_heads_avx2(column->bytes, offsets + idx);
+    __m256i const is_head_ok =
+      _mm256_cmpeq_epi64(_mm256_and_si256(heads, mask_vec), head_vec);
+    uint32_t const matches = (uint32_t)_mm256_movemask_pd(
+      _mm256_castsi256_pd(_mm256_and_si256(is_len_ok, is_head_ok))
+    );
+    // Spread each lane's bit out into its own byte, so we write all 4 results at once
+    uint32_t const lane_results = (matches * 0x00204081) & 0x01010101;
+    memcpy(results + idx, &lane_results, sizeof(lane_results));
+  }
+  return idx;
+}
+
+
+/*
+  Does what `pstr_batch_eq_block()` does for a whole block, 4 pairs of strings at a time.
+*/
+__attribute__((target("avx2")))
+static uint64_t pstr_batch_eq_block_avx2(
+  pstr_column const *column1, pstr_column const *column2, size_t const idx_block,
+  bool *results
+) {
+  size_t const *offsets1 = column1->offsets;
+  size_t const *offsets2 = column2->offsets;
+  __m256i const ones = _mm256_set1_epi64x(-1);
+  __m256i const eight = _mm256_set1_epi64x(8);
+  __m256i const sixteen = _mm256_set1_epi64x(16);
+  uint64_t needs_tail = 0;
+  for (size_t idx_group = 0; idx_group < PSTR_BATCH_BLOCK_SIZE; idx_group += 4) {
+    size_t const idx = idx_block + idx_group;
+    __m256i const starts1 = _mm256_loadu_si256((__m256i const *)(offsets1 + idx));
+    __m256i const starts2 = _mm256_loadu_si256((__m256i const *)(offsets2 + idx));
+    __m256i const lens1 = _mm256_sub_epi64(
+      _mm256_loadu_si256((__m256i const *)(offsets1 + idx + 1)), starts1
+    );
+    __m256i const lens2 = _mm256_sub_epi64(
+      _mm256_loadu_si256((__m256i const *)(offsets2 + idx + 1)), starts2
+    );
+    __m256i const head_diffs = _mm256_xor_si256(
+      pstr_column_load_heads_avx2(column1->bytes, offsets1 + idx),
+      pstr_column_load_heads_avx2(column2->bytes, offsets2 + idx)
+    );
+    // Shifting by 64 or more gives zero, so strings of 8 or more characters keep every
+    // byte of their heads
+    __m256i const outside_str = _mm256_sllv_epi64(ones, _mm256_slli_epi64(lens1, 3));
+    __m256i const last_word_diffs = _mm256_xor_si256(
+      _mm256_set_epi64x(
+        (long long)pstr_column_load_last_word(column1, idx + 3),
+        (long long)pstr_column_load_last_word(column1, idx + 2),
+        (long long)pstr_column_load_last_word(column1, idx + 1),
+        (long long)pstr_column_load_last_word(column1, idx)
+      ),
+      _mm256_set_epi64x(
+        (long long)pstr_column_load_last_word(column2, idx + 3),
+        (long long)pstr_column_load_last_word(column2, idx + 2),
+        (long long)pstr_column_load_last_word(column2, idx + 1),
+        (long long)pstr_column_load_last_word(column2, idx)
+      )
+    );
+    __m256i const is_eq = _mm256_and_si256(
+      _mm256_cmpeq_epi64(lens1, lens2),
+      _mm256_cmpeq_epi64(
+        _mm256_or_si256(
+          _mm256_andnot_si256(outside_str, head_diffs),
+          _mm256_and_si256(_mm256_cmpgt_epi64(lens1, eight), last_word_diffs)
+        ),
+        _mm256_setzero_si256()
+      )
+    );
+    uint32_t const matches = (uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(is_eq));
+    // Spread each lane's bit out into its own byte, so we write all 4 results at once
+    uint32_t const lane_results = (matches * 0x00204081) & 0x01010101;
+    memcpy(results + idx, &lane_results, sizeof(lane_results));
+    uint32_t const lane_needs_tail = (uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(
+      _mm256_and_si256(is_eq, _mm256_cmpgt_epi64(lens1, sixteen))
+    ));
+    needs_tail |= (uint64_t)lane_needs_tail << idx_group;
+  }
+  return needs_tail;
+}
+#endif
+
+
+/*
+  Returns whether the first `len` characters of `str1` and `str2` are the same, given
+  that their first 8 already are. `len` must be more than 8. Short tails are compared a
+  word at a time, finishing with the last 8 characters, which can overlap the word before
+  them, so that we don't have to call `memcmp()` for every string.
+*/
+static bool pstr_batch_tails_eq(char const *str1, char const *str2, size_t const len) {
+  if (len > 32) {
+    return memcmp(
+      str1 + PSTR_PREFIX_HEAD_LEN, str2 + PSTR_PREFIX_HEAD_LEN, len - PSTR_PREFIX_HEAD_LEN
+    ) == 0;
+  }
+  for (size_t idx = PSTR_PREFIX_HEAD_LEN; idx + 8 < len; idx += 8) {
+    if (pstr_swar_load(str1 + idx) != pstr_swar_load(str2 + idx)) {
+      return false;
+    }
+  }
+  return pstr_swar_load(str1 + len - 8) == pstr_swar_load(str2 + len - 8);
+}
+
+
+/*
+  Sets `results[idx]` to whether string `idx` of `column` starts with `str`, or, if
+  `is_exact`, whether it's equal to `str`. The first 8 characters are checked with one
+  masked word comparison, so the rest only need comparing for strings that get past that.
+*/
+static void pstr_batch_compare_heads(
+  pstr_column const *column, pstr_sv const str, bool const is_exact, bool *results
+) {
+  size_t const *offsets = column->offsets;
+  size_t const n_strs = column->n_strs;
+  size_t const bytes_end = offsets[n_strs];
+  size_t const head_len = str.len < PSTR_PREFIX_HEAD_LEN ? str.len : PSTR_PREFIX_HEAD_LEN;
+  uint64_t const head = head_len > 0 ? pstr_prefix_load_head(str.str, head_len) : 0;
+  uint64_t const mask = pstr_column_head_mask(head_len);
+
+  // Lengths and heads are checked together, without branching, since whether a string
+  // gets past either check is hard to predict. Only the last few strings are too close
+  // to the end of the column to load a whole word from.
+  size_t n_whole_heads = n_strs;
+  while (n_whole_heads > 0 && offsets[n_whole_heads - 1] + 8 > bytes_end) {
+    n_whole_heads--;
+  }
+  size_t idx_start = 0;
+#ifdef PSTR_X86
+  if (pstr_cpu_has_avx2()) {
+    idx_start = pstr_batch_compare_heads_avx2(
+      column, n_whole_heads, str, is_exact, head, mask, results
+    );
+  }
+#endif
+  for (size_t idx = idx_start; idx < n_whole_heads; idx++) {
+    size_t const len = offsets[idx + 1] - offsets[idx];
+    bool const is_len_ok = is_exact ? len == str.len : len >= str.len;
+    uint64_t const str_head = pstr_swar_load(column->bytes + offsets[idx]);
+    results[idx] = is_len_ok & ((str_head & mask) == head);
+  }
+  for (size_t idx = n_whole_heads; idx < n_strs; idx++) {
+    size_t const len = offsets[idx + 1] - offsets[idx];
+    bool const is_len_ok = is_exact ? len == str.len : len >= str.len;
+    results[idx] = is_len_ok && (
+      pstr_column_load_head(column->bytes, offsets[idx], bytes_end) & mask
+    ) == head;
+  }
+
+  // Few strings usually get this far, so we skip straight from one that has to the next
+  if (str.len > PSTR_PREFIX_HEAD_LEN) {
+    char const *matches = (char const *)results;
+    size_t idx = pstr_find_byte(matches, n_strs, true);
+    while (idx < n_strs) {
+      results[idx] = pstr_batch_tails_eq(column->bytes + offsets[idx], str.str, str.len);
+      idx++;
+      idx += pstr_find_byte(matches + idx, n_strs - idx, true);
+    }
+  }
+}
+
+
+pstr_sv pstr_column_get(pstr_column const *column, size_t const idx) {
+  size_t const start = column->offsets[idx];
+  return pstr_sv_from_n(column->bytes + start, column->offsets[idx + 1] - start);
+}
+
+
+/*
+  Returns the number of whitespace characters at the start of the `len` characters of
+  `str`. Most strings in a column have little or no whitespace around them, so we check
+  a few characters before calling the kernels, which are made for long runs.
+*/
+static size_t pstr_batch_leading_space(char const *str, size_t const len) {
+  size_t n_leading = 0;
+  while (n_leading < len && n_leading < 4 && pstr_is_trim_match(str[n_leading], true, 0)) {
+    n_leading++;
+  }
+  if (n_leading == 4) {
+    n_leading += pstr_trim_span(str + 4, len - 4, true, 0);
+  }
+  return n_leading;
+}
+
+
+/*
+  Returns where the `len` characters of `str` end once the whitespace at their end is
+  removed, never going back past `n_leading`, in the same way as
+  `pstr_batch_leading_space()`.
+*/
+static size_t pstr_batch_trimmed_end(
+  char const *str, size_t const n_leading, size_t const len
+) {
+  size_t end = len;
+  while (end > n_leading && len - end < 4 && pstr_is_trim_match(str[end - 1], true, 0)) {
+    end--;
+  }
+  if (len - end == 4) {
+    end -= pstr_trim_rspan(str + n_leading, end - n_leading, true, 0);
+  }
+  return end;
+}
+
+
+bool pstr_batch_trim(
+  pstr_column const *src, char *dest_bytes, size_t const dest_size, size_t *dest_offsets
+) {
+  size_t const n_strs = src->n_strs;
+  if (dest_size < src->offsets[n_strs] - src->offsets[0]) {
+    return false;
+  }
+
+  // Each string is read before anything is written over it, and it is never moved
+  // forwards, which is what makes trimming in place work
+  size_t start = src->offsets[0];
+  size_t dest_len = 0;
+  dest_offsets[0] = 0;
+  for (size_t idx = 0; idx < n_strs; idx++) {
+    size_t const end = src->offsets[idx + 1];
+    char const *str = src->bytes + start;
+    size_t const len = end - start;
+    size_t const n_leading = pstr_batch_leading_space(str, len);
+    size_t const trimmed_len = pstr_batch_trimmed_end(str, n_leading, len) - n_leading;
+    memmove(dest_bytes + dest_len, str + n_leading, trimmed_len);
+    dest_len += trimmed_len;
+    dest_offsets[idx + 1] = dest_len;
+    start = end;
+  }
+  return true;
+}
+
+
+/*
+  Sets `results[idx]` for the `n_strs` pairs of strings from `idx_block`, all of which
+  must have 8 bytes after their start, going by their lengths, their first 8 characters
+  and their last 8 characters, all compared without branching. This is all we need for
+  strings of up to 16 characters. Returns which of the pairs are longer than that and
+  have matched so far, as a bit for each pair, so that the rest of them can be compared
+  afterwards.
+*/
+static uint64_t pstr_batch_eq_block(
+  pstr_column const *column1, pstr_column const *column2, size_t const idx_block,
+  size_t const n_strs, bool *results
+) {
+#ifdef PSTR_X86
+  if (n_strs == PSTR_BATCH_BLOCK_SIZE && pstr_cpu_has_avx2()) {
+    return pstr_batch_eq_block_avx2(column1, column2, idx_block, results);
+  }
+#endif
+  size_t const *offsets1 = column1->offsets;
+  size_t const *offsets2 = column2->offsets;
+  uint64_t needs_tail = 0;
+  for (size_t idx_str = 0; idx_str < n_strs; idx_str++) {
+    size_t const idx = idx_block + idx_str;
+    size_t const len = offsets1[idx + 1] - offsets1[idx];
+    uint64_t const head_diff = pstr_swar_load(column1->bytes + offsets1[idx]) ^
+      pstr_swar_load(column2->bytes + offsets2[idx]);
+    uint64_t const last_word_diff = pstr_column_load_last_word(column1, idx) ^
+      pstr_column_load_last_word(column2, idx);
+    bool const is_eq = (len == offsets2[idx + 1] - offsets2[idx]) &
+      ((head_diff & pstr_column_head_mask(len)) == 0) &
+      ((len <= 8) | (last_word_diff == 0));
+    results[idx] = is_eq;
+    needs_tail |= (uint64_t)(is_eq & (len > 16)) << idx_str;
+  }
+  return needs_tail;
+}
+
+
+void pstr_batch_eq(
+  pstr_column const *column1, pstr_column const *column2, bool *results
+) {
+  size_t const *offsets1 = column1->offsets;
+  size_t const *offsets2 = column2->offsets;
+  size_t const n_strs = column1->n_strs;
+  size_t const bytes_end1 = offsets1[n_strs];
+  size_t const bytes_end2 = offsets2[n_strs];
+
+  // This works as `pstr_batch_compare_heads()` does, except that each pair of strings
+  // needs its own mask, so that we only compare the characters they have. Whether a
+  // pair is the same length is hard to predict, so rather than branching on it, we also
+  // compare their last 8 characters, and only go back to the few long strings that need
+  // more than that.
+  size_t n_whole_heads = n_strs;
+  while (
+    n_whole_heads > 0 && (
+      offsets1[n_whole_heads - 1] + 8 > bytes_end1 ||
+      offsets2[n_whole_heads - 1] + 8 > bytes_end2
+    )
+  ) {
+    n_whole_heads--;
+  }
+  for (size_t idx_block = 0; idx_block < n_whole_heads; idx_block += PSTR_BATCH_BLOCK_SIZE) {
+    size_t const n_block_strs = n_whole_heads - idx_block < PSTR_BATCH_BLOCK_SIZE ?
+      n_whole_heads - idx_block : PSTR_BATCH_BLOCK_SIZE;
+    uint64_t needs_tail =
+      pstr_batch_eq_block(column1, column2, idx_block, n_block_strs, results);
+    while (needs_tail) {
+      size_t const idx = idx_block + (size_t)__builtin_ctzll(needs_tail);
+      results[idx] = pstr_batch_tails_eq(
+        column1->bytes + offsets1[idx], column2->bytes + offsets2[idx],
+        offsets1[idx + 1] - offsets1[idx]
+      );
+      needs_tail &= needs_tail - 1;
+    }
+  }
+
+  for (size_t idx = n_whole_heads; idx < n_strs; idx++) {
+    size_t const len = offsets1[idx + 1] - offsets1[idx];
+    results[idx] = len == offsets2[idx + 1] - offsets2[idx] && ((
+      pstr_column_load_head(column1->bytes, offsets1[idx], bytes_end1) ^
+      pstr_column_load_head(column2->bytes, offsets2[idx], bytes_end2)
+    ) & pstr_column_head_mask(len)) == 0 && (
+      len <= PSTR_PREFIX_HEAD_LEN || pstr_batch_tails_eq(
+        column1->bytes + offsets1[idx], column2->bytes + offsets2[idx], len
+      )
+    );
+  }
+}
+
+
+void pstr_batch_eq_sv(pstr_column const *column, pstr_sv const str, bool *results) {
+  pstr_batch_compare_heads(column, str, true, results);
+}
+
+
+void pstr_batch_starts_with(
+  pstr_column const *column, pstr_sv const prefix, bool *results
+) {
+  if (prefix.len == 0) {
+    memset(results, 0, column->n_strs * sizeof(bool));
+    return;
+  }
+  pstr_batch_compare_heads(column, prefix, false, results);
+}
+
+
+bool pstr_batch_from_int64(
+  int64_t const *numbers, size_t const n_numbers,
+  char *dest_bytes, size_t const dest_size, size_t *dest_offsets
+) {
+  // If there's room for the longest possible numbers, everything fits, so we can write
+  // each number as soon as we know how long it is
+  if (n_numbers <= dest_size / 20) {
+    size_t dest_len = 0;
+    dest_offsets[0] = 0;
+    for (size_t idx = 0; idx < n_numbers; idx++) {
+      int64_t const number = numbers[idx];
+      uint64_t const magnitude =
+        (number < 0) ? (uint64_t)0 - (uint64_t)number : (uint64_t)number;
+      size_t const n_digits = pstr_count_decimal_digits(magnitude);
+      // If the number isn't negative, its first digit goes over this
+      dest_bytes[dest_len] = '-';
+      dest_len += (number < 0);
+      pstr_write_decimal_digits(dest_bytes + dest_len, n_digits, magnitude);
+      dest_len += n_digits;
+      dest_offsets[idx + 1] = dest_len;
+    }
+    return true;
+  }
+
+  // Otherwise, work out where every string goes first, so that we know whether they all
+  // fit before writing anything
+  size_t dest_len = 0;
+  dest_offsets[0] = 0;
+  for (size_t idx = 0; idx < n_numbers; idx++) {
+    int64_t const number = numbers[idx];
+    uint64_t const magnitude =
+      (number < 0) ? (uint64_t)0 - (uint64_t)number : (uint64_t)number;
+    dest_len += pstr_count_decimal_digits(magnitude) + (number < 0);
+    dest_offsets[idx + 1] = dest_len;
+  }
+  if (dest_len > dest_size) {
+    return false;
+  }
+
+  for (size_t idx = 0; idx < n_numbers; idx++) {
+    int64_t const number = numbers[idx];
+    uint64_t const magnitude =
+      (number < 0) ? (uint64_t)0 - (uint64_t)number : (uint64_t)number;
+    char *str = dest_bytes + dest_offsets[idx];
+    size_t const len = dest_offsets[idx + 1] - dest_offsets[idx];
+    // If the number isn't negative, its first digit goes over this
+    str[0] = '-';
+    pstr_write_decimal_digits(str + (number < 0), len - (number < 0), magnitude);
+  }
+  return true;
+}
+
+
+void pstr_batch_is_valid(pstr_column const *column, bool *results) {
+  size_t const *offsets = column->offsets;
+  size_t const bytes_end = offsets[column->n_strs];
+
+  // Rather than scanning each string on its own, we look for the next NULL byte across
+  // string boundaries, and only look for another once we're past it, so that every
+  // byte is scanned at most once
+  size_t idx_next_nul = 0;
+  bool has_searched = false;
+  for (size_t idx = 0; idx < column->n_strs; idx++) {
+    size_t const start = offsets[idx];
+    if (!has_searched || idx_next_nul < start) {
+      idx_next_nul =
+        start + pstr_find_byte(column->bytes + start, bytes_end - start, '\0');
+      has_searched = true;
+    }
+    results[idx] = idx_next_nul < offsets[idx + 1];
+  }
+}
+
+
+#ifdef PSTR_POOL
+// The number of bytes of input each chunk of work is made to cover, so that a chunk's
+// strings, offsets and output all fit in a core's cache together
+#define PSTR_POOL_CHUNK_SIZE 32768
+
+struct pstr_pool_worker {
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  size_t idx_next_chunk;
+  size_t idx_end_chunk;
+  pstr_pool *pool;
+  size_t idx_worker;
+};
+
+
+/*
+  Takes the next chunk off the front of `worker`'s own queue, if there is one.
+*/
+static bool pstr_pool_pop(pstr_pool_worker *worker, size_t *idx_chunk) {
+  pthread_mutex_lock(&worker->mutex);
+  bool const has_chunk = worker->idx_next_chunk < worker->idx_end_chunk;
+  if (has_chunk) {
+    *idx_chunk = worker->idx_next_chunk++;
+  }
+  pthread_mutex_unlock(&worker->mutex);
+  return has_chunk;
+}
+
+
+/*
+  Moves the back half of the first other queue that has anything left into the queue of
+  worker `idx_worker`. Returns false if every queue is empty, meaning that the job has
+  been handed out in full. Only one lock is ever held at a time, so threads stealing
+  from each other can't deadlock.
+*/
+static bool pstr_pool_steal(pstr_pool *pool, size_t const idx_worker) {
+  for (size_t idx_offset = 1; idx_offset < pool->n_threads; idx_offset++) {
+    pstr_pool_worker *victim = &pool->workers[(idx_worker + idx_offset) % pool->n_threads];
+    pthread_mutex_lock(&victim->mutex);
+    size_t const n_left = victim->idx_end_chunk - victim->idx_next_chunk;
+    size_t const idx_start = victim->idx_end_chunk - (n_left + 1) / 2;
+    size_t const idx_end = victim->idx_end_chunk;
+    victim->idx_end_chunk = idx_start;
+    pthread_mutex_unlock(&victim->mutex);
+    if (n_left > 0) {
+      pstr_pool_worker *thief = &pool->workers[idx_worker];
+      pthread_mutex_lock(&thief->mutex);
+      thief->idx_next_chunk = idx_start;
+      thief->idx_end_chunk = idx_end;
+      pthread_mutex_unlock(&thief->mutex);
+      return true;
+    }
+  }
+  return false;
+}
+
+
+/*
+  Does chunks of the current job as worker `idx_worker` until there are none left.
+*/
+static void pstr_pool_work(pstr_pool *pool, size_t const idx_worker) {
+  size_t idx_chunk;
+  do {
+    while (pstr_pool_pop(&pool->workers[idx_worker], &idx_chunk)) {
+      pool->job_fn(pool->job_ctx, idx_chunk);
+    }
+  } while (pstr_pool_steal(pool, idx_worker));
+}
+
+
+static void *pstr_pool_thread(void *arg) {
+  pstr_pool_worker *worker = arg;
+  pstr_pool *pool = worker->pool;
+  uint64_t last_generation = 0;
+
+  pthread_mutex_lock(&pool->mutex);
+  while (true) {
+    while (!pool->is_stopping && pool->job_generation == last_generation) {
+      pthread_cond_wait(&pool->job_started, &pool->mutex);
+    }
+    if (pool->is_stopping) {
+      break;
+    }
+    last_generation = pool->job_generation;
+    pthread_mutex_unlock(&pool->mutex);
+
+    pstr_pool_work(pool, worker->idx_worker);
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->n_workers_busy--;
+    if (pool->n_workers_busy == 0) {
+      pthread_cond_signal(&pool->job_finished);
+    }
+  }
+  pthread_mutex_unlock(&pool->mutex);
+  return NULL;
+}
+
+
+/*
+  Calls `job_fn(job_ctx, idx_chunk)` for every chunk from 0 to `n_chunks`, split between
+  the pool's threads, and returns once they've all been done. Each thread starts off
+  with an equal run of consecutive chunks, so that neighbouring chunks tend to be done
+  by the same thread.
+*/
+static void pstr_pool_run(
+  pstr_pool *pool, size_t const n_chunks, void (*job_fn)(void *ctx, size_t idx_chunk),
+  void *job_ctx
+) {
+  size_t const n_threads = pool->n_threads;
+  for (size_t idx_worker = 0; idx_worker < n_threads; idx_worker++) {
+    pstr_pool_worker *worker = &pool->workers[idx_worker];
+    pthread_mutex_lock(&worker->mutex);
+    worker->idx_next_chunk = n_chunks / n_threads * idx_worker +
+      (idx_worker < n_chunks % n_threads ? idx_worker : n_chunks % n_threads);
+    worker->idx_end_chunk = worker->idx_next_chunk + n_chunks / n_threads +
+      (idx_worker < n_chunks % n_threads);
+    pthread_mutex_unlock(&worker->mutex);
+  }
+
+  pthread_mutex_lock(&pool->mutex);
+  pool->job_fn = job_fn;
+  pool->job_ctx = job_ctx;
+  pool->n_workers_busy = n_threads - 1;
+  pool->job_generation++;
+  pthread_cond_broadcast(&pool->job_started);
+  pthread_mutex_unlock(&pool->mutex);
+
+  pstr_pool_work(pool, 0);
+
+  pthread_mutex_lock(&pool->mutex);
+  while (pool->n_workers_busy > 0) {
+    pthread_cond_wait(&pool->job_finished, &pool->mutex);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+
+/*
+  A job over a column, or an array of numbers, split into chunks of `chunk_len` items.
+  Jobs that make strings first measure each chunk's output into `chunk_starts`, which
+  then becomes where each chunk's output starts.
+*/
+typedef struct {
+  pstr_column const *column;
+  int64_t const *numbers;
+  size_t n_items;
+  size_t chunk_len;
+  pstr_sv str;
+  bool *results;
+  char *dest_bytes;
+  size_t *dest_offsets;
+  size_t *chunk_starts;
+} pstr_pool_job;
+
+
+static void pstr_pool_job_init(
+  pstr_pool_job *job, size_t const n_items, size_t const item_size
+) {
+  *job = (pstr_pool_job){ .n_items = n_items, .chunk_len = PSTR_POOL_CHUNK_SIZE / item_size };
+  if (job->chunk_len == 0) {
+    job->chunk_len = 1;
+  }
+}
+
+
+static size_t pstr_pool_job_n_chunks(pstr_pool_job const *job) {
+  return (job->n_items + job->chunk_len - 1) / job->chunk_len;
+}
+
+
+/*
+  Sets up `job` to go over `column`, in chunks of about `PSTR_POOL_CHUNK_SIZE` bytes
+  going by the column's average string length, counting its offsets.
+*/
+static void pstr_pool_job_init_column(pstr_pool_job *job, pstr_column const *column) {
+  size_t const n_strs = column->n_strs;
+  size_t const n_bytes = column->offsets[n_strs] - column->offsets[0];
+  size_t const avg_len = n_strs > 0 ? n_bytes / n_strs : 0;
+  pstr_pool_job_init(job, n_strs, avg_len + sizeof(size_t));
+  job->column = column;
+}
+
+
+/*
+  Returns the strings of chunk `idx_chunk` of `job` as a column of their own, which
+  shares its bytes and offsets with the whole column.
+*/
+static pstr_column pstr_pool_job_chunk_column(
+  pstr_pool_job const *job, size_t const idx_chunk
+) {
+  size_t const idx_first = idx_chunk * job->chunk_len;
+  size_t const n_left = job->n_items - idx_first;
+  return (pstr_column){
+    .bytes = job->column->bytes,
+    .offsets = job->column->offsets + idx_first,
+    .n_strs = n_left < job->chunk_len ? n_left : job->chunk_len,
+  };
+}
+
+
+/*
+  Turns the lengths in `job->chunk_starts` into where each chunk's output starts, and
+  returns the length of all of the output put together.
+*/
+static size_t pstr_pool_job_place_chunks(pstr_pool_job *job) {
+  size_t const n_chunks = pstr_pool_job_n_chunks(job);
+  size_t total_len = 0;
+  for (size_t idx_chunk = 0; idx_chunk < n_chunks; idx_chunk++) {
+    size_t const chunk_len = job->chunk_starts[idx_chunk];
+    job->chunk_starts[idx_chunk] = total_len;
+    total_len += chunk_len;
+  }
+  return total_len;
+}
+
+
+/*
+  Writes the length of each trimmed string in the chunk to its slot in `dest_offsets`,
+  to be turned into an offset once we know where the chunk starts.
+*/
+static void pstr_pool_trim_measure_chunk(void *ctx, size_t const idx_chunk) {
+  pstr_pool_job *job = ctx;
+  pstr_column const chunk = pstr_pool_job_chunk_column(job, idx_chunk);
+  size_t *dest_offsets = job->dest_offsets + idx_chunk * job->chunk_len;
+  size_t chunk_len = 0;
+  for (size_t idx = 0; idx < chunk.n_strs; idx++) {
+    char const *str = chunk.bytes + chunk.offsets[idx];
+    size_t const len = chunk.offsets[idx + 1] - chunk.offsets[idx];
+    size_t const n_leading = pstr_batch_leading_space(str, len);
+    size_t const trimmed_len = pstr_batch_trimmed_end(str, n_leading, len) - n_leading;
+    dest_offsets[idx + 1] = trimmed_len;
+    chunk_len += trimmed_len;
+  }
+  job->chunk_starts[idx_chunk] = chunk_len;
+}
+
+
+static void pstr_pool_trim_write_chunk(void *ctx, size_t const idx_chunk) {
+  pstr_pool_job *job = ctx;
+  pstr_column const chunk = pstr_pool_job_chunk_column(job, idx_chunk);
+  size_t *dest_offsets = job->dest_offsets + idx_chunk * job->chunk_len;
+  size_t dest_len = job->chunk_starts[idx_chunk];
+  for (size_t idx = 0; idx < chunk.n_strs; idx++) {
+    char const *str = chunk.bytes + chunk.offsets[idx];
+    size_t const len = chunk.offsets[idx + 1] - chunk.offsets[idx];
+    size_t const trimmed_len = dest_offsets[idx + 1];
+    size_t const n_leading = pstr_batch_leading_space(str, len);
+    memcpy(job->dest_bytes + dest_len, str + n_leading, trimmed_len);
+    dest_len += trimmed_len;
+    dest_offsets[idx + 1] = dest_len;
+  }
+}
+
+
+static void pstr_pool_eq_sv_chunk(void *ctx, size_t const idx_chunk) {
+  pstr_pool_job *job = ctx;
+  pstr_column const chunk = pstr_pool_job_chunk_column(job, idx_chunk);
+  pstr_batch_eq_sv(&chunk, job->str, job->results + idx_chunk * job->chunk_len);
+}
+
+
+static void pstr_pool_starts_with_chunk(void *ctx, size_t const idx_chunk) {
+  pstr_pool_job *job = ctx;
+  pstr_column const chunk = pstr_pool_job_chunk_column(job, idx_chunk);
+  pstr_batch_starts_with(&chunk, job->str, job->results + idx_chunk * job->chunk_len);
+}
+
+
+static void pstr_pool_is_valid_chunk(void *ctx, size_t const idx_chunk) {
+  pstr_pool_job *job = ctx;
+  pstr_column const chunk = pstr_pool_job_chunk_column(job, idx_chunk);
+  pstr_batch_is_valid(&chunk, job->results + idx_chunk * job->chunk_len);
+}
+
+
+static void pstr_pool_from_int64_measure_chunk(void *ctx, size_t const idx_chunk) {
+  pstr_pool_job *job = ctx;
+  size_t const idx_first = idx_chunk * job->chunk_len;
+  size_t const n_left = job->n_items - idx_first;
+  size_t const n_numbers = n_left < job->chunk_len ? n_left : job->chunk_len;
+  size_t chunk_len = 0;
+  for (size_t idx = idx_first; idx < idx_first + n_numbers; idx++) {
+    int64_t const number = job->numbers[idx];
+    uint64_t const magnitude =
+      (number < 0) ? (uint64_t)0 - (uint64_t)number : (uint64_t)number;
+    size_t const len = pstr_count_decimal_digits(magnitude) + (number < 0);
+    job->dest_offsets[idx + 1] = len;
+    chunk_len += len;
+  }
+  job->chunk_starts[idx_chunk] = chunk_len;
+}
+
+
+static void pstr_pool_from_int64_write_chunk(void *ctx, size_t const idx_chunk) {
+  pstr_pool_job *job = ctx;
+  size_t const idx_first = idx_chunk * job->chunk_len;
+  size_t const n_left = job->n_items - idx_first;
+  size_t const n_numbers = n_left < job->chunk_len ? n_left : job->chunk_len;
+  size_t dest_len = job->chunk_starts[idx_chunk];
+  for (size_t idx = idx_first; idx < idx_first + n_numbers; idx++) {
+    int64_t const number = job->numbers[idx];
+    uint64_t const magnitude =
+      (number < 0) ? (uint64_t)0 - (uint64_t)number : (uint64_t)number;
+    size_t const len = job->dest_offsets[idx + 1];
+    char *str = job->dest_bytes + dest_len;
+    // If the number isn't negative, its first digit goes over this
+    str[0] = '-';
+    pstr_write_decimal_digits(str + (number < 0), len - (number < 0), magnitude);
+    dest_len += len;
+    job->dest_offsets[idx + 1] = dest_len;
+  }
+}
+
+
+/*
+  Runs a job that makes strings, in two passes: the first measures each chunk's output
+  and the second writes it, so that the output comes out in one piece, in the same
+  order whichever threads do which chunks. Returns false, having only written the
+  lengths to `dest_offsets`, if the output doesn't fit into `dest_size`.
+*/
+static bool pstr_pool_run_writing(
+  pstr_pool *pool, pstr_pool_job *job, size_t const dest_size,
+  void (*measure_fn)(void *ctx, size_t idx_chunk),
+  void (*write_fn)(void *ctx, size_t idx_chunk)
+) {
+  size_t const n_chunks = pstr_pool_job_n_chunks(job);
+  job->dest_offsets[0] = 0;
+  if (n_chunks == 0) {
+    return true;
+  }
+  job->chunk_starts = pool->allocator.resize(
+    pool->allocator.ctx, NULL, 0, n_chunks * sizeof(size_t)
+  );
+  if (!job->chunk_starts) {
+    return false;
+  }
+
+  pstr_pool_run(pool, n_chunks, measure_fn, job);
+  bool const does_fit = pstr_pool_job_place_chunks(job) <= dest_size;
+  if (does_fit) {
+    pstr_pool_run(pool, n_chunks, write_fn, job);
+  }
+
+  pool->allocator.resize(
+    pool->allocator.ctx, job->chunk_starts, n_chunks * sizeof(size_t), 0
+  );
+  return does_fit;
+}
+
+
+/*
+  Stops the pool's threads, of which only the first `n_started` workers have one, and
+  waits for them to finish.
+*/
+static void pstr_pool_stop(pstr_pool *pool, size_t const n_started) {
+  pthread_mutex_lock(&pool->mutex);
+  pool->is_stopping = true;
+  pthread_cond_broadcast(&pool->job_started);
+  pthread_mutex_unlock(&pool->mutex);
+  for (size_t idx_worker = 1; idx_worker < n_started; idx_worker++) {
+    pthread_join(pool->workers[idx_worker].thread, NULL);
+  }
+}
+
+
+static void pstr_pool_destroy(pstr_pool *pool) {
+  for (size_t idx_worker = 0; idx_worker < pool->n_threads; idx_worker++) {
+    pthread_mutex_destroy(&pool->workers[idx_worker].mutex);
+  }
+  pthread_cond_destroy(&pool->job_finished);
+  pthread_cond_destroy(&pool->job_started);
+  pthread_mutex_destroy(&pool->mutex);
+  pool->allocator.resize(
+    pool->allocator.ctx, pool->workers, pool->n_threads * sizeof(pstr_pool_worker), 0
+  );
+  pool->workers = NULL;
+  pool->n_threads = 0;
+}
+
+
+bool pstr_pool_init(pstr_pool *pool, pstr_allocator const allocator, size_t const n_threads) {
+  if (n_threads == 0) {
+    return false;
+  }
+  pstr_pool_worker *workers =
+    allocator.resize(allocator.ctx, NULL, 0, n_threads * sizeof(pstr_pool_worker));
+  if (!workers) {
+    return false;
+  }
+
+  *pool = (pstr_pool){
+    .workers = workers, .n_threads = n_threads, .allocator = allocator,
+  };
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->job_started, NULL);
+  pthread_cond_init(&pool->job_finished, NULL);
+  for (size_t idx_worker = 0; idx_worker < n_threads; idx_worker++) {
+    workers[idx_worker] = (pstr_pool_worker){ .pool = pool, .idx_worker = idx_worker };
+    pthread_mutex_init(&workers[idx_worker].mutex, NULL);
+  }
+
+  // The calling thread is worker 0, so we only start threads for the others. If one
+  // can't be started, we stop the ones that were, and give up.
+  for (size_t idx_worker = 1; idx_worker < n_threads; idx_worker++) {
+    pstr_pool_worker *worker = &workers[idx_worker];
+    if (pthread_create(&worker->thread, NULL, pstr_pool_thread, worker) != 0) {
+      pstr_pool_stop(pool, idx_worker);
+      pstr_pool_destroy(pool);
+      return false;
+    }
+  }
+  return true;
+}
+
+
+void pstr_pool_free(pstr_pool *pool) {
+  pstr_pool_stop(pool, pool->n_threads);
+  pstr_pool_destroy(pool);
+}
+
+
+bool pstr_pool_batch_trim(
+  pstr_pool *pool, pstr_column const *src,
+  char *dest_bytes, size_t const dest_size, size_t *dest_offsets
+) {
+  // With no other threads to share the work, one pass is faster than measuring first,
+  // and gives the same result as long as the batch function knows the output will fit
+  size_t const src_size = src->offsets[src->n_strs] - src->offsets[0];
+  if (pool->n_threads == 1 && dest_size >= src_size) {
+    return pstr_batch_trim(src, dest_bytes, dest_size, dest_offsets);
+  }
+
+  pstr_pool_job job;
+  pstr_pool_job_init_column(&job, src);
+  job.dest_bytes = dest_bytes;
+  job.dest_offsets = dest_offsets;
+  return pstr_pool_run_writing(
+    pool, &job, dest_size, pstr_pool_trim_measure_chunk, pstr_pool_trim_write_chunk
+  );
+}
+
+
+void pstr_pool_batch_eq_sv(
+  pstr_pool *pool, pstr_column const *column, pstr_sv const str, bool *results
+) {
+  pstr_pool_job job;
+  pstr_pool_job_init_column(&job, column);
+  job.str = str;
+  job.results = results;
+  pstr_pool_run(pool, pstr_pool_job_n_chunks(&job), pstr_pool_eq_sv_chunk, &job);
+}
+
+
+void pstr_pool_batch_starts_with(
+  pstr_pool *pool, pstr_column const *column, pstr_sv const prefix, bool *results
+) {
+  pstr_pool_job job;
+  pstr_pool_job_init_column(&job, column);
+  job.str = prefix;
+  job.results = results;
+  pstr_pool_run(pool, pstr_pool_job_n_chunks(&job), pstr_pool_starts_with_chunk, &job);
+}
+
+
+bool pstr_pool_batch_from_int64(
+  pstr_pool *pool, int64_t const *numbers, size_t const n_numbers,
+  char *dest_bytes, size_t const dest_size, size_t *dest_offsets
+) {
+  if (pool->n_threads == 1) {
+    return pstr_batch_from_int64(numbers, n_numbers, dest_bytes, dest_size, dest_offsets);
+  }
+
+  // Each number takes up its own 8 bytes and its offset's, and makes a string of up to
+  // 20 characters
+  pstr_pool_job job;
+  pstr_pool_job_init(&job, n_numbers, sizeof(int64_t) + sizeof(size_t) + 20);
+  job.numbers = numbers;
+  job.dest_bytes = dest_bytes;
+  job.dest_offsets = dest_offsets;
+  return pstr_pool_run_writing(
+    pool, &job, dest_size,
+    pstr_pool_from_int64_measure_chunk, pstr_pool_from_int64_write_chunk
+  );
+}
+
+
+void pstr_pool_batch_is_valid(pstr_pool *pool, pstr_column const *column, bool *results) {
+  pstr_pool_job job;
+  pstr_pool_job_init_column(&job, column);
+  job.results = results;
+  pstr_pool_run(pool, pstr_pool_job_n_chunks(&job), pstr_pool_is_valid_chunk, &job);
+}
+#endif
+
+
+#ifdef PSTR_FILE_LINES
+// How big a buffer files that can't be mapped are read into, to begin with
+#define PSTR_FILE_LINES_BUFFER_SIZE 65536
+
+
+/*
+  Reads more of the file into the buffer, after moving the line we're partway through
+  to the front of it, and growing it if that line already fills it. Only the start of a
+  line is ever moved, and only once per read, so we never copy much.
+*/
+static bool pstr_file_lines_fill(pstr_file_lines *lines) {
+  if (lines->start > 0) {
+    size_t const n_kept = lines->end - lines->start;
+    memmove(lines->data, lines->data + lines->start, n_kept);
+    lines->idx_scanned -= lines->start;
+    lines->end = n_kept;
+    lines->start = 0;
+  }
+
+  if (lines->end == lines->size) {
+    if (lines->size > SIZE_MAX / 2) {
+      lines->did_fail = true;
+      return false;
+    }
+    char *new_data = lines->allocator.resize(
+      lines->allocator.ctx, lines->data, lines->size, lines->size * 2
+    );
+    if (!new_data) {
+      lines->did_fail = true;
+      return false;
+    }
+    lines->data = new_data;
+    lines->size *= 2;
+  }
+
+  ssize_t n_read;
+  do {
+    n_read = read(lines->fd, lines->data + lines->end, lines->size - lines->end);
+  } while (n_read < 0 && errno == EINTR);
+  if (n_read < 0) {
+    lines->did_fail = true;
+    return false;
+  }
+  lines->is_eof = (n_read == 0);
+  lines->end += (size_t)n_read;
+  return true;
+}
+
+
+bool pstr_file_lines_open(
+  pstr_file_lines *lines, pstr_allocator const allocator, char const *path
+) {
+  int const fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  // Files in procfs and sysfs say they're empty, but still have something to read, so we
+  // only map files that say how big they are, and read the rest
+  struct stat file_stat;
+  if (
+    fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && file_stat.st_size > 0 &&
+    (uintmax_t)file_stat.st_size <= SIZE_MAX
+  ) {
+    size_t const size = (size_t)file_stat.st_size;
+    void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      // We only read forwards, so the kernel can read ahead further, and drop pages
+      // we're done with sooner
+      posix_madvise(data, size, POSIX_MADV_SEQUENTIAL);
+      // The whole file is already there, so there's nothing more to read
+      *lines = (pstr_file_lines){
+        .fd = fd, .owns_fd = true, .data = data, .size = size, .end = size,
+        .is_mapped = true, .is_eof = true, .allocator = allocator,
+      };
+      return true;
+    }
+  }
+
+  if (!pstr_file_lines_from_fd(lines, allocator, fd)) {
+    close(fd);
+    return false;
+  }
+  lines->owns_fd = true;
+  return true;
+}
+
+
+bool pstr_file_lines_from_fd(
+  pstr_file_lines *lines, pstr_allocator const allocator, int const fd
+) {
+  char *data = allocator.resize(allocator.ctx, NULL, 0, PSTR_FILE_LINES_BUFFER_SIZE);
+  if (!data) {
+    return false;
+  }
+  *lines = (pstr_file_lines){
+    .fd = fd, .data = data, .size = PSTR_FILE_LINES_BUFFER_SIZE, .allocator = allocator,
+  };
+  return true;
+}
+
+
+bool pstr_file_lines_next(pstr_file_lines *lines, pstr_sv *line) {
+  while (true) {
+    // We remember how far we've looked, so that bytes aren't scanned again after each
+    // read, when a line is longer than what we had
+    if (lines->idx_scanned < lines->end) {
+      size_t const idx_newline = lines->idx_scanned + pstr_find_byte(
+        lines->data + lines->idx_scanned, lines->end - lines->idx_scanned, '\n'
+      );
+      if (idx_newline < lines->end) {
+        *line = pstr_sv_from_n(lines->data + lines->start, idx_newline - lines->start);
+        lines->start = idx_newline + 1;
+        lines->idx_scanned = lines->start;
+        return true;
+      }
+      lines->idx_scanned = lines->end;
+    }
+
+    if (lines->is_eof) {
+      if (lines->start == lines->end) {
+        return false;
+      }
+      *line = pstr_sv_from_n(lines->data + lines->start, lines->end - lines->start);
+      lines->start = lines->end;
+      return true;
+    }
+    if (!pstr_file_lines_fill(lines)) {
+      return false;
+    }
+  }
+}
+
+
+void pstr_file_lines_close(pstr_file_lines *lines) {
+  if (lines->is_mapped) {
+    if (lines->size > 0) {
+      munmap(lines->data, lines->size);
+    }
+  } else {
+    lines->allocator.resize(lines->allocator.ctx, lines->data, lines->size, 0);
+  }
+  if (lines->owns_fd) {
+    close(lines->fd);
+  }
+  lines->data = NULL;
+  lines->size = 0;
+  lines->start = 0;
+  lines->end = 0;
+  lines->idx_scanned = 0;
+}
+#endif
+
+
+void pstr_match_iterator_init(
+  pstr_match_iterator *iterator, pstr_matcher const *matcher, pstr_sv const str
+) {
+  iterator->matcher = matcher;
+  iterator->str = str;
+  iterator->idx = 0;
+  iterator->row = 0;
+  iterator->output_state = 0;
+}
+
+
+static void pstr_matcher_report(
+  pstr_matcher const *matcher, uint32_t const state, size_t const end, pstr_match *match
+) {
+  uint32_t const pattern_idx = matcher->state_patterns[state];
+  match->pattern_idx = pattern_idx;
+  match->len = matcher->pattern_lens[pattern_idx];
+  match->start = end - match->len;
+}
+
+
+bool pstr_match_iterator_next(pstr_match_iterator *iterator, pstr_match *match) {
+  pstr_matcher const *matcher = iterator->matcher;
+
+  // First report any shorter patterns that end where the last match did
+  if (iterator->output_state) {
+    pstr_matcher_report(matcher, iterator->output_state, iterator->idx, match);
+    iterator->output_state = matcher->output_links[iterator->output_state];
+    return true;
+  }
+
+  uint8_t const *str = (uint8_t const *)iterator->str.str;
+  size_t const len = iterator->str.len;
+  uint32_t const *transitions = matcher->transitions;
+  uint16_t const *byte_classes = matcher->byte_classes;
+  uint32_t row = iterator->row;
+  size_t idx = iterator->idx;
+  while (idx < len) {
+    uint32_t const next = transitions[row + byte_classes[str[idx]]];
+    idx++;
+    row = next & ~PSTR_MATCHER_MATCH_FLAG;
+    if (next & PSTR_MATCHER_MATCH_FLAG) {
+      uint32_t state = row / matcher->n_classes;
+      if (matcher->state_patterns[state] == PSTR_MATCHER_NO_PATTERN) {
+        state = matcher->output_links[state];
+      }
+      pstr_matcher_report(matcher, state, idx, match);
+      iterator->output_state = matcher->output_links[state];
+      iterator->row = row;
+      iterator->idx = idx;
+      return true;
+    }
+  }
+  iterator->row = row;
+  iterator->idx = idx;
+  return false;
+}
+
+
+#define PSTR_ARENA_DEFAULT_ALIGNMENT 16
+
+
+static char *pstr_arena_chunk_data(pstr_arena_chunk *chunk) {
+  return (char *)(chunk + 1);
+}
+
+
+/*
+  Returns the offset at which `size` bytes aligned to `alignment` would go in `chunk`,
+  or `SIZE_MAX` if they wouldn't fit.
+*/
+static size_t pstr_arena_chunk_fit(
+  pstr_arena_chunk *chunk, size_t const size, size_t const alignment
+) {
+  uintptr_t const data = (uintptr_t)pstr_arena_chunk_data(chunk);
+  uintptr_t const aligned = (data + chunk->used + alignment - 1) & ~(uintptr_t)(alignment - 1);
+  size_t const offset = (size_t)(aligned - data);
+  if (offset > chunk->size || chunk->size - offset < size) {
+    return SIZE_MAX;
+  }
+  return offset;
+}
+
+
+void pstr_arena_init(pstr_arena *arena, pstr_allocator const backing, size_t const chunk_size) {
+  arena->first_chunk = NULL;
+  arena->current_chunk = NULL;
+  arena->chunk_size = chunk_size;
+  arena->last_alloc = NULL;
+  arena->backing = backing;
+}
+
+
+void pstr_arena_free(pstr_arena *arena) {
+  pstr_arena_chunk *chunk = arena->first_chunk;
+  while (chunk) {
+    pstr_arena_chunk *next = chunk->next;
+    arena->backing.resize(
+      arena->backing.ctx, chunk, sizeof(pstr_arena_chunk) + chunk->size, 0
+    );
+    chunk = next;
+  }
+  arena->first_chunk = NULL;
+  arena->current_chunk = NULL;
+  arena->last_alloc = NULL;
+}
+
+
+void pstr_arena_reset(pstr_arena *arena) {
+  for (pstr_arena_chunk *chunk = arena->first_chunk; chunk; chunk = chunk->next) {
+    chunk->used = 0;
+  }
+  arena->current_chunk = arena->first_chunk;
+  arena->last_alloc = NULL;
+}
+
+
+void *pstr_arena_alloc(pstr_arena *arena, size_t const size, size_t const alignment) {
+  // Move along the chain until something fits. Chunks after the current one are only
+  // there if the arena has been reset, in which case they're empty.
+  pstr_arena_chunk *chunk = arena->current_chunk;
+  pstr_arena_chunk *last_chunk = chunk;
+  while (chunk) {
+    size_t const offset = pstr_arena_chunk_fit(chunk, size, alignment);
+    if (offset != SIZE_MAX) {
+      arena->current_chunk = chunk;
+      chunk->used = offset + size;
+      arena->last_alloc = pstr_arena_chunk_data(chunk) + offset;
+      return arena->last_alloc;
+    }
+    last_chunk = chunk;
+    chunk = chunk->next;
+  }
+
+  // Nothing fits, so we need a new chunk, big enough for this allocation at least. If
+  // that's more than we can ask for, we can't allocate it at all.
+  if (size > SIZE_MAX - sizeof(pstr_arena_chunk) - alignment) {
+    return NULL;
+  }
+  size_t chunk_size = arena->chunk_size;
+  if (chunk_size < size + alignment) {
+    chunk_size = size + alignment;
+  }
+  if (chunk_size > SIZE_MAX - sizeof(pstr_arena_chunk)) {
+    return NULL;
+  }
+  chunk = arena->backing.resize(
+    arena->backing.ctx, NULL, 0, sizeof(pstr_arena_chunk) + chunk_size
+  );
+  if (!chunk) {
+    return NULL;
+  }
+  chunk->next = NULL;
+  chunk->size = chunk_size;
+  chunk->used = 0;
+  size_t const offset = pstr_arena_chunk_fit(chunk, size, alignment);
+  if (offset == SIZE_MAX) {
+    arena->backing.resize(
+      arena->backing.ctx, chunk, sizeof(pstr_arena_chunk) + chunk_size, 0
+    );
+    return NULL;
+  }
+  if (last_chunk) {
+    last_chunk->next = chunk;
+  } else {
+    arena->first_chunk = chunk;
+  }
+
+  arena->current_chunk = chunk;
+  chunk->used = offset + size;
+  arena->last_alloc = pstr_arena_chunk_data(chunk) + offset;
+  return arena->last_alloc;
+}
+
+
+static void *pstr_arena_resize(
+  void *ctx, void *ptr, size_t const old_size, size_t const new_size
+) {
+  pstr_arena *arena = ctx;
+  pstr_arena_chunk *chunk = arena->current_chunk;
+  bool const is_last_alloc = ptr && ptr == arena->last_alloc;
+  size_t const offset = is_last_alloc ?
+    (size_t)((char *)ptr - pstr_arena_chunk_data(chunk)) : 0;
+
+  // Memory is only really freed when the arena is reset, but we can give back the
+  // most recent allocation
+  if (new_size == 0) {
+    if (is_last_alloc) {
+      chunk->used = offset;
+      arena->last_alloc = NULL;
+    }
+    return NULL;
+  }
+
+  // The most recent allocation can grow or shrink in place, if there's room
+  if (is_last_alloc && chunk->size - offset >= new_size) {
+    chunk->used = offset + new_size;
+    return ptr;
+  }
+
+  void *new_ptr = pstr_arena_alloc(arena, new_size, PSTR_ARENA_DEFAULT_ALIGNMENT);
+  if (new_ptr && ptr) {
+    memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+  }
+  return new_ptr;
+}
+
+
+pstr_allocator pstr_arena_allocator(pstr_arena *arena) {
+  pstr_allocator allocator = { .resize = pstr_arena_resize, .ctx = arena };
+  return allocator;
+}
+
+
+char *pstr_arena_dup(pstr_arena *arena, char const *src) {
+  return pstr_arena_dup_sv(arena, pstr_sv_from(src));
+}
+
+
+char *pstr_arena_dup_sv(pstr_arena *arena, pstr_sv const src) {
+  size_t const size = src.len + 1;
+  char *str = pstr_arena_alloc(arena, size, 1);
+  if (!str || !pstr_sv_copy(str, size, src)) {
+    return NULL;
+  }
+  return str;
+}
+
+
+char *pstr_arena_cat(pstr_arena *arena, char const *str1, char const *str2) {
+  pstr_sv const pieces[] = { pstr_sv_from(str1), pstr_sv_from(str2) };
+  return pstr_arena_vcat(arena, pieces, 2);
+}
+
+
+char *pstr_arena_vcat(pstr_arena *arena, pstr_sv const *pieces, size_t const n_pieces) {
+  size_t size = 1;
+  for (size_t idx = 0; idx < n_pieces; idx++) {
+    size += pieces[idx].len;
+  }
+  char *str = pstr_arena_alloc(arena, size, 1);
+  size_t str_len = 0;
+  if (!str || !pstr_sv_vcat(str, size, &str_len, pieces, n_pieces)) {
+    return NULL;
+  }
+  return str;
+}
+
+
+/*
+  Returns the slot where `str` is, or where it would go if it isn't in the pool.
+*/
+static pstr_intern_slot *pstr_intern_find_slot(
+  pstr_intern_slot *slots, size_t const n_slots, pstr_sv const str, uint64_t const hash
+) {
+  size_t idx = hash & (n_slots - 1);
+  while (true) {
+    pstr_intern_slot *slot = &slots[idx];
+    if (!slot->str) {
+      return slot;
+    }
+    if (
+      slot->hash == hash &&
+      pstr_sv_eq(pstr_sv_from_n(slot->str, slot->len), str)
+    ) {
+      return slot;
+    }
+    idx = (idx + 1) & (n_slots - 1);
+  }
+}
+
+
+static bool pstr_intern_pool_grow(pstr_intern_pool *pool) {
+  size_t const new_n_slots = pool->n_slots ? pool->n_slots * 2 : 64;
+  pstr_intern_slot *new_slots = pstr_arena_alloc(
+    pool->arena, new_n_slots * sizeof(pstr_intern_slot), sizeof(void *)
+  );
+  if (!new_slots) {
+    return false;
+  }
+  memset(new_slots, 0, new_n_slots * sizeof(pstr_intern_slot));
+
+  for (size_t idx = 0; idx < pool->n_slots; idx++) {
+    pstr_intern_slot const *slot = &pool->slots[idx];
+    if (slot->str) {
+      *pstr_intern_find_slot(
+        new_slots, new_n_slots, pstr_sv_from_n(slot->str, slot->len), slot->hash
+      ) = *slot;
+    }
+  }
+
+  pool->slots = new_slots;
+  pool->n_slots = new_n_slots;
+  return true;
+}
+
+
+void pstr_intern_pool_init(pstr_intern_pool *pool, pstr_arena *arena) {
+  pool->arena = arena;
+  pool->slots = NULL;
+  pool->n_slots = 0;
+  pool->n_strs = 0;
+}
+
+
+char const *pstr_intern(pstr_intern_pool *pool, char const *str) {
+  return pstr_intern_sv(pool, pstr_sv_from(str));
+}
+
+
+char const *pstr_intern_sv(pstr_intern_pool *pool, pstr_sv const str) {
+  uint64_t const hash = pstr_sv_hash64(str, 0);
+  pstr_intern_slot *slot = NULL;
+  if (pool->n_slots > 0) {
+    slot = pstr_intern_find_slot(pool->slots, pool->n_slots, str, hash);
+    if (slot->str) {
+      return slot->str;
+    }
+  }
+
+  // We're adding a string, so keep the table at most half full. Strings that are already
+  // there are found above, so we never need memory to return them.
+  if ((pool->n_strs + 1) * 2 > pool->n_slots) {
+    if (!pstr_intern_pool_grow(pool)) {
+      return NULL;
+    }
+    slot = pstr_intern_find_slot(pool->slots, pool->n_slots, str, hash);
+  }
+
+  char *interned_str = pstr_arena_dup_sv(pool->arena, str);
+  if (!interned_str) {
+    return NULL;
+  }
+  slot->hash = hash;
+  slot->str = interned_str;
+  slot->len = str.len;
+  pool->n_strs++;
+  return interned_str;
+}
+
+
+// Map
+// Slots are kept in groups of 16, and each has a control byte made from its key's hash,
+// so that a whole group can be checked for a key with one comparison.
+// ------------------------
+
+#define PSTR_MAP_GROUP_SIZE 16
+#define PSTR_MAP_MIN_SLOTS 16
+#define PSTR_MAP_KEY_CHUNK_SIZE 4096
+// Full slots have the low 7 bits of their key's hash as their control byte, so only
+// empty and deleted ones have the top bit set
+#define PSTR_MAP_EMPTY 0x80
+#define PSTR_MAP_DELETED 0xfe
+
+
+/*
+  Returns a mask with a bit set for each of the `PSTR_MAP_GROUP_SIZE` control bytes at
+  `ctrl` that is equal to `target`.
+*/
+static uint32_t pstr_map_match(uint8_t const *ctrl, uint8_t const target) {
+#ifdef PSTR_X86
+  __m128i const group = _mm_loadu_si128((__m128i const *)ctrl);
+  __m128i const pattern = _mm_set1_epi8((char)target);
+  return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, pattern));
+#else
+  uint32_t mask = 0;
+  for (size_t idx = 0; idx < PSTR_MAP_GROUP_SIZE; idx++) {
+    mask |= (uint32_t)(ctrl[idx] == target) << idx;
+  }
+  return mask;
+#endif
+}
+
+
+/*
+  Like `pstr_map_match()`, but matches the control bytes of slots that are empty or
+  deleted.
+*/
+static uint32_t pstr_map_match_free(uint8_t const *ctrl) {
+#ifdef PSTR_X86
+  return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((__m128i const *)ctrl));
+#else
+  uint32_t mask = 0;
+  for (size_t idx = 0; idx < PSTR_MAP_GROUP_SIZE; idx++) {
+    mask |= (uint32_t)(ctrl[idx] >> 7) << idx;
+  }
+  return mask;
+#endif
+}
+
+
+static size_t pstr_map_first_bit(uint32_t const mask) {
+#ifdef __GNUC__
+  return __builtin_ctz(mask);
+#else
+  size_t idx = 0;
+  while (!(mask & (1u << idx))) {
+    idx++;
+  }
+  return idx;
+#endif
+}
+
+
+/*
+  Returns how many bytes a table of `n_slots` slots takes: the entries, then a control
+  byte for each slot, then copies of the first `PSTR_MAP_GROUP_SIZE - 1` control bytes,
+  so that a group starting near the end can be loaded in one go.
+*/
+static size_t pstr_map_table_size(size_t const n_slots) {
+  return n_slots * sizeof(pstr_map_entry) + n_slots + PSTR_MAP_GROUP_SIZE - 1;
+}
+
+
+static void pstr_map_set_ctrl(
+  uint8_t *ctrl, size_t const n_slots, size_t const idx, uint8_t const value
+) {
+  ctrl[idx] = value;
+  if (idx < PSTR_MAP_GROUP_SIZE - 1) {
+    ctrl[n_slots + idx] = value;
+  }
+}
+
+
+/*
+  Returns the first empty or deleted slot that the hash `hash` leads to. Groups are
+  probed at triangular offsets, which visits every group when the number of slots is a
+  power of two, so we always get to a free slot in the end.
+*/
+static size_t pstr_map_find_free(
+  uint8_t const *ctrl, size_t const n_slots, uint64_t const hash
+) {
+  size_t const slot_mask = n_slots - 1;
+  size_t pos = (hash >> 7) & slot_mask;
+  for (size_t step = PSTR_MAP_GROUP_SIZE; ; step += PSTR_MAP_GROUP_SIZE) {
+    uint32_t const mask = pstr_map_match_free(ctrl + pos);
+    if (mask) {
+      return (pos + pstr_map_first_bit(mask)) & slot_mask;
+    }
+    pos = (pos + step) & slot_mask;
+  }
+}
+
+
+/*
+  Looks for `key`, whose hash is `hash`, putting its slot into `slot_idx` and returning
+  true if it's there. Keys are only compared when their control byte matches, and we
+  stop at the first group with an empty slot, which there always is, because the table
+  is never more than 7/8 full.
+*/
+static bool pstr_map_find(
+  pstr_map const *map, pstr_sv const key, uint64_t const hash, size_t *slot_idx
+) {
+  if (map->n_slots == 0) {
+    return false;
+  }
+  size_t const slot_mask = map->n_slots - 1;
+  uint8_t const tag = hash & 0x7f;
+  size_t pos = (hash >> 7) & slot_mask;
+  for (size_t step = PSTR_MAP_GROUP_SIZE; ; step += PSTR_MAP_GROUP_SIZE) {
+    uint8_t const *group = map->ctrl + pos;
+    uint32_t mask = pstr_map_match(group, tag);
+    while (mask) {
+      size_t const idx = (pos + pstr_map_first_bit(mask)) & slot_mask;
+      pstr_map_entry const *entry = &map->entries[idx];
+      if (pstr_sv_eq(pstr_sv_from_n(entry->key, entry->key_len), key)) {
+        *slot_idx = idx;
+        return true;
+      }
+      mask &= mask - 1;
+    }
+    if (pstr_map_match(group, PSTR_MAP_EMPTY)) {
+      return false;
+    }
+    pos = (pos + step) & slot_mask;
+  }
+}
+
+
+/*
+  Moves every entry into a new table with `new_n_slots` slots, which also gets rid of
+  deleted slots. The keys stay where they are in the arena.
+*/
+static bool pstr_map_rehash(pstr_map *map, size_t const new_n_slots) {
+  pstr_allocator const allocator = map->allocator;
+  pstr_map_entry *new_entries = allocator.resize(
+    allocator.ctx, NULL, 0, pstr_map_table_size(new_n_slots)
+  );
+  if (!new_entries) {
+    return false;
+  }
+  uint8_t *new_ctrl = (uint8_t *)(new_entries + new_n_slots);
+  memset(new_ctrl, PSTR_MAP_EMPTY, new_n_slots + PSTR_MAP_GROUP_SIZE - 1);
+
+  for (size_t idx = 0; idx < map->n_slots; idx++) {
+    if (map->ctrl[idx] & 0x80) {
+      continue;
+    }
+    pstr_map_entry const *entry = &map->entries[idx];
+    uint64_t const hash =
+      pstr_sv_hash64(pstr_sv_from_n(entry->key, entry->key_len), map->seed);
+    size_t const new_idx = pstr_map_find_free(new_ctrl, new_n_slots, hash);
+    pstr_map_set_ctrl(new_ctrl, new_n_slots, new_idx, hash & 0x7f);
+    new_entries[new_idx] = *entry;
+  }
+
+  if (map->entries) {
+    allocator.resize(allocator.ctx, map->entries, pstr_map_table_size(map->n_slots), 0);
+  }
+  map->entries = new_entries;
+  map->ctrl = new_ctrl;
+  map->n_slots = new_n_slots;
+  map->n_deleted = 0;
+  return true;
+}
+
+
+void pstr_map_init(pstr_map *map, pstr_allocator const allocator, uint64_t const seed) {
+  map->ctrl = NULL;
+  map->entries = NULL;
+  map->n_slots = 0;
+  map->n_entries = 0;
+  map->n_deleted = 0;
+  map->seed = seed;
+  pstr_arena_init(&map->keys, allocator, PSTR_MAP_KEY_CHUNK_SIZE);
+  map->allocator = allocator;
+}
+
+
+void pstr_map_free(pstr_map *map) {
+  if (map->entries) {
+    map->allocator.resize(
+      map->allocator.ctx, map->entries, pstr_map_table_size(map->n_slots), 0
+    );
+  }
+  pstr_arena_free(&map->keys);
+  map->ctrl = NULL;
+  map->entries = NULL;
+  map->n_slots = 0;
+  map->n_entries = 0;
+  map->n_deleted = 0;
+}
+
+
+void pstr_map_clear(pstr_map *map) {
+  if (map->ctrl) {
+    memset(map->ctrl, PSTR_MAP_EMPTY, map->n_slots + PSTR_MAP_GROUP_SIZE - 1);
+  }
+  pstr_arena_reset(&map->keys);
+  map->n_entries = 0;
+  map->n_deleted = 0;
+}
+
+
+bool pstr_map_insert(pstr_map *map, char const *key, void *value) {
+  return pstr_map_insert_sv(map, pstr_sv_from(key), value);
+}
+
+
+bool pstr_map_insert_sv(pstr_map *map, pstr_sv const key, void *value) {
+  uint64_t const hash = pstr_sv_hash64(key, map->seed);
+  size_t idx;
+  if (pstr_map_find(map, key, hash, &idx)) {
+    map->entries[idx].value = value;
+    return true;
+  }
+
+  // Keep the table at most 7/8 full, counting deleted slots. If it's the deleted slots
+  // that have filled it up, getting rid of them is enough, otherwise it doubles.
+  if ((map->n_entries + map->n_deleted + 1) * 8 > map->n_slots * 7) {
+    size_t new_n_slots = PSTR_MAP_MIN_SLOTS;
+    if (map->n_slots > 0) {
+      new_n_slots = (map->n_entries + 1) * 16 > map->n_slots * 7 ?
+        map->n_slots * 2 : map->n_slots;
+    }
+    if (!pstr_map_rehash(map, new_n_slots)) {
+      return false;
+    }
+  }
+
+  char const *key_copy = pstr_arena_dup_sv(&map->keys, key);
+  if (!key_copy) {
+    return false;
+  }
+  idx = pstr_map_find_free(map->ctrl, map->n_slots, hash);
+  if (map->ctrl[idx] == PSTR_MAP_DELETED) {
+    map->n_deleted--;
+  }
+  pstr_map_set_ctrl(map->ctrl, map->n_slots, idx, hash & 0x7f);
+  map->entries[idx].key = key_copy;
+  map->entries[idx].key_len = key.len;
+  map->entries[idx].value = value;
+  map->n_entries++;
+  return true;
+}
+
+
+bool pstr_map_lookup(pstr_map const *map, char const *key, void **value) {
+  return pstr_map_lookup_sv(map, pstr_sv_from(key), value);
+}
+
+
+bool pstr_map_lookup_sv(pstr_map const *map, pstr_sv const key, void **value) {
+  size_t idx;
+  if (!pstr_map_find(map, key, pstr_sv_hash64(key, map->seed), &idx)) {
+    return false;
+  }
+  if (value) {
+    *value = map->entries[idx].value;
+  }
+  return true;
+}
+
+
+bool pstr_map_delete(pstr_map *map, char const *key) {
+  return pstr_map_delete_sv(map, pstr_sv_from(key));
+}
+
+
+bool pstr_map_delete_sv(pstr_map *map, pstr_sv const key) {
+  size_t idx;
+  if (!pstr_map_find(map, key, pstr_sv_hash64(key, map->seed), &idx)) {
+    return false;
+  }
+  // Mark the slot as deleted rather than empty, so that lookups for keys that were
+  // put after it carry on past it
+  pstr_map_set_ctrl(map->ctrl, map->n_slots, idx, PSTR_MAP_DELETED);
+  map->n_entries--;
+  map->n_deleted++;
+  return true;
+}
+
+
+bool pstr_map_next(pstr_map const *map, size_t *idx, pstr_map_entry const **entry) {
+  while (*idx < map->n_slots) {
+    size_t const slot_idx = (*idx)++;
+    if (!(map->ctrl[slot_idx] & 0x80)) {
+      *entry = &map->entries[slot_idx];
       return true;
     }
   }
@@ -20,298 +5228,692 @@ bool pstr_is_valid(char const *str, size_t const size) {
 }
 
 
-int64_t pstr_len(char const *str) {
-  return strlen(str);
+pstr_sv pstr_sv_from(char const *str) {
+  return pstr_sv_from_n(str, strlen(str));
 }
 
 
-bool pstr_is_empty(char const *str) {
-  return str[0] == '\0';
+pstr_sv pstr_sv_from_n(char const *str, size_t const len) {
+  pstr_sv sv = { .str = str, .len = len };
+  return sv;
 }
 
 
-bool pstr_eq(char const *str1, char const *str2) {
-  return strcmp(str1, str2) == 0;
+bool pstr_sv_is_empty(pstr_sv const sv) {
+  return sv.len == 0;
 }
 
 
-bool pstr_starts_with_char(char const *str, char const character) {
-  return str[0] == character;
+bool pstr_sv_eq(pstr_sv const sv1, pstr_sv const sv2) {
+  return sv1.len == sv2.len && (sv1.str == sv2.str || memcmp(sv1.str, sv2.str, sv1.len) == 0);
 }
 
 
-bool pstr_starts_with(char const *str, char const *prefix) {
-  size_t str_len = pstr_len(str);
-  size_t prefix_len = pstr_len(prefix);
-  if (str_len == 0 || prefix_len == 0) {
+bool pstr_sv_starts_with_char(pstr_sv const sv, char const character) {
+  return sv.len > 0 && sv.str[0] == character;
+}
+
+
+bool pstr_sv_starts_with(pstr_sv const sv, pstr_sv const prefix) {
+  if (sv.len == 0 || prefix.len == 0) {
     return false;
   }
-  if (str_len < prefix_len) {
+  if (sv.len < prefix.len) {
     return false;
   }
-  return memcmp(str, prefix, prefix_len) == 0;
+  return memcmp(sv.str, prefix.str, prefix.len) == 0;
 }
 
 
-bool pstr_ends_with_char(char const *str, char const character) {
-  size_t str_len = pstr_len(str);
-  return str[str_len - 1] == character;
+bool pstr_sv_ends_with_char(pstr_sv const sv, char const character) {
+  return sv.len > 0 && sv.str[sv.len - 1] == character;
 }
 
 
-bool pstr_ends_with(char const *str, char const *prefix) {
-  size_t str_len = pstr_len(str);
-  size_t prefix_len = pstr_len(prefix);
-  if (str_len == 0 || prefix_len == 0) {
+bool pstr_sv_ends_with(pstr_sv const sv, pstr_sv const suffix) {
+  if (sv.len == 0 || suffix.len == 0) {
     return false;
   }
-  if (str_len < prefix_len) {
+  if (sv.len < suffix.len) {
     return false;
   }
-  return memcmp(str + str_len - prefix_len, prefix, prefix_len) == 0;
+  return memcmp(sv.str + sv.len - suffix.len, suffix.str, suffix.len) == 0;
 }
 
 
-bool pstr_copy(char *dest, size_t const dest_size, char const *src) {
-  size_t const src_len = pstr_len(src);
+bool pstr_sv_eq_ci(pstr_sv const sv1, pstr_sv const sv2) {
+  return sv1.len == sv2.len &&
+    (sv1.str == sv2.str || pstr_mismatch_ci(sv1.str, sv2.str, sv1.len) == sv1.len);
+}
 
-  // If there's no room, return false
-  if (dest_size < src_len + 1) {
+
+bool pstr_sv_starts_with_ci(pstr_sv const sv, pstr_sv const prefix) {
+  if (sv.len == 0 || prefix.len == 0 || sv.len < prefix.len) {
     return false;
   }
+  return pstr_mismatch_ci(sv.str, prefix.str, prefix.len) == prefix.len;
+}
 
-  memcpy(dest, src, src_len);
-  dest[src_len] = '\0';
 
-  return true;
+int64_t pstr_sv_starts_with_any(pstr_sv const sv, pstr_prefix_table const *table) {
+  size_t const head_len = sv.len < PSTR_PREFIX_HEAD_LEN ? sv.len : PSTR_PREFIX_HEAD_LEN;
+  return pstr_prefix_table_match(table, sv.str, head_len, sv.len);
 }
 
 
-bool pstr_copy_n(char *dest, size_t const dest_size, char const *src, size_t const n) {
-  size_t const src_len = pstr_len(src);
+bool pstr_sv_ends_with_ci(pstr_sv const sv, pstr_sv const suffix) {
+  if (sv.len == 0 || suffix.len == 0 || sv.len < suffix.len) {
+    return false;
+  }
+  char const *const tail = sv.str + sv.len - suffix.len;
+  return pstr_mismatch_ci(tail, suffix.str, suffix.len) == suffix.len;
+}
+
+
+int pstr_sv_cmp_ci(pstr_sv const sv1, pstr_sv const sv2) {
+  size_t const min_len = sv1.len < sv2.len ? sv1.len : sv2.len;
+  size_t const idx = pstr_mismatch_ci(sv1.str, sv2.str, min_len);
+  if (idx < min_len) {
+    return (unsigned char)pstr_ascii_to_lower(sv1.str[idx]) -
+      (unsigned char)pstr_ascii_to_lower(sv2.str[idx]);
+  }
+  return (sv1.len > sv2.len) - (sv1.len < sv2.len);
+}
+
+
+size_t pstr_sv_span(pstr_sv const sv, pstr_charset const *set) {
+  return pstr_charset_skip(sv.str, sv.len, set, true);
+}
+
 
+size_t pstr_sv_cspan(pstr_sv const sv, pstr_charset const *set) {
+  return pstr_charset_skip(sv.str, sv.len, set, false);
+}
+
+
+int64_t pstr_sv_find(pstr_sv const haystack, pstr_sv const needle) {
+  size_t const idx = pstr_find_sv(haystack, needle);
+  return idx < haystack.len ? (int64_t)idx : -1;
+}
+
+
+int64_t pstr_sv_rfind(pstr_sv const haystack, pstr_sv const needle) {
+  size_t const idx = pstr_rfind_sv(haystack, needle);
+  return idx < haystack.len ? (int64_t)idx : -1;
+}
+
+
+int64_t pstr_sv_find_char(pstr_sv const sv, char const character) {
+  size_t const idx = pstr_find_byte(sv.str, sv.len, character);
+  return idx < sv.len ? (int64_t)idx : -1;
+}
+
+
+size_t pstr_sv_count(pstr_sv const haystack, pstr_sv const needle) {
+  if (needle.len == 0 || needle.len > haystack.len) {
+    return 0;
+  }
+
+  size_t n_occurrences = 0;
+  pstr_search search = pstr_search_init(haystack, needle);
+  pstr_two_way tw;
+  size_t idx = pstr_search_next(&search, &tw, 0);
+  while (idx < haystack.len) {
+    n_occurrences++;
+    idx = pstr_search_next(&search, &tw, idx + needle.len);
+  }
+  return n_occurrences;
+}
+
+
+pstr_sv pstr_sv_slice_from(pstr_sv const sv, size_t const start) {
+  return pstr_sv_slice(sv, start, sv.len);
+}
+
+
+pstr_sv pstr_sv_slice_to(pstr_sv const sv, size_t const end) {
+  return pstr_sv_slice(sv, 0, end);
+}
+
+
+pstr_sv pstr_sv_slice(pstr_sv const sv, size_t const start, size_t const end) {
+  size_t const clamped_end = end < sv.len ? end : sv.len;
+  size_t const clamped_start = start < clamped_end ? start : clamped_end;
+  return pstr_sv_from_n(sv.str + clamped_start, clamped_end - clamped_start);
+}
+
+
+pstr_sv pstr_sv_ltrim(pstr_sv const sv) {
+  return pstr_sv_slice_from(sv, pstr_trim_span(sv.str, sv.len, true, 0));
+}
+
+
+pstr_sv pstr_sv_rtrim(pstr_sv const sv) {
+  return pstr_sv_slice_to(sv, sv.len - pstr_trim_rspan(sv.str, sv.len, true, 0));
+}
+
+
+pstr_sv pstr_sv_trim(pstr_sv const sv) {
+  return pstr_sv_ltrim(pstr_sv_rtrim(sv));
+}
+
+
+pstr_sv pstr_sv_ltrim_char(pstr_sv const sv, char const target) {
+  return pstr_sv_slice_from(sv, pstr_trim_span(sv.str, sv.len, false, target));
+}
+
+
+pstr_sv pstr_sv_rtrim_char(pstr_sv const sv, char const target) {
+  return pstr_sv_slice_to(sv, sv.len - pstr_trim_rspan(sv.str, sv.len, false, target));
+}
+
+
+pstr_sv pstr_sv_trim_char(pstr_sv const sv, char const target) {
+  return pstr_sv_ltrim_char(pstr_sv_rtrim_char(sv, target), target);
+}
+
+
+pstr_sv pstr_sv_ltrim_set(pstr_sv const sv, pstr_charset const *set) {
+  return pstr_sv_slice_from(sv, pstr_charset_skip(sv.str, sv.len, set, true));
+}
+
+
+pstr_sv pstr_sv_rtrim_set(pstr_sv const sv, pstr_charset const *set) {
+  return pstr_sv_slice_to(sv, sv.len - pstr_charset_rskip(sv.str, sv.len, set, true));
+}
+
+
+pstr_sv pstr_sv_trim_set(pstr_sv const sv, pstr_charset const *set) {
+  return pstr_sv_ltrim_set(pstr_sv_rtrim_set(sv, set), set);
+}
+
+
+uint64_t pstr_sv_hash64(pstr_sv const sv, uint64_t const seed) {
+  uint64_t const state = pstr_hash_init(seed);
+  uint64_t lanes[3] = { state, state, state };
+  return pstr_hash_rest(sv.str, sv.len, sv.len, lanes);
+}
+
+
+bool pstr_sv_copy(char *dest, size_t const dest_size, pstr_sv const src) {
   // If there's no room, return false
-  if (src_len < n || dest_size < n + 1) {
+  if (dest_size < src.len + 1) {
     return false;
   }
 
-  memcpy(dest, src, n);
-  dest[n] = '\0';
+  memcpy(dest, src.str, src.len);
+  dest[src.len] = '\0';
 
   return true;
 }
 
 
-bool pstr_cat(char *dest, size_t const dest_size, char const *src) {
-  size_t const src_len = pstr_len(src);
-  size_t const dest_len = pstr_len(dest);
-  size_t const free_size = dest_size - dest_len;
-
+bool pstr_sv_copy_n(char *dest, size_t const dest_size, pstr_sv const src, size_t const n) {
   // If there's no room, return false
-  if (free_size < src_len + 1 || src_len == 0) {
+  if (src.len < n || dest_size < n + 1) {
     return false;
   }
 
-  memcpy(dest + dest_len, src, src_len);
-  dest[dest_len + src_len] = '\0';
+  memcpy(dest, src.str, n);
+  dest[n] = '\0';
 
   return true;
 }
 
 
-bool pstr_vcat(char *dest, size_t const dest_size, ...) {
-  size_t const dest_len = pstr_len(dest);
-  size_t free_size = dest_size - dest_len;
-  char *cursor = dest + dest_len;
+bool pstr_sv_cat(
+  char *dest, size_t const dest_size, size_t *dest_len, pstr_sv const src
+) {
+  size_t const free_size = dest_size - *dest_len;
 
-  va_list args;
-  va_start(args, dest_size);
+  // If there's no room, return false
+  if (free_size < src.len + 1 || src.len == 0) {
+    return false;
+  }
 
-  char const *src;
+  memcpy(dest + *dest_len, src.str, src.len);
+  *dest_len += src.len;
+  dest[*dest_len] = '\0';
 
-  while (true) {
-    src = va_arg(args, char const*);
-    if (!src) {
-      break;
-    }
-    size_t const src_len = pstr_len(src);
+  return true;
+}
 
-    // If there's no room, return false
-    if (free_size < src_len + 1 || src_len == 0) {
-      // Restore our string to what it was before
-      dest[dest_len] = 0;
-      return false;
-    }
 
-    memcpy(cursor, src, src_len);
-    cursor += src_len;
-    free_size -= src_len;
+bool pstr_sv_vcat(
+  char *dest, size_t const dest_size, size_t *dest_len,
+  pstr_sv const *pieces, size_t const n_pieces
+) {
+  size_t total_len = 0;
+  for (size_t idx = 0; idx < n_pieces; idx++) {
+    total_len += pieces[idx].len;
+  }
+
+  // If there's no room, return false
+  if (dest_size - *dest_len < total_len + 1) {
+    return false;
   }
 
+  char *cursor = dest + *dest_len;
+  for (size_t idx = 0; idx < n_pieces; idx++) {
+    memcpy(cursor, pieces[idx].str, pieces[idx].len);
+    cursor += pieces[idx].len;
+  }
   *cursor = '\0';
+  *dest_len += total_len;
 
   return true;
 }
 
 
-bool pstr_split_on_first_occurrence(
-  char const *src,
+bool pstr_sv_split_on_first_occurrence(
+  pstr_sv const src,
   char *part1, size_t const part1_size,
   char *part2, size_t const part2_size,
   char const separator
 ) {
-  size_t const src_len = pstr_len(src);
-
   // Find separator
-  char const *separator_start = strchr(src, separator);
+  char const *separator_start = memchr(src.str, separator, src.len);
   if (!separator_start) {
     return false;
   }
-  size_t idx_separator = separator_start - src;
+  size_t idx_separator = separator_start - src.str;
 
   // Find how much space we need before and after the separator
   size_t const src_len_before_sep = idx_separator;
-  size_t const src_len_after_sep = src_len - idx_separator - 1;
+  size_t const src_len_after_sep = src.len - idx_separator - 1;
 
   // Return if we don't have enough space
   if (part1_size < src_len_before_sep + 1 || part2_size < src_len_after_sep + 1) {
     return false;
   }
 
-  memcpy(part1, src, src_len_before_sep);
+  memcpy(part1, src.str, src_len_before_sep);
+  part1[src_len_before_sep] = '\0';
   memcpy(part2, separator_start + 1, src_len_after_sep);
+  part2[src_len_after_sep] = '\0';
 
   return true;
 }
 
 
-void pstr_clear(char *str) {
-  str[0] = '\0';
-}
-
+bool pstr_sv_replace(
+  char *str, size_t const str_size, size_t *str_len,
+  pstr_sv const needle, pstr_sv const replacement
+) {
+  size_t const idx = pstr_find_sv(pstr_sv_from_n(str, *str_len), needle);
+  if (idx == *str_len) {
+    return false;
+  }
 
-bool pstr_slice_from(char *str, size_t const start) {
-  size_t const str_len = pstr_len(str);
-  if (start >= str_len) {
+  // Return if we don't have enough space
+  size_t const new_len = *str_len - needle.len + replacement.len;
+  if (str_size < new_len + 1) {
     return false;
   }
-  uint32_t idx = 0;
-  char *cursor = &str[start];
-  do {
-    str[idx++] = *cursor;
-    cursor++;
-  } while (*cursor != 0);
-  str[idx++] = 0;
+
+  // Move what comes after the needle, along with the NULL terminator, then fill the gap
+  size_t const idx_after = idx + needle.len;
+  memmove(str + idx + replacement.len, str + idx_after, *str_len - idx_after + 1);
+  memcpy(str + idx, replacement.str, replacement.len);
+  *str_len = new_len;
+
   return true;
 }
 
 
-bool pstr_slice_to(char *str, size_t const end) {
-  size_t const str_len = pstr_len(str);
-  if (end >= str_len) {
-    return false;
+/*
+  Copies `src` into `str`, replacing every occurrence of `needle` after `idx`, and
+  returns the new length. `src` must either start at `str`, with `replacement` no longer
+  than `needle`, or start far enough into the same buffer to make room for everything
+  we add, so that we never write over anything we haven't read yet.
+*/
+static size_t pstr_replace_forwards(
+  char *str, pstr_sv const src, size_t const idx,
+  pstr_sv const needle, pstr_sv const replacement
+) {
+  pstr_search search = pstr_search_init(src, needle);
+  pstr_two_way tw;
+  size_t idx_write = idx;
+  size_t idx_read = idx;
+  size_t idx_found = pstr_search_next(&search, &tw, idx_read);
+  while (idx_found < src.len) {
+    size_t const n_unchanged = idx_found - idx_read;
+    if (str + idx_write != src.str + idx_read) {
+      memmove(str + idx_write, src.str + idx_read, n_unchanged);
+    }
+    idx_write += n_unchanged;
+    memcpy(str + idx_write, replacement.str, replacement.len);
+    idx_write += replacement.len;
+    idx_read = idx_found + needle.len;
+    idx_found = pstr_search_next(&search, &tw, idx_read);
   }
-  str[end] = 0;
-  return true;
+  // Move the rest, along with the NULL terminator
+  size_t const n_rest = src.len - idx_read;
+  memmove(str + idx_write, src.str + idx_read, n_rest + 1);
+  return idx_write + n_rest;
 }
 
 
-bool pstr_slice(char *str, size_t const start, size_t const end) {
-  if (start >= end) {
-    return false;
+bool pstr_sv_replace_all(
+  char *str, size_t const str_size, size_t *str_len,
+  pstr_sv const needle, pstr_sv const replacement
+) {
+  pstr_sv const src = pstr_sv_from_n(str, *str_len);
+  if (needle.len == 0 || needle.len > src.len) {
+    return true;
   }
-  return pstr_slice_to(str, end) && pstr_slice_from(str, start);
-}
 
+  // If the string doesn't grow, it always fits, and we can go from the start, writing
+  // behind where we're reading
+  if (replacement.len <= needle.len) {
+    *str_len = pstr_replace_forwards(str, src, 0, needle, replacement);
+    return true;
+  }
 
-void pstr_ltrim(char *str) {
-  size_t n_spaces = 0;
-  while (isspace(str[n_spaces])) {
-    n_spaces++;
+  // Otherwise, count the occurrences to see if the result fits, keeping track of where
+  // the first few are
+  size_t idxs_found[PSTR_N_TRACKED_REPLACEMENTS];
+  size_t n_found = 0;
+  pstr_search search = pstr_search_init(src, needle);
+  pstr_two_way tw;
+  size_t idx = pstr_search_next(&search, &tw, 0);
+  while (idx < src.len) {
+    if (n_found < PSTR_N_TRACKED_REPLACEMENTS) {
+      idxs_found[n_found] = idx;
+    }
+    n_found++;
+    idx = pstr_search_next(&search, &tw, idx + needle.len);
+  }
+  if (n_found == 0) {
+    return true;
   }
-  pstr_slice_from(str, n_spaces);
-}
 
+  // Return if we don't have enough space
+  size_t const growth = replacement.len - needle.len;
+  if (str_size < *str_len + 1 || growth > (str_size - *str_len - 1) / n_found) {
+    return false;
+  }
+  size_t const new_len = *str_len + growth * n_found;
 
-void pstr_rtrim(char *str) {
-  size_t str_len = pstr_len(str);
-  size_t n_spaces = 0;
-  while (isspace(str[str_len - n_spaces - 1])) {
-    n_spaces++;
+  if (n_found <= PSTR_N_TRACKED_REPLACEMENTS) {
+    // We know where everything goes, so go from the end, writing ahead of where we're
+    // reading, and moving each character once
+    size_t idx_read_end = *str_len + 1;
+    size_t idx_write_end = new_len + 1;
+    for (size_t idx_found = n_found; idx_found-- > 0;) {
+      size_t const idx_after = idxs_found[idx_found] + needle.len;
+      size_t const n_unchanged = idx_read_end - idx_after;
+      idx_write_end -= n_unchanged;
+      memmove(str + idx_write_end, str + idx_after, n_unchanged);
+      idx_write_end -= replacement.len;
+      memcpy(str + idx_write_end, replacement.str, replacement.len);
+      idx_read_end = idxs_found[idx_found];
+    }
+  } else {
+    // There are too many to keep track of, so move everything from the first one on out
+    // of the way, then go from the start
+    size_t const idx_first = idxs_found[0];
+    size_t const total_growth = new_len - *str_len;
+    memmove(str + idx_first + total_growth, str + idx_first, *str_len - idx_first + 1);
+    pstr_replace_forwards(
+      str, pstr_sv_from_n(str + total_growth, *str_len), idx_first, needle, replacement
+    );
   }
-  pstr_slice_to(str, str_len - n_spaces);
+  *str_len = new_len;
+
+  return true;
 }
 
 
-void pstr_trim(char *str) {
-  pstr_ltrim(str);
-  pstr_rtrim(str);
+#ifdef PSTR_LITTLE_ENDIAN
+static bool pstr_swar_is_8_digits(uint64_t const word) {
+  return (word & 0xf0f0f0f0f0f0f0f0ULL) == 0x3030303030303030ULL &&
+    ((word + 0x0606060606060606ULL) & 0xf0f0f0f0f0f0f0f0ULL) == 0x3030303030303030ULL;
 }
 
 
-void pstr_ltrim_char(char *str, char const target) {
-  size_t n_matches = 0;
-  while (str[n_matches] == target) {
-    n_matches++;
+/*
+  Turns 8 ASCII digits, loaded little-endian so the first digit is the lowest byte, into
+  their value, by combining neighbouring digits, then pairs, then quads.
+*/
+static uint64_t pstr_swar_parse_8_digits(uint64_t word) {
+  word -= 0x3030303030303030ULL;
+  word = (word * 10) + (word >> 8);
+  return (
+    ((word & 0x000000ff000000ffULL) * (100 + (1000000ULL << 32))) +
+    (((word >> 16) & 0x000000ff000000ffULL) * (1 + (10000ULL << 32)))
+  ) >> 32;
+}
+#endif
+
+
+/*
+  Reads the digits at the start of `str` into `value`, 8 at a time where possible, and
+  puts how many there were into `n_digits`. Returns false if the value overflows.
+*/
+static bool pstr_parse_decimal_digits(
+  char const *str, size_t const len, uint64_t *value, size_t *n_digits
+) {
+  uint64_t result = 0;
+  size_t idx = 0;
+
+#ifdef PSTR_LITTLE_ENDIAN
+  while (idx + 8 <= len) {
+    uint64_t const word = pstr_swar_load(str + idx);
+    if (!pstr_swar_is_8_digits(word)) {
+      break;
+    }
+    uint64_t const chunk = pstr_swar_parse_8_digits(word);
+    if (result > (UINT64_MAX - chunk) / 100000000) {
+      return false;
+    }
+    result = result * 100000000 + chunk;
+    idx += 8;
+  }
+#endif
+
+  for (; idx < len; idx++) {
+    uint8_t const digit = (uint8_t)(str[idx] - '0');
+    if (digit > 9) {
+      break;
+    }
+    if (result > (UINT64_MAX - digit) / 10) {
+      return false;
+    }
+    result = result * 10 + digit;
   }
-  pstr_slice_from(str, n_matches);
+
+  *value = result;
+  *n_digits = idx;
+  return true;
 }
 
 
-void pstr_rtrim_char(char *str, char const target) {
-  size_t str_len = pstr_len(str);
-  size_t n_matches = 0;
-  while (str[str_len - n_matches - 1] == target) {
-    n_matches++;
+bool pstr_sv_to_uint64(pstr_sv const sv, uint64_t *number, size_t *n_consumed) {
+  uint64_t value;
+  size_t n_digits;
+  if (!pstr_parse_decimal_digits(sv.str, sv.len, &value, &n_digits) || n_digits == 0) {
+    return false;
   }
-  pstr_slice_to(str, str_len - n_matches);
+  *number = value;
+  *n_consumed = n_digits;
+  return true;
 }
 
 
-void pstr_trim_char(char *str, char const target) {
-  pstr_ltrim_char(str, target);
-  pstr_rtrim_char(str, target);
+bool pstr_sv_to_int64(pstr_sv const sv, int64_t *number, size_t *n_consumed) {
+  bool const is_negative = sv.len > 0 && sv.str[0] == '-';
+  size_t const n_sign = is_negative ? 1 : 0;
+  uint64_t magnitude;
+  size_t n_digits;
+
+  if (
+    !pstr_parse_decimal_digits(sv.str + n_sign, sv.len - n_sign, &magnitude, &n_digits) ||
+    n_digits == 0
+  ) {
+    return false;
+  }
+
+  // The negative range is one bigger than the positive range
+  uint64_t const max_magnitude = (uint64_t)INT64_MAX + (is_negative ? 1 : 0);
+  if (magnitude > max_magnitude) {
+    return false;
+  }
+
+  // Negate as unsigned, so that INT64_MIN doesn't overflow
+  *number = is_negative ? (int64_t)((uint64_t)0 - magnitude) : (int64_t)magnitude;
+  *n_consumed = n_sign + n_digits;
+  return true;
 }
 
 
-bool pstr_from_int64(
-  char *str, size_t const str_size, int64_t number, size_t *new_str_len
-) {
-  char *cursor = str;
-  *new_str_len = 0;
-  uint64_t number_abs = (number < 0) ? -number : number;
+static double const pstr_exact_pow10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
 
-  // Make a backwards string, since that's easier to produce
-  do {
-    *cursor++ = '0' + (number_abs % 10);
-    (*new_str_len)++;
+// A double's exact decimal expansion never needs more significant digits than this.
+// Any digits after this many only matter in that they're not all zero.
+#define PSTR_MAX_DOUBLE_DIGITS 768
 
-    // Check that we have space for the string so far, the NULL terminator and a
-    // potential '-' character
-    if (*new_str_len > str_size - 2) {
-      str[0] = 0;
-      return false;
+
+bool pstr_sv_to_double(pstr_sv const sv, double *number, size_t *n_consumed) {
+  char const *str = sv.str;
+  size_t const len = sv.len;
+  size_t idx = 0;
+  bool const is_negative = len > 0 && str[0] == '-';
+  if (is_negative) {
+    idx++;
+  }
+
+  pstr_sv const rest = pstr_sv_from_n(str + idx, len - idx);
+  if (pstr_sv_starts_with(rest, pstr_sv_from("inf"))) {
+    *number = is_negative ? -HUGE_VAL : HUGE_VAL;
+    *n_consumed = idx + 3;
+    return true;
+  }
+  if (!is_negative && pstr_sv_starts_with(rest, pstr_sv_from("nan"))) {
+    *number = NAN;
+    *n_consumed = idx + 3;
+    return true;
+  }
+
+  // Collect the significant digits, without leading zeros, with the
+  // exponent that goes with the last one we keep
+  char digits[PSTR_MAX_DOUBLE_DIGITS + 1];
+  size_t n_digits = 0;
+  size_t n_mantissa_chars = 0;
+  bool has_dropped_nonzero_digits = false;
+  int64_t exponent = 0;
+
+  for (; idx < len && str[idx] >= '0' && str[idx] <= '9'; idx++) {
+    n_mantissa_chars++;
+    if (n_digits == 0 && str[idx] == '0') {
+      continue;
+    }
+    if (n_digits < PSTR_MAX_DOUBLE_DIGITS) {
+      digits[n_digits++] = str[idx];
+    } else {
+      has_dropped_nonzero_digits |= (str[idx] != '0');
+      exponent++;
+    }
+  }
+
+  if (idx < len && str[idx] == '.') {
+    idx++;
+    for (; idx < len && str[idx] >= '0' && str[idx] <= '9'; idx++) {
+      n_mantissa_chars++;
+      if (n_digits == 0 && str[idx] == '0') {
+        exponent--;
+        continue;
+      }
+      if (n_digits < PSTR_MAX_DOUBLE_DIGITS) {
+        digits[n_digits++] = str[idx];
+        exponent--;
+      } else {
+        has_dropped_nonzero_digits |= (str[idx] != '0');
+      }
     }
+  }
 
-    number_abs /= 10;
-  } while(number_abs > 0);
+  if (n_mantissa_chars == 0) {
+    return false;
+  }
 
-  if (number < 0) {
-    *cursor++ = '-';
+  // Read the exponent, if there is one. An 'e' without digits after it isn't part of
+  // the number. Huge exponents are clamped, since they're infinity or zero anyway.
+  if (idx < len && (str[idx] == 'e' || str[idx] == 'E')) {
+    size_t exponent_idx = idx + 1;
+    bool const is_exponent_negative = exponent_idx < len && str[exponent_idx] == '-';
+    if (exponent_idx < len && (str[exponent_idx] == '-' || str[exponent_idx] == '+')) {
+      exponent_idx++;
+    }
+    if (exponent_idx < len && str[exponent_idx] >= '0' && str[exponent_idx] <= '9') {
+      int64_t explicit_exponent = 0;
+      while (exponent_idx < len && str[exponent_idx] >= '0' && str[exponent_idx] <= '9') {
+        if (explicit_exponent < 100000) {
+          explicit_exponent = explicit_exponent * 10 + (str[exponent_idx] - '0');
+        }
+        exponent_idx++;
+      }
+      exponent += is_exponent_negative ? -explicit_exponent : explicit_exponent;
+      idx = exponent_idx;
+    }
   }
 
-  *cursor = '\0';
+  double value;
+
+  // Trailing zeros are just a bigger exponent
+  while (n_digits > 0 && digits[n_digits - 1] == '0' && !has_dropped_nonzero_digits) {
+    n_digits--;
+    exponent++;
+  }
+
+  if (n_digits == 0) {
+    value = 0.0;
+  } else if (
+    n_digits <= 15 && !has_dropped_nonzero_digits && exponent >= -22 && exponent <= 22
+  ) {
+    // Both the digits and the power of ten are exact doubles, so one multiplication or
+    // division gives a correctly rounded result
+    uint64_t mantissa = 0;
+    for (size_t idx_digit = 0; idx_digit < n_digits; idx_digit++) {
+      mantissa = mantissa * 10 + (uint64_t)(digits[idx_digit] - '0');
+    }
+    value = (double)mantissa;
+    if (exponent < 0) {
+      value /= pstr_exact_pow10[-exponent];
+    } else {
+      value *= pstr_exact_pow10[exponent];
+    }
+  } else {
+    // Otherwise, let strtod() do the rounding, but give it a canonical string with no
+    // decimal point, so that the locale doesn't come into it
+    char canonical[PSTR_MAX_DOUBLE_DIGITS + 32];
+    memcpy(canonical, digits, n_digits);
+    size_t canonical_len = n_digits;
+    if (has_dropped_nonzero_digits) {
+      canonical[canonical_len++] = '1';
+      exponent--;
+    }
+    canonical[canonical_len++] = 'e';
+    if (exponent < 0) {
+      canonical[canonical_len++] = '-';
+    }
+    uint64_t const exponent_abs = (uint64_t)(exponent < 0 ? -exponent : exponent);
+    size_t const n_exponent_digits = pstr_count_decimal_digits(exponent_abs);
+    pstr_write_decimal_digits(canonical + canonical_len, n_exponent_digits, exponent_abs);
+    canonical_len += n_exponent_digits;
+    canonical[canonical_len] = '\0';
+    value = strtod(canonical, NULL);
+  }
 
-  // Reverse our string so it's the right way around again
-  char swapped_char;
-  cursor--;
-  while(str < cursor) {
-    swapped_char = *str;
-    *str = *cursor;
-    *cursor = swapped_char;
-    str++;
-    cursor--;
+  // Numbers too big for a double are rejected, like overflowing integers
+  if (value == HUGE_VAL) {
+    return false;
   }
 
+  *number = is_negative ? -value : value;
+  *n_consumed = idx;
   return true;
 }
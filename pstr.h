@@ -1,10 +1,380 @@
 // © 2021 Vlad-Stefan Harbuz <vlad@vladh.net>
 // SPDX-License-Identifier: blessing
 
+#pragma once
+
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 
+// Thread pools need pthreads, so they're only built if `PSTR_POOL` is defined
+#ifdef PSTR_POOL
+#include <pthread.h>
+#endif
+
+
+/*!
+  A view onto a string, made up of a pointer and a length. The characters pointed to
+  are not owned by the view and do not need to be NULL-terminated. Functions that take
+  views never scan for a NULL terminator, so they are useful when you already know how
+  long your strings are.
+*/
+typedef struct {
+  char const *str;
+  size_t len;
+} pstr_sv;
+
+/*!
+  Makes a view of a string literal, without scanning it, e.g. `PSTR_SV("hello")`.
+*/
+#define PSTR_SV(literal) ((pstr_sv){ .str = (literal), .len = sizeof(literal) - 1 })
+
+
+/*!
+  Somewhere that pstr can get memory from. `resize` should return a block of `new_size`
+  bytes that starts with the first `old_size` bytes of `ptr`, much like `realloc()`. `ptr`
+  is NULL for a new block. If the memory can't be had, `resize` should return NULL and
+  leave `ptr` alone. If `new_size` is 0, `ptr` is no longer needed, and `resize` can free
+  it and return NULL. `ctx` is passed through untouched.
+*/
+typedef struct {
+  void *(*resize)(void *ctx, void *ptr, size_t const old_size, size_t const new_size);
+  void *ctx;
+} pstr_allocator;
+
+/*!
+  A string that grows as you add to it, with memory from `allocator`. `str` is always
+  NULL-terminated and `len` is always its length, so you can read both directly.
+*/
+typedef struct {
+  char *str;
+  size_t len;
+  size_t capacity;
+  pstr_allocator allocator;
+} pstr_builder;
+
+
+/*!
+  A string with its storage inline, holding up to `capacity - 1` characters, which keeps
+  track of its own length, so it never has to be rescanned. `str` is always
+  NULL-terminated and `len` is always its length, so you can read both directly.
+  Set one up with `PSTR_SMALL_INIT()`, and pass it to the `pstr_small_*()` functions with
+  `PSTR_SMALL()`:
+
+  ```
+  pstr_small(64) name;
+  PSTR_SMALL_INIT(name);
+  pstr_small_copy(PSTR_SMALL(name), "Magpie");
+  ```
+*/
+#define pstr_small(capacity) struct { size_t size; size_t len; char str[capacity]; }
+
+/*!
+  What the `pstr_small_*()` functions take. Every `pstr_small(capacity)` starts like this,
+  with `size` being its capacity. The compiler is told that this can alias other types,
+  so that it doesn't assume it's a different object from the `pstr_small(capacity)`.
+*/
+#ifdef __GNUC__
+typedef struct __attribute__((__may_alias__)) {
+#else
+typedef struct {
+#endif
+  size_t size;
+  size_t len;
+  char str[];
+} pstr_small_str;
+
+/*!
+  Sets up `small`, a `pstr_small(capacity)`, with an empty string.
+*/
+#define PSTR_SMALL_INIT(small) \
+  ((small).size = sizeof((small).str), (small).len = 0, (small).str[0] = '\0')
+
+/*!
+  Gets a `pstr_small_str *` for `small`, a `pstr_small(capacity)`.
+*/
+#define PSTR_SMALL(small) ((pstr_small_str *)&(small))
+
+
+/*!
+  One block of memory in an arena. Its `size` usable bytes follow straight after it.
+*/
+typedef struct pstr_arena_chunk {
+  struct pstr_arena_chunk *next;
+  size_t size;
+  size_t used;
+} pstr_arena_chunk;
+
+/*!
+  A bump allocator, which hands out memory from a chain of chunks and frees it all at
+  once. Chunks are kept when the arena is reset, so a warmed-up arena doesn't need any
+  more memory from `backing`.
+*/
+typedef struct {
+  pstr_arena_chunk *first_chunk;
+  pstr_arena_chunk *current_chunk;
+  size_t chunk_size;
+  void *last_alloc;
+  pstr_allocator backing;
+} pstr_arena;
+
+typedef struct {
+  uint64_t hash;
+  char const *str;
+  size_t len;
+} pstr_intern_slot;
+
+/*!
+  A set of strings kept in an arena, where equal strings share storage, so that
+  interned strings can be compared by pointer.
+*/
+typedef struct {
+  pstr_arena *arena;
+  pstr_intern_slot *slots;
+  size_t n_slots;
+  size_t n_strs;
+} pstr_intern_pool;
+
+
+/*!
+  One key and its value in a `pstr_map`. `key` is NULL-terminated and `key_len` is its
+  length.
+*/
+typedef struct {
+  char const *key;
+  size_t key_len;
+  void *value;
+} pstr_map_entry;
+
+/*!
+  A hash map from strings to pointers, using open addressing. Each slot has a control
+  byte saying whether it's empty, deleted, or full, in which case it holds 7 bits of the
+  key's hash. Lookups check 16 control bytes at once, and only compare keys whose bits
+  match. Keys are copied into the map's own arena, so nothing is allocated per entry.
+  Use `pstr_map_init()`.
+*/
+typedef struct {
+  uint8_t *ctrl;
+  pstr_map_entry *entries;
+  size_t n_slots;
+  size_t n_entries;
+  size_t n_deleted;
+  uint64_t seed;
+  pstr_arena keys;
+  pstr_allocator allocator;
+} pstr_map;
+
+
+/*!
+  A set of characters, kept as a 256-bit bitmap, so that checking whether a character
+  is in it is one lookup with no branches. The bits are ordered by the low 4 bits of
+  each character, so that 32 characters can be checked at once with vector shuffles:
+  bit `(c >> 4) & 7` of `rows[(c & 15) + (c >= 128 ? 16 : 0)]` is set if the unsigned
+  character `c` is in the set. Make one with `pstr_charset_from()`, or start from one of
+  the `PSTR_CHARSET_*` initializers, which also work for static sets:
+
+  ```
+  static pstr_charset const digits = PSTR_CHARSET_DIGIT;
+  ```
+*/
+typedef struct {
+  uint8_t rows[32];
+} pstr_charset;
+
+/*!
+  Whitespace, as `isspace()` sees it in the "C" locale: ' ', '\t', '\n', '\v', '\f' and
+  '\r'.
+*/
+#define PSTR_CHARSET_SPACE \
+  { .rows = { 0x04, 0, 0, 0, 0, 0, 0, 0, 0, 0x01, 0x01, 0x01, 0x01, 0x01 } }
+
+/*!
+  The digits '0' to '9'.
+*/
+#define PSTR_CHARSET_DIGIT \
+  { .rows = { 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08 } }
+
+/*!
+  The ASCII letters 'A' to 'Z' and 'a' to 'z'.
+*/
+#define PSTR_CHARSET_ALPHA { .rows = { \
+  0xa0, 0xf0, 0xf0, 0xf0, 0xf0, 0xf0, 0xf0, 0xf0, \
+  0xf0, 0xf0, 0xf0, 0x50, 0x50, 0x50, 0x50, 0x50 \
+} }
+
+/*!
+  The ASCII letters and the digits.
+*/
+#define PSTR_CHARSET_ALNUM { .rows = { \
+  0xa8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8, \
+  0xf8, 0xf8, 0xf0, 0x50, 0x50, 0x50, 0x50, 0x50 \
+} }
+
+
+/*!
+  Splits a string into tokens, one at a time, without copying or changing it.
+  Use `pstr_tokenizer_init()` and `pstr_tokenizer_next()`.
+*/
+typedef struct {
+  pstr_sv rest;
+  pstr_sv separator;
+  // If set, the separator is any one of these characters, rather than `separator`
+  pstr_charset const *separators;
+  char quote;
+  bool is_done;
+} pstr_tokenizer;
+
+/*!
+  Splits a stream that arrives in chunks, such as from a socket, into records ending in
+  `separator`. Records that are wholly inside a chunk are given as views into it, and
+  only the end of a chunk, where a record is cut off, is copied into `tail`, which is
+  never longer than `max_record_len`. Use `pstr_splitter_init()`.
+*/
+typedef struct {
+  char separator;
+  size_t max_record_len;
+  pstr_sv chunk;
+  size_t idx_next;
+  // Separators in the 64 characters of `chunk` from `idx_block` that we haven't got to
+  // yet, one bit each, and where the next 64 characters to be looked at start
+  uint64_t block_separators;
+  size_t idx_block;
+  size_t idx_next_block;
+  char *tail;
+  size_t tail_len;
+  size_t tail_size;
+  bool did_fail;
+  pstr_allocator allocator;
+} pstr_splitter;
+
+
+/*!
+  One occurrence of one of a `pstr_matcher`'s patterns: pattern `pattern_idx` was found
+  at `start`, and is `len` characters long.
+*/
+typedef struct {
+  size_t pattern_idx;
+  size_t start;
+  size_t len;
+} pstr_match;
+
+/*!
+  A set of patterns compiled into an Aho-Corasick automaton, which finds all of them in
+  one pass over a string. Each character costs one table lookup however many patterns
+  there are. Use `pstr_matcher_init()`.
+*/
+typedef struct {
+  uint16_t byte_classes[256];
+  size_t n_classes;
+  size_t n_states;
+  size_t n_patterns;
+  uint32_t *transitions;
+  uint32_t *state_patterns;
+  uint32_t *output_links;
+  uint32_t *pattern_lens;
+  pstr_allocator allocator;
+} pstr_matcher;
+
+/*!
+  Goes through the matches of a `pstr_matcher` in a string, one at a time.
+  Use `pstr_match_iterator_init()` and `pstr_match_iterator_next()`.
+*/
+typedef struct {
+  pstr_matcher const *matcher;
+  pstr_sv str;
+  size_t idx;
+  uint32_t row;
+  uint32_t output_state;
+} pstr_match_iterator;
+
+
+/*!
+  One of a `pstr_prefix_table`'s prefixes, with its first 8 characters loaded into
+  `head`, and `head_mask` covering the ones it has.
+*/
+typedef struct {
+  uint64_t head;
+  uint64_t head_mask;
+  char const *str;
+  size_t len;
+  size_t prefix_idx;
+} pstr_prefix;
+
+/*!
+  A set of prefixes compiled for `pstr_starts_with_any()`, which checks a string against
+  all of them at once. Prefixes are kept longest first, grouped by their first
+  character, so only the ones that start with the string's first character are looked
+  at. Use `pstr_prefix_table_init()`.
+*/
+typedef struct {
+  uint32_t first_char_starts[257];
+  pstr_prefix *prefixes;
+  size_t n_prefixes;
+  size_t size;
+  pstr_allocator allocator;
+} pstr_prefix_table;
+
+
+/*!
+  A column of `n_strs` strings packed one after another into `bytes`, without NULL
+  terminators, like Arrow's string layout. String `idx` runs from `offsets[idx]` to
+  `offsets[idx + 1]`, so there are `n_strs + 1` offsets, which never go down.
+*/
+typedef struct {
+  char const *bytes;
+  size_t const *offsets;
+  size_t n_strs;
+} pstr_column;
+
+#ifdef PSTR_POOL
+/*!
+  One of a pool's threads, along with the range of chunks it has left to do.
+*/
+typedef struct pstr_pool_worker pstr_pool_worker;
+
+/*!
+  A pool of threads that the `pstr_pool_batch_*()` functions split their work between.
+  Work is split into chunks of a few strings each, and each thread takes chunks off its
+  own queue, stealing from another thread's queue when its own runs out. The pool must
+  not be moved once it's set up. Use `pstr_pool_init()`.
+*/
+typedef struct {
+  pstr_pool_worker *workers;
+  size_t n_threads;
+  pstr_allocator allocator;
+  pthread_mutex_t mutex;
+  pthread_cond_t job_started;
+  pthread_cond_t job_finished;
+  uint64_t job_generation;
+  size_t n_workers_busy;
+  bool is_stopping;
+  void (*job_fn)(void *ctx, size_t idx_chunk);
+  void *job_ctx;
+} pstr_pool;
+#endif
+
+#ifdef PSTR_FILE_LINES
+/*!
+  Reads a file one line at a time, giving each line as a view. If the file can be
+  mapped into memory, the views point straight into it. Otherwise, such as for pipes,
+  the file is read bit by bit into a buffer, which is reused, and grown if a line
+  doesn't fit. Use `pstr_file_lines_open()` or `pstr_file_lines_from_fd()`.
+*/
+typedef struct {
+  int fd;
+  bool owns_fd;
+  char *data;
+  size_t size;
+  size_t start;
+  size_t end;
+  size_t idx_scanned;
+  bool is_mapped;
+  bool is_eof;
+  bool did_fail;
+  pstr_allocator allocator;
+} pstr_file_lines;
+#endif
+
 
 // Information functions
 // These functions all assume the strings they are passed are valid
@@ -28,7 +398,8 @@ int64_t pstr_len(char const *str);
 bool pstr_is_empty(char const *str);
 
 /*!
-  Returns whether or not `str` and `str2` are equal.
+  Returns whether or not `str` and `str2` are equal. This is a pointer comparison if they
+  are the same pointer, which is always the case for equal interned strings.
 */
 bool pstr_eq(char const *str1, char const *str2);
 
@@ -38,10 +409,20 @@ bool pstr_eq(char const *str1, char const *str2);
 bool pstr_starts_with_char(char const *str, char const character);
 
 /*!
-  Returns whether or not string `str` starts with the string `prefix`.
+  Returns whether or not string `str` starts with the string `prefix`. Only as many
+  characters of `str` as there are in `prefix` are looked at, so this doesn't depend on
+  how long `str` is.
 */
 bool pstr_starts_with(char const *str, char const *prefix);
 
+/*!
+  Returns the index of the longest prefix in `table` that `str` starts with, or -1 if
+  there isn't one. If more than one prefix is that long, the index of the first one is
+  returned. This looks at the first 8 characters of `str` once, and then at the rest of
+  those prefixes that start with the same character and are longer than 8 characters.
+*/
+int64_t pstr_starts_with_any(char const *str, pstr_prefix_table const *table);
+
 /*!
   Returns whether or not string `str` ends with `character`.
   This check will not match the NULL terminator.
@@ -54,6 +435,92 @@ bool pstr_ends_with_char(char const *str, char const character);
 */
 bool pstr_ends_with(char const *str, char const *prefix);
 
+/*!
+  Like `pstr_ends_with_char()`, for when you already know that `str` is `str_len`
+  characters long, so that it doesn't need to be scanned.
+*/
+bool pstr_ends_with_char_len(char const *str, size_t const str_len, char const character);
+
+/*!
+  Like `pstr_ends_with()`, for when you already know that `str` is `str_len` characters
+  long, so that only `suffix` needs to be scanned.
+*/
+bool pstr_ends_with_len(char const *str, size_t const str_len, char const *suffix);
+
+/*!
+  Like `pstr_eq()`, but ignores the case of ASCII letters. No other characters are
+  folded, and the locale is never consulted.
+*/
+bool pstr_eq_ci(char const *str1, char const *str2);
+
+/*!
+  Like `pstr_starts_with()`, but ignores the case of ASCII letters. This also only
+  looks at as many characters of `str` as there are in `prefix`.
+*/
+bool pstr_starts_with_ci(char const *str, char const *prefix);
+
+/*!
+  Like `pstr_ends_with()`, but ignores the case of ASCII letters.
+*/
+bool pstr_ends_with_ci(char const *str, char const *suffix);
+
+/*!
+  Compares `str1` and `str2` like `strcmp()`, but ignoring the case of ASCII letters,
+  which are compared as if they were lower case. Returns a negative number, 0 or a
+  positive number if `str1` sorts before, the same as or after `str2`.
+*/
+int pstr_cmp_ci(char const *str1, char const *str2);
+
+/*!
+  Returns the length of the longest prefix of `str` that is made up only of characters
+  in `set`, like `strspn()`.
+*/
+size_t pstr_span(char const *str, pstr_charset const *set);
+
+/*!
+  Returns the length of the longest prefix of `str` that has none of the characters in
+  `set`, like `strcspn()`.
+*/
+size_t pstr_cspan(char const *str, pstr_charset const *set);
+
+/*!
+  Returns the index of the first occurrence of `needle` in `str`, or -1 if there isn't
+  one. An empty `needle` is never found. This takes time linear in the length of `str`,
+  even for inputs that make `strstr()` slow.
+*/
+int64_t pstr_find(char const *str, char const *needle);
+
+/*!
+  Like `pstr_find()`, but returns the index of the last occurrence of `needle`.
+*/
+int64_t pstr_rfind(char const *str, char const *needle);
+
+/*!
+  Returns the index of the first occurrence of `character` in `str`, or -1 if there
+  isn't one. This check will not match the NULL terminator.
+*/
+int64_t pstr_find_char(char const *str, char const character);
+
+/*!
+  Returns how many times `needle` occurs in `str`, not counting occurrences that overlap
+  one already counted. An empty `needle` never occurs.
+*/
+size_t pstr_count(char const *str, char const *needle);
+
+/*!
+  Returns a 64-bit hash of `str`, for use in hash tables. It is fast rather than
+  cryptographically strong, so use a random `seed` if the strings might be chosen to
+  collide. The same string and seed always give the same hash on the same kind of
+  machine.
+*/
+uint64_t pstr_hash64(char const *str, uint64_t const seed);
+
+/*!
+  Like `pstr_hash64()`, but also puts the length of `str` into `len`, finding both in
+  one pass over the string, rather than one pass for each.
+*/
+uint64_t pstr_len_and_hash(char const *str, uint64_t const seed, size_t *len);
+
 
 // Transformation functions
 // These functions try hard not to make an invalid string
@@ -108,6 +575,29 @@ bool pstr_split_on_first_occurrence(
   char const separator
 );
 
+/*!
+  Replaces the first occurrence of `needle` in `str` with `replacement`, in place.
+  Returns true if it succeeded. Returns false if `needle` was not found, or if there
+  wasn't enough space, in which case `str` is unchanged.
+  `needle` and `replacement` must not point into `str`.
+*/
+bool pstr_replace(
+  char *str, size_t const str_size, char const *needle, char const *replacement
+);
+
+/*!
+  Replaces every occurrence of `needle` in `str` with `replacement`, in place, going
+  from left to right, like `pstr_count()`. Returns true if it succeeded, including if
+  `needle` was not found. Returns false if there wasn't enough space for the result,
+  in which case `str` is unchanged.
+  Occurrences are counted before anything is changed, so whether the result fits is
+  known up front, and the string is then rewritten in place, without another buffer.
+  `needle` and `replacement` must not point into `str`.
+*/
+bool pstr_replace_all(
+  char *str, size_t const str_size, char const *needle, char const *replacement
+);
+
 /*!
   Empties a string by settings its first character to the NULL terminator.
 */
@@ -135,7 +625,8 @@ bool pstr_slice_to(char *str, size_t const end);
 bool pstr_slice(char *str, size_t const start, size_t const end);
 
 /*!
-  Remove whitespace from the beginning of `str`.
+  Remove whitespace from the beginning of `str`. If `str` is made up only of whitespace,
+  it's left unchanged.
 */
 void pstr_ltrim(char *str);
 
@@ -150,7 +641,8 @@ void pstr_rtrim(char *str);
 void pstr_trim(char *str);
 
 /*!
-  Remove instances of `target` from the beginning of `str`.
+  Remove instances of `target` from the beginning of `str`. If `str` is made up only of
+  `target`, it's left unchanged.
 */
 void pstr_ltrim_char(char *str, char const target);
 
@@ -164,17 +656,1100 @@ void pstr_rtrim_char(char *str, char const target);
 */
 void pstr_trim_char(char *str, char const target);
 
+/*!
+  Remove the characters in `set` from the beginning of `str`.
+*/
+void pstr_ltrim_set(char *str, pstr_charset const *set);
+
+/*!
+  Remove the characters in `set` from the end of `str`.
+*/
+void pstr_rtrim_set(char *str, pstr_charset const *set);
+
+/*!
+  Remove the characters in `set` from the beginning and end of `str`.
+*/
+void pstr_trim_set(char *str, pstr_charset const *set);
+
+/*!
+  Turns every ASCII upper case letter in `str` into lower case. Other characters,
+  including any bytes of multibyte UTF-8 characters, are left as they are.
+*/
+void pstr_to_lower(char *str);
+
+/*!
+  Turns every ASCII lower case letter in `str` into upper case, like `pstr_to_lower()`.
+*/
+void pstr_to_upper(char *str);
+
 
 // Creation functions
 // These functions make a string from scratch
 // ------------------------
 
 /*!
-  Puts a string reprensentation of `number` into `str`.
+  Puts a string reprensentation of `number` into `str`, and its length (including any
+  '-' sign) into `new_str_len`.
   Returns true if it succeeds. If the number does not fit into `str` because its
-  length is more than `str_size` characters, this function fails and returns false,
+  length is more than `str_size - 1` characters, this function fails and returns false,
   with `str` being set to an empty string.
+  Any 64-bit number fits into 21 bytes.
 */
 bool pstr_from_int64(
   char *str, size_t const str_size, int64_t number, size_t *new_str_len
 );
+
+/*!
+  Like `pstr_from_int64()`, but for unsigned numbers.
+*/
+bool pstr_from_uint64(
+  char *str, size_t const str_size, uint64_t number, size_t *new_str_len
+);
+
+/*!
+  Like `pstr_from_int64()`, but for 32-bit numbers, which always fit into 12 bytes.
+*/
+bool pstr_from_int32(
+  char *str, size_t const str_size, int32_t number, size_t *new_str_len
+);
+
+/*!
+  Like `pstr_from_uint64()`, but the number is written in lowercase hexadecimal, with no
+  "0x" prefix. Any 64-bit number fits into 17 bytes.
+*/
+bool pstr_from_uint64_hex(
+  char *str, size_t const str_size, uint64_t number, size_t *new_str_len
+);
+
+/*!
+  Puts the shortest string that reads back as exactly `number` into `str`, and its length
+  into `new_str_len`. The output doesn't depend on the locale. Numbers from 1e-6 up to
+  1e21 are written as decimals (e.g. "0.1", "1234.5", "100"), and others in exponential
+  notation (e.g. "1e21", "1.5e-7"). Infinities and NaN are written as "inf", "-inf" and
+  "nan".
+  Returns true if it succeeds. If the string does not fit into `str`, this function
+  fails and returns false, with `str` being set to an empty string.
+  Any double fits into 26 bytes.
+*/
+bool pstr_from_double(
+  char *str, size_t const str_size, double number, size_t *new_str_len
+);
+
+
+// Parsing functions
+// These functions read a value out of a string
+// ------------------------
+
+/*!
+  Reads the decimal number in `str`, which may start with a '-', into `number`, and puts
+  the number of characters read into `n_consumed`.
+  Returns true if it succeeds. If `str` is empty, has anything other than the number in
+  it (including whitespace), or holds a number that doesn't fit into an `int64_t`, this
+  function fails and returns false without changing `number` or `n_consumed`.
+*/
+bool pstr_to_int64(char const *str, int64_t *number, size_t *n_consumed);
+
+/*!
+  Like `pstr_to_int64()`, but for unsigned numbers. A '-' is not allowed.
+*/
+bool pstr_to_uint64(char const *str, uint64_t *number, size_t *n_consumed);
+
+/*!
+  Reads the number in `str` into `number`, rounding correctly, and puts the number of
+  characters read into `n_consumed`. The number can look like "-12", "0.5", "1.5e-7" or
+  "2E+10", or can be one of "inf", "-inf" and "nan". The decimal point is always '.',
+  whatever the locale.
+  Returns false without changing `number` or `n_consumed` if `str` is empty, has
+  anything other than the number in it, or holds a number too big for a double.
+*/
+bool pstr_to_double(char const *str, double *number, size_t *n_consumed);
+
+
+// Builder functions
+// These functions make strings of any length, getting more memory as they need it.
+// As with the other functions, if they can't get enough memory they stop and return
+// false, leaving the string as it was.
+// ------------------------
+
+/*!
+  Returns an allocator that uses `realloc()` and `free()`.
+*/
+pstr_allocator pstr_libc_allocator();
+
+/*!
+  Sets up `builder` with an empty string and room for at least `initial_capacity`
+  characters, taking memory from `allocator`. Returns false if no memory could be had.
+*/
+bool pstr_builder_init(
+  pstr_builder *builder, pstr_allocator const allocator, size_t const initial_capacity
+);
+
+/*!
+  Gives the builder's memory back to its allocator. The builder can't be used after this,
+  unless it is set up again with `pstr_builder_init()`.
+*/
+void pstr_builder_free(pstr_builder *builder);
+
+/*!
+  Makes sure there's room for at least `extra_len` more characters, plus the NULL
+  terminator, so that adding them won't need any more memory. The capacity at least
+  doubles whenever it grows, so adding to a builder takes amortized constant time per
+  character. Returns false if no memory could be had, or if the string would be too
+  long for its length to fit into a `size_t`.
+*/
+bool pstr_builder_reserve(pstr_builder *builder, size_t const extra_len);
+
+/*!
+  Adds `src` onto the end of the builder's string. Returns false, leaving the string as
+  it was, if no memory could be had.
+*/
+bool pstr_builder_append(pstr_builder *builder, char const *src);
+
+/*!
+  Like `pstr_builder_append()`, but takes a view.
+*/
+bool pstr_builder_append_sv(pstr_builder *builder, pstr_sv const src);
+
+/*!
+  Adds `character` onto the end of the builder's string.
+*/
+bool pstr_builder_append_char(pstr_builder *builder, char const character);
+
+/*!
+  Adds the string representation of `number` onto the end of the builder's string,
+  writing it in place with `pstr_from_int64()`.
+*/
+bool pstr_builder_append_int64(pstr_builder *builder, int64_t const number);
+
+/*!
+  Empties the builder's string, keeping its memory around for reuse.
+*/
+void pstr_builder_clear(pstr_builder *builder);
+
+/*!
+  Returns a view of the builder's string. No copy is made, so the view is only good until
+  the builder is next changed.
+*/
+pstr_sv pstr_builder_view(pstr_builder const *builder);
+
+
+// Small string functions
+// These functions work like the ones for NULL-terminated strings, but never rescan the
+// string, because they keep its length up to date. They fail in the same cases, and
+// leave the string and its length in the same state when they do.
+// ------------------------
+
+/*!
+  Like `pstr_copy()`.
+*/
+bool pstr_small_copy(pstr_small_str *small, char const *src);
+
+/*!
+  Like `pstr_copy()`, but takes a view.
+*/
+bool pstr_small_copy_sv(pstr_small_str *small, pstr_sv const src);
+
+/*!
+  Like `pstr_cat()`. This only costs as much as copying `src`, however long `small` is.
+*/
+bool pstr_small_cat(pstr_small_str *small, char const *src);
+
+/*!
+  Like `pstr_cat()`, but takes a view.
+*/
+bool pstr_small_cat_sv(pstr_small_str *small, pstr_sv const src);
+
+/*!
+  Like `pstr_vcat()`. The last string given should be a NULL pointer.
+*/
+bool pstr_small_vcat(pstr_small_str *small, ...);
+
+/*!
+  Like `pstr_ltrim()`.
+*/
+void pstr_small_ltrim(pstr_small_str *small);
+
+/*!
+  Like `pstr_rtrim()`.
+*/
+void pstr_small_rtrim(pstr_small_str *small);
+
+/*!
+  Like `pstr_trim()`.
+*/
+void pstr_small_trim(pstr_small_str *small);
+
+/*!
+  Like `pstr_ltrim_char()`.
+*/
+void pstr_small_ltrim_char(pstr_small_str *small, char const target);
+
+/*!
+  Like `pstr_rtrim_char()`.
+*/
+void pstr_small_rtrim_char(pstr_small_str *small, char const target);
+
+/*!
+  Like `pstr_trim_char()`.
+*/
+void pstr_small_trim_char(pstr_small_str *small, char const target);
+
+/*!
+  Like `pstr_from_int64()`, replacing the string with the number, or emptying it if the
+  number doesn't fit.
+*/
+bool pstr_small_from_int64(pstr_small_str *small, int64_t const number);
+
+/*!
+  Empties the string.
+*/
+void pstr_small_clear(pstr_small_str *small);
+
+/*!
+  Returns a view of the string. No copy is made, so the view is only good until the
+  string is next changed.
+*/
+pstr_sv pstr_small_view(pstr_small_str const *small);
+
+
+// Character set functions
+// These functions make sets of characters for the span, trim and tokenizer functions.
+// ------------------------
+
+/*!
+  Returns a set of the characters in `chars`.
+*/
+pstr_charset pstr_charset_from(char const *chars);
+
+/*!
+  Like `pstr_charset_from()`, but takes a view, so the set can include '\0'.
+*/
+pstr_charset pstr_charset_from_sv(pstr_sv const chars);
+
+/*!
+  Adds `character` to `set`.
+*/
+void pstr_charset_add(pstr_charset *set, char const character);
+
+/*!
+  Adds the characters from `first` to `last`, inclusive, to `set`. Characters are
+  compared as unsigned bytes, so `pstr_charset_add_range(&set, '\x80', '\xff')` adds
+  every byte of every multibyte UTF-8 character.
+*/
+void pstr_charset_add_range(pstr_charset *set, char const first, char const last);
+
+/*!
+  Returns whether or not `character` is in `set`.
+*/
+bool pstr_charset_has(pstr_charset const *set, char const character);
+
+
+// Tokenizer functions
+// These functions split a string into views of its parts, without copying anything.
+// ------------------------
+
+/*!
+  Sets up `tokenizer` to split `src` on every occurrence of `separator`, which can be one
+  or more characters long. `src` must stay around for as long as its tokens are in use.
+*/
+void pstr_tokenizer_init(
+  pstr_tokenizer *tokenizer, pstr_sv const src, pstr_sv const separator
+);
+
+/*!
+  Like `pstr_tokenizer_init()`, but a token that starts with `quote` runs until the next
+  `quote`, even if it has separators in it. The token returned is what's between the
+  quotes. A doubled `quote` inside a quoted token, as in CSV, does not end the token, and
+  is left as it is, since tokens are never copied. If anything other than a separator
+  comes after the closing quote, as in `"ab"cd`, the token runs until the next separator
+  and is returned as it is, quotes and all, so that nothing is lost. A quote that is
+  never closed, as in `"ab,cd`, makes the rest of `src` into one last token, separators
+  and all, which is also returned as it is, starting with the quote.
+*/
+void pstr_tokenizer_init_quoted(
+  pstr_tokenizer *tokenizer, pstr_sv const src, pstr_sv const separator, char const quote
+);
+
+/*!
+  Like `pstr_tokenizer_init()`, but splits `src` on every character that is in
+  `separators`, so splitting "a, b" on " ," gives "a", "" and "b". `separators` must also
+  stay around for as long as the tokenizer is in use.
+*/
+void pstr_tokenizer_init_set(
+  pstr_tokenizer *tokenizer, pstr_sv const src, pstr_charset const *separators
+);
+
+/*!
+  Puts a view of the next token into `token` and returns true, or returns false if there
+  are no tokens left. Tokens can be empty, for example between two separators in a row,
+  so splitting "a,,b" on "," gives "a", "" and "b", and splitting "" gives one empty
+  token.
+
+  ```
+  pstr_tokenizer tokenizer;
+  pstr_sv field;
+  pstr_tokenizer_init(&tokenizer, pstr_sv_from(line), PSTR_SV("\t"));
+  while (pstr_tokenizer_next(&tokenizer, &field)) {
+    // ...
+  }
+  ```
+*/
+bool pstr_tokenizer_next(pstr_tokenizer *tokenizer, pstr_sv *token);
+
+
+// Splitter functions
+// These functions split a stream into records, a chunk at a time, copying only the
+// records that are cut in two by the end of a chunk.
+// ------------------------
+
+/*!
+  Sets up `splitter` to split records on `separator`, keeping up to `max_record_len`
+  characters of a record that is cut off, in memory from `allocator`. No memory is
+  allocated until a record is cut off.
+*/
+void pstr_splitter_init(
+  pstr_splitter *splitter, pstr_allocator const allocator, char const separator,
+  size_t const max_record_len
+);
+
+/*!
+  Gives `splitter` the next chunk of the stream. Its records are then got with
+  `pstr_splitter_next()`, until it returns false, after which the chunk is no longer
+  needed, and its memory can be reused for the next one.
+*/
+void pstr_splitter_feed(pstr_splitter *splitter, pstr_sv const chunk);
+
+/*!
+  Puts the next record from the current chunk into `record`, without its separator, and
+  returns true. If the record began in an earlier chunk, it is put together in the
+  splitter's own memory, and is only valid until the next call. Otherwise, it is a view
+  into the chunk.
+
+  Returns false once there are no whole records left in the chunk, keeping whatever is
+  left of it for when the next chunk comes. Also returns false, and sets `did_fail`, if
+  a record is longer than `max_record_len`, or there isn't enough memory to keep it, in
+  which case the splitter can't be used any more.
+
+  ```
+  pstr_splitter splitter;
+  pstr_sv record;
+  pstr_splitter_init(&splitter, pstr_libc_allocator(), '\n', 4096);
+  while ((n_read = read(socket, buffer, sizeof(buffer))) > 0) {
+    pstr_splitter_feed(&splitter, pstr_sv_from_n(buffer, n_read));
+    while (pstr_splitter_next(&splitter, &record)) {
+      // ...
+    }
+  }
+  if (pstr_splitter_finish(&splitter, &record)) {
+    // The last record, which had no separator after it
+  }
+  pstr_splitter_free(&splitter);
+  ```
+*/
+bool pstr_splitter_next(pstr_splitter *splitter, pstr_sv *record);
+
+/*!
+  Puts whatever is left at the end of the stream, which had no separator after it, into
+  `record`, and returns true, or returns false if there's nothing left. Only call this
+  once `pstr_splitter_next()` has returned false for the last chunk.
+*/
+bool pstr_splitter_finish(pstr_splitter *splitter, pstr_sv *record);
+
+/*!
+  Gives the splitter's memory back to its allocator. No record from the splitter can be
+  used after this.
+*/
+void pstr_splitter_free(pstr_splitter *splitter);
+
+
+// Matcher functions
+// These functions look for many patterns at once, in one pass over a string.
+// ------------------------
+
+/*!
+  Compiles the `n_patterns` strings in `patterns` into `matcher`, taking memory from
+  `allocator`. The patterns are only read while this runs. Empty patterns never match,
+  and if a pattern is given more than once, matches are reported for the first one.
+  Returns false if no memory could be had.
+*/
+bool pstr_matcher_init(
+  pstr_matcher *matcher, pstr_allocator const allocator,
+  char const *const *patterns, size_t const n_patterns
+);
+
+/*!
+  Like `pstr_matcher_init()`, but takes views.
+*/
+bool pstr_matcher_init_sv(
+  pstr_matcher *matcher, pstr_allocator const allocator,
+  pstr_sv const *patterns, size_t const n_patterns
+);
+
+/*!
+  Gives the matcher's memory back to its allocator. The matcher can't be used after this,
+  unless it is set up again with `pstr_matcher_init()`.
+*/
+void pstr_matcher_free(pstr_matcher *matcher);
+
+/*!
+  Looks for the first match of any of the matcher's patterns in `str`, meaning the one
+  that ends first, or the longest of those that end there. If there is one, puts it into
+  `match` and returns true.
+*/
+bool pstr_matcher_find(pstr_matcher const *matcher, char const *str, pstr_match *match);
+
+/*!
+  Like `pstr_matcher_find()`, but takes a view.
+*/
+bool pstr_matcher_find_sv(
+  pstr_matcher const *matcher, pstr_sv const str, pstr_match *match
+);
+
+/*!
+  Sets up `iterator` to go through all matches of `matcher`'s patterns in `str`,
+  including ones that overlap. `matcher` and `str` must stay around while it's in use.
+*/
+void pstr_match_iterator_init(
+  pstr_match_iterator *iterator, pstr_matcher const *matcher, pstr_sv const str
+);
+
+/*!
+  Puts the next match into `match` and returns true, or returns false if there are no
+  matches left. Matches come in the order they end in, and matches that end in the same
+  place come longest first.
+
+  ```
+  char const *keywords[] = {"error", "warning", "fatal"};
+  pstr_matcher matcher;
+  pstr_match_iterator iterator;
+  pstr_match match;
+  pstr_matcher_init(&matcher, pstr_libc_allocator(), keywords, 3);
+  pstr_match_iterator_init(&iterator, &matcher, pstr_sv_from(line));
+  while (pstr_match_iterator_next(&iterator, &match)) {
+    // keywords[match.pattern_idx] is at line + match.start
+  }
+  ```
+*/
+bool pstr_match_iterator_next(pstr_match_iterator *iterator, pstr_match *match);
+
+
+// Prefix table functions
+// These functions check which of many prefixes a string starts with, all at once.
+// ------------------------
+
+/*!
+  Compiles the `n_prefixes` strings in `prefixes` into `table`, taking memory from
+  `allocator`, for use with `pstr_starts_with_any()`. The prefixes are copied, so they
+  are only read while this runs. Empty prefixes never match.
+  Returns false if no memory could be had.
+
+  ```
+  char const *routes[] = {"/", "/api/", "/api/users/", "/static/"};
+  pstr_prefix_table table;
+  pstr_prefix_table_init(&table, pstr_libc_allocator(), routes, 4);
+  pstr_starts_with_any("/api/users/42", &table); // 2
+  ```
+*/
+bool pstr_prefix_table_init(
+  pstr_prefix_table *table, pstr_allocator const allocator,
+  char const *const *prefixes, size_t const n_prefixes
+);
+
+/*!
+  Gives the table's memory back to its allocator. The table can't be used after this,
+  unless it is set up again with `pstr_prefix_table_init()`.
+*/
+void pstr_prefix_table_free(pstr_prefix_table *table);
+
+
+// Batch functions
+// These functions do the same thing to every string in a `pstr_column`, in one call.
+// Functions that make strings write them out as another column, into `dest_bytes` and
+// `dest_offsets`, the latter of which must have room for `n_strs + 1` offsets. The first
+// of these is always 0.
+// ------------------------
+
+/*!
+  Returns a view of string `idx` of `column`.
+*/
+pstr_sv pstr_column_get(pstr_column const *column, size_t const idx);
+
+/*!
+  Removes whitespace from the start and end of every string in `src`, writing the results
+  out as a column. `dest_size` must be at least as big as all of `src`'s strings put
+  together, or nothing is written and false is returned. `dest_bytes` and `dest_offsets`
+  can be the same as `src`'s, to trim a column in place.
+*/
+bool pstr_batch_trim(
+  pstr_column const *src, char *dest_bytes, size_t const dest_size, size_t *dest_offsets
+);
+
+/*!
+  Sets `results[idx]` to whether or not string `idx` of `column1` is equal to string
+  `idx` of `column2`. The columns must have the same number of strings.
+*/
+void pstr_batch_eq(pstr_column const *column1, pstr_column const *column2, bool *results);
+
+/*!
+  Sets `results[idx]` to whether or not string `idx` of `column` is equal to `str`.
+*/
+void pstr_batch_eq_sv(pstr_column const *column, pstr_sv const str, bool *results);
+
+/*!
+  Sets `results[idx]` to whether or not string `idx` of `column` starts with `prefix`.
+  As with `pstr_sv_starts_with()`, an empty string or `prefix` never matches.
+*/
+void pstr_batch_starts_with(
+  pstr_column const *column, pstr_sv const prefix, bool *results
+);
+
+/*!
+  Writes the `n_numbers` numbers in `numbers` out as a column of strings, as with
+  `pstr_from_int64()`. If they don't fit into the `dest_size` bytes of `dest_bytes`,
+  nothing is written there and false is returned. Any `n` numbers fit into `20 * n`
+  bytes.
+*/
+bool pstr_batch_from_int64(
+  int64_t const *numbers, size_t const n_numbers,
+  char *dest_bytes, size_t const dest_size, size_t *dest_offsets
+);
+
+/*!
+  Sets `results[idx]` to whether or not string `idx` of `column` is valid, as with
+  `pstr_is_valid()`, meaning that it has a NULL terminator. This is useful for a column
+  of fixed-size buffers, such as one with offsets `0, 32, 64, ...`. The whole column is
+  scanned once, whatever the size of its strings.
+*/
+void pstr_batch_is_valid(pstr_column const *column, bool *results);
+
+
+#ifdef PSTR_POOL
+// Pool functions
+// These functions do the same thing as the batch functions, but split the work between
+// a pool's threads. Their results are always the same as the batch functions', however
+// many threads there are. They're only available if `PSTR_POOL` is defined, in which
+// case you'll need to build with `-pthread`.
+// ------------------------
+
+/*!
+  Sets up a pool of `n_threads` threads, counting the one that calls the
+  `pstr_pool_batch_*()` functions, which does its share of the work. So, with one
+  thread, no new threads are started. Returns false if `n_threads` is 0, or the pool's
+  memory can't be allocated, or the threads can't be started.
+*/
+bool pstr_pool_init(pstr_pool *pool, pstr_allocator const allocator, size_t const n_threads);
+
+/*!
+  Stops the pool's threads and gives its memory back to its allocator. The pool can't be
+  used after this, unless it is set up again with `pstr_pool_init()`.
+*/
+void pstr_pool_free(pstr_pool *pool);
+
+/*!
+  As with `pstr_batch_trim()`, but false is only returned if the trimmed strings don't
+  fit into `dest_size`, or if the pool can't allocate the little memory it needs to
+  keep track of the chunks. In those cases, nothing is written to `dest_bytes`. Unlike
+  with `pstr_batch_trim()`, `dest_bytes` and `dest_offsets` can't overlap `src`'s.
+*/
+bool pstr_pool_batch_trim(
+  pstr_pool *pool, pstr_column const *src,
+  char *dest_bytes, size_t const dest_size, size_t *dest_offsets
+);
+
+/*!
+  As with `pstr_batch_eq_sv()`.
+*/
+void pstr_pool_batch_eq_sv(
+  pstr_pool *pool, pstr_column const *column, pstr_sv const str, bool *results
+);
+
+/*!
+  As with `pstr_batch_starts_with()`.
+*/
+void pstr_pool_batch_starts_with(
+  pstr_pool *pool, pstr_column const *column, pstr_sv const prefix, bool *results
+);
+
+/*!
+  As with `pstr_batch_from_int64()`, but false is also returned if the pool can't
+  allocate the little memory it needs to keep track of the chunks.
+*/
+bool pstr_pool_batch_from_int64(
+  pstr_pool *pool, int64_t const *numbers, size_t const n_numbers,
+  char *dest_bytes, size_t const dest_size, size_t *dest_offsets
+);
+
+/*!
+  As with `pstr_batch_is_valid()`.
+*/
+void pstr_pool_batch_is_valid(pstr_pool *pool, pstr_column const *column, bool *results);
+#endif
+
+
+#ifdef PSTR_FILE_LINES
+// File line functions
+// These functions read files line by line, without copying lines out one at a time, as
+// `fgets()` does. They need POSIX's `mmap()` and `read()`, so they're only available if
+// `PSTR_FILE_LINES` is defined, and `_POSIX_C_SOURCE` is at least 200112L. Lines end at
+// a "\n", which isn't part of the line, and the last line doesn't need one.
+// ------------------------
+
+/*!
+  Opens the file at `path` for reading line by line. Regular files are mapped into
+  memory, so lines stay valid until the reader is closed. The file must not shrink while
+  it's mapped. Anything else, any file that can't be mapped, and any file that says it's
+  empty, as those in `/proc` do, is read as with `pstr_file_lines_from_fd()`. Returns false if the file can't be opened, or if no
+  buffer could be allocated for it.
+*/
+bool pstr_file_lines_open(
+  pstr_file_lines *lines, pstr_allocator const allocator, char const *path
+);
+
+/*!
+  Sets up a reader for the file descriptor `fd`, such as a pipe or `STDIN_FILENO`, which
+  is read with `read()` into a buffer from `allocator`. Each line is only valid until
+  the next call to `pstr_file_lines_next()`. `fd` is not closed when the reader is.
+  Returns false if no buffer could be allocated.
+*/
+bool pstr_file_lines_from_fd(
+  pstr_file_lines *lines, pstr_allocator const allocator, int const fd
+);
+
+/*!
+  Sets `line` to the next line, and returns true, or returns false if there are no
+  more lines. If reading failed, or a line was too long for the buffer to be grown to
+  fit it, false is returned and `lines->did_fail` is set.
+*/
+bool pstr_file_lines_next(pstr_file_lines *lines, pstr_sv *line);
+
+/*!
+  Unmaps or frees the reader's memory, and closes the file if it was opened with
+  `pstr_file_lines_open()`. No line from the reader can be used after this.
+*/
+void pstr_file_lines_close(pstr_file_lines *lines);
+#endif
+
+
+// Arena functions
+// These functions make strings in an arena, so that they can all be freed at once.
+// ------------------------
+
+/*!
+  Sets up an empty arena, which will get chunks of at least `chunk_size` bytes from
+  `backing` as it needs them. No memory is allocated until it's needed.
+*/
+void pstr_arena_init(pstr_arena *arena, pstr_allocator const backing, size_t const chunk_size);
+
+/*!
+  Gives all of the arena's chunks back to its backing allocator.
+*/
+void pstr_arena_free(pstr_arena *arena);
+
+/*!
+  Frees everything allocated from `arena` at once, but keeps its chunks for reuse.
+  Anything previously allocated from the arena must not be used after this.
+*/
+void pstr_arena_reset(pstr_arena *arena);
+
+/*!
+  Returns `size` bytes from `arena`, aligned to `alignment`, which must be a power of two.
+  Returns NULL if the arena needed a new chunk and couldn't get one.
+*/
+void *pstr_arena_alloc(pstr_arena *arena, size_t const size, size_t const alignment);
+
+/*!
+  Returns an allocator that takes memory from `arena`, for example for a `pstr_builder`.
+  Growing the most recent allocation happens in place when there's room.
+*/
+pstr_allocator pstr_arena_allocator(pstr_arena *arena);
+
+/*!
+  Makes a copy of `src` in `arena`. Returns NULL if there wasn't enough memory.
+*/
+char *pstr_arena_dup(pstr_arena *arena, char const *src);
+
+/*!
+  Like `pstr_arena_dup()`, but takes a view.
+*/
+char *pstr_arena_dup_sv(pstr_arena *arena, pstr_sv const src);
+
+/*!
+  Makes a new string in `arena` from `str1` followed by `str2`. Returns NULL if there
+  wasn't enough memory.
+*/
+char *pstr_arena_cat(pstr_arena *arena, char const *str1, char const *str2);
+
+/*!
+  Makes a new string in `arena` from the `n_pieces` views in `pieces`, one after the
+  other, as `pstr_sv_vcat()` would. Returns NULL if there wasn't enough memory.
+*/
+char *pstr_arena_vcat(pstr_arena *arena, pstr_sv const *pieces, size_t const n_pieces);
+
+/*!
+  Sets up an empty intern pool, which keeps its strings and its table in `arena`.
+*/
+void pstr_intern_pool_init(pstr_intern_pool *pool, pstr_arena *arena);
+
+/*!
+  Returns the pool's copy of `str`, adding one if it isn't there yet. Interning equal
+  strings always returns the same pointer. Returns NULL if there wasn't enough memory.
+  Interned strings live as long as the pool's arena isn't reset.
+*/
+char const *pstr_intern(pstr_intern_pool *pool, char const *str);
+
+/*!
+  Like `pstr_intern()`, but takes a view.
+*/
+char const *pstr_intern_sv(pstr_intern_pool *pool, pstr_sv const str);
+
+
+// Map functions
+// These functions keep values by string key. As with the other functions, if they can't
+// get enough memory they stop and return false, leaving the map as it was.
+// ------------------------
+
+/*!
+  Sets up an empty map, which gets memory from `allocator`, hashing keys with `seed`.
+  No memory is allocated until the first key is added. If your keys could be chosen to
+  collide, such as ones that come from the network, use a random `seed`.
+*/
+void pstr_map_init(pstr_map *map, pstr_allocator const allocator, uint64_t const seed);
+
+/*!
+  Gives all of the map's memory back to its allocator. The map can't be used after this,
+  unless it is set up again with `pstr_map_init()`.
+*/
+void pstr_map_free(pstr_map *map);
+
+/*!
+  Removes every key from the map, keeping its memory around for reuse.
+*/
+void pstr_map_clear(pstr_map *map);
+
+/*!
+  Sets the value for `key` to `value`, adding `key` if it isn't in the map yet, in which
+  case a copy of it is made. Returns false if no memory could be had.
+*/
+bool pstr_map_insert(pstr_map *map, char const *key, void *value);
+
+/*!
+  Like `pstr_map_insert()`, but takes a view.
+*/
+bool pstr_map_insert_sv(pstr_map *map, pstr_sv const key, void *value);
+
+/*!
+  If `key` is in the map, puts its value into `value`, if that isn't NULL, and returns
+  true. Otherwise, returns false.
+*/
+bool pstr_map_lookup(pstr_map const *map, char const *key, void **value);
+
+/*!
+  Like `pstr_map_lookup()`, but takes a view.
+*/
+bool pstr_map_lookup_sv(pstr_map const *map, pstr_sv const key, void **value);
+
+/*!
+  Removes `key` from the map. Returns false if it wasn't there. The memory for the
+  map's copy of `key` is only reused once the map is cleared.
+*/
+bool pstr_map_delete(pstr_map *map, char const *key);
+
+/*!
+  Like `pstr_map_delete()`, but takes a view.
+*/
+bool pstr_map_delete_sv(pstr_map *map, pstr_sv const key);
+
+/*!
+  Goes through the map's entries, in no particular order. Start with `*idx` set to 0,
+  and call this until it returns false. Each call puts the next entry into `entry`.
+  The map must not be changed while going through it.
+
+  ```
+  size_t idx = 0;
+  pstr_map_entry const *entry;
+  while (pstr_map_next(&map, &idx, &entry)) {
+    printf("%s\n", entry->key);
+  }
+  ```
+*/
+bool pstr_map_next(pstr_map const *map, size_t *idx, pstr_map_entry const **entry);
+
+
+// View functions
+// These functions work on views, so they never have to scan for the NULL terminator.
+// The NULL-terminated functions above are implemented in terms of these.
+// ------------------------
+
+/*!
+  Makes a view of the NULL-terminated string `str`. This is the only view function that
+  scans for the NULL terminator.
+*/
+pstr_sv pstr_sv_from(char const *str);
+
+/*!
+  Makes a view of the first `len` characters of `str`.
+*/
+pstr_sv pstr_sv_from_n(char const *str, size_t const len);
+
+/*!
+  Returns whether or not view `sv` has length 0.
+*/
+bool pstr_sv_is_empty(pstr_sv const sv);
+
+/*!
+  Returns whether or not `sv1` and `sv2` are equal.
+*/
+bool pstr_sv_eq(pstr_sv const sv1, pstr_sv const sv2);
+
+/*!
+  Returns whether or not view `sv` starts with `character`.
+*/
+bool pstr_sv_starts_with_char(pstr_sv const sv, char const character);
+
+/*!
+  Returns whether or not view `sv` starts with `prefix`.
+  As with `pstr_starts_with()`, an empty `sv` or `prefix` never matches.
+*/
+bool pstr_sv_starts_with(pstr_sv const sv, pstr_sv const prefix);
+
+/*!
+  Returns whether or not view `sv` ends with `character`.
+  An empty view does not end with any character.
+*/
+bool pstr_sv_ends_with_char(pstr_sv const sv, char const character);
+
+/*!
+  Returns whether or not view `sv` ends with `suffix`.
+  As with `pstr_ends_with()`, an empty `sv` or `suffix` never matches.
+*/
+bool pstr_sv_ends_with(pstr_sv const sv, pstr_sv const suffix);
+
+/*!
+  Like `pstr_eq_ci()`, but takes views.
+*/
+bool pstr_sv_eq_ci(pstr_sv const sv1, pstr_sv const sv2);
+
+/*!
+  Like `pstr_sv_starts_with()`, but ignores the case of ASCII letters.
+*/
+bool pstr_sv_starts_with_ci(pstr_sv const sv, pstr_sv const prefix);
+
+/*!
+  Like `pstr_starts_with_any()`, but takes a view.
+*/
+int64_t pstr_sv_starts_with_any(pstr_sv const sv, pstr_prefix_table const *table);
+
+/*!
+  Like `pstr_sv_ends_with()`, but ignores the case of ASCII letters.
+*/
+bool pstr_sv_ends_with_ci(pstr_sv const sv, pstr_sv const suffix);
+
+/*!
+  Like `pstr_cmp_ci()`, but takes views. A view that is a prefix of the other sorts
+  first.
+*/
+int pstr_sv_cmp_ci(pstr_sv const sv1, pstr_sv const sv2);
+
+/*!
+  Like `pstr_span()`, but takes a view.
+*/
+size_t pstr_sv_span(pstr_sv const sv, pstr_charset const *set);
+
+/*!
+  Like `pstr_cspan()`, but takes a view. '\0' is only special if it's in `set`.
+*/
+size_t pstr_sv_cspan(pstr_sv const sv, pstr_charset const *set);
+
+/*!
+  Like `pstr_find()`, but takes views.
+*/
+int64_t pstr_sv_find(pstr_sv const haystack, pstr_sv const needle);
+
+/*!
+  Like `pstr_rfind()`, but takes views.
+*/
+int64_t pstr_sv_rfind(pstr_sv const haystack, pstr_sv const needle);
+
+/*!
+  Like `pstr_find_char()`, but takes a view.
+*/
+int64_t pstr_sv_find_char(pstr_sv const sv, char const character);
+
+/*!
+  Like `pstr_count()`, but takes views.
+*/
+size_t pstr_sv_count(pstr_sv const haystack, pstr_sv const needle);
+
+/*!
+  Like `pstr_hash64()`, but takes a view.
+*/
+uint64_t pstr_sv_hash64(pstr_sv const sv, uint64_t const seed);
+
+/*!
+  Returns the part of `sv` starting from index `start`. This doesn't copy anything, so
+  it takes the same time however long `sv` is. If `start` is past the end of `sv`, the
+  view is empty.
+*/
+pstr_sv pstr_sv_slice_from(pstr_sv const sv, size_t const start);
+
+/*!
+  Returns the part of `sv` up to, but not including, index `end`. If `end` is past the
+  end of `sv`, the view is all of `sv`.
+*/
+pstr_sv pstr_sv_slice_to(pstr_sv const sv, size_t const end);
+
+/*!
+  Returns the part of `sv` from index `start` up to, but not including, index `end`.
+  If `end` is past the end of `sv`, the view stops at the end of `sv`, and if `start` is
+  not before `end`, the view is empty.
+*/
+pstr_sv pstr_sv_slice(pstr_sv const sv, size_t const start, size_t const end);
+
+/*!
+  Returns `sv` without the whitespace at its beginning.
+*/
+pstr_sv pstr_sv_ltrim(pstr_sv const sv);
+
+/*!
+  Returns `sv` without the whitespace at its end.
+*/
+pstr_sv pstr_sv_rtrim(pstr_sv const sv);
+
+/*!
+  Returns `sv` without the whitespace at its start and end.
+*/
+pstr_sv pstr_sv_trim(pstr_sv const sv);
+
+/*!
+  Returns `sv` without the instances of `target` at its beginning.
+*/
+pstr_sv pstr_sv_ltrim_char(pstr_sv const sv, char const target);
+
+/*!
+  Returns `sv` without the instances of `target` at its end.
+*/
+pstr_sv pstr_sv_rtrim_char(pstr_sv const sv, char const target);
+
+/*!
+  Returns `sv` without the instances of `target` at its beginning and end.
+*/
+pstr_sv pstr_sv_trim_char(pstr_sv const sv, char const target);
+
+/*!
+  Returns `sv` without the characters in `set` at its beginning.
+*/
+pstr_sv pstr_sv_ltrim_set(pstr_sv const sv, pstr_charset const *set);
+
+/*!
+  Returns `sv` without the characters in `set` at its end.
+*/
+pstr_sv pstr_sv_rtrim_set(pstr_sv const sv, pstr_charset const *set);
+
+/*!
+  Returns `sv` without the characters in `set` at its beginning and end.
+*/
+pstr_sv pstr_sv_trim_set(pstr_sv const sv, pstr_charset const *set);
+
+/*!
+  Tries to copy `src` into `dest`, requiring `src.len + 1` bytes in `dest`,
+  to allow for the NULL terminator. If successful, returns true.
+  If it won't fit, it does not copy anything, and returns false.
+*/
+bool pstr_sv_copy(char *dest, size_t const dest_size, pstr_sv const src);
+
+/*!
+  Tries to copy `n` characters from `src` into `dest`, requiring `n + 1` bytes in `dest`.
+  If it won't fit, or `src` is shorter than `n`, it does not copy anything, and returns
+  false.
+*/
+bool pstr_sv_copy_n(char *dest, size_t const dest_size, pstr_sv const src, size_t const n);
+
+/*!
+  Tries to add `src` onto the end of `dest`, whose current length is `*dest_len`.
+  If there is enough space, the copy proceeds, `*dest_len` is updated to the new length
+  and true is returned. If there isn't enough space, or `src` is empty, nothing is copied
+  and false is returned.
+
+  Keeping hold of `dest_len` between calls means `dest` never has to be rescanned:
+
+  ```
+  size_t len = 0;
+  pstr_clear(dest);
+  pstr_sv_cat(dest, dest_size, &len, pstr_sv_from_n("hi ", 3));
+  pstr_sv_cat(dest, dest_size, &len, name_sv);
+  ```
+*/
+bool pstr_sv_cat(
+  char *dest, size_t const dest_size, size_t *dest_len, pstr_sv const src
+);
+
+/*!
+  Tries to add all `n_pieces` views in `pieces` onto the end of `dest`, whose current
+  length is `*dest_len`. The total size is checked once, before anything is copied, so
+  if there isn't enough space, false is returned and `dest` is untouched. Otherwise, the
+  pieces are copied, `*dest_len` is updated and true is returned.
+  Unlike `pstr_vcat()`, no NULL terminator is needed at the end of the list, and empty
+  pieces are allowed. For example:
+
+  ```
+  pstr_sv const pieces[] = { PSTR_SV("HTTP/1.1 "), status, PSTR_SV("\r\n") };
+  pstr_sv_vcat(dest, dest_size, &dest_len, pieces, 3);
+  ```
+*/
+bool pstr_sv_vcat(
+  char *dest, size_t const dest_size, size_t *dest_len,
+  pstr_sv const *pieces, size_t const n_pieces
+);
+
+/*!
+  Finds `separator` in `src`, puts the part before it into `part1`,
+  and the part after it into `part2`. Returns true if it succeeded.
+  Returns false if there wasn't enough space or if the separator was not found,
+  in which case nothing is copied.
+*/
+bool pstr_sv_split_on_first_occurrence(
+  pstr_sv const src,
+  char *part1, size_t const part1_size,
+  char *part2, size_t const part2_size,
+  char const separator
+);
+
+/*!
+  Like `pstr_replace()`, but takes the current length of `str` as `*str_len`, and
+  updates it if successful.
+*/
+bool pstr_sv_replace(
+  char *str, size_t const str_size, size_t *str_len,
+  pstr_sv const needle, pstr_sv const replacement
+);
+
+/*!
+  Like `pstr_replace_all()`, but takes the current length of `str` as `*str_len`, and
+  updates it if successful.
+*/
+bool pstr_sv_replace_all(
+  char *str, size_t const str_size, size_t *str_len,
+  pstr_sv const needle, pstr_sv const replacement
+);
+
+/*!
+  Reads the decimal number at the start of `sv`, which may start with a '-', into
+  `number`, and puts the number of characters read into `n_consumed`.
+  Unlike `pstr_to_int64()`, reading stops at the first character that isn't a digit, so
+  `sv` may be followed by other things. Check `n_consumed == sv.len` if you want the
+  whole view to be a number.
+  Returns false without changing `number` or `n_consumed` if there are no digits, or if
+  the number doesn't fit into an `int64_t`.
+*/
+bool pstr_sv_to_int64(pstr_sv const sv, int64_t *number, size_t *n_consumed);
+
+/*!
+  Like `pstr_sv_to_int64()`, but for unsigned numbers. A '-' is not allowed.
+*/
+bool pstr_sv_to_uint64(pstr_sv const sv, uint64_t *number, size_t *n_consumed);
+
+/*!
+  Like `pstr_to_double()`, but reading stops at the first character that isn't part of
+  the number, as with `pstr_sv_to_int64()`.
+*/
+bool pstr_sv_to_double(pstr_sv const sv, double *number, size_t *n_consumed);
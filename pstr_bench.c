@@ -0,0 +1,2593 @@
+// © 2021 Vlad-Stefan Harbuz <vlad@vladh.net>
+// SPDX-License-Identifier: blessing
+
+// For `clock_gettime()`, `hsearch()` and `strcasecmp()`
+#define _XOPEN_SOURCE 600
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <search.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <strings.h>
+#include <time.h>
+
+#define PSTR_POOL
+#define PSTR_FILE_LINES
+#include "pstr.h"
+
+#include "pstr.c"
+
+
+// Each benchmark is run in batches until at least this much time has passed
+static double const min_bench_seconds = 0.1;
+
+// If set, only benchmarks whose group contains this are run
+static char const *bench_filter = NULL;
+
+// Results are written here, so the compiler can't throw away the work
+static volatile size_t bench_sink = 0;
+
+// A benchmark runs one batch of operations on `ctx`, and returns the number of bytes it
+// processed
+typedef size_t (*bench_fn)(void *ctx);
+
+
+static double get_time() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+
+static uint64_t bench_rand(uint64_t *state) {
+  // xorshift64, so that every run gets the same inputs
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+
+static void print_bench_header() {
+  printf("group,function,len,ops_per_s,bytes_per_s\n");
+}
+
+
+static void run_bench(
+  char const *group, char const *function, size_t const len,
+  size_t const n_ops_per_batch, bench_fn fn, void *ctx
+) {
+  if (bench_filter && !strstr(group, bench_filter)) {
+    return;
+  }
+
+  // Warm up caches and branch predictors
+  fn(ctx);
+
+  size_t n_ops = 0;
+  size_t n_bytes = 0;
+  double const start = get_time();
+  double elapsed;
+  do {
+    n_bytes += fn(ctx);
+    n_ops += n_ops_per_batch;
+    elapsed = get_time() - start;
+  } while (elapsed < min_bench_seconds);
+
+  printf(
+    "%s,%s,%zu,%.0f,%.0f\n",
+    group, function, len, (double)n_ops / elapsed, (double)n_bytes / elapsed
+  );
+}
+
+
+// String functions
+// Each of these is run on strings from 8 B to 1 MiB long, against the nearest libc
+// equivalent.
+// ------------------------
+
+// The pointers are volatile so that the compiler has to redo every operation, rather than
+// noticing that it's always given the same string
+typedef struct {
+  size_t len;
+  size_t n_ops;
+  // `len` random letters, with a NULL terminator
+  char *volatile str;
+  // An equal copy of `str`
+  char *volatile str_copy;
+  // `str` in upper case
+  char *volatile str_upper;
+  // `str` with a run of whitespace a quarter of its length on each side
+  char *volatile padded;
+  // `str` with a run of '-' a quarter of its length on each side
+  char *volatile dashed;
+  // `str` split into 20 tab-separated fields
+  char *volatile fields;
+  // Somewhere to write to, with room for two copies of `str`
+  char *volatile dest;
+  size_t dest_size;
+} str_bench;
+
+
+static size_t bench_pstr_is_valid(void *ctx) {
+  str_bench *bench = ctx;
+  size_t n_valid = 0;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    n_valid += pstr_is_valid(bench->str, bench->len + 1);
+  }
+  bench_sink += n_valid;
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_memchr(void *ctx) {
+  str_bench *bench = ctx;
+  size_t n_valid = 0;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    n_valid += memchr(bench->str, 0, bench->len + 1) != NULL;
+  }
+  bench_sink += n_valid;
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_pstr_len(void *ctx) {
+  str_bench *bench = ctx;
+  size_t total_len = 0;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    total_len += pstr_len(bench->str);
+  }
+  bench_sink += total_len;
+  return total_len;
+}
+
+
+static size_t bench_strlen(void *ctx) {
+  str_bench *bench = ctx;
+  size_t total_len = 0;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    total_len += strlen(bench->str);
+  }
+  bench_sink += total_len;
+  return total_len;
+}
+
+
+static size_t bench_pstr_eq(void *ctx) {
+  str_bench *bench = ctx;
+  size_t n_equal = 0;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    n_equal += pstr_eq(bench->str, bench->str_copy);
+  }
+  bench_sink += n_equal;
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_strcmp(void *ctx) {
+  str_bench *bench = ctx;
+  size_t n_equal = 0;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    n_equal += strcmp(bench->str, bench->str_copy) == 0;
+  }
+  bench_sink += n_equal;
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_pstr_starts_with(void *ctx) {
+  str_bench *bench = ctx;
+  size_t n_matches = 0;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    n_matches += pstr_starts_with(bench->str, "GET ");
+  }
+  bench_sink += n_matches;
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_strncmp(void *ctx) {
+  str_bench *bench = ctx;
+  size_t n_matches = 0;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    n_matches += strncmp(bench->str, "GET ", 4) == 0;
+  }
+  bench_sink += n_matches;
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_pstr_ends_with(void *ctx) {
+  str_bench *bench = ctx;
+  size_t n_matches = 0;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    n_matches += pstr_ends_with(bench->str, "\r\n");
+  }
+  bench_sink += n_matches;
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_strlen_memcmp(void *ctx) {
+  str_bench *bench = ctx;
+  size_t n_matches = 0;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    size_t const len = strlen(bench->str);
+    n_matches += len >= 2 && memcmp(bench->str + len - 2, "\r\n", 2) == 0;
+  }
+  bench_sink += n_matches;
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_pstr_ends_with_char(void *ctx) {
+  str_bench *bench = ctx;
+  size_t n_matches = 0;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    n_matches += pstr_ends_with_char(bench->str, '\n');
+  }
+  bench_sink += n_matches;
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_strlen_last_char(void *ctx) {
+  str_bench *bench = ctx;
+  size_t n_matches = 0;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    size_t const len = strlen(bench->str);
+    n_matches += len > 0 && bench->str[len - 1] == '\n';
+  }
+  bench_sink += n_matches;
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_pstr_eq_ci(void *ctx) {
+  str_bench *bench = ctx;
+  size_t n_equal = 0;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    n_equal += pstr_eq_ci(bench->str, bench->str_upper);
+  }
+  bench_sink += n_equal;
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_strcasecmp(void *ctx) {
+  str_bench *bench = ctx;
+  size_t n_equal = 0;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    n_equal += strcasecmp(bench->str, bench->str_upper) == 0;
+  }
+  bench_sink += n_equal;
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_pstr_hash64(void *ctx) {
+  str_bench *bench = ctx;
+  uint64_t hash = 0;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    hash ^= pstr_hash64(bench->str, idx);
+  }
+  bench_sink += (size_t)hash;
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_pstr_len_and_hash(void *ctx) {
+  str_bench *bench = ctx;
+  uint64_t hash = 0;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    size_t len;
+    hash ^= pstr_len_and_hash(bench->str, idx, &len);
+    hash ^= len;
+  }
+  bench_sink += (size_t)hash;
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_pstr_sv_hash64(void *ctx) {
+  str_bench *bench = ctx;
+  uint64_t hash = 0;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    hash ^= pstr_sv_hash64(pstr_sv_from_n(bench->str, bench->len), idx);
+  }
+  bench_sink += (size_t)hash;
+  return bench->n_ops * bench->len;
+}
+
+
+// libc has no string hash, so compare against FNV-1a, a common choice for hand-rolled
+// ones, over a known length
+static size_t bench_fnv1a(void *ctx) {
+  str_bench *bench = ctx;
+  uint64_t hash = 0;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    char const *str = bench->str;
+    uint64_t str_hash = 0xcbf29ce484222325ULL ^ idx;
+    for (size_t idx_char = 0; idx_char < bench->len; idx_char++) {
+      str_hash ^= (uint8_t)str[idx_char];
+      str_hash *= 0x100000001b3ULL;
+    }
+    hash ^= str_hash;
+  }
+  bench_sink += (size_t)hash;
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_pstr_copy(void *ctx) {
+  str_bench *bench = ctx;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    pstr_copy(bench->dest, bench->dest_size, bench->str);
+  }
+  bench_sink += (size_t)bench->dest[0];
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_strcpy(void *ctx) {
+  str_bench *bench = ctx;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    strcpy(bench->dest, bench->str);
+  }
+  bench_sink += (size_t)bench->dest[0];
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_snprintf_copy(void *ctx) {
+  str_bench *bench = ctx;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    snprintf(bench->dest, bench->dest_size, "%s", bench->str);
+  }
+  bench_sink += (size_t)bench->dest[0];
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_pstr_copy_n(void *ctx) {
+  str_bench *bench = ctx;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    pstr_copy_n(bench->dest, bench->dest_size, bench->str, bench->len / 2);
+  }
+  bench_sink += (size_t)bench->dest[0];
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_strlen_memcpy(void *ctx) {
+  str_bench *bench = ctx;
+  size_t const n = bench->len / 2;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    if (strlen(bench->str) >= n && n < bench->dest_size) {
+      memcpy(bench->dest, bench->str, n);
+      bench->dest[n] = '\0';
+    }
+  }
+  bench_sink += (size_t)bench->dest[0];
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_pstr_cat(void *ctx) {
+  str_bench *bench = ctx;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    bench->dest[0] = '\0';
+    pstr_cat(bench->dest, bench->dest_size, bench->str);
+    pstr_cat(bench->dest, bench->dest_size, bench->str);
+  }
+  bench_sink += (size_t)bench->dest[0];
+  return bench->n_ops * bench->len * 2;
+}
+
+
+static size_t bench_strcat(void *ctx) {
+  str_bench *bench = ctx;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    bench->dest[0] = '\0';
+    strcat(bench->dest, bench->str);
+    strcat(bench->dest, bench->str);
+  }
+  bench_sink += (size_t)bench->dest[0];
+  return bench->n_ops * bench->len * 2;
+}
+
+
+static size_t bench_pstr_vcat(void *ctx) {
+  str_bench *bench = ctx;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    bench->dest[0] = '\0';
+    pstr_vcat(bench->dest, bench->dest_size, bench->str, ", ", bench->str, NULL);
+  }
+  bench_sink += (size_t)bench->dest[0];
+  return bench->n_ops * bench->len * 2;
+}
+
+
+static size_t bench_pstr_sv_vcat(void *ctx) {
+  str_bench *bench = ctx;
+  pstr_sv const str = pstr_sv_from_n(bench->str, bench->len);
+  pstr_sv const pieces[] = { str, PSTR_SV(", "), str };
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    size_t dest_len = 0;
+    pstr_sv_vcat(bench->dest, bench->dest_size, &dest_len, pieces, 3);
+  }
+  bench_sink += (size_t)bench->dest[0];
+  return bench->n_ops * bench->len * 2;
+}
+
+
+static size_t bench_snprintf_vcat(void *ctx) {
+  str_bench *bench = ctx;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    snprintf(bench->dest, bench->dest_size, "%s, %s", bench->str, bench->str);
+  }
+  bench_sink += (size_t)bench->dest[0];
+  return bench->n_ops * bench->len * 2;
+}
+
+
+static size_t bench_pstr_split_on_first_occurrence(void *ctx) {
+  str_bench *bench = ctx;
+  size_t const part_size = bench->dest_size / 2;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    pstr_split_on_first_occurrence(
+      bench->padded, bench->dest, part_size, bench->dest + part_size, part_size, ','
+    );
+  }
+  bench_sink += (size_t)bench->dest[0];
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_strchr_memcpy(void *ctx) {
+  str_bench *bench = ctx;
+  size_t const part_size = bench->dest_size / 2;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    char const *sep = strchr(bench->padded, ',');
+    size_t const len_before_sep = sep - bench->padded;
+    size_t const len_after_sep = strlen(sep + 1);
+    memcpy(bench->dest, bench->padded, len_before_sep);
+    bench->dest[len_before_sep] = '\0';
+    memcpy(bench->dest + part_size, sep + 1, len_after_sep + 1);
+  }
+  bench_sink += (size_t)bench->dest[0];
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_pstr_slice_from(void *ctx) {
+  str_bench *bench = ctx;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    memcpy(bench->dest, bench->str, bench->len + 1);
+    pstr_slice_from(bench->dest, bench->len / 2);
+  }
+  bench_sink += (size_t)bench->dest[0];
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_strlen_memmove(void *ctx) {
+  str_bench *bench = ctx;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    memcpy(bench->dest, bench->str, bench->len + 1);
+    size_t const len = strlen(bench->dest);
+    memmove(bench->dest, bench->dest + bench->len / 2, len - bench->len / 2 + 1);
+  }
+  bench_sink += (size_t)bench->dest[0];
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_pstr_slice(void *ctx) {
+  str_bench *bench = ctx;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    memcpy(bench->dest, bench->str, bench->len + 1);
+    pstr_slice(bench->dest, bench->len / 4, bench->len * 3 / 4);
+  }
+  bench_sink += (size_t)bench->dest[0];
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_strlen_memmove_slice(void *ctx) {
+  str_bench *bench = ctx;
+  size_t const start = bench->len / 4;
+  size_t const end = bench->len * 3 / 4;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    memcpy(bench->dest, bench->str, bench->len + 1);
+    if (start < end && end < strlen(bench->dest)) {
+      memmove(bench->dest, bench->dest + start, end - start);
+      bench->dest[end - start] = '\0';
+    }
+  }
+  bench_sink += (size_t)bench->dest[0];
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_pstr_trim(void *ctx) {
+  str_bench *bench = ctx;
+  size_t const padded_len = strlen(bench->padded);
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    memcpy(bench->dest, bench->padded, padded_len + 1);
+    pstr_trim(bench->dest);
+  }
+  bench_sink += (size_t)bench->dest[0];
+  return bench->n_ops * padded_len;
+}
+
+
+static size_t bench_pstr_ltrim(void *ctx) {
+  str_bench *bench = ctx;
+  size_t const padded_len = strlen(bench->padded);
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    memcpy(bench->dest, bench->padded, padded_len + 1);
+    pstr_ltrim(bench->dest);
+  }
+  bench_sink += (size_t)bench->dest[0];
+  return bench->n_ops * padded_len;
+}
+
+
+static size_t bench_pstr_rtrim(void *ctx) {
+  str_bench *bench = ctx;
+  size_t const padded_len = strlen(bench->padded);
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    memcpy(bench->dest, bench->padded, padded_len + 1);
+    pstr_rtrim(bench->dest);
+  }
+  bench_sink += (size_t)bench->dest[0];
+  return bench->n_ops * padded_len;
+}
+
+
+static size_t bench_pstr_trim_char(void *ctx) {
+  str_bench *bench = ctx;
+  size_t const dashed_len = strlen(bench->dashed);
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    memcpy(bench->dest, bench->dashed, dashed_len + 1);
+    pstr_trim_char(bench->dest, '-');
+  }
+  bench_sink += (size_t)bench->dest[0];
+  return bench->n_ops * dashed_len;
+}
+
+
+static size_t bench_pstr_sv_trim(void *ctx) {
+  str_bench *bench = ctx;
+  size_t const padded_len = strlen(bench->padded);
+  size_t trimmed_len = 0;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    trimmed_len += pstr_sv_trim(pstr_sv_from_n(bench->padded, padded_len)).len;
+  }
+  bench_sink += trimmed_len;
+  return bench->n_ops * padded_len;
+}
+
+
+static size_t bench_pstr_sv_trim_set(void *ctx) {
+  str_bench *bench = ctx;
+  pstr_charset const space = PSTR_CHARSET_SPACE;
+  size_t const padded_len = strlen(bench->padded);
+  size_t trimmed_len = 0;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    trimmed_len += pstr_sv_trim_set(pstr_sv_from_n(bench->padded, padded_len), &space).len;
+  }
+  bench_sink += trimmed_len;
+  return bench->n_ops * padded_len;
+}
+
+
+static size_t bench_pstr_sv_span(void *ctx) {
+  str_bench *bench = ctx;
+  pstr_charset const alpha = PSTR_CHARSET_ALPHA;
+  size_t total_len = 0;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    total_len += pstr_sv_span(pstr_sv_from_n(bench->str, bench->len), &alpha);
+  }
+  bench_sink += total_len;
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_strspn(void *ctx) {
+  str_bench *bench = ctx;
+  size_t total_len = 0;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    total_len += strspn(
+      bench->str, "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+    );
+  }
+  bench_sink += total_len;
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_pstr_sv_cspan(void *ctx) {
+  str_bench *bench = ctx;
+  pstr_charset const separators = pstr_charset_from(" \t\r\n,;");
+  size_t total_len = 0;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    total_len += pstr_sv_cspan(pstr_sv_from_n(bench->str, bench->len), &separators);
+  }
+  bench_sink += total_len;
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_strcspn(void *ctx) {
+  str_bench *bench = ctx;
+  size_t total_len = 0;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    total_len += strcspn(bench->str, " \t\r\n,;");
+  }
+  bench_sink += total_len;
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_pstr_to_lower(void *ctx) {
+  str_bench *bench = ctx;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    memcpy(bench->dest, bench->str_upper, bench->len + 1);
+    pstr_to_lower(bench->dest);
+  }
+  bench_sink += (size_t)bench->dest[0];
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_tolower(void *ctx) {
+  str_bench *bench = ctx;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    memcpy(bench->dest, bench->str_upper, bench->len + 1);
+    for (char *c = bench->dest; *c; c++) {
+      *c = (char)tolower((unsigned char)*c);
+    }
+  }
+  bench_sink += (size_t)bench->dest[0];
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_isspace_trim(void *ctx) {
+  str_bench *bench = ctx;
+  size_t const padded_len = strlen(bench->padded);
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    memcpy(bench->dest, bench->padded, padded_len + 1);
+    // The usual hand-written trim
+    char *start = bench->dest;
+    while (isspace((unsigned char)*start)) {
+      start++;
+    }
+    size_t len = strlen(start);
+    while (len > 0 && isspace((unsigned char)start[len - 1])) {
+      len--;
+    }
+    memmove(bench->dest, start, len);
+    bench->dest[len] = '\0';
+  }
+  bench_sink += (size_t)bench->dest[0];
+  return bench->n_ops * padded_len;
+}
+
+
+static size_t bench_isspace_ltrim(void *ctx) {
+  str_bench *bench = ctx;
+  size_t const padded_len = strlen(bench->padded);
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    memcpy(bench->dest, bench->padded, padded_len + 1);
+    char *start = bench->dest;
+    while (isspace((unsigned char)*start)) {
+      start++;
+    }
+    memmove(bench->dest, start, strlen(start) + 1);
+  }
+  bench_sink += (size_t)bench->dest[0];
+  return bench->n_ops * padded_len;
+}
+
+
+static size_t bench_isspace_rtrim(void *ctx) {
+  str_bench *bench = ctx;
+  size_t const padded_len = strlen(bench->padded);
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    memcpy(bench->dest, bench->padded, padded_len + 1);
+    size_t len = strlen(bench->dest);
+    while (len > 0 && isspace((unsigned char)bench->dest[len - 1])) {
+      len--;
+    }
+    bench->dest[len] = '\0';
+  }
+  bench_sink += (size_t)bench->dest[0];
+  return bench->n_ops * padded_len;
+}
+
+
+static size_t bench_loop_trim_char(void *ctx) {
+  str_bench *bench = ctx;
+  size_t const dashed_len = strlen(bench->dashed);
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    memcpy(bench->dest, bench->dashed, dashed_len + 1);
+    char *start = bench->dest;
+    while (*start == '-') {
+      start++;
+    }
+    size_t len = strlen(start);
+    while (len > 0 && start[len - 1] == '-') {
+      len--;
+    }
+    memmove(bench->dest, start, len);
+    bench->dest[len] = '\0';
+  }
+  bench_sink += (size_t)bench->dest[0];
+  return bench->n_ops * dashed_len;
+}
+
+
+static size_t bench_pstr_replace_all(void *ctx) {
+  str_bench *bench = ctx;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    memcpy(bench->dest, bench->fields, bench->len + 1);
+    pstr_replace_all(bench->dest, bench->dest_size, "\t", ", ");
+  }
+  bench_sink += (size_t)bench->dest[0];
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_strstr_memmove(void *ctx) {
+  str_bench *bench = ctx;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    memcpy(bench->dest, bench->fields, bench->len + 1);
+    char *match = bench->dest;
+    while ((match = strstr(match, "\t"))) {
+      memmove(match + 2, match + 1, strlen(match + 1) + 1);
+      memcpy(match, ", ", 2);
+      match += 2;
+    }
+  }
+  bench_sink += (size_t)bench->dest[0];
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_pstr_tokenizer(void *ctx) {
+  str_bench *bench = ctx;
+  size_t n_fields = 0;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    pstr_tokenizer tokenizer;
+    pstr_sv field;
+    pstr_sv const line = pstr_sv_from_n(bench->fields, bench->len);
+    pstr_tokenizer_init(&tokenizer, line, PSTR_SV("\t"));
+    while (pstr_tokenizer_next(&tokenizer, &field)) {
+      n_fields++;
+    }
+  }
+  bench_sink += n_fields;
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_strchr_tokenize(void *ctx) {
+  str_bench *bench = ctx;
+  size_t n_fields = 0;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    char const *field = bench->fields;
+    while (true) {
+      n_fields++;
+      char const *separator = strchr(field, '\t');
+      if (!separator) {
+        break;
+      }
+      field = separator + 1;
+    }
+  }
+  bench_sink += n_fields;
+  return bench->n_ops * bench->len;
+}
+
+
+static void bench_strs_of_len(size_t const len) {
+  str_bench bench;
+  uint64_t state = 0x9e3779b97f4a7c15ULL;
+
+  bench.len = len;
+  // Do about 1 MiB of work per batch
+  bench.n_ops = len < (1 << 20) ? (1 << 20) / len : 1;
+  bench.str = malloc(len + 1);
+  bench.str_copy = malloc(len + 1);
+  bench.str_upper = malloc(len + 1);
+  bench.padded = malloc(len * 2 + 1);
+  bench.dashed = malloc(len * 2 + 1);
+  bench.fields = malloc(len + 1);
+  bench.dest_size = len * 2 + 16;
+  bench.dest = malloc(bench.dest_size);
+
+  for (size_t idx = 0; idx < len; idx++) {
+    bench.str[idx] = (char)('a' + bench_rand(&state) % 26);
+  }
+  bench.str[len] = '\0';
+  memcpy(bench.str_copy, bench.str, len + 1);
+  for (size_t idx = 0; idx <= len; idx++) {
+    bench.str_upper[idx] = (char)toupper((unsigned char)bench.str[idx]);
+  }
+
+  size_t const padding_len = len / 4;
+  memset(bench.padded, ' ', padding_len);
+  memcpy(bench.padded + padding_len, bench.str, len);
+  memset(bench.padded + padding_len + len, '\t', padding_len);
+  bench.padded[padding_len * 2 + len] = '\0';
+  // Give the splitting benchmark a separator in the middle
+  bench.padded[padding_len + len / 2] = ',';
+
+  memset(bench.dashed, '-', padding_len);
+  memcpy(bench.dashed + padding_len, bench.str, len);
+  memset(bench.dashed + padding_len + len, '-', padding_len);
+  bench.dashed[padding_len * 2 + len] = '\0';
+
+  memcpy(bench.fields, bench.str, len + 1);
+  for (size_t idx = 1; idx < 20; idx++) {
+    bench.fields[idx * len / 20] = '\t';
+  }
+
+  run_bench("is_valid", "pstr_is_valid", len, bench.n_ops, bench_pstr_is_valid, &bench);
+  run_bench("is_valid", "memchr", len, bench.n_ops, bench_memchr, &bench);
+  run_bench("len", "pstr_len", len, bench.n_ops, bench_pstr_len, &bench);
+  run_bench("len", "strlen", len, bench.n_ops, bench_strlen, &bench);
+  run_bench("eq", "pstr_eq", len, bench.n_ops, bench_pstr_eq, &bench);
+  run_bench("eq", "strcmp", len, bench.n_ops, bench_strcmp, &bench);
+  run_bench(
+    "starts_with", "pstr_starts_with", len, bench.n_ops, bench_pstr_starts_with, &bench
+  );
+  run_bench("starts_with", "strncmp", len, bench.n_ops, bench_strncmp, &bench);
+  run_bench("ends_with", "pstr_ends_with", len, bench.n_ops, bench_pstr_ends_with, &bench);
+  run_bench("ends_with", "strlen+memcmp", len, bench.n_ops, bench_strlen_memcmp, &bench);
+  run_bench(
+    "ends_with_char", "pstr_ends_with_char", len, bench.n_ops, bench_pstr_ends_with_char,
+    &bench
+  );
+  run_bench("ends_with_char", "strlen", len, bench.n_ops, bench_strlen_last_char, &bench);
+  run_bench("eq_ci", "pstr_eq_ci", len, bench.n_ops, bench_pstr_eq_ci, &bench);
+  run_bench("eq_ci", "strcasecmp", len, bench.n_ops, bench_strcasecmp, &bench);
+  run_bench("hash", "pstr_hash64", len, bench.n_ops, bench_pstr_hash64, &bench);
+  run_bench("hash", "pstr_len_and_hash", len, bench.n_ops, bench_pstr_len_and_hash, &bench);
+  run_bench("hash", "pstr_sv_hash64", len, bench.n_ops, bench_pstr_sv_hash64, &bench);
+  run_bench("hash", "fnv1a", len, bench.n_ops, bench_fnv1a, &bench);
+  run_bench("copy", "pstr_copy", len, bench.n_ops, bench_pstr_copy, &bench);
+  run_bench("copy", "strcpy", len, bench.n_ops, bench_strcpy, &bench);
+  run_bench("copy", "snprintf", len, bench.n_ops, bench_snprintf_copy, &bench);
+  run_bench("copy_n", "pstr_copy_n", len, bench.n_ops, bench_pstr_copy_n, &bench);
+  run_bench("copy_n", "strlen+memcpy", len, bench.n_ops, bench_strlen_memcpy, &bench);
+  run_bench("cat", "pstr_cat", len, bench.n_ops, bench_pstr_cat, &bench);
+  run_bench("cat", "strcat", len, bench.n_ops, bench_strcat, &bench);
+  run_bench("vcat", "pstr_vcat", len, bench.n_ops, bench_pstr_vcat, &bench);
+  run_bench("vcat", "pstr_sv_vcat", len, bench.n_ops, bench_pstr_sv_vcat, &bench);
+  run_bench("vcat", "snprintf", len, bench.n_ops, bench_snprintf_vcat, &bench);
+  run_bench(
+    "split", "pstr_split_on_first_occurrence", len, bench.n_ops,
+    bench_pstr_split_on_first_occurrence, &bench
+  );
+  run_bench("split", "strchr+memcpy", len, bench.n_ops, bench_strchr_memcpy, &bench);
+  run_bench("slice_from", "pstr_slice_from", len, bench.n_ops, bench_pstr_slice_from, &bench);
+  run_bench("slice_from", "strlen+memmove", len, bench.n_ops, bench_strlen_memmove, &bench);
+  run_bench("slice", "pstr_slice", len, bench.n_ops, bench_pstr_slice, &bench);
+  run_bench(
+    "slice", "strlen+memmove", len, bench.n_ops, bench_strlen_memmove_slice, &bench
+  );
+  run_bench("trim", "pstr_trim", len, bench.n_ops, bench_pstr_trim, &bench);
+  run_bench("trim", "pstr_sv_trim", len, bench.n_ops, bench_pstr_sv_trim, &bench);
+  run_bench("trim", "pstr_sv_trim_set", len, bench.n_ops, bench_pstr_sv_trim_set, &bench);
+  run_bench("trim", "isspace", len, bench.n_ops, bench_isspace_trim, &bench);
+  run_bench("ltrim", "pstr_ltrim", len, bench.n_ops, bench_pstr_ltrim, &bench);
+  run_bench("ltrim", "isspace", len, bench.n_ops, bench_isspace_ltrim, &bench);
+  run_bench("rtrim", "pstr_rtrim", len, bench.n_ops, bench_pstr_rtrim, &bench);
+  run_bench("rtrim", "isspace", len, bench.n_ops, bench_isspace_rtrim, &bench);
+  run_bench(
+    "trim_char", "pstr_trim_char", len, bench.n_ops, bench_pstr_trim_char, &bench
+  );
+  run_bench("trim_char", "loop", len, bench.n_ops, bench_loop_trim_char, &bench);
+  run_bench("span", "pstr_sv_span", len, bench.n_ops, bench_pstr_sv_span, &bench);
+  run_bench("span", "strspn", len, bench.n_ops, bench_strspn, &bench);
+  run_bench("cspan", "pstr_sv_cspan", len, bench.n_ops, bench_pstr_sv_cspan, &bench);
+  run_bench("cspan", "strcspn", len, bench.n_ops, bench_strcspn, &bench);
+  run_bench("to_lower", "pstr_to_lower", len, bench.n_ops, bench_pstr_to_lower, &bench);
+  run_bench("to_lower", "tolower", len, bench.n_ops, bench_tolower, &bench);
+  run_bench(
+    "replace_all", "pstr_replace_all", len, bench.n_ops, bench_pstr_replace_all, &bench
+  );
+  run_bench("replace_all", "strstr+memmove", len, bench.n_ops, bench_strstr_memmove, &bench);
+  run_bench("tokenize", "pstr_tokenizer", len, bench.n_ops, bench_pstr_tokenizer, &bench);
+  run_bench("tokenize", "strchr", len, bench.n_ops, bench_strchr_tokenize, &bench);
+
+  free(bench.str);
+  free(bench.str_copy);
+  free(bench.str_upper);
+  free(bench.padded);
+  free(bench.dashed);
+  free(bench.fields);
+  free(bench.dest);
+}
+
+
+static void bench_strs() {
+  for (size_t len = 8; len <= (1 << 20); len *= 8) {
+    bench_strs_of_len(len);
+  }
+  // 8 * 8^6 is 256 KiB, so finish off with the full 1 MiB
+  bench_strs_of_len(1 << 20);
+}
+
+
+// Substring search
+// Needles are searched for in random letters, where a match is rare, and in two kinds of
+// input made to be slow to search: a run of one letter, with a needle that matches
+// everywhere except in the middle, and "abab...", with a needle that matches
+// everywhere except near the end.
+// ------------------------
+
+typedef enum {
+  FIND_INPUT_RANDOM,
+  FIND_INPUT_RUN,
+  FIND_INPUT_PERIODIC,
+} find_input;
+
+typedef struct {
+  size_t len;
+  size_t needle_len;
+  size_t n_ops;
+  char *volatile haystack;
+  char *volatile needle;
+} find_bench;
+
+
+static size_t bench_pstr_find(void *ctx) {
+  find_bench *bench = ctx;
+  int64_t sum = 0;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    sum += pstr_find(bench->haystack, bench->needle);
+  }
+  bench_sink += (size_t)sum;
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_pstr_sv_find(void *ctx) {
+  find_bench *bench = ctx;
+  int64_t sum = 0;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    sum += pstr_sv_find(
+      pstr_sv_from_n(bench->haystack, bench->len),
+      pstr_sv_from_n(bench->needle, bench->needle_len)
+    );
+  }
+  bench_sink += (size_t)sum;
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_strstr(void *ctx) {
+  find_bench *bench = ctx;
+  size_t n_found = 0;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    n_found += strstr(bench->haystack, bench->needle) != NULL;
+  }
+  bench_sink += n_found;
+  return bench->n_ops * bench->len;
+}
+
+
+static void bench_find_of_len(
+  size_t const len, size_t const needle_len, find_input const input
+) {
+  find_bench bench;
+  uint64_t state = 0x9e3779b97f4a7c15ULL;
+  char const *input_names[] = {"random", "run", "periodic"};
+  char group[32];
+
+  snprintf(group, sizeof(group), "find_%s_%zu", input_names[input], needle_len);
+  bench.len = len;
+  bench.needle_len = needle_len;
+  bench.n_ops = len < (1 << 20) ? (1 << 20) / len : 1;
+  bench.haystack = malloc(len + 1);
+  bench.needle = malloc(needle_len + 1);
+
+  for (size_t idx = 0; idx < len; idx++) {
+    if (input == FIND_INPUT_RANDOM) {
+      bench.haystack[idx] = (char)('a' + bench_rand(&state) % 26);
+    } else if (input == FIND_INPUT_RUN) {
+      bench.haystack[idx] = 'a';
+    } else {
+      bench.haystack[idx] = idx % 2 ? 'b' : 'a';
+    }
+  }
+  for (size_t idx = 0; idx < needle_len; idx++) {
+    if (input == FIND_INPUT_RANDOM) {
+      bench.needle[idx] = (char)('a' + bench_rand(&state) % 26);
+    } else if (input == FIND_INPUT_RUN) {
+      bench.needle[idx] = idx == needle_len / 2 ? 'b' : 'a';
+    } else {
+      bench.needle[idx] = idx % 2 || idx == needle_len - 2 ? 'b' : 'a';
+    }
+  }
+  bench.haystack[len] = '\0';
+  bench.needle[needle_len] = '\0';
+
+  run_bench(group, "pstr_find", len, bench.n_ops, bench_pstr_find, &bench);
+  run_bench(group, "pstr_sv_find", len, bench.n_ops, bench_pstr_sv_find, &bench);
+  run_bench(group, "strstr", len, bench.n_ops, bench_strstr, &bench);
+
+  free(bench.haystack);
+  free(bench.needle);
+}
+
+
+static void bench_find() {
+  size_t const needle_lens[] = {4, 16, 64, 256};
+  for (size_t idx_needle = 0; idx_needle < 4; idx_needle++) {
+    for (size_t len = 4096; len <= (1 << 20); len *= 16) {
+      bench_find_of_len(len, needle_lens[idx_needle], FIND_INPUT_RANDOM);
+      bench_find_of_len(len, needle_lens[idx_needle], FIND_INPUT_RUN);
+      bench_find_of_len(len, needle_lens[idx_needle], FIND_INPUT_PERIODIC);
+    }
+  }
+}
+
+
+// Multi-pattern matching
+// Lines of log-like text are checked against a number of keywords, either all at once
+// with a `pstr_matcher`, or one keyword at a time.
+// ------------------------
+
+#define N_BENCH_LINES 1024
+#define BENCH_LINE_LEN 120
+#define MAX_BENCH_KEYWORDS 512
+
+typedef struct {
+  size_t n_keywords;
+  char keyword_strs[MAX_BENCH_KEYWORDS][12];
+  char const *keywords[MAX_BENCH_KEYWORDS];
+  char lines[N_BENCH_LINES][BENCH_LINE_LEN + 1];
+  pstr_matcher matcher;
+} match_bench;
+
+
+static size_t bench_pstr_matcher(void *ctx) {
+  match_bench *bench = ctx;
+  size_t n_matched = 0;
+  for (size_t idx = 0; idx < N_BENCH_LINES; idx++) {
+    pstr_match match;
+    n_matched += pstr_matcher_find(&bench->matcher, bench->lines[idx], &match);
+  }
+  bench_sink += n_matched;
+  return N_BENCH_LINES * BENCH_LINE_LEN;
+}
+
+
+static size_t bench_pstr_find_each(void *ctx) {
+  match_bench *bench = ctx;
+  size_t n_matched = 0;
+  for (size_t idx = 0; idx < N_BENCH_LINES; idx++) {
+    pstr_sv const line = pstr_sv_from(bench->lines[idx]);
+    for (size_t idx_keyword = 0; idx_keyword < bench->n_keywords; idx_keyword++) {
+      if (pstr_sv_find(line, pstr_sv_from(bench->keywords[idx_keyword])) >= 0) {
+        n_matched++;
+        break;
+      }
+    }
+  }
+  bench_sink += n_matched;
+  return N_BENCH_LINES * BENCH_LINE_LEN;
+}
+
+
+static size_t bench_strstr_each(void *ctx) {
+  match_bench *bench = ctx;
+  size_t n_matched = 0;
+  for (size_t idx = 0; idx < N_BENCH_LINES; idx++) {
+    for (size_t idx_keyword = 0; idx_keyword < bench->n_keywords; idx_keyword++) {
+      if (strstr(bench->lines[idx], bench->keywords[idx_keyword])) {
+        n_matched++;
+        break;
+      }
+    }
+  }
+  bench_sink += n_matched;
+  return N_BENCH_LINES * BENCH_LINE_LEN;
+}
+
+
+static void bench_match_keywords(size_t const n_keywords) {
+  static match_bench bench;
+  uint64_t state = 0x9e3779b97f4a7c15ULL;
+  char group[32];
+
+  snprintf(group, sizeof(group), "match_%zu", n_keywords);
+  bench.n_keywords = n_keywords;
+  for (size_t idx = 0; idx < n_keywords; idx++) {
+    size_t const len = 4 + bench_rand(&state) % 8;
+    for (size_t idx_char = 0; idx_char < len; idx_char++) {
+      bench.keyword_strs[idx][idx_char] = (char)('a' + bench_rand(&state) % 26);
+    }
+    bench.keyword_strs[idx][len] = '\0';
+    bench.keywords[idx] = bench.keyword_strs[idx];
+  }
+
+  // Lines of random words, with a keyword in every tenth one
+  for (size_t idx = 0; idx < N_BENCH_LINES; idx++) {
+    char *line = bench.lines[idx];
+    for (size_t idx_char = 0; idx_char < BENCH_LINE_LEN; idx_char++) {
+      line[idx_char] = bench_rand(&state) % 6 == 0 ?
+        ' ' : (char)('a' + bench_rand(&state) % 26);
+    }
+    line[BENCH_LINE_LEN] = '\0';
+    if (idx % 10 == 0) {
+      char const *keyword = bench.keywords[bench_rand(&state) % n_keywords];
+      memcpy(line + BENCH_LINE_LEN / 2, keyword, strlen(keyword));
+    }
+  }
+
+  pstr_matcher_init(&bench.matcher, pstr_libc_allocator(), bench.keywords, n_keywords);
+  run_bench(
+    group, "pstr_matcher", BENCH_LINE_LEN, N_BENCH_LINES, bench_pstr_matcher, &bench
+  );
+  run_bench(
+    group, "pstr_find", BENCH_LINE_LEN, N_BENCH_LINES, bench_pstr_find_each, &bench
+  );
+  run_bench(group, "strstr", BENCH_LINE_LEN, N_BENCH_LINES, bench_strstr_each, &bench);
+  pstr_matcher_free(&bench.matcher);
+}
+
+
+static void bench_match() {
+  for (size_t n_keywords = 8; n_keywords <= MAX_BENCH_KEYWORDS; n_keywords *= 4) {
+    bench_match_keywords(n_keywords);
+  }
+}
+
+
+// Prefix tables
+// Request lines are dispatched to the longest of a number of routes that they start
+// with, either with a `pstr_prefix_table`, or by checking each route in turn.
+// ------------------------
+
+#define N_BENCH_REQUESTS 1024
+#define MAX_BENCH_ROUTES 256
+
+typedef struct {
+  size_t n_routes;
+  char route_strs[MAX_BENCH_ROUTES][24];
+  char const *routes[MAX_BENCH_ROUTES];
+  char requests[N_BENCH_REQUESTS][64];
+  size_t total_request_len;
+  pstr_prefix_table table;
+} route_bench;
+
+
+static size_t bench_pstr_starts_with_any(void *ctx) {
+  route_bench *bench = ctx;
+  int64_t total = 0;
+  for (size_t idx = 0; idx < N_BENCH_REQUESTS; idx++) {
+    total += pstr_starts_with_any(bench->requests[idx], &bench->table);
+  }
+  bench_sink += (size_t)total;
+  return bench->total_request_len;
+}
+
+
+static size_t bench_pstr_starts_with_each(void *ctx) {
+  route_bench *bench = ctx;
+  int64_t total = 0;
+  for (size_t idx = 0; idx < N_BENCH_REQUESTS; idx++) {
+    int64_t idx_best = -1;
+    size_t best_len = 0;
+    for (size_t idx_route = 0; idx_route < bench->n_routes; idx_route++) {
+      if (pstr_starts_with(bench->requests[idx], bench->routes[idx_route])) {
+        size_t const len = strlen(bench->routes[idx_route]);
+        if (len > best_len) {
+          idx_best = (int64_t)idx_route;
+          best_len = len;
+        }
+      }
+    }
+    total += idx_best;
+  }
+  bench_sink += (size_t)total;
+  return bench->total_request_len;
+}
+
+
+static size_t bench_strncmp_each(void *ctx) {
+  route_bench *bench = ctx;
+  int64_t total = 0;
+  for (size_t idx = 0; idx < N_BENCH_REQUESTS; idx++) {
+    int64_t idx_best = -1;
+    size_t best_len = 0;
+    for (size_t idx_route = 0; idx_route < bench->n_routes; idx_route++) {
+      size_t const len = strlen(bench->routes[idx_route]);
+      char const *route = bench->routes[idx_route];
+      if (len > best_len && strncmp(bench->requests[idx], route, len) == 0) {
+        idx_best = (int64_t)idx_route;
+        best_len = len;
+      }
+    }
+    total += idx_best;
+  }
+  bench_sink += (size_t)total;
+  return bench->total_request_len;
+}
+
+
+static void bench_routes_of_count(size_t const n_routes) {
+  static route_bench bench;
+  uint64_t state = 0x9e3779b97f4a7c15ULL;
+  char group[32];
+
+  // Routes like "GET /abc/defg/", all starting with "GET /", so that the first character
+  // alone doesn't tell them apart
+  snprintf(group, sizeof(group), "routes_%zu", n_routes);
+  bench.n_routes = n_routes;
+  for (size_t idx = 0; idx < n_routes; idx++) {
+    char *route = bench.route_strs[idx];
+    size_t len = 0;
+    memcpy(route, "GET /", 5);
+    len += 5;
+    size_t const n_parts = 1 + bench_rand(&state) % 3;
+    for (size_t idx_part = 0; idx_part < n_parts; idx_part++) {
+      size_t const part_len = 2 + bench_rand(&state) % 3;
+      for (size_t idx_char = 0; idx_char < part_len; idx_char++) {
+        route[len++] = (char)('a' + bench_rand(&state) % 4);
+      }
+      route[len++] = '/';
+    }
+    route[len] = '\0';
+    bench.routes[idx] = route;
+  }
+
+  // Requests for a route, with more after it, and every tenth for no route at all
+  bench.total_request_len = 0;
+  for (size_t idx = 0; idx < N_BENCH_REQUESTS; idx++) {
+    char *request = bench.requests[idx];
+    char const *route = idx % 10 == 0 ?
+      "GET /zzz/" : bench.routes[bench_rand(&state) % n_routes];
+    snprintf(request, sizeof(bench.requests[idx]), "%s%s", route, "index.html HTTP/1.1");
+    bench.total_request_len += strlen(request);
+  }
+
+  pstr_prefix_table_init(&bench.table, pstr_libc_allocator(), bench.routes, n_routes);
+  run_bench(
+    group, "pstr_starts_with_any", n_routes, N_BENCH_REQUESTS,
+    bench_pstr_starts_with_any, &bench
+  );
+  run_bench(
+    group, "pstr_starts_with", n_routes, N_BENCH_REQUESTS,
+    bench_pstr_starts_with_each, &bench
+  );
+  run_bench(group, "strncmp", n_routes, N_BENCH_REQUESTS, bench_strncmp_each, &bench);
+  pstr_prefix_table_free(&bench.table);
+}
+
+
+static void bench_routes() {
+  for (size_t n_routes = 4; n_routes <= MAX_BENCH_ROUTES; n_routes *= 4) {
+    bench_routes_of_count(n_routes);
+  }
+}
+
+
+// Batches
+// A column of short strings, as in a table with millions of rows, is processed with the
+// batch functions, or by calling the per-string function on each one.
+// ------------------------
+
+#define N_BENCH_ROWS 65536
+
+typedef struct {
+  pstr_column column;
+  pstr_column other_column;
+  size_t total_len;
+  int64_t numbers[N_BENCH_ROWS];
+  char *dest_bytes;
+  size_t dest_size;
+  size_t *dest_offsets;
+  bool results[N_BENCH_ROWS];
+} batch_bench;
+
+
+static size_t bench_pstr_batch_trim(void *ctx) {
+  batch_bench *bench = ctx;
+  pstr_batch_trim(&bench->column, bench->dest_bytes, bench->dest_size, bench->dest_offsets);
+  bench_sink += bench->dest_offsets[N_BENCH_ROWS];
+  return bench->total_len;
+}
+
+
+static size_t bench_pstr_sv_trim_each(void *ctx) {
+  batch_bench *bench = ctx;
+  size_t dest_len = 0;
+  bench->dest_offsets[0] = 0;
+  for (size_t idx = 0; idx < N_BENCH_ROWS; idx++) {
+    pstr_sv const trimmed = pstr_sv_trim(pstr_column_get(&bench->column, idx));
+    memcpy(bench->dest_bytes + dest_len, trimmed.str, trimmed.len);
+    dest_len += trimmed.len;
+    bench->dest_offsets[idx + 1] = dest_len;
+  }
+  bench_sink += dest_len;
+  return bench->total_len;
+}
+
+
+static size_t bench_pstr_batch_eq_sv(void *ctx) {
+  batch_bench *bench = ctx;
+  pstr_batch_eq_sv(&bench->column, PSTR_SV("  magpie "), bench->results);
+  bench_sink += bench->results[0];
+  return bench->total_len;
+}
+
+
+static size_t bench_pstr_sv_eq_each(void *ctx) {
+  batch_bench *bench = ctx;
+  for (size_t idx = 0; idx < N_BENCH_ROWS; idx++) {
+    bench->results[idx] =
+      pstr_sv_eq(pstr_column_get(&bench->column, idx), PSTR_SV("  magpie "));
+  }
+  bench_sink += bench->results[0];
+  return bench->total_len;
+}
+
+
+static size_t bench_pstr_batch_eq(void *ctx) {
+  batch_bench *bench = ctx;
+  pstr_batch_eq(&bench->column, &bench->other_column, bench->results);
+  bench_sink += bench->results[0];
+  return bench->total_len;
+}
+
+
+static size_t bench_pstr_sv_eq_pairs(void *ctx) {
+  batch_bench *bench = ctx;
+  for (size_t idx = 0; idx < N_BENCH_ROWS; idx++) {
+    bench->results[idx] = pstr_sv_eq(
+      pstr_column_get(&bench->column, idx), pstr_column_get(&bench->other_column, idx)
+    );
+  }
+  bench_sink += bench->results[0];
+  return bench->total_len;
+}
+
+
+static size_t bench_pstr_batch_starts_with(void *ctx) {
+  batch_bench *bench = ctx;
+  pstr_batch_starts_with(&bench->column, PSTR_SV("  m"), bench->results);
+  bench_sink += bench->results[0];
+  return bench->total_len;
+}
+
+
+static size_t bench_pstr_sv_starts_with_each(void *ctx) {
+  batch_bench *bench = ctx;
+  for (size_t idx = 0; idx < N_BENCH_ROWS; idx++) {
+    bench->results[idx] =
+      pstr_sv_starts_with(pstr_column_get(&bench->column, idx), PSTR_SV("  m"));
+  }
+  bench_sink += bench->results[0];
+  return bench->total_len;
+}
+
+
+static size_t bench_pstr_batch_from_int64(void *ctx) {
+  batch_bench *bench = ctx;
+  pstr_batch_from_int64(
+    bench->numbers, N_BENCH_ROWS, bench->dest_bytes, bench->dest_size, bench->dest_offsets
+  );
+  bench_sink += bench->dest_offsets[N_BENCH_ROWS];
+  return bench->dest_offsets[N_BENCH_ROWS];
+}
+
+
+static size_t bench_pstr_from_int64_each(void *ctx) {
+  batch_bench *bench = ctx;
+  size_t dest_len = 0;
+  bench->dest_offsets[0] = 0;
+  for (size_t idx = 0; idx < N_BENCH_ROWS; idx++) {
+    size_t len;
+    pstr_from_int64(
+      bench->dest_bytes + dest_len, bench->dest_size - dest_len, bench->numbers[idx], &len
+    );
+    dest_len += len;
+    bench->dest_offsets[idx + 1] = dest_len;
+  }
+  bench_sink += dest_len;
+  return dest_len;
+}
+
+
+static size_t bench_pstr_batch_is_valid(void *ctx) {
+  batch_bench *bench = ctx;
+  pstr_batch_is_valid(&bench->column, bench->results);
+  bench_sink += bench->results[0];
+  return bench->total_len;
+}
+
+
+static size_t bench_pstr_is_valid_each(void *ctx) {
+  batch_bench *bench = ctx;
+  for (size_t idx = 0; idx < N_BENCH_ROWS; idx++) {
+    pstr_sv const str = pstr_column_get(&bench->column, idx);
+    bench->results[idx] = pstr_is_valid(str.str, str.len);
+  }
+  bench_sink += bench->results[0];
+  return bench->total_len;
+}
+
+
+static void bench_batch() {
+  static batch_bench bench;
+  uint64_t state = 0x9e3779b97f4a7c15ULL;
+
+  // Words of 1 to 16 letters with up to 3 spaces on either side, with no NULL bytes, so
+  // that checking for validity has to scan everything
+  char *bytes = malloc(N_BENCH_ROWS * 24);
+  size_t *offsets = malloc((N_BENCH_ROWS + 1) * sizeof(size_t));
+  size_t len = 0;
+  offsets[0] = 0;
+  for (size_t idx = 0; idx < N_BENCH_ROWS; idx++) {
+    size_t const n_leading = bench_rand(&state) % 4;
+    size_t const n_letters = 1 + bench_rand(&state) % 16;
+    size_t const n_trailing = bench_rand(&state) % 4;
+    memset(bytes + len, ' ', n_leading);
+    len += n_leading;
+    for (size_t idx_char = 0; idx_char < n_letters; idx_char++) {
+      bytes[len++] = (char)('a' + bench_rand(&state) % 26);
+    }
+    memset(bytes + len, ' ', n_trailing);
+    len += n_trailing;
+    offsets[idx + 1] = len;
+    bench.numbers[idx] = (int64_t)bench_rand(&state) >> (bench_rand(&state) % 64);
+  }
+  bench.column = (pstr_column){ .bytes = bytes, .offsets = offsets, .n_strs = N_BENCH_ROWS };
+
+  // The same column with about half of its strings changed, by a letter or by their
+  // length, to compare it with row by row
+  char *other_bytes = malloc(N_BENCH_ROWS * 25);
+  size_t *other_offsets = malloc((N_BENCH_ROWS + 1) * sizeof(size_t));
+  size_t other_len = 0;
+  other_offsets[0] = 0;
+  for (size_t idx = 0; idx < N_BENCH_ROWS; idx++) {
+    size_t const str_len = offsets[idx + 1] - offsets[idx];
+    memcpy(other_bytes + other_len, bytes + offsets[idx], str_len);
+    other_len += str_len;
+    uint64_t const change = bench_rand(&state) % 4;
+    if (change == 1) {
+      other_bytes[other_len - 1] = 'A';
+    } else if (change == 2) {
+      other_bytes[other_len++] = 'A';
+    }
+    other_offsets[idx + 1] = other_len;
+  }
+  bench.other_column = (pstr_column){
+    .bytes = other_bytes, .offsets = other_offsets, .n_strs = N_BENCH_ROWS
+  };
+  bench.total_len = len;
+  bench.dest_size = N_BENCH_ROWS * 24;
+  bench.dest_bytes = malloc(bench.dest_size);
+  bench.dest_offsets = malloc((N_BENCH_ROWS + 1) * sizeof(size_t));
+
+  run_bench(
+    "batch_trim", "pstr_batch_trim", N_BENCH_ROWS, N_BENCH_ROWS,
+    bench_pstr_batch_trim, &bench
+  );
+  run_bench(
+    "batch_trim", "pstr_sv_trim", N_BENCH_ROWS, N_BENCH_ROWS,
+    bench_pstr_sv_trim_each, &bench
+  );
+  run_bench(
+    "batch_eq", "pstr_batch_eq_sv", N_BENCH_ROWS, N_BENCH_ROWS,
+    bench_pstr_batch_eq_sv, &bench
+  );
+  run_bench(
+    "batch_eq", "pstr_sv_eq", N_BENCH_ROWS, N_BENCH_ROWS, bench_pstr_sv_eq_each, &bench
+  );
+  run_bench(
+    "batch_eq_pairs", "pstr_batch_eq", N_BENCH_ROWS, N_BENCH_ROWS,
+    bench_pstr_batch_eq, &bench
+  );
+  run_bench(
+    "batch_eq_pairs", "pstr_sv_eq", N_BENCH_ROWS, N_BENCH_ROWS,
+    bench_pstr_sv_eq_pairs, &bench
+  );
+  run_bench(
+    "batch_starts_with", "pstr_batch_starts_with", N_BENCH_ROWS, N_BENCH_ROWS,
+    bench_pstr_batch_starts_with, &bench
+  );
+  run_bench(
+    "batch_starts_with", "pstr_sv_starts_with", N_BENCH_ROWS, N_BENCH_ROWS,
+    bench_pstr_sv_starts_with_each, &bench
+  );
+  run_bench(
+    "batch_from_int64", "pstr_batch_from_int64", N_BENCH_ROWS, N_BENCH_ROWS,
+    bench_pstr_batch_from_int64, &bench
+  );
+  run_bench(
+    "batch_from_int64", "pstr_from_int64", N_BENCH_ROWS, N_BENCH_ROWS,
+    bench_pstr_from_int64_each, &bench
+  );
+  run_bench(
+    "batch_is_valid", "pstr_batch_is_valid", N_BENCH_ROWS, N_BENCH_ROWS,
+    bench_pstr_batch_is_valid, &bench
+  );
+  run_bench(
+    "batch_is_valid", "pstr_is_valid", N_BENCH_ROWS, N_BENCH_ROWS,
+    bench_pstr_is_valid_each, &bench
+  );
+
+  free(bytes);
+  free(offsets);
+  free(other_bytes);
+  free(other_offsets);
+  free(bench.dest_bytes);
+  free(bench.dest_offsets);
+}
+
+
+// Pools
+// A column of a million short strings is processed by pools of 1 to 64 threads, to see
+// how the pool functions scale, and by the batch functions on their own.
+// ------------------------
+
+#define N_POOL_BENCH_ROWS (1 << 20)
+#define MAX_BENCH_THREADS 64
+
+typedef struct {
+  pstr_pool pool;
+  pstr_column column;
+  size_t total_len;
+  int64_t *numbers;
+  char *dest_bytes;
+  size_t dest_size;
+  size_t *dest_offsets;
+  bool *results;
+} pool_bench;
+
+
+static size_t bench_pstr_pool_batch_trim(void *ctx) {
+  pool_bench *bench = ctx;
+  pstr_pool_batch_trim(
+    &bench->pool, &bench->column, bench->dest_bytes, bench->dest_size, bench->dest_offsets
+  );
+  bench_sink += bench->dest_offsets[N_POOL_BENCH_ROWS];
+  return bench->total_len;
+}
+
+
+static size_t bench_pstr_pool_batch_from_int64(void *ctx) {
+  pool_bench *bench = ctx;
+  pstr_pool_batch_from_int64(
+    &bench->pool, bench->numbers, N_POOL_BENCH_ROWS,
+    bench->dest_bytes, bench->dest_size, bench->dest_offsets
+  );
+  bench_sink += bench->dest_offsets[N_POOL_BENCH_ROWS];
+  return bench->dest_offsets[N_POOL_BENCH_ROWS];
+}
+
+
+static size_t bench_pstr_pool_batch_starts_with(void *ctx) {
+  pool_bench *bench = ctx;
+  pstr_pool_batch_starts_with(&bench->pool, &bench->column, PSTR_SV("  m"), bench->results);
+  bench_sink += bench->results[0];
+  return bench->total_len;
+}
+
+
+static size_t bench_pstr_batch_trim_unpooled(void *ctx) {
+  pool_bench *bench = ctx;
+  pstr_batch_trim(&bench->column, bench->dest_bytes, bench->dest_size, bench->dest_offsets);
+  bench_sink += bench->dest_offsets[N_POOL_BENCH_ROWS];
+  return bench->total_len;
+}
+
+
+static size_t bench_pstr_batch_from_int64_unpooled(void *ctx) {
+  pool_bench *bench = ctx;
+  pstr_batch_from_int64(
+    bench->numbers, N_POOL_BENCH_ROWS,
+    bench->dest_bytes, bench->dest_size, bench->dest_offsets
+  );
+  bench_sink += bench->dest_offsets[N_POOL_BENCH_ROWS];
+  return bench->dest_offsets[N_POOL_BENCH_ROWS];
+}
+
+
+static size_t bench_pstr_batch_starts_with_unpooled(void *ctx) {
+  pool_bench *bench = ctx;
+  pstr_batch_starts_with(&bench->column, PSTR_SV("  m"), bench->results);
+  bench_sink += bench->results[0];
+  return bench->total_len;
+}
+
+
+static void bench_pool() {
+  static pool_bench bench;
+  uint64_t state = 0x9e3779b97f4a7c15ULL;
+
+  // The same sort of strings as for the batch benchmarks, but many more of them
+  char *bytes = malloc(N_POOL_BENCH_ROWS * 24);
+  size_t *offsets = malloc((N_POOL_BENCH_ROWS + 1) * sizeof(size_t));
+  bench.numbers = malloc(N_POOL_BENCH_ROWS * sizeof(int64_t));
+  size_t len = 0;
+  offsets[0] = 0;
+  for (size_t idx = 0; idx < N_POOL_BENCH_ROWS; idx++) {
+    size_t const n_leading = bench_rand(&state) % 4;
+    size_t const n_letters = 1 + bench_rand(&state) % 16;
+    size_t const n_trailing = bench_rand(&state) % 4;
+    memset(bytes + len, ' ', n_leading);
+    len += n_leading;
+    for (size_t idx_char = 0; idx_char < n_letters; idx_char++) {
+      bytes[len++] = (char)('a' + bench_rand(&state) % 26);
+    }
+    memset(bytes + len, ' ', n_trailing);
+    len += n_trailing;
+    offsets[idx + 1] = len;
+    bench.numbers[idx] = (int64_t)bench_rand(&state) >> (bench_rand(&state) % 64);
+  }
+  bench.column = (pstr_column){
+    .bytes = bytes, .offsets = offsets, .n_strs = N_POOL_BENCH_ROWS
+  };
+  bench.total_len = len;
+  bench.dest_size = N_POOL_BENCH_ROWS * 24;
+  bench.dest_bytes = malloc(bench.dest_size);
+  bench.dest_offsets = malloc((N_POOL_BENCH_ROWS + 1) * sizeof(size_t));
+  bench.results = malloc(N_POOL_BENCH_ROWS * sizeof(bool));
+
+  run_bench(
+    "pool_trim", "pstr_batch_trim", N_POOL_BENCH_ROWS, N_POOL_BENCH_ROWS,
+    bench_pstr_batch_trim_unpooled, &bench
+  );
+  run_bench(
+    "pool_from_int64", "pstr_batch_from_int64", N_POOL_BENCH_ROWS, N_POOL_BENCH_ROWS,
+    bench_pstr_batch_from_int64_unpooled, &bench
+  );
+  run_bench(
+    "pool_starts_with", "pstr_batch_starts_with", N_POOL_BENCH_ROWS, N_POOL_BENCH_ROWS,
+    bench_pstr_batch_starts_with_unpooled, &bench
+  );
+
+  for (size_t n_threads = 1; n_threads <= MAX_BENCH_THREADS; n_threads *= 2) {
+    if (!pstr_pool_init(&bench.pool, pstr_libc_allocator(), n_threads)) {
+      break;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "pstr_pool_%zu", n_threads);
+    run_bench(
+      "pool_trim", name, N_POOL_BENCH_ROWS, N_POOL_BENCH_ROWS,
+      bench_pstr_pool_batch_trim, &bench
+    );
+    run_bench(
+      "pool_from_int64", name, N_POOL_BENCH_ROWS, N_POOL_BENCH_ROWS,
+      bench_pstr_pool_batch_from_int64, &bench
+    );
+    run_bench(
+      "pool_starts_with", name, N_POOL_BENCH_ROWS, N_POOL_BENCH_ROWS,
+      bench_pstr_pool_batch_starts_with, &bench
+    );
+    pstr_pool_free(&bench.pool);
+  }
+
+  free(bytes);
+  free(offsets);
+  free(bench.numbers);
+  free(bench.dest_bytes);
+  free(bench.dest_offsets);
+  free(bench.results);
+}
+
+
+// File lines
+// A log file of about 32 MiB is read line by line, and each line is trimmed, by mapping
+// it, by reading it through a buffer, and with `fgets()`. The file is made in the
+// temporary directory, and stays in the page cache, so this measures how fast we get
+// through it rather than how fast the disk is.
+// ------------------------
+
+#define N_BENCH_LOG_LINES 262144
+
+typedef struct {
+  char path[64];
+  size_t total_len;
+} file_lines_bench;
+
+
+// If the file can't be made or opened, the results would be missing or meaningless, so
+// we stop rather than carry on without them, removing the file if we got as far as
+// making it
+static void bench_file_lines_fail(char const *path, bool const did_create) {
+  fprintf(stderr, "Could not open benchmark file %s\n", path);
+  if (did_create) {
+    remove(path);
+  }
+  exit(1);
+}
+
+
+static size_t bench_pstr_file_lines_mapped(void *ctx) {
+  file_lines_bench *bench = ctx;
+  pstr_file_lines lines;
+  if (!pstr_file_lines_open(&lines, pstr_libc_allocator(), bench->path)) {
+    bench_file_lines_fail(bench->path, true);
+  }
+  pstr_sv line;
+  size_t trimmed_len = 0;
+  while (pstr_file_lines_next(&lines, &line)) {
+    trimmed_len += pstr_sv_trim(line).len;
+  }
+  pstr_file_lines_close(&lines);
+  bench_sink += trimmed_len;
+  return bench->total_len;
+}
+
+
+static size_t bench_pstr_file_lines_read(void *ctx) {
+  file_lines_bench *bench = ctx;
+  int const fd = open(bench->path, O_RDONLY);
+  pstr_file_lines lines;
+  if (fd < 0 || !pstr_file_lines_from_fd(&lines, pstr_libc_allocator(), fd)) {
+    bench_file_lines_fail(bench->path, true);
+  }
+  pstr_sv line;
+  size_t trimmed_len = 0;
+  while (pstr_file_lines_next(&lines, &line)) {
+    trimmed_len += pstr_sv_trim(line).len;
+  }
+  pstr_file_lines_close(&lines);
+  close(fd);
+  bench_sink += trimmed_len;
+  return bench->total_len;
+}
+
+
+static size_t bench_fgets(void *ctx) {
+  file_lines_bench *bench = ctx;
+  FILE *file = fopen(bench->path, "rb");
+  if (!file) {
+    bench_file_lines_fail(bench->path, true);
+  }
+  char line[4096];
+  size_t trimmed_len = 0;
+  while (fgets(line, sizeof(line), file)) {
+    trimmed_len += pstr_sv_trim(pstr_sv_from(line)).len;
+  }
+  fclose(file);
+  bench_sink += trimmed_len;
+  return bench->total_len;
+}
+
+
+static void bench_file_lines() {
+  if (bench_filter && !strstr("file_lines", bench_filter)) {
+    return;
+  }
+  static file_lines_bench bench = { .path = "/tmp/pstr_bench_lines_XXXXXX" };
+  uint64_t state = 0x9e3779b97f4a7c15ULL;
+
+  // Lines of 40 to 215 characters, like a log's, with a little whitespace at the end
+  int const fd = mkstemp(bench.path);
+  FILE *file = fd >= 0 ? fdopen(fd, "wb") : NULL;
+  if (!file) {
+    bench_file_lines_fail(bench.path, fd >= 0);
+  }
+  char line[256];
+  for (size_t idx = 0; idx < N_BENCH_LOG_LINES; idx++) {
+    size_t const len = 40 + bench_rand(&state) % 176;
+    for (size_t idx_char = 0; idx_char < len; idx_char++) {
+      line[idx_char] = (char)('a' + bench_rand(&state) % 26);
+    }
+    line[len - 1] = ' ';
+    line[len] = '\n';
+    fwrite(line, 1, len + 1, file);
+    bench.total_len += len + 1;
+  }
+  if (fclose(file) != 0) {
+    bench_file_lines_fail(bench.path, true);
+  }
+
+  run_bench(
+    "file_lines", "pstr_file_lines_open", N_BENCH_LOG_LINES, N_BENCH_LOG_LINES,
+    bench_pstr_file_lines_mapped, &bench
+  );
+  run_bench(
+    "file_lines", "pstr_file_lines_from_fd", N_BENCH_LOG_LINES, N_BENCH_LOG_LINES,
+    bench_pstr_file_lines_read, &bench
+  );
+  run_bench("file_lines", "fgets", N_BENCH_LOG_LINES, N_BENCH_LOG_LINES, bench_fgets, &bench);
+
+  remove(bench.path);
+}
+
+
+// Splitters
+// A stream of log lines, as from a socket, is split into records as it arrives in 64 KiB
+// chunks, either with a splitter, or by copying each record into a line buffer, as one
+// has to when every record must be in one piece in a fixed-size buffer. The stream is
+// small enough to stay in the cache, as a chunk that's just been received would be.
+// ------------------------
+
+#define N_BENCH_STREAM_LINES 2048
+#define BENCH_STREAM_CHUNK_SIZE 65536
+
+typedef struct {
+  char *stream;
+  size_t len;
+  size_t n_records;
+} splitter_bench;
+
+
+// Something cheap to do with each record, which still needs all of it to be there
+static bool bench_ends_with_space(pstr_sv const record) {
+  return record.len > 0 && record.str[record.len - 1] == ' ';
+}
+
+
+static size_t bench_pstr_splitter(void *ctx) {
+  splitter_bench *bench = ctx;
+  pstr_splitter splitter;
+  pstr_splitter_init(&splitter, pstr_libc_allocator(), '\n', 4096);
+  pstr_sv record;
+  size_t n_spaces = 0;
+  for (size_t idx = 0; idx < bench->len; idx += BENCH_STREAM_CHUNK_SIZE) {
+    size_t const n_left = bench->len - idx;
+    size_t const chunk_len =
+      n_left < BENCH_STREAM_CHUNK_SIZE ? n_left : BENCH_STREAM_CHUNK_SIZE;
+    pstr_splitter_feed(&splitter, pstr_sv_from_n(bench->stream + idx, chunk_len));
+    while (pstr_splitter_next(&splitter, &record)) {
+      n_spaces += bench_ends_with_space(record);
+    }
+  }
+  if (pstr_splitter_finish(&splitter, &record)) {
+    n_spaces += bench_ends_with_space(record);
+  }
+  pstr_splitter_free(&splitter);
+  bench_sink += n_spaces;
+  return bench->len;
+}
+
+
+static size_t bench_line_buffer(void *ctx) {
+  splitter_bench *bench = ctx;
+  char line[4096];
+  size_t line_len = 0;
+  size_t n_spaces = 0;
+  for (size_t idx = 0; idx < bench->len; idx += BENCH_STREAM_CHUNK_SIZE) {
+    size_t const n_left = bench->len - idx;
+    char const *chunk = bench->stream + idx;
+    char const *chunk_end =
+      chunk + (n_left < BENCH_STREAM_CHUNK_SIZE ? n_left : BENCH_STREAM_CHUNK_SIZE);
+    while (chunk < chunk_end) {
+      char const *newline = memchr(chunk, '\n', (size_t)(chunk_end - chunk));
+      char const *piece_end = newline ? newline : chunk_end;
+      memcpy(line + line_len, chunk, (size_t)(piece_end - chunk));
+      line_len += (size_t)(piece_end - chunk);
+      if (!newline) {
+        break;
+      }
+      n_spaces += bench_ends_with_space(pstr_sv_from_n(line, line_len));
+      line_len = 0;
+      chunk = newline + 1;
+    }
+  }
+  n_spaces += bench_ends_with_space(pstr_sv_from_n(line, line_len));
+  bench_sink += n_spaces;
+  return bench->len;
+}
+
+
+static void bench_splitter() {
+  static splitter_bench bench;
+  uint64_t state = 0x9e3779b97f4a7c15ULL;
+
+  // The same lines as for reading files
+  bench.stream = malloc(N_BENCH_STREAM_LINES * 216);
+  for (size_t idx = 0; idx < N_BENCH_STREAM_LINES; idx++) {
+    size_t const len = 40 + bench_rand(&state) % 176;
+    for (size_t idx_char = 0; idx_char < len; idx_char++) {
+      bench.stream[bench.len++] = (char)('a' + bench_rand(&state) % 26);
+    }
+    bench.stream[bench.len - 1] = ' ';
+    bench.stream[bench.len++] = '\n';
+  }
+
+  run_bench(
+    "splitter", "pstr_splitter", N_BENCH_STREAM_LINES, N_BENCH_STREAM_LINES,
+    bench_pstr_splitter, &bench
+  );
+  run_bench(
+    "splitter", "line_buffer", N_BENCH_STREAM_LINES, N_BENCH_STREAM_LINES,
+    bench_line_buffer, &bench
+  );
+
+  free(bench.stream);
+}
+
+
+// Maps
+// Random keys of 8 to 23 letters are looked up in a map holding all of them, against
+// libc's `hsearch()`, whose table can only hold a fixed number of keys.
+// ------------------------
+
+#define MAX_BENCH_KEYS 65536
+#define MAX_BENCH_KEY_LEN 24
+
+typedef struct {
+  size_t n_keys;
+  size_t total_key_len;
+  char keys[MAX_BENCH_KEYS][MAX_BENCH_KEY_LEN];
+  size_t key_lens[MAX_BENCH_KEYS];
+  pstr_map map;
+} map_bench;
+
+
+static size_t bench_pstr_map_lookup(void *ctx) {
+  map_bench *bench = ctx;
+  size_t n_found = 0;
+  for (size_t idx = 0; idx < bench->n_keys; idx++) {
+    n_found += pstr_map_lookup(&bench->map, bench->keys[idx], NULL);
+  }
+  bench_sink += n_found;
+  return bench->total_key_len;
+}
+
+
+static size_t bench_pstr_map_lookup_sv(void *ctx) {
+  map_bench *bench = ctx;
+  size_t n_found = 0;
+  for (size_t idx = 0; idx < bench->n_keys; idx++) {
+    pstr_sv const key = pstr_sv_from_n(bench->keys[idx], bench->key_lens[idx]);
+    n_found += pstr_map_lookup_sv(&bench->map, key, NULL);
+  }
+  bench_sink += n_found;
+  return bench->total_key_len;
+}
+
+
+static size_t bench_hsearch(void *ctx) {
+  map_bench *bench = ctx;
+  size_t n_found = 0;
+  for (size_t idx = 0; idx < bench->n_keys; idx++) {
+    ENTRY item = { .key = bench->keys[idx], .data = NULL };
+    n_found += hsearch(item, FIND) != NULL;
+  }
+  bench_sink += n_found;
+  return bench->total_key_len;
+}
+
+
+static void bench_map_keys(size_t const n_keys) {
+  static map_bench bench;
+  uint64_t state = 0x9e3779b97f4a7c15ULL;
+  char group[32];
+
+  snprintf(group, sizeof(group), "map_%zu", n_keys);
+  bench.n_keys = n_keys;
+  bench.total_key_len = 0;
+  for (size_t idx = 0; idx < n_keys; idx++) {
+    size_t const len = 8 + bench_rand(&state) % (MAX_BENCH_KEY_LEN - 8);
+    for (size_t idx_char = 0; idx_char < len; idx_char++) {
+      bench.keys[idx][idx_char] = (char)('a' + bench_rand(&state) % 26);
+    }
+    bench.keys[idx][len] = '\0';
+    bench.key_lens[idx] = len;
+    bench.total_key_len += len;
+  }
+
+  pstr_map_init(&bench.map, pstr_libc_allocator(), 0);
+  // `hsearch()` works best with some room to spare
+  hcreate(n_keys * 2);
+  for (size_t idx = 0; idx < n_keys; idx++) {
+    pstr_map_insert(&bench.map, bench.keys[idx], NULL);
+    ENTRY item = { .key = bench.keys[idx], .data = NULL };
+    hsearch(item, ENTER);
+  }
+
+  run_bench(group, "pstr_map_lookup", n_keys, n_keys, bench_pstr_map_lookup, &bench);
+  run_bench(
+    group, "pstr_map_lookup_sv", n_keys, n_keys, bench_pstr_map_lookup_sv, &bench
+  );
+  run_bench(group, "hsearch", n_keys, n_keys, bench_hsearch, &bench);
+
+  hdestroy();
+  pstr_map_free(&bench.map);
+}
+
+
+static void bench_map() {
+  for (size_t n_keys = 16; n_keys <= MAX_BENCH_KEYS; n_keys *= 16) {
+    bench_map_keys(n_keys);
+  }
+}
+
+
+// Small strings
+// A 64-byte string is built up from short pieces, which is where rescanning the string to
+// find its end costs the most for its size.
+// ------------------------
+
+#define N_BENCH_PIECES 10
+
+typedef struct {
+  char const *volatile pieces[N_BENCH_PIECES];
+  size_t len;
+  size_t n_ops;
+} small_bench;
+
+
+static size_t bench_pstr_small_cat(void *ctx) {
+  small_bench *bench = ctx;
+  pstr_small(64) small;
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    PSTR_SMALL_INIT(small);
+    for (size_t idx_piece = 0; idx_piece < N_BENCH_PIECES; idx_piece++) {
+      pstr_small_cat(PSTR_SMALL(small), bench->pieces[idx_piece]);
+    }
+    bench_sink += small.len;
+  }
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_pstr_cat_small(void *ctx) {
+  small_bench *bench = ctx;
+  char str[64];
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    pstr_clear(str);
+    for (size_t idx_piece = 0; idx_piece < N_BENCH_PIECES; idx_piece++) {
+      pstr_cat(str, sizeof(str), bench->pieces[idx_piece]);
+    }
+    bench_sink += (size_t)str[0];
+  }
+  return bench->n_ops * bench->len;
+}
+
+
+static size_t bench_strcat_small(void *ctx) {
+  small_bench *bench = ctx;
+  char str[64];
+  for (size_t idx = 0; idx < bench->n_ops; idx++) {
+    str[0] = '\0';
+    for (size_t idx_piece = 0; idx_piece < N_BENCH_PIECES; idx_piece++) {
+      strcat(str, bench->pieces[idx_piece]);
+    }
+    bench_sink += (size_t)str[0];
+  }
+  return bench->n_ops * bench->len;
+}
+
+
+static void bench_small() {
+  small_bench bench = {
+    .pieces = { "user", ":", "1234", "@", "eu-west", "/", "shard", "-", "07", ".idx" },
+    .n_ops = 1 << 14,
+  };
+  bench.len = 0;
+  for (size_t idx = 0; idx < N_BENCH_PIECES; idx++) {
+    bench.len += strlen(bench.pieces[idx]);
+  }
+  size_t const len = bench.len;
+  size_t const n_ops = bench.n_ops;
+  run_bench("small_cat", "pstr_small_cat", len, n_ops, bench_pstr_small_cat, &bench);
+  run_bench("small_cat", "pstr_cat", len, n_ops, bench_pstr_cat_small, &bench);
+  run_bench("small_cat", "strcat", len, n_ops, bench_strcat_small, &bench);
+}
+
+
+// Builders, arenas and interning
+// Words of 2 to 13 letters, drawn from a vocabulary of a few hundred so that most of them
+// repeat, are joined into one string, copied one by one, and interned. These are compared
+// against growing a buffer with `realloc()`, `malloc()`-ing each copy, and keeping the
+// unique copies in `hsearch()`'s table.
+// ------------------------
+
+#define N_BENCH_WORDS 16384
+#define N_BENCH_VOCAB 512
+#define MAX_BENCH_WORD_LEN 16
+
+typedef struct {
+  char words[N_BENCH_WORDS][MAX_BENCH_WORD_LEN];
+  size_t total_len;
+  char *copies[N_BENCH_WORDS];
+  pstr_arena arena;
+} build_bench;
+
+
+static size_t bench_pstr_builder_append(void *ctx) {
+  build_bench *bench = ctx;
+  pstr_builder builder;
+  pstr_builder_init(&builder, pstr_libc_allocator(), 0);
+  for (size_t idx = 0; idx < N_BENCH_WORDS; idx++) {
+    pstr_builder_append(&builder, bench->words[idx]);
+  }
+  bench_sink += builder.len;
+  pstr_builder_free(&builder);
+  return bench->total_len;
+}
+
+
+static size_t bench_pstr_builder_append_arena(void *ctx) {
+  build_bench *bench = ctx;
+  pstr_builder builder;
+  pstr_arena_reset(&bench->arena);
+  pstr_builder_init(&builder, pstr_arena_allocator(&bench->arena), 0);
+  for (size_t idx = 0; idx < N_BENCH_WORDS; idx++) {
+    pstr_builder_append(&builder, bench->words[idx]);
+  }
+  bench_sink += builder.len;
+  return bench->total_len;
+}
+
+
+static size_t bench_realloc_append(void *ctx) {
+  build_bench *bench = ctx;
+  char *str = NULL;
+  size_t len = 0;
+  size_t capacity = 0;
+  for (size_t idx = 0; idx < N_BENCH_WORDS; idx++) {
+    size_t const word_len = strlen(bench->words[idx]);
+    if (len + word_len + 1 > capacity) {
+      capacity = capacity * 2 > len + word_len + 1 ? capacity * 2 : len + word_len + 1;
+      char *const new_str = realloc(str, capacity);
+      if (!new_str) {
+        break;
+      }
+      str = new_str;
+    }
+    memcpy(str + len, bench->words[idx], word_len);
+    len += word_len;
+    str[len] = '\0';
+  }
+  bench_sink += len;
+  free(str);
+  return bench->total_len;
+}
+
+
+static size_t bench_pstr_arena_dup(void *ctx) {
+  build_bench *bench = ctx;
+  pstr_arena_reset(&bench->arena);
+  for (size_t idx = 0; idx < N_BENCH_WORDS; idx++) {
+    bench->copies[idx] = pstr_arena_dup(&bench->arena, bench->words[idx]);
+  }
+  bench_sink += (size_t)bench->copies[N_BENCH_WORDS - 1][0];
+  return bench->total_len;
+}
+
+
+static size_t bench_malloc_memcpy(void *ctx) {
+  build_bench *bench = ctx;
+  for (size_t idx = 0; idx < N_BENCH_WORDS; idx++) {
+    size_t const size = strlen(bench->words[idx]) + 1;
+    bench->copies[idx] = malloc(size);
+    memcpy(bench->copies[idx], bench->words[idx], size);
+  }
+  bench_sink += (size_t)bench->copies[N_BENCH_WORDS - 1][0];
+  for (size_t idx = 0; idx < N_BENCH_WORDS; idx++) {
+    free(bench->copies[idx]);
+  }
+  return bench->total_len;
+}
+
+
+static size_t bench_pstr_intern(void *ctx) {
+  build_bench *bench = ctx;
+  pstr_intern_pool pool;
+  size_t n_same = 0;
+  pstr_arena_reset(&bench->arena);
+  pstr_intern_pool_init(&pool, &bench->arena);
+  char const *prev = NULL;
+  for (size_t idx = 0; idx < N_BENCH_WORDS; idx++) {
+    char const *const interned = pstr_intern(&pool, bench->words[idx]);
+    n_same += interned == prev;
+    prev = interned;
+  }
+  bench_sink += n_same + pool.n_strs;
+  return bench->total_len;
+}
+
+
+static size_t bench_hsearch_intern(void *ctx) {
+  build_bench *bench = ctx;
+  size_t n_same = 0;
+  size_t n_copies = 0;
+  hcreate(N_BENCH_VOCAB * 2);
+  char const *prev = NULL;
+  for (size_t idx = 0; idx < N_BENCH_WORDS; idx++) {
+    ENTRY item = { .key = bench->words[idx], .data = NULL };
+    ENTRY *found = hsearch(item, FIND);
+    if (!found) {
+      size_t const size = strlen(bench->words[idx]) + 1;
+      item.key = malloc(size);
+      memcpy(item.key, bench->words[idx], size);
+      bench->copies[n_copies++] = item.key;
+      found = hsearch(item, ENTER);
+    }
+    n_same += found->key == prev;
+    prev = found->key;
+  }
+  hdestroy();
+  bench_sink += n_same + n_copies;
+  for (size_t idx = 0; idx < n_copies; idx++) {
+    free(bench->copies[idx]);
+  }
+  return bench->total_len;
+}
+
+
+static void bench_build() {
+  static build_bench bench;
+  uint64_t state = 0x9e3779b97f4a7c15ULL;
+  char vocab[N_BENCH_VOCAB][MAX_BENCH_WORD_LEN];
+
+  for (size_t idx = 0; idx < N_BENCH_VOCAB; idx++) {
+    size_t const len = 2 + bench_rand(&state) % (MAX_BENCH_WORD_LEN - 4);
+    for (size_t idx_char = 0; idx_char < len; idx_char++) {
+      vocab[idx][idx_char] = (char)('a' + bench_rand(&state) % 26);
+    }
+    vocab[idx][len] = '\0';
+  }
+  bench.total_len = 0;
+  for (size_t idx = 0; idx < N_BENCH_WORDS; idx++) {
+    size_t const idx_vocab = bench_rand(&state) % N_BENCH_VOCAB;
+    memcpy(bench.words[idx], vocab[idx_vocab], MAX_BENCH_WORD_LEN);
+    bench.total_len += strlen(bench.words[idx]);
+  }
+  size_t const avg_len = bench.total_len / N_BENCH_WORDS;
+
+  // Chunks big enough that, once warmed up, each batch fits in one
+  pstr_arena_init(&bench.arena, pstr_libc_allocator(), 1 << 20);
+
+  run_bench(
+    "build", "pstr_builder_append", avg_len, N_BENCH_WORDS, bench_pstr_builder_append,
+    &bench
+  );
+  run_bench(
+    "build", "pstr_builder_append (arena)", avg_len, N_BENCH_WORDS,
+    bench_pstr_builder_append_arena, &bench
+  );
+  run_bench(
+    "build", "realloc+memcpy", avg_len, N_BENCH_WORDS, bench_realloc_append, &bench
+  );
+  run_bench(
+    "dup", "pstr_arena_dup", avg_len, N_BENCH_WORDS, bench_pstr_arena_dup, &bench
+  );
+  run_bench("dup", "malloc+memcpy", avg_len, N_BENCH_WORDS, bench_malloc_memcpy, &bench);
+  run_bench("intern", "pstr_intern", avg_len, N_BENCH_WORDS, bench_pstr_intern, &bench);
+  run_bench("intern", "hsearch", avg_len, N_BENCH_WORDS, bench_hsearch_intern, &bench);
+
+  pstr_arena_free(&bench.arena);
+}
+
+
+// Integer formatting and parsing
+// ------------------------
+
+#define N_BENCH_INTS 4096
+
+typedef struct {
+  int64_t numbers[N_BENCH_INTS];
+  char strs[N_BENCH_INTS][24];
+  size_t avg_len;
+  uint64_t unsigned_numbers[N_BENCH_INTS];
+  char unsigned_strs[N_BENCH_INTS][24];
+  size_t avg_unsigned_len;
+} int_bench;
+
+
+static size_t bench_pstr_from_int64(void *ctx) {
+  int_bench *bench = ctx;
+  char str[24];
+  size_t n_bytes = 0;
+  for (size_t idx = 0; idx < N_BENCH_INTS; idx++) {
+    size_t new_str_len;
+    pstr_from_int64(str, sizeof(str), bench->numbers[idx], &new_str_len);
+    n_bytes += new_str_len;
+  }
+  bench_sink += n_bytes;
+  return n_bytes;
+}
+
+
+static size_t bench_snprintf_int64(void *ctx) {
+  int_bench *bench = ctx;
+  char str[24];
+  size_t n_bytes = 0;
+  for (size_t idx = 0; idx < N_BENCH_INTS; idx++) {
+    n_bytes += snprintf(str, sizeof(str), "%" PRId64, bench->numbers[idx]);
+  }
+  bench_sink += n_bytes;
+  return n_bytes;
+}
+
+
+static size_t bench_pstr_to_int64(void *ctx) {
+  int_bench *bench = ctx;
+  size_t n_bytes = 0;
+  int64_t sum = 0;
+  for (size_t idx = 0; idx < N_BENCH_INTS; idx++) {
+    int64_t number = 0;
+    size_t n_consumed = 0;
+    pstr_to_int64(bench->strs[idx], &number, &n_consumed);
+    sum += number;
+    n_bytes += n_consumed;
+  }
+  bench_sink += (size_t)sum;
+  return n_bytes;
+}
+
+
+static size_t bench_strtoll(void *ctx) {
+  int_bench *bench = ctx;
+  size_t n_bytes = 0;
+  int64_t sum = 0;
+  for (size_t idx = 0; idx < N_BENCH_INTS; idx++) {
+    char *end;
+    sum += strtoll(bench->strs[idx], &end, 10);
+    n_bytes += (size_t)(end - bench->strs[idx]);
+  }
+  bench_sink += (size_t)sum;
+  return n_bytes;
+}
+
+
+static size_t bench_pstr_from_uint64(void *ctx) {
+  int_bench *bench = ctx;
+  char str[24];
+  size_t n_bytes = 0;
+  for (size_t idx = 0; idx < N_BENCH_INTS; idx++) {
+    size_t new_str_len;
+    pstr_from_uint64(str, sizeof(str), bench->unsigned_numbers[idx], &new_str_len);
+    n_bytes += new_str_len;
+  }
+  bench_sink += n_bytes;
+  return n_bytes;
+}
+
+
+static size_t bench_snprintf_uint64(void *ctx) {
+  int_bench *bench = ctx;
+  char str[24];
+  size_t n_bytes = 0;
+  for (size_t idx = 0; idx < N_BENCH_INTS; idx++) {
+    n_bytes += snprintf(str, sizeof(str), "%" PRIu64, bench->unsigned_numbers[idx]);
+  }
+  bench_sink += n_bytes;
+  return n_bytes;
+}
+
+
+static size_t bench_pstr_to_uint64(void *ctx) {
+  int_bench *bench = ctx;
+  size_t n_bytes = 0;
+  uint64_t sum = 0;
+  for (size_t idx = 0; idx < N_BENCH_INTS; idx++) {
+    uint64_t number = 0;
+    size_t n_consumed = 0;
+    pstr_to_uint64(bench->unsigned_strs[idx], &number, &n_consumed);
+    sum += number;
+    n_bytes += n_consumed;
+  }
+  bench_sink += (size_t)sum;
+  return n_bytes;
+}
+
+
+static size_t bench_strtoull(void *ctx) {
+  int_bench *bench = ctx;
+  size_t n_bytes = 0;
+  uint64_t sum = 0;
+  for (size_t idx = 0; idx < N_BENCH_INTS; idx++) {
+    char *end;
+    sum += strtoull(bench->unsigned_strs[idx], &end, 10);
+    n_bytes += (size_t)(end - bench->unsigned_strs[idx]);
+  }
+  bench_sink += (size_t)sum;
+  return n_bytes;
+}
+
+
+static void bench_ints() {
+  static int_bench bench;
+  uint64_t state = 0x9e3779b97f4a7c15ULL;
+  size_t total_len = 0;
+
+  // Numbers of all sizes, like counters and IDs
+  for (size_t idx = 0; idx < N_BENCH_INTS; idx++) {
+    uint64_t const r = bench_rand(&state);
+    int64_t const number = (int64_t)(r >> (r % 64));
+    size_t new_str_len;
+    bench.numbers[idx] = (idx % 4 == 0) ? -number : number;
+    pstr_from_int64(bench.strs[idx], sizeof(bench.strs[idx]), bench.numbers[idx], &new_str_len);
+    total_len += new_str_len;
+  }
+  bench.avg_len = total_len / N_BENCH_INTS;
+
+  // The same spread of sizes, but reaching all the way up to `UINT64_MAX`
+  size_t total_unsigned_len = 0;
+  for (size_t idx = 0; idx < N_BENCH_INTS; idx++) {
+    uint64_t const r = bench_rand(&state);
+    size_t new_str_len;
+    bench.unsigned_numbers[idx] = r >> (r % 64);
+    pstr_from_uint64(
+      bench.unsigned_strs[idx], sizeof(bench.unsigned_strs[idx]),
+      bench.unsigned_numbers[idx], &new_str_len
+    );
+    total_unsigned_len += new_str_len;
+  }
+  bench.avg_unsigned_len = total_unsigned_len / N_BENCH_INTS;
+
+  run_bench(
+    "from_int64", "pstr_from_int64", bench.avg_len, N_BENCH_INTS,
+    bench_pstr_from_int64, &bench
+  );
+  run_bench(
+    "from_int64", "snprintf", bench.avg_len, N_BENCH_INTS,
+    bench_snprintf_int64, &bench
+  );
+  run_bench(
+    "to_int64", "pstr_to_int64", bench.avg_len, N_BENCH_INTS,
+    bench_pstr_to_int64, &bench
+  );
+  run_bench(
+    "to_int64", "strtoll", bench.avg_len, N_BENCH_INTS,
+    bench_strtoll, &bench
+  );
+  run_bench(
+    "from_uint64", "pstr_from_uint64", bench.avg_unsigned_len, N_BENCH_INTS,
+    bench_pstr_from_uint64, &bench
+  );
+  run_bench(
+    "from_uint64", "snprintf", bench.avg_unsigned_len, N_BENCH_INTS,
+    bench_snprintf_uint64, &bench
+  );
+  run_bench(
+    "to_uint64", "pstr_to_uint64", bench.avg_unsigned_len, N_BENCH_INTS,
+    bench_pstr_to_uint64, &bench
+  );
+  run_bench(
+    "to_uint64", "strtoull", bench.avg_unsigned_len, N_BENCH_INTS,
+    bench_strtoull, &bench
+  );
+}
+
+
+// Floating-point formatting and parsing
+// ------------------------
+
+#define N_BENCH_DOUBLES 4096
+
+typedef struct {
+  double numbers[N_BENCH_DOUBLES];
+  char strs[N_BENCH_DOUBLES][32];
+  size_t avg_len;
+} double_bench;
+
+
+static size_t bench_pstr_from_double(void *ctx) {
+  double_bench *bench = ctx;
+  char str[32];
+  size_t n_bytes = 0;
+  for (size_t idx = 0; idx < N_BENCH_DOUBLES; idx++) {
+    size_t new_str_len;
+    pstr_from_double(str, sizeof(str), bench->numbers[idx], &new_str_len);
+    n_bytes += new_str_len;
+  }
+  bench_sink += n_bytes;
+  return n_bytes;
+}
+
+
+static size_t bench_snprintf_double(void *ctx) {
+  double_bench *bench = ctx;
+  char str[32];
+  size_t n_bytes = 0;
+  for (size_t idx = 0; idx < N_BENCH_DOUBLES; idx++) {
+    // %.17g is what it takes for snprintf() to always round-trip
+    n_bytes += snprintf(str, sizeof(str), "%.17g", bench->numbers[idx]);
+  }
+  bench_sink += n_bytes;
+  return n_bytes;
+}
+
+
+static size_t bench_pstr_to_double(void *ctx) {
+  double_bench *bench = ctx;
+  size_t n_bytes = 0;
+  double sum = 0;
+  for (size_t idx = 0; idx < N_BENCH_DOUBLES; idx++) {
+    double number = 0;
+    size_t n_consumed = 0;
+    pstr_to_double(bench->strs[idx], &number, &n_consumed);
+    sum += number;
+    n_bytes += n_consumed;
+  }
+  bench_sink += (size_t)(sum != 0);
+  return n_bytes;
+}
+
+
+static size_t bench_strtod(void *ctx) {
+  double_bench *bench = ctx;
+  size_t n_bytes = 0;
+  double sum = 0;
+  for (size_t idx = 0; idx < N_BENCH_DOUBLES; idx++) {
+    char *end;
+    sum += strtod(bench->strs[idx], &end);
+    n_bytes += (size_t)(end - bench->strs[idx]);
+  }
+  bench_sink += (size_t)(sum != 0);
+  return n_bytes;
+}
+
+
+static void bench_doubles() {
+  static double_bench bench;
+  uint64_t state = 0x9e3779b97f4a7c15ULL;
+  size_t total_len = 0;
+
+  // Half "human" numbers like prices and measurements, half arbitrary doubles
+  for (size_t idx = 0; idx < N_BENCH_DOUBLES; idx++) {
+    uint64_t const r = bench_rand(&state);
+    double number;
+    if (idx % 2 == 0) {
+      number = (double)(r % 1000000) / 100.0;
+    } else {
+      uint64_t const bits = (r & 0x800fffffffffffffULL) | ((uint64_t)(900 + r % 250) << 52);
+      memcpy(&number, &bits, sizeof(number));
+    }
+    size_t new_str_len;
+    bench.numbers[idx] = number;
+    pstr_from_double(bench.strs[idx], sizeof(bench.strs[idx]), number, &new_str_len);
+    total_len += new_str_len;
+  }
+  bench.avg_len = total_len / N_BENCH_DOUBLES;
+
+  run_bench(
+    "from_double", "pstr_from_double", bench.avg_len, N_BENCH_DOUBLES,
+    bench_pstr_from_double, &bench
+  );
+  run_bench(
+    "from_double", "snprintf", bench.avg_len, N_BENCH_DOUBLES,
+    bench_snprintf_double, &bench
+  );
+  run_bench(
+    "to_double", "pstr_to_double", bench.avg_len, N_BENCH_DOUBLES,
+    bench_pstr_to_double, &bench
+  );
+  run_bench(
+    "to_double", "strtod", bench.avg_len, N_BENCH_DOUBLES,
+    bench_strtod, &bench
+  );
+}
+
+
+int main(int argc, char **argv) {
+  if (argc > 1) {
+    bench_filter = argv[1];
+  }
+  print_bench_header();
+  bench_strs();
+  bench_find();
+  bench_match();
+  bench_routes();
+  bench_batch();
+  bench_pool();
+  bench_file_lines();
+  bench_splitter();
+  bench_map();
+  bench_small();
+  bench_build();
+  bench_ints();
+  bench_doubles();
+}
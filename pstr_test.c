@@ -1,10 +1,15 @@
 // © 2021 Vlad-Stefan Harbuz <vlad@vladh.net>
 // SPDX-License-Identifier: blessing
 
+// For `posix_madvise()`, which `PSTR_FILE_LINES` needs
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
 
+#define PSTR_POOL
+#define PSTR_FILE_LINES
 #include "pstr.h"
 
 #include "pstr.c"
@@ -60,6 +65,22 @@ static void test_pstr_is_valid() {
     "Invalid string is recognised as such",
     !pstr_is_valid(invalid, size)
   );
+
+  char long_str[100];
+  memset(long_str, 'x', sizeof(long_str));
+  long_str[77] = 0;
+  run_test(
+    "A terminator past the first few blocks is found",
+    pstr_is_valid(long_str, sizeof(long_str))
+  );
+  run_test(
+    "A terminator just past the size is not found",
+    !pstr_is_valid(long_str, 77)
+  );
+  run_test(
+    "A terminator at the last byte is found",
+    pstr_is_valid(long_str, 78)
+  );
 }
 
 
@@ -137,6 +158,10 @@ static void test_pstr_starts_with() {
     "\"Magpie\" does not start with \"\"",
     !pstr_starts_with("Magpie", "")
   );
+  run_test(
+    "\"Mag\" does not start with \"Magpie\"",
+    !pstr_starts_with("Mag", "Magpie")
+  );
 }
 
 
@@ -175,6 +200,211 @@ static void test_pstr_ends_with() {
     "\"Magpie\" does not end with \"\\0\"",
     !pstr_ends_with("Magpie", "\\0")
   );
+  run_test(
+    "A string of a known length is checked from that length",
+    pstr_ends_with_len("Magpie pie", 6, "pie") && !pstr_ends_with_len("Magpie!", 6, "!") &&
+    pstr_ends_with_char_len("Magpie!", 6, 'e') && !pstr_ends_with_char_len("", 0, '\0')
+  );
+}
+
+
+static void test_pstr_eq_ci() {
+  print_test_group("pstr_eq_ci()");
+  run_test(
+    "Strings that differ only in case are equal",
+    pstr_eq_ci("Magpie", "mAGPIE")
+  );
+  run_test(
+    "Different strings are not equal",
+    !pstr_eq_ci("Magpie", "Magpin")
+  );
+  run_test(
+    "Only ASCII letters are folded",
+    !pstr_eq_ci("[magpie]", "{magpie}") && !pstr_eq_ci("\xc3\xa9", "\xc3\x89")
+  );
+  run_test(
+    "Long strings are compared past the first block",
+    pstr_eq_ci(
+      "the quick brown fox jumps over the lazy dog, the quick brown fox",
+      "THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG, THE QUICK BROWN FOX"
+    ) &&
+    !pstr_eq_ci(
+      "the quick brown fox jumps over the lazy dog, the quick brown fox",
+      "THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG, THE QUICK BROWN FOY"
+    )
+  );
+  run_test(
+    "\"Magpie\" starts with \"mAG\" and ends with \"PIE\"",
+    pstr_starts_with_ci("Magpie", "mAG") && pstr_ends_with_ci("Magpie", "PIE")
+  );
+  run_test(
+    "\"Magpie\" does not start or end with \"\"",
+    !pstr_starts_with_ci("Magpie", "") && !pstr_ends_with_ci("Magpie", "")
+  );
+  run_test(
+    "Case-insensitive comparison orders as if letters were lower case",
+    pstr_cmp_ci("Magpie", "mAGPIE") == 0 &&
+    pstr_cmp_ci("magpie", "Magpin") < 0 &&
+    pstr_cmp_ci("Magpie_", "magpie[") > 0
+  );
+  run_test(
+    "Case-insensitive comparison sorts a prefix first",
+    pstr_cmp_ci("MAG", "magpie") < 0 && pstr_cmp_ci("magpie", "MAG") > 0
+  );
+}
+
+
+static void test_pstr_find() {
+  print_test_group("pstr_find()");
+  run_test(
+    "\"pie\" is found in \"Magpie pie\" at index 3",
+    pstr_find("Magpie pie", "pie") == 3
+  );
+  run_test(
+    "\"pies\" is not found in \"Magpie pie\"",
+    pstr_find("Magpie pie", "pies") == -1
+  );
+  run_test(
+    "An empty needle is not found",
+    pstr_find("Magpie", "") == -1
+  );
+  run_test(
+    "'p' is found in \"Magpie\" at index 3",
+    pstr_find_char("Magpie", 'p') == 3
+  );
+  run_test(
+    "'\\0' is not found in \"Magpie\"",
+    pstr_find_char("Magpie", '\0') == -1
+  );
+
+  // A long run of 'a's with one 'b' at the end, searched for with needles that make a
+  // naive search do a lot of work
+  char haystack[1001];
+  char needle[101];
+  memset(haystack, 'a', 1000);
+  haystack[999] = 'b';
+  haystack[1000] = '\0';
+  memset(needle, 'a', 100);
+  needle[99] = 'b';
+  needle[100] = '\0';
+  run_test(
+    "A long needle is found at the end of a long haystack",
+    pstr_find(haystack, needle) == 900
+  );
+  needle[98] = 'b';
+  run_test(
+    "A long needle that almost matches is not found",
+    pstr_find(haystack, needle) == -1
+  );
+  run_test(
+    "Short needles that almost match are not found, but one that matches is",
+    pstr_find(haystack, needle + 90) == -1 && pstr_find(haystack, needle + 88) == -1 &&
+      pstr_find(haystack, "aab") == 997
+  );
+}
+
+
+static void test_pstr_rfind() {
+  print_test_group("pstr_rfind()");
+  run_test(
+    "The last \"pie\" is found in \"Magpie pie\" at index 7",
+    pstr_rfind("Magpie pie", "pie") == 7
+  );
+  run_test(
+    "The last 'e' is found in \"Magpie pie\" at index 9",
+    pstr_rfind("Magpie pie", "e") == 9
+  );
+  run_test(
+    "\"pies\" is not found in \"Magpie pie\"",
+    pstr_rfind("Magpie pie", "pies") == -1
+  );
+
+  char haystack[1001];
+  char needle[101];
+  memset(haystack, 'a', 1000);
+  haystack[0] = 'b';
+  haystack[1000] = '\0';
+  memset(needle, 'a', 100);
+  needle[0] = 'b';
+  needle[100] = '\0';
+  run_test(
+    "A long needle is found at the start of a long haystack",
+    pstr_rfind(haystack, needle) == 0
+  );
+  run_test(
+    "A long needle of all the same character is found at the end",
+    pstr_rfind(haystack, needle + 1) == 901
+  );
+}
+
+
+static void test_pstr_count() {
+  print_test_group("pstr_count()");
+  run_test(
+    "\"pie\" occurs twice in \"Magpie pie\"",
+    pstr_count("Magpie pie", "pie") == 2
+  );
+  run_test(
+    "Overlapping occurrences are only counted once",
+    pstr_count("aaaaa", "aa") == 2
+  );
+  run_test(
+    "An empty needle occurs 0 times",
+    pstr_count("Magpie", "") == 0
+  );
+
+  char haystack[1001];
+  memset(haystack, 'a', 1000);
+  haystack[1000] = '\0';
+  run_test(
+    "A long needle is counted the right number of times",
+    pstr_count(haystack, haystack + 950) == 20
+  );
+}
+
+
+static void test_pstr_hash64() {
+  print_test_group("pstr_hash64()");
+  // wyhash's own test vectors, where each string is hashed with its index as the seed
+  char const *strs[] = {
+    "", "a", "abc", "message digest", "abcdefghijklmnopqrstuvwxyz",
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789",
+    "12345678901234567890123456789012345678901234567890123456789012345678901234567890",
+  };
+  uint64_t const expected[] = {
+    0x0409638ee2bde459ULL, 0xa8412d091b5fe0a9ULL, 0x32dd92e4b2915153ULL,
+    0x8619124089a3a16bULL, 0x7a43afb61d7f5f40ULL, 0xff42329b90e50d58ULL,
+    0xc39cab13b115aad3ULL,
+  };
+  bool did_match = true;
+  for (size_t idx = 0; idx < 7; idx++) {
+    did_match &= pstr_hash64(strs[idx], idx) == expected[idx];
+  }
+  run_test("Strings hash to wyhash's test vectors", did_match);
+
+  run_test(
+    "A different seed gives a different hash",
+    pstr_hash64("Magpie", 0) != pstr_hash64("Magpie", 1)
+  );
+
+  char str[2001];
+  for (size_t idx = 0; idx < 2000; idx++) {
+    str[idx] = (char)('a' + idx % 26);
+  }
+  str[2000] = '\0';
+  did_match = true;
+  for (size_t len = 0; len <= 2000; len += 7) {
+    char const saved = str[len];
+    size_t hashed_len = 0;
+    str[len] = '\0';
+    did_match &= pstr_len_and_hash(str, 42, &hashed_len) ==
+      pstr_sv_hash64(pstr_sv_from_n(str, len), 42) && hashed_len == len;
+    str[len] = saved;
+  }
+  run_test(
+    "Finding the length and hash at once gives the same hash, for any length",
+    did_match
+  );
 }
 
 
@@ -354,6 +584,16 @@ static void test_pstr_split_on_first_occurrence() {
       memcmp(part2, "there!\0", part2_size) == 0
   );
 
+  memcpy(part1, "xxxxxx", part1_size);
+  memcpy(part2, "xxxxxxx", part2_size);
+  did_succeed = pstr_split_on_first_occurrence(
+    src_good_fit, part1, part1_size, part2, part2_size, ','
+  );
+  run_test(
+    "Both parts are NULL-terminated",
+    did_succeed && memcmp(part1, "hi\0", 3) == 0 && memcmp(part2, "thar\0", 5) == 0
+  );
+
   memcpy(part1, "\0\0\0\0\0\0", part1_size);
   memcpy(part2, "\0\0\0\0\0\0\0", part2_size);
   did_succeed = pstr_split_on_first_occurrence(
@@ -457,6 +697,89 @@ static void test_pstr_split_on_first_occurrence() {
 }
 
 
+static void test_pstr_replace() {
+  print_test_group("pstr_replace()");
+  bool did_succeed;
+  size_t const str_size = 12;
+  char str[str_size];
+
+  pstr_copy(str, str_size, "cat, cat");
+  did_succeed = pstr_replace(str, str_size, "cat", "horse");
+  run_test(
+    "Only the first occurrence is replaced",
+    did_succeed && pstr_eq(str, "horse, cat")
+  );
+
+  did_succeed = pstr_replace(str, str_size, "cat", "horse");
+  run_test(
+    "A replacement that does not fit is not made",
+    !did_succeed && pstr_eq(str, "horse, cat")
+  );
+
+  did_succeed = pstr_replace(str, str_size, "dog", "cat");
+  run_test(
+    "Nothing is replaced if the needle is not found",
+    !did_succeed && pstr_eq(str, "horse, cat")
+  );
+}
+
+
+static void test_pstr_replace_all() {
+  print_test_group("pstr_replace_all()");
+  bool did_succeed;
+  size_t const str_size = 16;
+  char str[str_size];
+
+  pstr_copy(str, str_size, "a {x} b {x} c");
+  did_succeed = pstr_replace_all(str, str_size, "{x}", "1");
+  run_test(
+    "A shorter replacement replaces every occurrence",
+    did_succeed && pstr_eq(str, "a 1 b 1 c")
+  );
+
+  did_succeed = pstr_replace_all(str, str_size, "1", "one");
+  run_test(
+    "A longer replacement replaces every occurrence",
+    did_succeed && pstr_eq(str, "a one b one c")
+  );
+
+  did_succeed = pstr_replace_all(str, str_size, "one", "three");
+  run_test(
+    "Replacements that do not fit are not made",
+    !did_succeed && pstr_eq(str, "a one b one c")
+  );
+
+  did_succeed = pstr_replace_all(str, str_size, "two", "three");
+  run_test(
+    "Nothing is replaced if the needle is not found, which is not an error",
+    did_succeed && pstr_eq(str, "a one b one c")
+  );
+
+  pstr_copy(str, str_size, "aaaaa");
+  did_succeed = pstr_replace_all(str, str_size, "aa", "b");
+  run_test(
+    "Overlapping occurrences are replaced from left to right",
+    did_succeed && pstr_eq(str, "bba")
+  );
+
+  // Grow by more occurrences than are kept track of
+  size_t const long_str_len = PSTR_N_TRACKED_REPLACEMENTS * 3;
+  char long_str[PSTR_N_TRACKED_REPLACEMENTS * 5 + 1];
+  char expected[PSTR_N_TRACKED_REPLACEMENTS * 5 + 1];
+  pstr_clear(expected);
+  for (size_t idx = 0; idx < long_str_len; idx++) {
+    long_str[idx] = idx % 2 == 0 ? 'x' : '-';
+    pstr_cat(expected, sizeof(expected), idx % 2 == 0 ? "yy" : "-");
+  }
+  long_str[long_str_len] = '\0';
+  did_succeed = pstr_replace_all(long_str, sizeof(long_str), "x", "yy");
+  run_test(
+    "Every one of many occurrences is replaced",
+    did_succeed && pstr_eq(long_str, expected)
+  );
+}
+
+
 static void test_pstr_clear() {
   print_test_group("test_pstr_clear()");
   char str[] = "hello!";
@@ -577,6 +900,22 @@ static void test_pstr_ltrim() {
     "Nothing is trimmed if there are no leading spaces",
     memcmp(str, "hello\0", 6) == 0
   );
+
+  memcpy(str, "   \0\0\0\0\0\0", 9);
+  pstr_ltrim(str);
+  run_test(
+    "A string made up only of whitespace is left unchanged",
+    memcmp(str, "   \0", 4) == 0
+  );
+
+  char long_str[80];
+  memset(long_str, ' ', sizeof(long_str));
+  memcpy(long_str + 70, "hello \t\0", 9);
+  pstr_ltrim(long_str);
+  run_test(
+    "A long run of leading whitespace is trimmed",
+    memcmp(long_str, "hello \t\0", 8) == 0
+  );
 }
 
 
@@ -604,6 +943,23 @@ static void test_pstr_rtrim() {
     "Nothing is trimmed if there are no trailing spaces",
     memcmp(str, "hello\0", 6) == 0
   );
+
+  char long_str[80];
+  memset(long_str, '\r', sizeof(long_str));
+  memcpy(long_str, " hello", 6);
+  long_str[79] = 0;
+  pstr_rtrim(long_str);
+  run_test(
+    "A long run of trailing whitespace is trimmed",
+    memcmp(long_str, " hello\0", 7) == 0
+  );
+
+  memcpy(str, " \t \n\0\0\0\0", 9);
+  pstr_rtrim(str);
+  run_test(
+    "A string made only of whitespace is emptied",
+    str[0] == 0
+  );
 }
 
 
@@ -644,6 +1000,22 @@ static void test_pstr_ltrim_char() {
     "Nothing is trimmed if there are no leading characters",
     memcmp(str, "hello\0", 6) == 0
   );
+
+  memcpy(str, "xxx\0\0\0\0\0\0", 9);
+  pstr_ltrim_char(str, 'x');
+  run_test(
+    "A string made up only of the target is left unchanged",
+    memcmp(str, "xxx\0", 4) == 0
+  );
+
+  char long_str[80];
+  memset(long_str, ',', sizeof(long_str));
+  memcpy(long_str + 40, "hello,,\0", 8);
+  pstr_ltrim_char(long_str, ',');
+  run_test(
+    "A long run of leading characters is trimmed",
+    memcmp(long_str, "hello,,\0", 8) == 0
+  );
 }
 
 
@@ -664,6 +1036,16 @@ static void test_pstr_rtrim_char() {
     "Nothing is trimmed if there are no trailing characters",
     memcmp(str, "hello\0", 6) == 0
   );
+
+  char long_str[80];
+  memset(long_str, ',', sizeof(long_str));
+  memcpy(long_str, ",,hello", 7);
+  long_str[79] = 0;
+  pstr_rtrim_char(long_str, ',');
+  run_test(
+    "A long run of trailing characters is trimmed",
+    memcmp(long_str, ",,hello\0", 8) == 0
+  );
 }
 
 
@@ -687,6 +1069,34 @@ static void test_pstr_trim_char() {
 }
 
 
+static void test_pstr_to_lower() {
+  print_test_group("test_pstr_to_lower()");
+  char str[64];
+
+  pstr_copy(
+    str, sizeof(str), "Hello, World! @[`{ \xc3\x89t\xc3\xa9 AZaz 0123456789 MAGPIE"
+  );
+  pstr_to_lower(str);
+  run_test(
+    "Only ASCII upper case letters are turned into lower case",
+    pstr_eq(str, "hello, world! @[`{ \xc3\x89t\xc3\xa9 azaz 0123456789 magpie")
+  );
+
+  pstr_to_upper(str);
+  run_test(
+    "Only ASCII lower case letters are turned into upper case",
+    pstr_eq(str, "HELLO, WORLD! @[`{ \xc3\x89T\xc3\xa9 AZAZ 0123456789 MAGPIE")
+  );
+
+  pstr_clear(str);
+  pstr_to_upper(str);
+  run_test(
+    "An empty string is left empty",
+    pstr_is_empty(str)
+  );
+}
+
+
 static void test_pstr_from_int64() {
   print_test_group("test_pstr_from_int64()");
   bool did_succeed;
@@ -710,6 +1120,1559 @@ static void test_pstr_from_int64() {
     "The function fails for a number that does not fit in our string",
     !did_succeed
   );
+
+  char big_str[21];
+  did_succeed = pstr_from_int64(big_str, 21, INT64_MIN, &new_str_len);
+  run_test(
+    "INT64_MIN is rendered correctly",
+    did_succeed && new_str_len == 20 &&
+      memcmp(big_str, "-9223372036854775808\0", 21) == 0
+  );
+
+  did_succeed = pstr_from_int64(str, 16, 0, &new_str_len);
+  run_test(
+    "Zero is rendered correctly",
+    did_succeed && new_str_len == 1 && memcmp(str, "0\0", 2) == 0
+  );
+
+  did_succeed = pstr_from_int64(str, 6, -1234, &new_str_len);
+  run_test(
+    "A negative number that fits snugly is rendered correctly",
+    did_succeed && new_str_len == 5 && memcmp(str, "-1234\0", 6) == 0
+  );
+
+  did_succeed = pstr_from_int64(str, 5, -1234, &new_str_len);
+  run_test(
+    "The function fails if there is no space for the '-' sign",
+    !did_succeed && str[0] == 0
+  );
+}
+
+
+static void test_pstr_from_uint64() {
+  print_test_group("test_pstr_from_uint64()");
+  bool did_succeed;
+  char str[21];
+  size_t new_str_len;
+
+  did_succeed = pstr_from_uint64(str, 21, UINT64_MAX, &new_str_len);
+  run_test(
+    "UINT64_MAX is rendered correctly",
+    did_succeed && new_str_len == 20 &&
+      memcmp(str, "18446744073709551615\0", 21) == 0
+  );
+
+  did_succeed = pstr_from_uint64(str, 20, UINT64_MAX, &new_str_len);
+  run_test(
+    "The function fails if there is no space for the NULL terminator",
+    !did_succeed && str[0] == 0
+  );
+}
+
+
+static void test_pstr_from_int32() {
+  print_test_group("test_pstr_from_int32()");
+  bool did_succeed;
+  char str[12];
+  size_t new_str_len;
+
+  did_succeed = pstr_from_int32(str, 12, INT32_MIN, &new_str_len);
+  run_test(
+    "INT32_MIN is rendered correctly",
+    did_succeed && new_str_len == 11 && memcmp(str, "-2147483648\0", 12) == 0
+  );
+}
+
+
+static void test_pstr_from_uint64_hex() {
+  print_test_group("test_pstr_from_uint64_hex()");
+  bool did_succeed;
+  char str[17];
+  size_t new_str_len;
+
+  did_succeed = pstr_from_uint64_hex(str, 17, 0xdeadbeef, &new_str_len);
+  run_test(
+    "A number is rendered in hexadecimal",
+    did_succeed && new_str_len == 8 && memcmp(str, "deadbeef\0", 9) == 0
+  );
+
+  did_succeed = pstr_from_uint64_hex(str, 17, UINT64_MAX, &new_str_len);
+  run_test(
+    "UINT64_MAX is rendered in hexadecimal",
+    did_succeed && new_str_len == 16 && memcmp(str, "ffffffffffffffff\0", 17) == 0
+  );
+}
+
+
+static void test_pstr_sv_from() {
+  print_test_group("pstr_sv_from()");
+  pstr_sv const sv = pstr_sv_from("Magpie");
+  run_test(
+    "A view of \"Magpie\" has length 6",
+    sv.len == 6 && memcmp(sv.str, "Magpie", 6) == 0
+  );
+  run_test(
+    "A view of \"\" is empty",
+    pstr_sv_is_empty(pstr_sv_from(""))
+  );
+}
+
+
+static void test_pstr_sv_eq() {
+  print_test_group("pstr_sv_eq()");
+  run_test(
+    "Equal views are equal",
+    pstr_sv_eq(pstr_sv_from("Magpie"), pstr_sv_from_n("Magpies", 6))
+  );
+  run_test(
+    "Views of different lengths are not equal",
+    !pstr_sv_eq(pstr_sv_from("Magpie"), pstr_sv_from("Magpies"))
+  );
+  run_test(
+    "Different views of the same length are not equal",
+    !pstr_sv_eq(pstr_sv_from("Magpie"), pstr_sv_from("Magpin"))
+  );
+}
+
+
+static void test_pstr_sv_starts_with() {
+  print_test_group("pstr_sv_starts_with()");
+  pstr_sv const sv = pstr_sv_from_n("Magpie!!!", 6);
+  run_test(
+    "\"Magpie\" starts with \"Mag\"",
+    pstr_sv_starts_with(sv, pstr_sv_from("Mag"))
+  );
+  run_test(
+    "\"Magpie\" does not start with \"Magpie!\", even if it is followed by '!'",
+    !pstr_sv_starts_with(sv, pstr_sv_from("Magpie!"))
+  );
+  run_test(
+    "\"Magpie\" does not start with \"\"",
+    !pstr_sv_starts_with(sv, pstr_sv_from(""))
+  );
+}
+
+
+static void test_pstr_sv_ends_with() {
+  print_test_group("pstr_sv_ends_with()");
+  pstr_sv const sv = pstr_sv_from_n("Magpie!!!", 6);
+  run_test(
+    "\"Magpie\" ends with \"pie\"",
+    pstr_sv_ends_with(sv, pstr_sv_from("pie"))
+  );
+  run_test(
+    "\"Magpie\" ends with 'e'",
+    pstr_sv_ends_with_char(sv, 'e')
+  );
+  run_test(
+    "An empty view does not end with '\\0'",
+    !pstr_sv_ends_with_char(pstr_sv_from(""), '\0')
+  );
+}
+
+
+static void test_pstr_sv_slice() {
+  print_test_group("pstr_sv_slice()");
+  pstr_sv const sv = pstr_sv_from("Magpie");
+  pstr_sv const slice = pstr_sv_slice(sv, 1, 4);
+  run_test(
+    "A slice points into the original string",
+    slice.str == sv.str + 1 && pstr_sv_eq(slice, pstr_sv_from("agp"))
+  );
+  run_test(
+    "Slicing from an index keeps the rest",
+    pstr_sv_eq(pstr_sv_slice_from(sv, 3), pstr_sv_from("pie"))
+  );
+  run_test(
+    "Slicing to an index keeps the start",
+    pstr_sv_eq(pstr_sv_slice_to(sv, 3), pstr_sv_from("Mag"))
+  );
+  run_test(
+    "An end past the end of the view stops at the end",
+    pstr_sv_eq(pstr_sv_slice(sv, 3, 100), pstr_sv_from("pie"))
+  );
+  run_test(
+    "A start past the end gives an empty view",
+    pstr_sv_is_empty(pstr_sv_slice(sv, 5, 2)) &&
+      pstr_sv_is_empty(pstr_sv_slice_from(sv, 7))
+  );
+}
+
+
+static void test_pstr_sv_trim() {
+  print_test_group("pstr_sv_trim()");
+  pstr_sv const sv = pstr_sv_from(" \t Magpie \n");
+  run_test(
+    "Whitespace is trimmed from the start",
+    pstr_sv_eq(pstr_sv_ltrim(sv), pstr_sv_from("Magpie \n"))
+  );
+  run_test(
+    "Whitespace is trimmed from the end",
+    pstr_sv_eq(pstr_sv_rtrim(sv), pstr_sv_from(" \t Magpie"))
+  );
+  run_test(
+    "Whitespace is trimmed from both ends, without touching the string",
+    pstr_sv_eq(pstr_sv_trim(sv), pstr_sv_from("Magpie")) && sv.str[sv.len - 1] == '\n'
+  );
+  run_test(
+    "A character is trimmed from both ends",
+    pstr_sv_eq(pstr_sv_trim_char(pstr_sv_from("--a-b--"), '-'), pstr_sv_from("a-b"))
+  );
+  run_test(
+    "A view of only whitespace is trimmed to nothing",
+    pstr_sv_is_empty(pstr_sv_trim(pstr_sv_from(" \t\n ")))
+  );
+}
+
+
+static void test_pstr_charset() {
+  print_test_group("pstr_charset");
+  pstr_charset const space = PSTR_CHARSET_SPACE;
+  pstr_charset const alnum = PSTR_CHARSET_ALNUM;
+  pstr_charset set = pstr_charset_from(" \t\r\n,");
+
+  bool are_all_correct = true;
+  for (int c = 0; c < 256; c++) {
+    are_all_correct = are_all_correct &&
+      pstr_charset_has(&space, (char)c) == (c == ' ' || (c >= '\t' && c <= '\r')) &&
+      pstr_charset_has(&alnum, (char)c) == (
+        (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')
+      );
+  }
+  run_test(
+    "The built-in sets have exactly the right characters",
+    are_all_correct
+  );
+
+  pstr_charset_add_range(&set, '\x80', '\xff');
+  run_test(
+    "A set has the characters it was made from and the ranges added to it",
+    pstr_charset_has(&set, ',') && pstr_charset_has(&set, '\xc3') &&
+    pstr_charset_has(&set, '\xff') && !pstr_charset_has(&set, 'a') &&
+    !pstr_charset_has(&set, '\0') && !pstr_charset_has(&set, '\x7f')
+  );
+
+  run_test(
+    "Span and cspan count the characters in and not in the set",
+    pstr_span(", \t,Magpie", &set) == 4 && pstr_cspan("Magpie, pie", &set) == 6 &&
+    pstr_cspan("Magpie", &set) == 6 && pstr_span("", &set) == 0
+  );
+
+  pstr_sv const padded = pstr_sv_from(
+    " ,\t\r\n, ,\t\r\n, ,\t\r\n, ,\t\r\n, ,\t\r\n,Magpie\xc3\xa9"
+    " , ,\t\r\n, ,\t\r\n, ,\t\r\n, ,\t\r\n"
+  );
+  run_test(
+    "Views are trimmed of the characters in the set, past the first block",
+    pstr_sv_eq(pstr_sv_trim_set(padded, &set), pstr_sv_from("Magpie")) &&
+    pstr_sv_span(padded, &set) == 30 &&
+    pstr_sv_cspan(pstr_sv_slice_from(padded, 30), &set) == 6
+  );
+
+  char str[16];
+  pstr_copy(str, sizeof(str), "\n, Magpie,\n");
+  pstr_trim_set(str, &set);
+  run_test(
+    "A string is trimmed of the characters in the set in place",
+    pstr_eq(str, "Magpie")
+  );
+}
+
+
+static void test_pstr_sv_cat() {
+  print_test_group("pstr_sv_cat()");
+  bool did_succeed;
+  size_t const dest_size = 8;
+  char dest[dest_size];
+  size_t dest_len = 0;
+
+  pstr_clear(dest);
+  did_succeed = pstr_sv_cat(dest, dest_size, &dest_len, pstr_sv_from_n("hi!!", 2)) &&
+    pstr_sv_cat(dest, dest_size, &dest_len, pstr_sv_from("there"));
+  run_test(
+    "Consecutive views are concatenated and the length is kept up to date",
+    did_succeed && dest_len == 7 && memcmp(dest, "hithere\0", dest_size) == 0
+  );
+
+  did_succeed = pstr_sv_cat(dest, dest_size, &dest_len, pstr_sv_from("!"));
+  run_test(
+    "A view that does not fit is not concatenated and the length is unchanged",
+    !did_succeed && dest_len == 7 && memcmp(dest, "hithere\0", dest_size) == 0
+  );
+}
+
+
+static void test_pstr_to_int64() {
+  print_test_group("test_pstr_to_int64()");
+  bool did_succeed;
+  int64_t number = 42;
+  size_t n_consumed = 42;
+
+  did_succeed = pstr_to_int64("-4815162342", &number, &n_consumed);
+  run_test(
+    "A negative number is parsed correctly",
+    did_succeed && number == -4815162342LL && n_consumed == 11
+  );
+
+  did_succeed = pstr_to_int64("-9223372036854775808", &number, &n_consumed);
+  run_test(
+    "INT64_MIN is parsed correctly",
+    did_succeed && number == INT64_MIN && n_consumed == 20
+  );
+
+  number = 42;
+  n_consumed = 42;
+  did_succeed = pstr_to_int64("9223372036854775808", &number, &n_consumed);
+  run_test(
+    "A number that overflows is rejected without side effects",
+    !did_succeed && number == 42 && n_consumed == 42
+  );
+
+  did_succeed = pstr_to_int64("12345678901234x", &number, &n_consumed);
+  run_test(
+    "A number with trailing garbage is rejected without side effects",
+    !did_succeed && number == 42 && n_consumed == 42
+  );
+
+  did_succeed = pstr_to_int64("", &number, &n_consumed) ||
+    pstr_to_int64("-", &number, &n_consumed);
+  run_test(
+    "A string without digits is rejected",
+    !did_succeed && number == 42 && n_consumed == 42
+  );
+}
+
+
+static void test_pstr_to_uint64() {
+  print_test_group("test_pstr_to_uint64()");
+  bool did_succeed;
+  uint64_t number = 42;
+  size_t n_consumed = 42;
+
+  did_succeed = pstr_to_uint64("18446744073709551615", &number, &n_consumed);
+  run_test(
+    "UINT64_MAX is parsed correctly",
+    did_succeed && number == UINT64_MAX && n_consumed == 20
+  );
+
+  did_succeed = pstr_to_uint64("000000000000000000000000000001", &number, &n_consumed);
+  run_test(
+    "Leading zeros do not cause an overflow",
+    did_succeed && number == 1 && n_consumed == 30
+  );
+
+  number = 42;
+  did_succeed = pstr_to_uint64("18446744073709551616", &number, &n_consumed) ||
+    pstr_to_uint64("-1", &number, &n_consumed);
+  run_test(
+    "Overflowing and negative numbers are rejected",
+    !did_succeed && number == 42
+  );
+}
+
+
+static void test_pstr_sv_to_int64() {
+  print_test_group("pstr_sv_to_int64()");
+  bool did_succeed;
+  int64_t number;
+  size_t n_consumed;
+
+  did_succeed = pstr_sv_to_int64(pstr_sv_from("1234567890,-12"), &number, &n_consumed);
+  run_test(
+    "Parsing stops at the first character that isn't a digit",
+    did_succeed && number == 1234567890 && n_consumed == 10
+  );
+
+  did_succeed = pstr_sv_to_int64(pstr_sv_from_n("123456789", 4), &number, &n_consumed);
+  run_test(
+    "Nothing past the end of the view is read",
+    did_succeed && number == 1234 && n_consumed == 4
+  );
+}
+
+
+static void test_pstr_from_double() {
+  print_test_group("test_pstr_from_double()");
+  bool did_succeed;
+  char str[26];
+  size_t new_str_len;
+
+  did_succeed = pstr_from_double(str, 26, 0.1, &new_str_len);
+  run_test(
+    "0.1 is rendered with the shortest digits",
+    did_succeed && new_str_len == 3 && memcmp(str, "0.1\0", 4) == 0
+  );
+
+  did_succeed = pstr_from_double(str, 26, -1234.5, &new_str_len);
+  run_test(
+    "A negative number is rendered correctly",
+    did_succeed && memcmp(str, "-1234.5\0", 8) == 0
+  );
+
+  did_succeed = pstr_from_double(str, 26, 1e21, &new_str_len);
+  run_test(
+    "A large number is rendered in exponential notation",
+    did_succeed && memcmp(str, "1e21\0", 5) == 0
+  );
+
+  did_succeed = pstr_from_double(str, 26, -1.5e-7, &new_str_len);
+  run_test(
+    "A small number is rendered in exponential notation",
+    did_succeed && memcmp(str, "-1.5e-7\0", 8) == 0
+  );
+
+  did_succeed = pstr_from_double(str, 26, 5e-324, &new_str_len);
+  run_test(
+    "The smallest subnormal number is rendered correctly",
+    did_succeed && memcmp(str, "5e-324\0", 7) == 0
+  );
+
+  did_succeed = pstr_from_double(str, 26, 2.7183163742986588e276, &new_str_len);
+  run_test(
+    "A number that needs exact arithmetic gets the shortest digits",
+    did_succeed && memcmp(str, "2.718316374298659e276\0", 22) == 0
+  );
+
+  did_succeed = pstr_from_double(str, 26, -1.8305252769034021e208, &new_str_len);
+  run_test(
+    "A negative number that needs exact arithmetic gets the shortest digits",
+    did_succeed && memcmp(str, "-1.830525276903402e208\0", 23) == 0
+  );
+
+  did_succeed = pstr_from_double(str, 26, 30892612233637952.0, &new_str_len);
+  run_test(
+    "A large whole number that needs exact arithmetic gets the shortest digits",
+    did_succeed && memcmp(str, "30892612233637950\0", 18) == 0
+  );
+
+  did_succeed = pstr_from_double(str, 26, 9.999999999999999e22, &new_str_len);
+  run_test(
+    "A number that lies halfway to a shorter one is rendered with the shorter one",
+    did_succeed && memcmp(str, "1e23\0", 5) == 0
+  );
+
+  did_succeed = pstr_from_double(str, 26, -HUGE_VAL, &new_str_len);
+  run_test(
+    "Negative infinity is rendered as \"-inf\"",
+    did_succeed && memcmp(str, "-inf\0", 5) == 0
+  );
+
+  did_succeed = pstr_from_double(str, 7, 0.0001234, &new_str_len);
+  run_test(
+    "The function fails for a number that does not fit in our string",
+    !did_succeed && str[0] == 0
+  );
+}
+
+
+static void test_pstr_to_double() {
+  print_test_group("test_pstr_to_double()");
+  bool did_succeed;
+  double number = 42;
+  size_t n_consumed = 42;
+
+  did_succeed = pstr_to_double("-1.5e-7", &number, &n_consumed);
+  run_test(
+    "A number in exponential notation is parsed correctly",
+    did_succeed && number == -1.5e-7 && n_consumed == 7
+  );
+
+  did_succeed = pstr_to_double("0.30000000000000004", &number, &n_consumed);
+  run_test(
+    "A number with 17 significant digits is parsed correctly",
+    did_succeed && number == 0.1 + 0.2
+  );
+
+  did_succeed = pstr_to_double("1.7976931348623157e308", &number, &n_consumed);
+  run_test(
+    "The largest double is parsed correctly",
+    did_succeed && number == 1.7976931348623157e308
+  );
+
+  number = 42;
+  n_consumed = 42;
+  did_succeed = pstr_to_double("1e309", &number, &n_consumed) ||
+    pstr_to_double("1.5x", &number, &n_consumed) ||
+    pstr_to_double(".", &number, &n_consumed) ||
+    pstr_to_double("", &number, &n_consumed);
+  run_test(
+    "Overflowing numbers, trailing garbage and strings without digits are rejected",
+    !did_succeed && number == 42 && n_consumed == 42
+  );
+
+  did_succeed = pstr_sv_to_double(pstr_sv_from("2.5e,"), &number, &n_consumed);
+  run_test(
+    "An 'e' with no digits after it is not part of the number",
+    did_succeed && number == 2.5 && n_consumed == 3
+  );
+}
+
+
+static void test_pstr_sv_vcat() {
+  print_test_group("pstr_sv_vcat()");
+  bool did_succeed;
+  size_t const dest_size = 20;
+  char dest[dest_size];
+  size_t dest_len = 2;
+  pstr_sv const pieces[] = {
+    PSTR_SV(" there"), PSTR_SV(""), pstr_sv_from_n(" dear!!!", 5), PSTR_SV(" pal!!")
+  };
+
+  memcpy(dest, "hi\0", 3);
+  did_succeed = pstr_sv_vcat(dest, dest_size, &dest_len, pieces, 4);
+  run_test(
+    "Multiple views, including empty ones, are concatenated successfully",
+    did_succeed && dest_len == 19 && memcmp(dest, "hi there dear pal!!\0", 20) == 0
+  );
+
+  dest_len = 2;
+  memcpy(dest, "hi\0", 3);
+  did_succeed = pstr_sv_vcat(dest, dest_size, &dest_len, pieces, 4) &&
+    pstr_sv_vcat(dest, dest_size, &dest_len, pieces, 1);
+  run_test(
+    "Views that add up to too much are not concatenated and the string is unchanged",
+    !did_succeed && dest_len == 19 && memcmp(dest, "hi there dear pal!!\0", 20) == 0
+  );
+}
+
+
+static void *test_failing_resize(
+  void *ctx, void *ptr, size_t const old_size, size_t const new_size
+) {
+  // Hands out memory up to a limit, which is kept in `ctx`
+  size_t const *limit = ctx;
+  if (new_size > *limit) {
+    return NULL;
+  }
+  return pstr_libc_allocator().resize(NULL, ptr, old_size, new_size);
+}
+
+
+static void test_pstr_builder() {
+  print_test_group("pstr_builder");
+  bool did_succeed;
+  pstr_builder builder;
+
+  did_succeed = pstr_builder_init(&builder, pstr_libc_allocator(), 0);
+  run_test(
+    "A new builder holds an empty string",
+    did_succeed && builder.len == 0 && builder.str[0] == 0
+  );
+
+  for (size_t idx = 0; idx < 1000; idx++) {
+    did_succeed &= pstr_builder_append(&builder, "ab");
+  }
+  run_test(
+    "Appending grows the string as needed",
+    did_succeed && builder.len == 2000 && pstr_len(builder.str) == 2000 &&
+      pstr_sv_ends_with(pstr_builder_view(&builder), PSTR_SV("abab"))
+  );
+
+  pstr_builder_clear(&builder);
+  did_succeed = pstr_builder_append_sv(&builder, PSTR_SV("n=")) &&
+    pstr_builder_append_int64(&builder, INT64_MIN) &&
+    pstr_builder_append_char(&builder, ';');
+  run_test(
+    "Views, numbers and characters are appended",
+    did_succeed && pstr_eq(builder.str, "n=-9223372036854775808;") && builder.len == 23
+  );
+  pstr_builder_free(&builder);
+
+  pstr_builder_init(&builder, pstr_libc_allocator(), 0);
+  did_succeed = pstr_builder_append(&builder, "magpie");
+  for (size_t idx = 0; idx < 10; idx++) {
+    did_succeed &= pstr_builder_append_sv(&builder, pstr_builder_view(&builder));
+  }
+  did_succeed &= pstr_builder_append(&builder, builder.str + builder.len - 3);
+  run_test(
+    "A builder's own string can be appended to it, even when it has to grow",
+    did_succeed && builder.len == 6147 &&
+      pstr_sv_ends_with(pstr_builder_view(&builder), PSTR_SV("magpiepie"))
+  );
+  run_test(
+    "Room for more than could ever fit is not reserved",
+    !pstr_builder_reserve(&builder, SIZE_MAX) &&
+      !pstr_builder_reserve(&builder, SIZE_MAX - builder.len) && builder.len == 6147
+  );
+  pstr_builder_free(&builder);
+
+  size_t limit = 10;
+  pstr_allocator const failing_allocator = {
+    .resize = test_failing_resize, .ctx = &limit
+  };
+  pstr_builder_init(&builder, failing_allocator, 4);
+  did_succeed = pstr_builder_append(&builder, "hello") &&
+    pstr_builder_append(&builder, " there");
+  run_test(
+    "If no more memory can be had, the string is left as it was",
+    !did_succeed && pstr_eq(builder.str, "hello") && builder.len == 5
+  );
+  pstr_builder_free(&builder);
+}
+
+
+static void test_pstr_small() {
+  print_test_group("pstr_small");
+  bool did_succeed;
+  pstr_small(12) name;
+
+  PSTR_SMALL_INIT(name);
+  run_test(
+    "A new small string is empty",
+    name.size == 12 && name.len == 0 && pstr_eq(name.str, "")
+  );
+
+  did_succeed = pstr_small_copy(PSTR_SMALL(name), "Mag") &&
+    pstr_small_cat(PSTR_SMALL(name), "pie") &&
+    pstr_small_vcat(PSTR_SMALL(name), " ", "pie", NULL);
+  run_test(
+    "Copying and concatenating keeps the length up to date",
+    did_succeed && pstr_eq(name.str, "Magpie pie") && name.len == 10
+  );
+
+  did_succeed = pstr_small_vcat(PSTR_SMALL(name), "!", "!!", NULL);
+  run_test(
+    "Strings that do not fit are not concatenated",
+    !did_succeed && pstr_eq(name.str, "Magpie pie") && name.len == 10
+  );
+
+  pstr_small_copy(PSTR_SMALL(name), " \t Magpie \n");
+  pstr_small_trim(PSTR_SMALL(name));
+  run_test(
+    "Trimming keeps the length up to date",
+    pstr_eq(name.str, "Magpie") && name.len == 6
+  );
+
+  pstr_small_copy(PSTR_SMALL(name), "--Magpie--");
+  pstr_small_rtrim_char(PSTR_SMALL(name), '-');
+  run_test(
+    "Trimming a character keeps the length up to date",
+    pstr_eq(name.str, "--Magpie") && name.len == 8
+  );
+
+  char spaces[] = "   ";
+  char xs[] = "xxx";
+  pstr_ltrim(spaces);
+  pstr_ltrim_char(xs, 'x');
+  pstr_small_copy(PSTR_SMALL(name), "   ");
+  pstr_small_ltrim(PSTR_SMALL(name));
+  bool const is_ltrim_same = pstr_eq(name.str, spaces) && name.len == 3;
+  pstr_small_copy(PSTR_SMALL(name), "xxx");
+  pstr_small_ltrim_char(PSTR_SMALL(name), 'x');
+  run_test(
+    "Strings that would be trimmed away entirely are left as pstr_ltrim() leaves them",
+    is_ltrim_same && pstr_eq(name.str, xs) && name.len == 3
+  );
+
+  did_succeed = pstr_small_from_int64(PSTR_SMALL(name), -1234567890);
+  run_test(
+    "A number replaces the string",
+    did_succeed && pstr_eq(name.str, "-1234567890") && name.len == 11
+  );
+
+  did_succeed = pstr_small_from_int64(PSTR_SMALL(name), INT64_MIN);
+  run_test(
+    "A number that does not fit empties the string",
+    !did_succeed && pstr_eq(name.str, "") && name.len == 0
+  );
+}
+
+
+static void test_pstr_arena() {
+  print_test_group("pstr_arena");
+  pstr_arena arena;
+  pstr_arena_init(&arena, pstr_libc_allocator(), 64);
+
+  char *str1 = pstr_arena_dup(&arena, "Magpie");
+  char *str2 = pstr_arena_cat(&arena, "Mag", "pie");
+  run_test(
+    "Strings are copied and concatenated into the arena",
+    str1 && str2 && str1 != str2 && pstr_eq(str1, "Magpie") && pstr_eq(str2, "Magpie")
+  );
+
+  uint64_t *numbers = pstr_arena_alloc(&arena, 100 * sizeof(uint64_t), sizeof(uint64_t));
+  run_test(
+    "Allocations bigger than a chunk get a chunk of their own, and are aligned",
+    numbers && (uintptr_t)numbers % sizeof(uint64_t) == 0 &&
+      arena.first_chunk->next != NULL && pstr_eq(str1, "Magpie")
+  );
+
+  run_test(
+    "Allocations too big to ever fit fail, and leave the arena as it was",
+    !pstr_arena_alloc(&arena, SIZE_MAX - 8, 16) &&
+      !pstr_arena_alloc(&arena, SIZE_MAX, 1) &&
+      !pstr_arena_dup_sv(&arena, pstr_sv_from_n("Magpie", SIZE_MAX - 1)) &&
+      arena.first_chunk->next->next == NULL
+  );
+
+  pstr_arena_chunk *first_chunk = arena.first_chunk;
+  pstr_arena_reset(&arena);
+  char *str3 = pstr_arena_dup(&arena, "Pelican");
+  run_test(
+    "Chunks are reused after a reset",
+    arena.first_chunk == first_chunk && str3 == str1 && pstr_eq(str3, "Pelican")
+  );
+
+  pstr_builder builder;
+  pstr_builder_init(&builder, pstr_arena_allocator(&arena), 4);
+  char *builder_start = builder.str;
+  pstr_builder_append(&builder, "abc");
+  pstr_builder_append(&builder, "defghij");
+  run_test(
+    "A builder at the end of the arena grows in place",
+    builder.str == builder_start && pstr_eq(builder.str, "abcdefghij")
+  );
+
+  pstr_arena_free(&arena);
+}
+
+
+static void test_pstr_intern() {
+  print_test_group("pstr_intern()");
+  pstr_arena arena;
+  pstr_arena_init(&arena, pstr_libc_allocator(), 1024);
+  pstr_intern_pool pool;
+  pstr_intern_pool_init(&pool, &arena);
+
+  char buffer[8];
+  pstr_copy(buffer, sizeof(buffer), "Magpie");
+  char const *interned1 = pstr_intern(&pool, "Magpie");
+  char const *interned2 = pstr_intern(&pool, buffer);
+  char const *interned3 = pstr_intern_sv(&pool, PSTR_SV("Mag"));
+  run_test(
+    "Equal strings are interned to the same pointer",
+    interned1 && interned1 == interned2 && interned1 != buffer
+  );
+  run_test(
+    "Different strings are interned to different pointers",
+    interned3 && interned3 != interned1 && pstr_eq(interned3, "Mag")
+  );
+
+  bool are_all_found = true;
+  char number[21];
+  size_t number_len;
+  char const *interned_numbers[500];
+  for (int64_t idx = 0; idx < 500; idx++) {
+    pstr_from_int64(number, sizeof(number), idx, &number_len);
+    interned_numbers[idx] = pstr_intern(&pool, number);
+  }
+  for (int64_t idx = 0; idx < 500; idx++) {
+    pstr_from_int64(number, sizeof(number), idx, &number_len);
+    are_all_found &= pstr_intern(&pool, number) == interned_numbers[idx];
+  }
+  run_test(
+    "Strings are still found after the pool grows",
+    are_all_found && pool.n_strs == 502 && pstr_intern(&pool, "Magpie") == interned1
+  );
+
+  pstr_arena_free(&arena);
+
+  // Fill a pool up to the point where it would have to grow, with an arena that can't
+  // get any more memory
+  size_t limit = sizeof(pstr_arena_chunk) + 2048;
+  pstr_allocator const failing_allocator = {
+    .resize = test_failing_resize, .ctx = &limit,
+  };
+  pstr_arena_init(&arena, failing_allocator, 2048);
+  pstr_intern_pool_init(&pool, &arena);
+  char const *interned_seven = NULL;
+  for (int64_t idx = 0; idx < 32; idx++) {
+    pstr_from_int64(number, sizeof(number), idx, &number_len);
+    char const *interned = pstr_intern(&pool, number);
+    if (idx == 7) {
+      interned_seven = interned;
+    }
+  }
+  run_test(
+    "Strings already in a full pool are found without it growing",
+    pool.n_slots == 64 && interned_seven && pstr_intern(&pool, "7") == interned_seven &&
+      !pstr_intern(&pool, "32")
+  );
+
+  pstr_arena_free(&arena);
+}
+
+
+static bool test_tokens_are(
+  pstr_tokenizer *tokenizer, char const **expected, size_t const n_expected
+) {
+  pstr_sv token;
+  for (size_t idx = 0; idx < n_expected; idx++) {
+    if (
+      !pstr_tokenizer_next(tokenizer, &token) ||
+      !pstr_sv_eq(token, pstr_sv_from(expected[idx]))
+    ) {
+      return false;
+    }
+  }
+  return !pstr_tokenizer_next(tokenizer, &token);
+}
+
+
+static void test_pstr_map() {
+  print_test_group("pstr_map");
+  bool did_succeed;
+  void *value;
+  pstr_map map;
+  pstr_map_init(&map, pstr_libc_allocator(), 0);
+
+  int get = 1;
+  int post = 2;
+  run_test(
+    "An empty map has no keys",
+    !pstr_map_lookup(&map, "GET", &value) && !pstr_map_delete(&map, "GET")
+  );
+
+  char buffer[8];
+  pstr_copy(buffer, sizeof(buffer), "GET");
+  did_succeed = pstr_map_insert(&map, buffer, &get) &&
+    pstr_map_insert_sv(&map, PSTR_SV("POST"), &post);
+  pstr_copy(buffer, sizeof(buffer), "PUT");
+  run_test(
+    "Added keys are found, and the map keeps its own copy of them",
+    did_succeed && map.n_entries == 2 &&
+      pstr_map_lookup(&map, "GET", &value) && value == &get &&
+      pstr_map_lookup_sv(&map, PSTR_SV("POST"), &value) && value == &post &&
+      !pstr_map_lookup(&map, "PUT", NULL)
+  );
+
+  did_succeed = pstr_map_insert(&map, "GET", &post);
+  run_test(
+    "Adding a key again replaces its value",
+    did_succeed && map.n_entries == 2 && pstr_map_lookup(&map, "GET", &value) &&
+      value == &post
+  );
+
+  did_succeed = pstr_map_delete(&map, "GET");
+  run_test(
+    "Deleted keys are no longer found",
+    did_succeed && map.n_entries == 1 && !pstr_map_lookup(&map, "GET", NULL) &&
+      pstr_map_lookup(&map, "POST", NULL)
+  );
+
+  // Add and delete enough keys that the map has to grow and clear out deleted slots
+  bool are_all_found = true;
+  char number[21];
+  size_t number_len;
+  for (int64_t idx = 0; idx < 2000; idx++) {
+    pstr_from_int64(number, sizeof(number), idx, &number_len);
+    did_succeed &= pstr_map_insert(&map, number, (void *)(intptr_t)idx);
+  }
+  for (int64_t idx = 0; idx < 2000; idx += 2) {
+    pstr_from_int64(number, sizeof(number), idx, &number_len);
+    did_succeed &= pstr_map_delete(&map, number);
+  }
+  for (int64_t idx = 0; idx < 2000; idx++) {
+    pstr_from_int64(number, sizeof(number), idx, &number_len);
+    bool const is_found = pstr_map_lookup(&map, number, &value);
+    bool const should_be_found = idx % 2 == 1;
+    are_all_found &= is_found == should_be_found &&
+      (!is_found || value == (void *)(intptr_t)idx);
+  }
+  run_test(
+    "Many keys can be added and deleted",
+    did_succeed && are_all_found && map.n_entries == 1001
+  );
+
+  size_t idx = 0;
+  size_t n_entries = 0;
+  pstr_map_entry const *entry;
+  while (pstr_map_next(&map, &idx, &entry)) {
+    n_entries++;
+  }
+  run_test("Going through the map visits every entry", n_entries == 1001);
+
+  pstr_map_clear(&map);
+  run_test(
+    "A cleared map has no keys",
+    map.n_entries == 0 && !pstr_map_lookup(&map, "POST", NULL)
+  );
+  pstr_map_free(&map);
+
+  size_t limit = 8192;
+  pstr_allocator const failing_allocator = {
+    .resize = test_failing_resize, .ctx = &limit
+  };
+  pstr_map_init(&map, failing_allocator, 0);
+  did_succeed = true;
+  for (int64_t idx = 0; idx < 1000 && did_succeed; idx++) {
+    pstr_from_int64(number, sizeof(number), idx, &number_len);
+    did_succeed = pstr_map_insert(&map, number, NULL);
+  }
+  run_test(
+    "If no more memory can be had, the key is not added",
+    !did_succeed && !pstr_map_lookup(&map, number, NULL) &&
+      pstr_map_lookup(&map, "0", NULL)
+  );
+  pstr_map_free(&map);
+}
+
+
+static void test_pstr_tokenizer() {
+  print_test_group("pstr_tokenizer");
+  pstr_tokenizer tokenizer;
+
+  char const *expected_fields[] = { "a", "bb", "", "ccc", "" };
+  pstr_tokenizer_init(&tokenizer, pstr_sv_from("a,bb,,ccc,"), PSTR_SV(","));
+  run_test(
+    "A string is split into all of its fields, including empty ones",
+    test_tokens_are(&tokenizer, expected_fields, 5)
+  );
+
+  char const *expected_empty[] = { "" };
+  pstr_tokenizer_init(&tokenizer, pstr_sv_from(""), PSTR_SV(","));
+  run_test(
+    "An empty string has one empty token",
+    test_tokens_are(&tokenizer, expected_empty, 1)
+  );
+
+  char const *expected_multi[] = { "GET", "/index.html", "HTTP/1.1", "" };
+  pstr_tokenizer_init(
+    &tokenizer, pstr_sv_from("GET :: /index.html :: HTTP/1.1 :: "), PSTR_SV(" :: ")
+  );
+  run_test(
+    "A string is split on a multi-character separator",
+    test_tokens_are(&tokenizer, expected_multi, 4)
+  );
+
+  char const long_line[] =
+    "a long field that is well over thirty-two characters long\t"
+    "and another one that's just as long, if not longer";
+  char const *expected_long[] = {
+    "a long field that is well over thirty-two characters long",
+    "and another one that's just as long, if not longer"
+  };
+  pstr_tokenizer_init(&tokenizer, pstr_sv_from(long_line), PSTR_SV("\t"));
+  run_test(
+    "Long fields are split correctly",
+    test_tokens_are(&tokenizer, expected_long, 2)
+  );
+
+  char const *expected_quoted[] = { "a", "b,c", "say \"\"hi\"\"", "", "d" };
+  pstr_tokenizer_init_quoted(
+    &tokenizer, pstr_sv_from("a,\"b,c\",\"say \"\"hi\"\"\",\"\",d"), PSTR_SV(","), '"'
+  );
+  run_test(
+    "Quoted fields can contain separators and doubled quotes",
+    test_tokens_are(&tokenizer, expected_quoted, 5)
+  );
+
+  char const *expected_trailing[] = { "\"ab\"cd", "e", "\"f,g\" h", "i" };
+  pstr_tokenizer_init_quoted(
+    &tokenizer, pstr_sv_from("\"ab\"cd,e,\"f,g\" h,\"i\""), PSTR_SV(","), '"'
+  );
+  run_test(
+    "Text after a closing quote is kept, along with the quotes",
+    test_tokens_are(&tokenizer, expected_trailing, 4)
+  );
+
+  char const *expected_unterminated[] = { "\"ab,cd" };
+  pstr_tokenizer_init_quoted(&tokenizer, pstr_sv_from("\"ab,cd"), PSTR_SV(","), '"');
+  run_test(
+    "A quote that is never closed makes the rest into one token, quote and all",
+    test_tokens_are(&tokenizer, expected_unterminated, 1)
+  );
+
+  pstr_charset const separators = pstr_charset_from(" ,;");
+  char const *expected_set[] = { "a", "", "bb", "c", "" };
+  pstr_tokenizer_init_set(&tokenizer, pstr_sv_from("a, bb;c "), &separators);
+  run_test(
+    "A string is split on any of a set of separators",
+    test_tokens_are(&tokenizer, expected_set, 5)
+  );
+}
+
+
+/*
+  Feeds `stream` to `splitter` in chunks of `chunk_len` characters, and checks that the
+  records that come out are `expected`.
+*/
+static bool test_splits_into(
+  pstr_splitter *splitter, char const *stream, size_t const chunk_len,
+  char const *const *expected, size_t const n_expected
+) {
+  size_t const len = strlen(stream);
+  size_t n_records = 0;
+  pstr_sv record;
+  for (size_t idx = 0; idx < len; idx += chunk_len) {
+    size_t const n_left = len - idx;
+    pstr_splitter_feed(
+      splitter, pstr_sv_from_n(stream + idx, n_left < chunk_len ? n_left : chunk_len)
+    );
+    while (pstr_splitter_next(splitter, &record)) {
+      if (n_records == n_expected) {
+        return false;
+      }
+      if (!pstr_sv_eq(record, pstr_sv_from(expected[n_records++]))) {
+        return false;
+      }
+    }
+  }
+  if (pstr_splitter_finish(splitter, &record)) {
+    if (n_records == n_expected) {
+      return false;
+    }
+    if (!pstr_sv_eq(record, pstr_sv_from(expected[n_records++]))) {
+      return false;
+    }
+  }
+  return n_records == n_expected && !splitter->did_fail;
+}
+
+
+static void test_pstr_splitter() {
+  print_test_group("pstr_splitter");
+  pstr_splitter splitter;
+  pstr_sv record;
+
+  char const chunk1[] = "one\ntwo\nthr";
+  char const chunk2[] = "ee\nfour";
+  pstr_splitter_init(&splitter, pstr_libc_allocator(), '\n', 64);
+  pstr_splitter_feed(&splitter, PSTR_SV(chunk1));
+  bool const is_first_a_view = pstr_splitter_next(&splitter, &record) &&
+    record.str == chunk1 && record.len == 3;
+  bool const is_second_a_view = pstr_splitter_next(&splitter, &record) &&
+    record.str == chunk1 + 4 && record.len == 3;
+  bool const is_chunk1_done = !pstr_splitter_next(&splitter, &record);
+  pstr_splitter_feed(&splitter, PSTR_SV(chunk2));
+  bool const is_third_joined = pstr_splitter_next(&splitter, &record) &&
+    pstr_sv_eq(record, PSTR_SV("three")) && record.str == splitter.tail;
+  bool const is_chunk2_done = !pstr_splitter_next(&splitter, &record);
+  run_test(
+    "Records inside a chunk are views, and records across chunks are put together",
+    is_first_a_view && is_second_a_view && is_chunk1_done && is_third_joined &&
+      is_chunk2_done
+  );
+  run_test(
+    "The end of the stream is the last record",
+    pstr_splitter_finish(&splitter, &record) && pstr_sv_eq(record, PSTR_SV("four")) &&
+      !pstr_splitter_finish(&splitter, &record)
+  );
+  pstr_splitter_free(&splitter);
+
+  char const *stream = "magpie\n\nmagpies, and more magpies\n\n!";
+  char const *expected[] = { "magpie", "", "magpies, and more magpies", "", "!" };
+  bool are_all_correct = true;
+  for (size_t chunk_len = 1; chunk_len <= 40; chunk_len++) {
+    pstr_splitter_init(&splitter, pstr_libc_allocator(), '\n', 64);
+    are_all_correct = are_all_correct &&
+      test_splits_into(&splitter, stream, chunk_len, expected, 5);
+    pstr_splitter_free(&splitter);
+  }
+  run_test(
+    "A stream is split the same way whatever size its chunks are", are_all_correct
+  );
+
+  char const *expected_ending[] = { "magpie", "pie" };
+  pstr_splitter_init(&splitter, pstr_libc_allocator(), '\n', 64);
+  run_test(
+    "A separator at the end of the stream doesn't make an empty record",
+    test_splits_into(&splitter, "magpie\npie\n", 4, expected_ending, 2)
+  );
+  pstr_splitter_free(&splitter);
+
+  pstr_splitter_init(&splitter, pstr_libc_allocator(), '\n', 8);
+  pstr_splitter_feed(&splitter, PSTR_SV("short\nand much too lo"));
+  bool const is_short_fine = pstr_splitter_next(&splitter, &record);
+  pstr_splitter_next(&splitter, &record);
+  pstr_splitter_feed(&splitter, PSTR_SV("ng\n"));
+  run_test(
+    "Records longer than the limit make the splitter fail",
+    is_short_fine && splitter.did_fail && !pstr_splitter_next(&splitter, &record)
+  );
+  pstr_splitter_free(&splitter);
+
+  size_t limit = 0;
+  pstr_allocator const failing_allocator = {
+    .resize = test_failing_resize, .ctx = &limit
+  };
+  pstr_splitter_init(&splitter, failing_allocator, '\n', 64);
+  pstr_splitter_feed(&splitter, PSTR_SV("whole\ncut"));
+  bool const is_whole_fine = pstr_splitter_next(&splitter, &record);
+  run_test(
+    "If no memory can be had, the splitter fails once a record is cut off",
+    is_whole_fine && !pstr_splitter_next(&splitter, &record) && splitter.did_fail
+  );
+  pstr_splitter_free(&splitter);
+}
+
+
+static void test_pstr_matcher() {
+  print_test_group("pstr_matcher");
+  bool did_succeed;
+  pstr_matcher matcher;
+  pstr_match_iterator iterator;
+  pstr_match match;
+  char const *patterns[] = { "he", "she", "his", "hers", "" };
+
+  did_succeed = pstr_matcher_init(&matcher, pstr_libc_allocator(), patterns, 5);
+  run_test(
+    "A matcher is compiled from a list of patterns",
+    did_succeed
+  );
+
+  run_test(
+    "The first match is the one that ends first",
+    pstr_matcher_find(&matcher, "ushers", &match) &&
+      match.pattern_idx == 1 && match.start == 1 && match.len == 3
+  );
+  run_test(
+    "A string without any of the patterns has no matches",
+    !pstr_matcher_find(&matcher, "magpies", &match)
+  );
+
+  // "ushers" has "she" and "he" ending at index 4, and "hers" ending at index 6
+  size_t const expected[][2] = { {1, 1}, {0, 2}, {3, 2} };
+  size_t n_matches = 0;
+  did_succeed = true;
+  pstr_match_iterator_init(&iterator, &matcher, PSTR_SV("ushers"));
+  while (pstr_match_iterator_next(&iterator, &match)) {
+    did_succeed &= n_matches < 3 &&
+      match.pattern_idx == expected[n_matches][0] && match.start == expected[n_matches][1];
+    n_matches++;
+  }
+  run_test(
+    "All matches are found, including overlapping ones, in order",
+    did_succeed && n_matches == 3
+  );
+  pstr_matcher_free(&matcher);
+
+  size_t limit = 64;
+  pstr_allocator const failing_allocator = {
+    .resize = test_failing_resize, .ctx = &limit
+  };
+  run_test(
+    "If no memory can be had, the matcher is not compiled",
+    !pstr_matcher_init(&matcher, failing_allocator, patterns, 5)
+  );
+}
+
+
+static void test_pstr_prefix_table() {
+  print_test_group("pstr_prefix_table");
+  bool did_succeed;
+  pstr_prefix_table table;
+  char const *prefixes[] = {
+    "/", "/api/", "/api/users/", "", "/static/", "/api/users/settings/", "GET ", "/api/"
+  };
+
+  did_succeed = pstr_prefix_table_init(&table, pstr_libc_allocator(), prefixes, 8);
+  run_test(
+    "A prefix table is compiled from a list of prefixes",
+    did_succeed
+  );
+  run_test(
+    "The longest prefix that matches is the one found",
+    pstr_starts_with_any("/api/users/42", &table) == 2 &&
+    pstr_starts_with_any("/api/users/settings/email", &table) == 5 &&
+    pstr_starts_with_any("/index.html", &table) == 0 &&
+    pstr_starts_with_any("GET /", &table) == 6
+  );
+  run_test(
+    "Of prefixes that are given more than once, the first one is found",
+    pstr_starts_with_any("/api/ping", &table) == 1
+  );
+  run_test(
+    "Strings that are shorter than a prefix, or empty, don't match it",
+    pstr_starts_with_any("/api/users", &table) == 1 &&
+    pstr_starts_with_any("GET", &table) == -1 &&
+    pstr_starts_with_any("", &table) == -1
+  );
+  run_test(
+    "Nothing past the end of a view is looked at",
+    pstr_sv_starts_with_any(pstr_sv_from_n("/api/users/settings/", 19), &table) == 2 &&
+    pstr_sv_starts_with_any(pstr_sv_from_n("/api/", 4), &table) == 0 &&
+    pstr_sv_starts_with_any(pstr_sv_from_n("/", 0), &table) == -1
+  );
+  bool is_order_consistent = true;
+  for (size_t idx1 = 0; idx1 < table.n_prefixes; idx1++) {
+    for (size_t idx2 = 0; idx2 < table.n_prefixes; idx2++) {
+      int const order = pstr_prefix_compare(&table.prefixes[idx1], &table.prefixes[idx2]);
+      int const reverse_order =
+        pstr_prefix_compare(&table.prefixes[idx2], &table.prefixes[idx1]);
+      is_order_consistent = is_order_consistent &&
+        (idx1 == idx2 ? order == 0 : order == -reverse_order && order != 0);
+    }
+  }
+  run_test(
+    "Prefixes are sorted with a consistent order, where each is equal only to itself",
+    is_order_consistent
+  );
+  pstr_prefix_table_free(&table);
+
+  size_t limit = 64;
+  pstr_allocator const failing_allocator = {
+    .resize = test_failing_resize, .ctx = &limit
+  };
+  run_test(
+    "If no memory can be had, the prefix table is not compiled",
+    !pstr_prefix_table_init(&table, failing_allocator, prefixes, 8)
+  );
+}
+
+
+static bool test_column_is(pstr_column const *column, char const *const *expected) {
+  for (size_t idx = 0; idx < column->n_strs; idx++) {
+    if (!pstr_sv_eq(pstr_column_get(column, idx), pstr_sv_from(expected[idx]))) {
+      return false;
+    }
+  }
+  return column->offsets[0] == 0;
+}
+
+
+#define N_TEST_BATCH_STRS 1000
+
+
+static void test_pstr_batch() {
+  print_test_group("pstr_batch");
+  bool did_succeed;
+  bool results[5];
+  char bytes[64];
+  size_t offsets[6];
+
+  char const src_bytes[] = " magpie\t" "MAGPIE" "   " "magpies  " "\n\nmag pie\n";
+  size_t const src_offsets[] = { 0, 8, 14, 17, 26, 36 };
+  pstr_column const src = { .bytes = src_bytes, .offsets = src_offsets, .n_strs = 5 };
+  pstr_column const trimmed = { .bytes = bytes, .offsets = offsets, .n_strs = 5 };
+  char const *expected_trimmed[] = { "magpie", "MAGPIE", "", "magpies", "mag pie" };
+
+  did_succeed = pstr_batch_trim(&src, bytes, sizeof(bytes), offsets);
+  run_test(
+    "Every string in a column is trimmed",
+    did_succeed && test_column_is(&trimmed, expected_trimmed)
+  );
+
+  memcpy(bytes, src_bytes, sizeof(src_bytes));
+  memcpy(offsets, src_offsets, sizeof(src_offsets));
+  did_succeed = pstr_batch_trim(&trimmed, bytes, sizeof(bytes), offsets);
+  run_test(
+    "A column can be trimmed in place",
+    did_succeed && test_column_is(&trimmed, expected_trimmed)
+  );
+
+  run_test(
+    "Nothing is trimmed if the result might not fit",
+    !pstr_batch_trim(&src, bytes, 35, offsets)
+  );
+
+  pstr_batch_eq_sv(&trimmed, PSTR_SV("magpie"), results);
+  run_test(
+    "Every string in a column is compared to a string",
+    results[0] && !results[1] && !results[2] && !results[3] && !results[4]
+  );
+
+  pstr_batch_eq(&trimmed, &src, results);
+  bool const are_eq_correct = !results[0] && results[1] && !results[2] && !results[3];
+  pstr_batch_eq(&trimmed, &trimmed, results);
+  run_test(
+    "The strings in two columns are compared pairwise",
+    are_eq_correct && results[0] && results[2] && results[4]
+  );
+
+  pstr_batch_starts_with(&trimmed, PSTR_SV("magpie"), results);
+  bool const are_short_correct =
+    results[0] && !results[1] && !results[2] && results[3] && !results[4];
+  pstr_batch_starts_with(&src, PSTR_SV("\n\nmag pie"), results);
+  run_test(
+    "Every string in a column is checked for a short or long prefix",
+    are_short_correct && !results[0] && !results[3] && results[4]
+  );
+
+  // Enough strings, of every length up to 40, to be compared in blocks, and with some
+  // of them changed at their start, in their middle, at their end, or in length
+  static char long_bytes[2][N_TEST_BATCH_STRS * 41];
+  static size_t long_offsets[2][N_TEST_BATCH_STRS + 1];
+  static bool long_results[3][N_TEST_BATCH_STRS];
+  char const letters[] = "the quick brown fox jumps over the lazy dog";
+  long_offsets[0][0] = 0;
+  long_offsets[1][0] = 0;
+  for (size_t idx = 0; idx < N_TEST_BATCH_STRS; idx++) {
+    size_t const str_len = idx % 41;
+    char *str1 = long_bytes[0] + long_offsets[0][idx];
+    char *str2 = long_bytes[1] + long_offsets[1][idx];
+    memcpy(str1, letters, str_len);
+    memcpy(str2, letters, str_len);
+    size_t str2_len = str_len;
+    size_t const change = (idx / 41) % 5;
+    if (change == 1 && str_len > 0) {
+      str2[str_len - 1] = '!';
+    } else if (change == 2 && str_len > 0) {
+      str2[0] = '!';
+    } else if (change == 3) {
+      str2[str2_len++] = '!';
+    } else if (change == 4 && str_len > 0) {
+      str2[str_len / 2] = '!';
+    }
+    long_offsets[0][idx + 1] = long_offsets[0][idx] + str_len;
+    long_offsets[1][idx + 1] = long_offsets[1][idx] + str2_len;
+  }
+  pstr_column const long_columns[2] = {
+    { .bytes = long_bytes[0], .offsets = long_offsets[0], .n_strs = N_TEST_BATCH_STRS },
+    { .bytes = long_bytes[1], .offsets = long_offsets[1], .n_strs = N_TEST_BATCH_STRS },
+  };
+  pstr_sv const long_str = pstr_sv_from_n(letters, 20);
+  pstr_sv const long_prefix = pstr_sv_from_n(letters, 12);
+  pstr_batch_eq(&long_columns[0], &long_columns[1], long_results[0]);
+  pstr_batch_eq_sv(&long_columns[1], long_str, long_results[1]);
+  pstr_batch_starts_with(&long_columns[1], long_prefix, long_results[2]);
+  bool are_long_correct = true;
+  for (size_t idx = 0; idx < N_TEST_BATCH_STRS; idx++) {
+    pstr_sv const str1 = pstr_column_get(&long_columns[0], idx);
+    pstr_sv const str2 = pstr_column_get(&long_columns[1], idx);
+    are_long_correct = are_long_correct &&
+      long_results[0][idx] == pstr_sv_eq(str1, str2) &&
+      long_results[1][idx] == pstr_sv_eq(str2, long_str) &&
+      long_results[2][idx] == pstr_sv_starts_with(str2, long_prefix);
+  }
+  run_test(
+    "Strings of any length are compared just as pstr_sv_eq() and pstr_sv_starts_with() do",
+    are_long_correct
+  );
+
+  int64_t const numbers[] = { 0, -7, 1234567890, INT64_MIN, 42 };
+  pstr_column const formatted = { .bytes = bytes, .offsets = offsets, .n_strs = 5 };
+  char const *expected_formatted[] = {
+    "0", "-7", "1234567890", "-9223372036854775808", "42"
+  };
+  did_succeed = pstr_batch_from_int64(numbers, 5, bytes, 35, offsets);
+  run_test(
+    "Numbers are written out as a column of strings",
+    did_succeed && offsets[5] == 35 && test_column_is(&formatted, expected_formatted)
+  );
+  run_test(
+    "Numbers are not written out if they don't fit",
+    !pstr_batch_from_int64(numbers, 5, bytes, 34, offsets)
+  );
+
+  char const buffers[] = "magpie\0\0" "magpies!" "mag\0pie\0" "" "\0";
+  size_t const buffer_offsets[] = { 0, 8, 16, 24, 24, 25 };
+  pstr_column const buffer_column = {
+    .bytes = buffers, .offsets = buffer_offsets, .n_strs = 5
+  };
+  pstr_batch_is_valid(&buffer_column, results);
+  run_test(
+    "Strings are valid if they have a NULL terminator within their bounds",
+    results[0] && !results[1] && results[2] && !results[3] && results[4]
+  );
+}
+
+
+#define N_TEST_POOL_STRS 20000
+
+
+static bool test_columns_match(
+  char const *bytes1, size_t const *offsets1, char const *bytes2, size_t const *offsets2
+) {
+  return memcmp(offsets1, offsets2, (N_TEST_POOL_STRS + 1) * sizeof(size_t)) == 0 &&
+    memcmp(bytes1, bytes2, offsets1[N_TEST_POOL_STRS]) == 0;
+}
+
+
+static void test_pstr_pool() {
+  print_test_group("pstr_pool");
+  pstr_pool pool;
+  static char src_bytes[N_TEST_POOL_STRS * 8];
+  static size_t src_offsets[N_TEST_POOL_STRS + 1];
+  static int64_t numbers[N_TEST_POOL_STRS];
+  static char bytes[2][N_TEST_POOL_STRS * 20];
+  static size_t offsets[2][N_TEST_POOL_STRS + 1];
+  static bool results[2][N_TEST_POOL_STRS];
+
+  // Enough strings of different lengths, some with spaces around them, to be split into
+  // lots of chunks
+  size_t len = 0;
+  src_offsets[0] = 0;
+  for (size_t idx = 0; idx < N_TEST_POOL_STRS; idx++) {
+    size_t const str_len = idx % 8;
+    for (size_t idx_char = 0; idx_char < str_len; idx_char++) {
+      src_bytes[len++] = (idx_char + idx) % 3 == 0 ? ' ' : (char)('a' + idx_char);
+    }
+    src_offsets[idx + 1] = len;
+    numbers[idx] = (int64_t)(idx * 2654435761u) * ((idx % 2) ? -1 : 1);
+  }
+  pstr_column const src = {
+    .bytes = src_bytes, .offsets = src_offsets, .n_strs = N_TEST_POOL_STRS
+  };
+  size_t const dest_size = sizeof(bytes[0]);
+
+  pstr_batch_trim(&src, bytes[0], dest_size, offsets[0]);
+  pstr_batch_from_int64(numbers, N_TEST_POOL_STRS, bytes[1], dest_size, offsets[1]);
+  pstr_batch_starts_with(&src, PSTR_SV("ab"), results[0]);
+
+  // Results mustn't depend on how many threads there are, or which of them did what
+  for (size_t n_threads = 1; n_threads <= 4; n_threads += 3) {
+    static char pool_bytes[N_TEST_POOL_STRS * 20];
+    static size_t pool_offsets[N_TEST_POOL_STRS + 1];
+    bool const did_init = pstr_pool_init(&pool, pstr_libc_allocator(), n_threads);
+
+    bool did_succeed = did_init &&
+      pstr_pool_batch_trim(&pool, &src, pool_bytes, dest_size, pool_offsets);
+    run_test(
+      "A pool trims a column just as the batch functions do",
+      did_succeed && test_columns_match(pool_bytes, pool_offsets, bytes[0], offsets[0])
+    );
+
+    did_succeed = did_init && pstr_pool_batch_from_int64(
+      &pool, numbers, N_TEST_POOL_STRS, pool_bytes, dest_size, pool_offsets
+    );
+    run_test(
+      "A pool writes numbers out just as the batch functions do",
+      did_succeed && test_columns_match(pool_bytes, pool_offsets, bytes[1], offsets[1])
+    );
+
+    did_succeed = did_init && pstr_pool_batch_from_int64(
+      &pool, numbers, N_TEST_POOL_STRS, pool_bytes, 64, pool_offsets
+    );
+    run_test("A pool doesn't write numbers out if they don't fit", did_init && !did_succeed);
+
+    if (did_init) {
+      pstr_pool_batch_starts_with(&pool, &src, PSTR_SV("ab"), results[1]);
+    }
+    run_test(
+      "A pool checks prefixes just as the batch functions do",
+      did_init && memcmp(results[0], results[1], sizeof(results[0])) == 0
+    );
+
+    if (did_init) {
+      pstr_pool_free(&pool);
+    }
+  }
+
+  run_test(
+    "A pool can't have no threads",
+    !pstr_pool_init(&pool, pstr_libc_allocator(), 0)
+  );
+}
+
+
+static bool test_write_file(char const *path, char const *contents, size_t const len) {
+  FILE *file = fopen(path, "wb");
+  if (!file) {
+    return false;
+  }
+  bool const did_write = fwrite(contents, 1, len, file) == len;
+  return fclose(file) == 0 && did_write;
+}
+
+
+static bool test_lines_are(pstr_file_lines *lines, char const *const *expected, size_t n) {
+  pstr_sv line;
+  for (size_t idx = 0; idx < n; idx++) {
+    if (!pstr_file_lines_next(lines, &line)) {
+      return false;
+    }
+    if (!pstr_sv_eq(line, pstr_sv_from(expected[idx]))) {
+      return false;
+    }
+  }
+  return !pstr_file_lines_next(lines, &line) && !lines->did_fail;
+}
+
+
+static void test_pstr_file_lines() {
+  print_test_group("pstr_file_lines");
+  bool did_succeed;
+  pstr_file_lines lines;
+  char const *path = "bin/pstr_test_lines.txt";
+  char const contents[] = "magpie\n\npie\r\nthe last one";
+  char const *expected[] = { "magpie", "", "pie\r", "the last one" };
+
+  did_succeed = test_write_file(path, contents, sizeof(contents) - 1) &&
+    pstr_file_lines_open(&lines, pstr_libc_allocator(), path);
+  run_test(
+    "A file is mapped and read line by line",
+    did_succeed && lines.is_mapped && test_lines_are(&lines, expected, 4)
+  );
+  if (did_succeed) {
+    pstr_file_lines_close(&lines);
+  }
+
+  int fd = open(path, O_RDONLY);
+  did_succeed = fd >= 0 && pstr_file_lines_from_fd(&lines, pstr_libc_allocator(), fd);
+  run_test(
+    "A file descriptor is read line by line",
+    did_succeed && !lines.is_mapped && test_lines_are(&lines, expected, 4)
+  );
+  if (did_succeed) {
+    pstr_file_lines_close(&lines);
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+
+  // One line is longer than the buffer, which has to grow to fit it
+  static char long_contents[3 * PSTR_FILE_LINES_BUFFER_SIZE];
+  memset(long_contents, 'm', sizeof(long_contents));
+  long_contents[1] = '\n';
+  long_contents[sizeof(long_contents) - 3] = '\n';
+  fd = test_write_file(path, long_contents, sizeof(long_contents)) ?
+    open(path, O_RDONLY) : -1;
+  did_succeed = fd >= 0 && pstr_file_lines_from_fd(&lines, pstr_libc_allocator(), fd);
+  pstr_sv line;
+  bool const is_long_line_correct = did_succeed &&
+    pstr_file_lines_next(&lines, &line) && line.len == 1 &&
+    pstr_file_lines_next(&lines, &line) && line.len == sizeof(long_contents) - 5 &&
+    pstr_file_lines_next(&lines, &line) && pstr_sv_eq(line, PSTR_SV("mm")) &&
+    !pstr_file_lines_next(&lines, &line);
+  run_test("Lines longer than the buffer are read whole", is_long_line_correct);
+  if (did_succeed) {
+    pstr_file_lines_close(&lines);
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+
+  did_succeed = test_write_file(path, "", 0) &&
+    pstr_file_lines_open(&lines, pstr_libc_allocator(), path);
+  run_test(
+    "An empty file has no lines",
+    did_succeed && !pstr_file_lines_next(&lines, &line) && !lines.did_fail
+  );
+  if (did_succeed) {
+    pstr_file_lines_close(&lines);
+  }
+  remove(path);
+
+  // Files in /proc say they're empty, but aren't, so they have to be read rather than
+  // mapped. If there's no /proc, there's nothing to check.
+  size_t n_expected_lines = 0;
+  FILE *proc_file = fopen("/proc/self/status", "r");
+  if (proc_file) {
+    int c;
+    while ((c = fgetc(proc_file)) != EOF) {
+      n_expected_lines += (c == '\n');
+    }
+    fclose(proc_file);
+  }
+  size_t n_lines = 0;
+  did_succeed = !proc_file ||
+    pstr_file_lines_open(&lines, pstr_libc_allocator(), "/proc/self/status");
+  if (proc_file && did_succeed) {
+    while (pstr_file_lines_next(&lines, &line)) {
+      n_lines++;
+    }
+    did_succeed = !lines.is_mapped && !lines.did_fail;
+    pstr_file_lines_close(&lines);
+  }
+  run_test(
+    "Files that say they're empty, like those in /proc, are read",
+    did_succeed && n_lines == n_expected_lines && (!proc_file || n_lines > 0)
+  );
+
+  run_test(
+    "A file that doesn't exist can't be opened",
+    !pstr_file_lines_open(&lines, pstr_libc_allocator(), "bin/pstr_no_such_file")
+  );
+
+  size_t limit = 0;
+  pstr_allocator const failing_allocator = {
+    .resize = test_failing_resize, .ctx = &limit
+  };
+  run_test(
+    "If no buffer can be had, a file descriptor can't be read",
+    !pstr_file_lines_from_fd(&lines, failing_allocator, 0)
+  );
 }
 
 
@@ -722,11 +2685,18 @@ int main(int argc, char **argv) {
   test_pstr_starts_with();
   test_pstr_ends_with_char();
   test_pstr_ends_with();
+  test_pstr_eq_ci();
+  test_pstr_find();
+  test_pstr_rfind();
+  test_pstr_count();
+  test_pstr_hash64();
   test_pstr_copy();
   test_pstr_copy_n();
   test_pstr_cat();
   test_pstr_vcat();
   test_pstr_split_on_first_occurrence();
+  test_pstr_replace();
+  test_pstr_replace_all();
   test_pstr_clear();
   test_pstr_slice_from();
   test_pstr_slice_to();
@@ -737,6 +2707,36 @@ int main(int argc, char **argv) {
   test_pstr_ltrim_char();
   test_pstr_rtrim_char();
   test_pstr_trim_char();
+  test_pstr_to_lower();
   test_pstr_from_int64();
+  test_pstr_from_uint64();
+  test_pstr_from_int32();
+  test_pstr_from_uint64_hex();
+  test_pstr_to_int64();
+  test_pstr_to_uint64();
+  test_pstr_from_double();
+  test_pstr_to_double();
+  test_pstr_builder();
+  test_pstr_small();
+  test_pstr_arena();
+  test_pstr_intern();
+  test_pstr_sv_from();
+  test_pstr_sv_eq();
+  test_pstr_sv_starts_with();
+  test_pstr_sv_ends_with();
+  test_pstr_sv_slice();
+  test_pstr_sv_trim();
+  test_pstr_charset();
+  test_pstr_sv_cat();
+  test_pstr_sv_vcat();
+  test_pstr_map();
+  test_pstr_tokenizer();
+  test_pstr_splitter();
+  test_pstr_matcher();
+  test_pstr_prefix_table();
+  test_pstr_batch();
+  test_pstr_pool();
+  test_pstr_file_lines();
+  test_pstr_sv_to_int64();
   print_test_statistics();
 }